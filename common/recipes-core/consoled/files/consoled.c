@@ -31,11 +31,12 @@
 #include <signal.h>
 #include <sys/stat.h>
 #include <openbmc/pal.h>
+#include <openbmc/cbuf.h>
 
 #define BAUDRATE      B57600
 #define CTRL_X        0x18
 #define ASCII_ENTER   0x0D
-#define MAX_LOGFILE_LINES 1200 // Maximum lines based on carriage returns or new line
+#define MAX_LOGFILE_LINES 1200 // Maximum lines based on new line
 #define MAX_LOGFILE_SIZE 102400 // 100KB size => 1200 lines of 80 characters each = ~108000B
 static sig_atomic_t sigexit = 0;
 
@@ -72,13 +73,11 @@ print_usage() {
 static void
 run_console(char* fru_name, int term) {
 
-  int i;
   int tty;    // serial port
-  int buf_fd;  // Buffer File
+  cbuf_t *cb;  // Buffer File
   int blen;   // len for
   int nfd = 0;      // For number of fd
   int nevents;      // For number of events in fd
-  int nline = 0;
   //int pid_fd;
   int flags;
   pid_t pid;        // For pid of the daemon
@@ -97,8 +96,6 @@ run_console(char* fru_name, int term) {
   struct termios ostditio, nstditio;  // For STDIN_FILENO
   struct termios ostdotio, nstdotio;  // For STDOUT_FILENO
 
-  struct stat buf_stat;
-
   struct pollfd pfd[2];
 
   /* Start Daemon for the console buffering */
@@ -147,7 +144,8 @@ run_console(char* fru_name, int term) {
   /* Buffering the console data into a file */
   sprintf(old_bfname, "/tmp/consoled_%s_log-old", fru_name);
   sprintf(bfname, "/tmp/consoled_%s_log", fru_name);
-  if ((buf_fd = open(bfname, O_RDWR | O_APPEND | O_CREAT, 0666)) < 0) {
+  cb = cbuf_open(bfname, old_bfname, MAX_LOGFILE_SIZE, MAX_LOGFILE_LINES);
+  if (cb == NULL) {
     syslog(LOG_WARNING, "Cannot open the file %s", bfname);
     exit(-1);
   }
@@ -176,7 +174,14 @@ run_console(char* fru_name, int term) {
   }
 
   /* Handling the input event from the  terminal and tty dev */
-  while (!sigexit && (nevents = poll(pfd, nfd, -1 /* Timeout */))) {
+  while (!sigexit) {
+    nevents = poll(pfd, nfd, cbuf_timeout(cb));
+
+    /* Flush buffered console data once its interval has expired */
+    cbuf_sync(cb);
+    if (nevents <= 0) {
+      continue;
+    }
 
     /* Input to the terminal from the user */
     if (term && nevents && nfd > 1 && pfd[1].revents > 0) {
@@ -198,40 +203,19 @@ run_console(char* fru_name, int term) {
     if (nevents && pfd[0].revents > 0) {
       blen = read(tty, buf, sizeof(buf));
       if (blen > 0) {
-        for (i = 0; i < blen; i++) {
-          if (buf[i] == 0xD || buf[i] == 0xA)
-            nline++;
-        }
-        write_data(buf_fd, buf, blen, bfname);
-        fsync(buf_fd);
+        cbuf_write(cb, buf, blen);
         if (term) {
           write_data(stdo, buf, blen, "STDOUT_FILENO");
         }
       } else if (blen < 0) {
         raise(SIGHUP);
       }
-
-      // Get File stat information
-      memset(&buf_stat, 0, sizeof(struct stat));
-      fstat(buf_fd, &buf_stat);
-
-      /* Log Rotation based on max number of lines or max file size */
-      if (nline >= MAX_LOGFILE_LINES || buf_stat.st_size >= MAX_LOGFILE_SIZE) {
-        close(buf_fd);
-        remove(old_bfname);
-        rename(bfname, old_bfname);
-        if ((buf_fd = open(bfname, O_RDWR | O_APPEND | O_CREAT, 0666)) < 0) {
-          syslog(LOG_WARNING, "Cannot open the file %s", bfname);
-          exit(-1);
-        }
-        nline = 0;
-      }
       nevents--;
     }
   }
 
-  /* Close the console buffer file */
-  close(buf_fd);
+  /* Flush and close the console buffer file */
+  cbuf_close(cb);
 
   /* Revert the tty dev to old attributes */
   tcflush(tty, TCIFLUSH);
@@ -7,6 +7,9 @@ import fsc_parser
 import json
 import sys
 
+# Marks a name that was not in the context before a binding shadowed it
+unbound = object()
+
 class InfixNode():
     def __init__(self, op, lhs, rhs):
         self.op = op
@@ -22,6 +25,12 @@ class InfixNode():
         fv = self.op.apply(lhv, rhv)
         return (fv, "%s %s %s" % (lht, str(self.op), rht))
 
+    def compile(self):
+        apply = self.op.apply
+        lhs = self.lhs.compile()
+        rhs = self.rhs.compile()
+        return lambda ctx: apply(lhs(ctx), rhs(ctx))
+
     def __str__(self):
         return str(self.lhs) + " " + str(self.op) + " " + str(self.rhs)
 
@@ -38,6 +47,10 @@ class ListNode():
         dts = [dt for (fv, dt) in evals]
         return (fvs, "[\n " + ",\n " .join(dts) + "]")
 
+    def compile(self):
+        inners = [i.compile() for i in self.inners]
+        return lambda ctx: [i(ctx) for i in inners]
+
     def __str__(self):
         return "[" + ", ".join([str(i) for i in self.inners]) + "]"
 
@@ -59,6 +72,23 @@ class BindNode():
         (ifv, idt) = self.innernode.dbgeval(innerctx)
         return (ifv, "{}[{}] = {};\n{}".format(self.name, bfv, bdt, idt))
 
+    def compile(self):
+        name = self.name
+        bind = self.bindnode.compile()
+        inner = self.innernode.compile()
+        def run(ctx):
+            # Shadow the name in place rather than copying the context
+            saved = ctx.get(name, unbound)
+            ctx[name] = bind(ctx)
+            try:
+                return inner(ctx)
+            finally:
+                if saved is unbound:
+                    del ctx[name]
+                else:
+                    ctx[name] = saved
+        return run
+
     def __str__(self):
         return "{} = {};\n{}".format(
                 self.name,
@@ -76,6 +106,10 @@ class IdentNode():
         fv = ctx.get(self.name, None)
         return (fv, "{}={}".format(self.name, fv))
 
+    def compile(self):
+        name = self.name
+        return lambda ctx: ctx.get(name, None)
+
     def __str__(self):
         return self.name
 
@@ -90,6 +124,10 @@ class ConstNode():
     def dbgeval(self, ctx):
         return self.value
 
+    def compile(self):
+        value = self.value
+        return lambda ctx: value
+
     def __str__(self):
         return str(self.value)
 
@@ -112,6 +150,11 @@ class ApplyNode():
             fv = self.op.apply(iv, ctx)
         return (fv, "{}[{}]({})".format(ft, fv, it))
 
+    def compile(self):
+        apply = self.op.apply
+        inner = self.inner.compile()
+        return lambda ctx: apply(inner(ctx), ctx)
+
     def __str__(self):
         return self.name + "(" + str(self.inner) + ")"
 
@@ -182,6 +225,11 @@ def make_eval_tree(source, profiles):
     eval_root = make_eval_node(root_ast_node, info, profiles)
     return (eval_root, info)
 
+# Flatten an eval tree into nested closures, so each control interval runs
+# plain function calls instead of walking the node objects
+def compile_eval_tree(eval_root):
+    return eval_root.compile()
+
 class InvalidExpression(Exception):
     pass
 
@@ -25,8 +25,6 @@ import os.path
 import traceback
 from collections import namedtuple
 import time
-from subprocess import Popen, PIPE
-import re
 import signal
 from lib_pal import *
 
@@ -47,52 +45,33 @@ SensorValue = namedtuple('SensorValue', ['id','name','value','unit','status'])
 def bmc_symbolize_sensorname(name):
     return name.lower().replace(" ", "_")
 
-# BAD. Lifted from REST API and patched up a bit
-# TODO: add a --json to sensor-util
-
 def bmc_sensor_read(fru):
     result = {}
-    cmd = '/usr/local/bin/sensor-util ' + fru
-    data = Popen(cmd, shell=True, stdout=PIPE).stdout.read()
-    sdata = data.split('\n')
-    for line in sdata:
-        # skip lines with " or startin with FRU
-        if line.find("bic_read_sensor_wrapper") != -1:
-            continue
-        if line.find("failed") != -1:
-            continue
-
-        if line.find(" NA "):
-            m = re.match(r"^(.*)\((0x..?)\)\s+:\s+([^\s]+)\s+.\s+\((.+)\)$", line)
-            if m is not None:
-                sid = int(m.group(2), 16)
-                name = m.group(1).strip()
-                value = None
-                status = m.group(4)
-                symname = bmc_symbolize_sensorname(name)
-                result[symname] = SensorValue(sid, name, value, None, status)
-                continue
-        m = re.match(r"^(.*)\((0x..?)\)\s+:\s+([^\s]+)\s+([^\s]+)\s+.\s+\((.+)\)$", line)
-        if m is not None:
-            sid = int(m.group(2), 16)
-            name = m.group(1).strip()
-            value = float(m.group(3))
-            unit = m.group(4)
-            status = m.group(5)
-            symname = bmc_symbolize_sensorname(name)
-            result[symname] = SensorValue(sid, name, value, unit, status)
+    sensors = pal_get_fru_sensors(fru)
+    if sensors is None:
+        return result
+    for snr in sensors:
+        name = snr['name'].strip()
+        if snr['value'] is None:
+            value = None
+            unit = None
+        else:
+            value = snr['value']
+            unit = snr['units']
+        symname = bmc_symbolize_sensorname(name)
+        result[symname] = SensorValue(snr['num'], name, value, unit,
+                                      snr['status'])
     return result
 
 def bmc_read_speed():
-    cmd = '/usr/local/bin/fan-util --get'
-    data = Popen(cmd, shell=True, stdout=PIPE).stdout.read()
-    sdata = data.split('\n')
+    # Numbered from 1 over the fans that could be read, as fan-util --get
+    # used to list them
     result = {}
     fan_n = 1
-    for line in sdata:
-        m = re.match(r"Fan .*\sSpeed:\s+(\d+)\s", line)
-        if m is not None:
-            result[fan_n] = int(m.group(1))
+    for fan in range(pal_get_tach_cnt()):
+        rpm = pal_get_fan_speed(fan)
+        if rpm is not None:
+            result[fan_n] = rpm
             fan_n += 1
     return result
 
@@ -101,16 +80,19 @@ class BMCMachine:
         self.frus = set()
     def set_pwm(self, pwm, pct):
         print("Set pwm %d to %d" % (pwm, pct))
-        cmd = ('/usr/local/bin/fan-util --set %d %d' % (pct, pwm))
-        response = Popen(cmd, shell=True, stdout=PIPE).stdout.read()
-        if response.find("Setting") == -1:
-            raise Exception(response)
+        if pal_set_fan_speed(pwm, pct):
+            raise Exception("Error while setting fan speed for Fan %d" % pwm)
     def set_all_pwm(self, pct):
         print("Set all pwm to %d" % (pct))
-        cmd = ('/usr/local/bin/fan-util --set %d' % (pct))
-        response = Popen(cmd, shell=True, stdout=PIPE).stdout.read()
-        if response.find("Setting") == -1:
-            raise Exception(response)
+        # This is the fail-safe path, so one bad fan must not stop the
+        # rest from being driven
+        failed = []
+        for pwm in range(pal_get_pwm_cnt()):
+            if pal_set_fan_speed(pwm, pct):
+                failed.append(pwm)
+        if failed:
+            raise Exception("Error while setting fan speed for Fan %s" %
+                            ', '.join(str(pwm) for pwm in failed))
     def read_speed(self):
         return bmc_read_speed()
     def read_sensors(self):
@@ -173,13 +155,16 @@ class Zone:
         self.expr = expr
         self.expr_meta = expr_meta
         self.expr_str = str(expr)
+        self.compiled = fsc_expr.compile_eval_tree(expr)
+        # Resolve each "board:sensor" variable once instead of every tick
+        self.sensor_vars = [(v,) + tuple(v.split(":"))
+                            for v in expr_meta['ext_vars']]
 
     def run(self, sensors, dt):
         ctx = {'dt': dt}
         outmin = 0
         missing = set()
-        for v in self.expr_meta['ext_vars']:
-            board, sname = v.split(":")
+        for (v, board, sname) in self.sensor_vars:
             if sname in sensors[board]:
                 sensor = sensors[board][sname]
                 ctx[v] = sensor.value
@@ -198,7 +183,7 @@ class Zone:
             (exprout, dxstr) = self.expr.dbgeval(ctx)
             print(dxstr + " = " + str(exprout))
         else:
-            exprout = self.expr.eval(ctx)
+            exprout = self.compiled(ctx)
             print(self.expr_str + " = " + str(exprout))
         # If *all* sensors in the top level max() report None, the
         # expression will report None
@@ -210,6 +195,16 @@ class Zone:
         exprout = clamp(exprout, 0, 100)
         return exprout
 
+def report_timing(interval, start, sensors_done, speeds_done, end):
+    # Time spent in each phase of a control interval, in ms
+    busy = end - start
+    print("Tick: sensors %.1f ms, fans %.1f ms, zones %.1f ms, total %.1f ms" %
+          ((sensors_done - start) * 1000, (speeds_done - sensors_done) * 1000,
+           (end - speeds_done) * 1000, busy * 1000))
+    if busy > interval:
+        warn("Control loop took %.1f ms, longer than the %.1f ms interval" %
+             (busy * 1000, interval * 1000))
+
 def profile_constructor(data):
     return lambda: make_controller(data)
 
@@ -282,8 +277,11 @@ def main():
             wdfile.write('V')
             wdfile.flush()
         time.sleep(interval)
+        tick_start = time.time()
         sensors = machine.read_sensors()
+        sensors_done = time.time()
         speeds = machine.read_speed()
+        speeds_done = time.time()
         fan_fail = False
         now = time.time()
         dt = now - last
@@ -348,6 +346,8 @@ def main():
                     machine.set_pwm(output, pwmval)
             else:
                 machine.set_pwm(zone.pwm_output, pwmval)
+        report_timing(interval, tick_start, sensors_done, speeds_done,
+                      time.time())
 
 def handle_term(signum, frame):
     global wdfile
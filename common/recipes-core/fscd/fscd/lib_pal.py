@@ -1,9 +1,32 @@
 from ctypes import *
+from openbmc_sdr import pal_get_fru_id, pal_get_fru_sensors
 import subprocess
 
 lpal_hndl = CDLL("libpal.so")
 
 
+def pal_get_pwm_cnt():
+    return c_size_t.in_dll(lpal_hndl, 'pal_pwm_cnt').value
+
+def pal_get_tach_cnt():
+    return c_size_t.in_dll(lpal_hndl, 'pal_tach_cnt').value
+
+def pal_set_fan_speed(fan, pwm):
+    ret = lpal_hndl.pal_set_fan_speed(c_ubyte(fan), c_ubyte(pwm))
+    if ret:
+        return -1
+    else:
+        return 0
+
+def pal_get_fan_speed(fan):
+    rpm = c_int()
+    p_rpm = pointer(rpm)
+    ret = lpal_hndl.pal_get_fan_speed(c_ubyte(fan), p_rpm)
+    if ret:
+        return None
+    else:
+        return rpm.value
+
 def pal_fan_dead_handle(fan):
     ret = lpal_hndl.pal_fan_dead_handle(fan)
     if ret:
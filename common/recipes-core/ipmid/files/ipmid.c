@@ -1596,6 +1596,7 @@ ipmi_handle_oem_1s(unsigned char *request, unsigned char req_len,
     case CMD_OEM_1S_INTR:
       syslog(LOG_INFO, "ipmi_handle_oem_1s: 1S server interrupt#%d received "
                 "for payload#%d\n", req->data[3], req->payload_id);
+      pal_gpio_intr_handle(req->payload_id, req->data[3]);
 
       res->cc = CC_SUCCESS;
       memcpy(res->data, req->data, SIZE_IANA_ID); //IANA ID
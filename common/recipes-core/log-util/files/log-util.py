@@ -22,8 +22,10 @@ import re
 from datetime import datetime
 import sys
 import os
+from time import mktime
 from ctypes import *
 from lib_pal import *
+from log_store import *
 
 syslogfiles = ['/mnt/data/logfile.0', '/mnt/data/logfile']
 cmdlist = ['--print', '--clear']
@@ -33,8 +35,18 @@ frulist = ''
 def print_usage():
     global frulist
 
-    print 'Usage: %s [ %s ] %s' % (APPNAME, ' | '.join(frulist), cmdlist[0])
+    print 'Usage: %s [ %s ] %s [ --start <time> ] [ --end <time> ]' % (
+        APPNAME, ' | '.join(frulist), cmdlist[0])
     print '       %s [ %s ] %s' % (APPNAME, ' | '.join(frulist), cmdlist[1])
+    print '       <time> is "YYYY-MM-DD HH:MM:SS"'
+
+
+def parse_time(value):
+    try:
+        t = datetime.strptime(value, '%Y-%m-%d %H:%M:%S')
+    except ValueError:
+        return None
+    return int(mktime(t.timetuple()))
 
 
 def log_main():
@@ -46,13 +58,33 @@ def log_main():
     frulist = re.split(r',\s', frus)
     frulist.append('sys')
 
-    if len(sys.argv) is not 3:
+    if len(sys.argv) < 3:
         print_usage()
         return -1
 
     fru = sys.argv[1]
     cmd = sys.argv[2]
 
+    # Optional time range for --print
+    start = None
+    end = None
+    args = sys.argv[3:]
+    while args:
+        if cmd != cmdlist[0] or len(args) < 2 or \
+           args[0] not in ('--start', '--end'):
+            print_usage()
+            return -1
+        t = parse_time(args[1])
+        if t is None:
+            print "Invalid time: %s \n" % args[1]
+            print_usage()
+            return -1
+        if args[0] == '--start':
+            start = t
+        else:
+            end = t
+        args = args[2:]
+
     # Check if the fru passed in as argument exists in the fru list
     if fru not in frulist:
         print "Error: Fru not in the list [ %s ] \n" % ' | '.join(frulist)
@@ -65,6 +97,27 @@ def log_main():
         print_usage()
         return -1
 
+    store = LogStore()
+    store.ingest(syslogfiles)
+
+    # Clear cmd
+    if cmd == cmdlist[1]:
+        if fru == 'all':
+            for i in range(0, MAX_FRU + 1):
+                store.clear(i)
+            temp = 'all'
+        elif fru == 'sys':
+            store.clear(0)
+        else:
+            fru_num = frulist.index(fru)
+            store.clear(fru_num)
+            temp = 'FRU: ' + str(fru_num)
+
+        if fru != 'sys':
+            time = datetime.now()
+            log = time.strftime('%b %d %H:%M:%S') + ' log-util: User cleared ' + temp + ' logs\n'
+            store.append(event_fru(log), line_time(log, time), log)
+
     # Print cmd
     if cmd == cmdlist[0]:
         print '%-4s %-8s %-22s %-16s %s' % (
@@ -75,115 +128,54 @@ def log_main():
             "MESSAGE"
             )
 
-    for logfile in syslogfiles:
-
-        try:
-            fd = open(logfile, 'r')
-            syslog = fd.readlines()
-            fd.close()
-        except IOError:
-            continue
-
-        # Clear cmd
-        if cmd == cmdlist[1]:
-
-            newlog = ''
-
-            for log in syslog:
-                # Print only critical logs
-                if not (re.search(r' bmc [a-z]*.crit ', log) or re.search(r'log-util:', log)):
-                    continue
-
-                # Find the FRU number
-                if re.search(r'FRU: [0-9]{1,2}', log, re.IGNORECASE):
-                    fru_num = ''.join(re.findall(r'FRU: [0-9]{1,2}', log, re.IGNORECASE))
-                    # FRU is in format "FRU: X"
-                    fru_num = fru_num[5]
-                else:
-                    fru_num = '0'
-
-                # FRU # is always aligned with indexing of fru list
-                if fru == 'sys' and fru_num == '0':
-                    fruname = 'sys'
-                else:
-                    fruname = frulist[int(fru_num)]
-
-                # Clear the log is the argument fru matches the log fru
-                if fru == 'all' or fru == fruname:
-                    # Drop this log line
-                    continue
-                else:
-                    newlog = newlog + log
-
-            # Dump the new log in a tmp file
-            if logfile == syslogfiles[1] and fru != 'sys':
-               if fru == 'all':
-                  temp = 'all'
-               else:
-                  fru_num = str(frulist.index(fru))
-                  temp = 'FRU: ' + fru_num
-               time = datetime.now()
-               newlog = newlog + time.strftime('%b %d %H:%M:%S') + ' log-util: User cleared ' + temp + ' logs\n'
-            curpid = os.getpid()
-            tmpfd = open('%s.tmp%d' % (logfile, curpid), 'w')
-            tmpfd.write(newlog)
-            tmpfd.close()
-            # Rename the tmp file to original syslog file
-            os.rename('%s.tmp%d' % (logfile, curpid), logfile)
-
-        # Print cmd
-        if cmd == cmdlist[0]:
-
-            for log in syslog:
-                # Print only critical logs
-                if not (re.search(r' bmc [a-z]*.crit ', log) or re.search(r'log-util:', log)):
-                    continue
-
-                # Find the FRU number
-                if re.search(r'FRU: [0-9]{1,2}', log, re.IGNORECASE):
-                    fru_num = ''.join(re.findall(r'FRU: [0-9]{1,2}', log, re.IGNORECASE))
-                    # FRU is in format "FRU: X"
-                    fru_num = fru_num[5]
-                else:
-                    fru_num = '0'
-
-                # FRU # is always aligned with indexing of fru list
-                if fru == 'sys' and fru_num == '0':
-                    fruname = 'sys'
-                else:
-                    fruname = frulist[int(fru_num)]
-
-                # Print only if the argument fru matches the log fru
-                if re.search(r'log-util:', log):
-                   if re.search(r'all logs', log):
-                     print (log)
-                     continue
-
-                if fru != 'all' and fru != fruname:
-                    continue
-
-                if re.search(r'log-util:', log):
-                     print (log)
-                     continue
-                # Time format Sep 28 22:10:50
-                temp = re.split(r' bmc [a-z]*.crit ', log)
-                ts = temp[0]
-                currtime = datetime.now()
-                ts = '%d %s' % (currtime.year, ts)
-                time = datetime.strptime(ts, '%Y %b %d %H:%M:%S')
-                time = time.strftime('%Y-%m-%d %H:%M:%S')
-
-                temp2 = re.split(r': ', temp[1], 1)
-                app = temp2[0]
-                message = temp2[1].rstrip('\n')
-
-                print '%-4s %-8s %-22s %-16s %s' % (
-                    fru_num,
-                    fruname,
-                    time,
-                    app,
-                    message
-                    )
+        # FRU 0 also holds log-util's "all logs" notes shown for every FRU
+        if fru == 'all':
+            frus = range(0, MAX_FRU + 1)
+        elif fru == 'sys':
+            frus = [0]
+        else:
+            frus = [0, frulist.index(fru)]
+
+        for fru_id, ts, log in store.events(frus, start, end):
+            fru_num = str(fru_id)
+
+            # FRU # is always aligned with indexing of fru list
+            if fru == 'sys' and fru_num == '0':
+                fruname = 'sys'
+            elif fru_id < len(frulist):
+                fruname = frulist[fru_id]
+            else:
+                continue
+
+            # Print only if the argument fru matches the log fru
+            if 'log-util:' in log:
+               if 'all logs' in log:
+                 print (log)
+                 continue
+
+            if fru != 'all' and fru != fruname:
+                continue
+
+            if 'log-util:' in log:
+                 print (log)
+                 continue
+
+            temp = crit_re.split(log, 1)
+            time = datetime.fromtimestamp(ts).strftime('%Y-%m-%d %H:%M:%S')
+
+            temp2 = re.split(r': ', temp[1], 1)
+            app = temp2[0]
+            message = temp2[1].rstrip('\n')
+
+            print '%-4s %-8s %-22s %-16s %s' % (
+                fru_num,
+                fruname,
+                time,
+                app,
+                message
+                )
+
+    store.close()
 
     if cmd == cmdlist[1]:
         if fru == 'all':
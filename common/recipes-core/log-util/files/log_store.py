@@ -0,0 +1,289 @@
+#!/usr/bin/env python
+#
+# Copyright 2016-present Facebook. All Rights Reserved.
+#
+# This program file is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by the
+# Free Software Foundation; version 2 of the License.
+#
+# This program is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+# for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program in a file named COPYING; if not, write to the
+# Free Software Foundation, Inc.,
+# 51 Franklin Street, Fifth Floor,
+# Boston, MA 02110-1301 USA
+#
+
+# Store of the critical BMC events log-util shows, kept per FRU.
+#
+# Every FRU has a <fru>.dat file holding the raw log lines and a <fru>.idx
+# file of fixed-size (time, sequence, offset) entries, both append-only.
+# New syslog lines are picked up incrementally: the byte offset reached in
+# each syslog file (keyed by inode, so rotation is followed) is kept in
+# 'state', and only the lines past it are read.  Time ranges are found by
+# bisecting the index, and clearing a FRU truncates just that FRU's files.
+#
+# A FRU whose .dat file grows past MAX_FRU_SIZE is cut back to its newest
+# MAX_FRU_SIZE / 2 bytes, so the store stays bounded like the syslog files
+# it replaces.  Timestamps come from the log lines and can go backwards
+# (clock set at boot, a year guessed wrong), so 'state' also records which
+# FRUs are out of time order; their queries scan the whole index.
+
+import copy
+import errno
+import fcntl
+import heapq
+import json
+import os
+import re
+import struct
+import time
+from datetime import datetime
+
+STORE_DIR = '/mnt/data/log-util'
+IDX = struct.Struct('<III')     # time, sequence, offset in the .dat file
+MAX_FRU = 15
+MAX_FRU_SIZE = 256 * 1024
+
+crit_re = re.compile(r' bmc [a-z]*.crit ')
+fru_re = re.compile(r'FRU: [0-9]{1,2}', re.IGNORECASE)
+
+
+def is_event(line):
+    ''' Only critical logs and log-util's own notes are kept '''
+    if '.crit ' not in line and 'log-util:' not in line:
+        return False
+    return crit_re.search(line) is not None or 'log-util:' in line
+
+
+def event_fru(line):
+    ''' FRU number from "FRU: X"; 0 when the line names no FRU '''
+    m = fru_re.search(line)
+    if m is None:
+        return 0
+    # Only the first digit is used, as log-util always has
+    fru = int(m.group(0)[5])
+    return fru if fru <= MAX_FRU else 0
+
+
+def line_time(line, now):
+    ''' Epoch seconds of a syslog line; the year is not logged, so assume
+        the latest one that does not put the line in the future '''
+    try:
+        ts = datetime.strptime('%d %s' % (now.year, line[:15]),
+                               '%Y %b %d %H:%M:%S')
+    except ValueError:
+        return int(time.mktime(now.timetuple()))
+    if (ts - now).days >= 1:
+        ts = ts.replace(year=now.year - 1)
+    return int(time.mktime(ts.timetuple()))
+
+
+class LogStore(object):
+
+    def __init__(self, path=STORE_DIR):
+        self.path = path
+        try:
+            os.makedirs(path)
+        except OSError as e:
+            if e.errno != errno.EEXIST:
+                raise
+        self.lockfd = open(os.path.join(path, 'lock'), 'a')
+        fcntl.flock(self.lockfd, fcntl.LOCK_EX)
+        self.state = self._load_state()
+        self.saved = copy.deepcopy(self.state)
+        self.files = {}
+        self.full = set()
+
+    def close(self):
+        self.flush()
+        # A query that found nothing new leaves the flash alone
+        if self.state != self.saved:
+            self._save_state()
+        fcntl.flock(self.lockfd, fcntl.LOCK_UN)
+        self.lockfd.close()
+
+    def flush(self):
+        for dat, idx in self.files.values():
+            dat.close()
+            idx.close()
+        self.files = {}
+        for fru in self.full:
+            self._trim(fru)
+        self.full = set()
+
+    def _file(self, fru, ext):
+        return os.path.join(self.path, '%d.%s' % (fru, ext))
+
+    def _load_state(self):
+        try:
+            with open(os.path.join(self.path, 'state'), 'r') as fd:
+                state = json.load(fd)
+        except (IOError, ValueError):
+            state = {}
+        state.setdefault('seq', 0)
+        state.setdefault('logs', {})
+        # Time of the last entry per FRU, and the FRUs out of time order
+        state.setdefault('last', {})
+        state.setdefault('unsorted', [])
+        return state
+
+    def _save_state(self):
+        tmp = os.path.join(self.path, 'state.tmp')
+        with open(tmp, 'w') as fd:
+            json.dump(self.state, fd)
+        os.rename(tmp, os.path.join(self.path, 'state'))
+
+    def append(self, fru, ts, line):
+        if fru not in self.files:
+            self.files[fru] = (open(self._file(fru, 'dat'), 'ab'),
+                               open(self._file(fru, 'idx'), 'ab'))
+        dat, idx = self.files[fru]
+        dat.seek(0, os.SEEK_END)
+        offset = dat.tell()
+        dat.write(line.encode('utf-8') if not isinstance(line, bytes) else line)
+        idx.write(IDX.pack(ts, self.state['seq'], offset))
+        self.state['seq'] += 1
+        self._order(fru, ts)
+        if dat.tell() > MAX_FRU_SIZE:
+            self.full.add(fru)
+
+    def _order(self, fru, ts):
+        key = str(fru)
+        if ts < self.state['last'].get(key, 0) and \
+           fru not in self.state['unsorted']:
+            self.state['unsorted'].append(fru)
+        self.state['last'][key] = ts
+
+    def _trim(self, fru):
+        ''' Keep the newest MAX_FRU_SIZE / 2 bytes of a FRU's events '''
+        try:
+            with open(self._file(fru, 'idx'), 'rb') as fd:
+                index = fd.read()
+            with open(self._file(fru, 'dat'), 'rb') as fd:
+                data = fd.read()
+        except IOError:
+            return
+        entries = [IDX.unpack_from(index, i * IDX.size)
+                   for i in range(len(index) // IDX.size)]
+        first = 0
+        while first < len(entries) and \
+              len(data) - entries[first][2] > MAX_FRU_SIZE // 2:
+            first += 1
+        entries = entries[first:]
+        base = entries[0][2] if entries else len(data)
+
+        with open(self._file(fru, 'dat') + '.tmp', 'wb') as fd:
+            fd.write(data[base:])
+        with open(self._file(fru, 'idx') + '.tmp', 'wb') as fd:
+            for ts, seq, offset in entries:
+                fd.write(IDX.pack(ts, seq, offset - base))
+        os.rename(self._file(fru, 'dat') + '.tmp', self._file(fru, 'dat'))
+        os.rename(self._file(fru, 'idx') + '.tmp', self._file(fru, 'idx'))
+
+        self._forget(fru)
+        for ts, seq, offset in entries:
+            self._order(fru, ts)
+
+    def _forget(self, fru):
+        self.state['last'].pop(str(fru), None)
+        if fru in self.state['unsorted']:
+            self.state['unsorted'].remove(fru)
+
+    def ingest(self, logfiles):
+        ''' Add the events syslog wrote since the last call '''
+        now = datetime.now()
+        seen = {}
+        count = 0
+        for logfile in logfiles:
+            try:
+                fd = open(logfile, 'rb')
+            except IOError:
+                continue
+            st = os.fstat(fd.fileno())
+            key = str(st.st_ino)
+            offset = self.state['logs'].get(key, 0)
+            if st.st_size < offset:
+                offset = 0
+            fd.seek(offset)
+            data = fd.read()
+            fd.close()
+            # Leave a partly written last line for the next call
+            end = data.rfind(b'\n') + 1
+            for line in data[:end].decode('utf-8', 'replace').splitlines(True):
+                if not is_event(line):
+                    continue
+                self.append(event_fru(line), line_time(line, now), line)
+                count += 1
+            seen[key] = offset + end
+        self.state['logs'] = seen
+        self.flush()
+        return count
+
+    def query(self, fru, start=None, end=None):
+        ''' (time, seq, line) of one FRU's events, start <= time < end '''
+        try:
+            with open(self._file(fru, 'idx'), 'rb') as fd:
+                index = fd.read()
+            dat = open(self._file(fru, 'dat'), 'rb')
+        except IOError:
+            return
+        n = len(index) // IDX.size
+        entry = lambda i: IDX.unpack_from(index, i * IDX.size)
+
+        if fru in self.state['unsorted']:
+            for i in range(n):
+                ts, seq, offset = entry(i)
+                if (start is not None and ts < start) or \
+                   (end is not None and ts >= end):
+                    continue
+                dat.seek(offset)
+                yield ts, seq, dat.readline().decode('utf-8', 'replace')
+            dat.close()
+            return
+
+        # Lines are indexed in the order syslog wrote them, so by time
+        lo, hi = 0, n
+        if start is not None:
+            while lo < hi:
+                mid = (lo + hi) // 2
+                if entry(mid)[0] < start:
+                    lo = mid + 1
+                else:
+                    hi = mid
+        first = lo
+        if first < n:
+            dat.seek(entry(first)[2])
+        for i in range(first, n):
+            ts, seq, offset = entry(i)
+            if end is not None and ts >= end:
+                break
+            line = dat.readline().decode('utf-8', 'replace')
+            yield ts, seq, line
+        dat.close()
+
+    def _stream(self, fru, start, end):
+        for ts, seq, line in self.query(fru, start, end):
+            yield seq, ts, fru, line
+
+    def events(self, frus, start=None, end=None):
+        ''' Events of several FRUs, in the order they were logged '''
+        streams = [self._stream(fru, start, end) for fru in frus]
+        for seq, ts, fru, line in heapq.merge(*streams):
+            yield fru, ts, line
+
+    def clear(self, fru):
+        for ext in ('dat', 'idx'):
+            try:
+                open(self._file(fru, ext), 'w').close()
+            except IOError:
+                pass
+        if fru in self.files:
+            for fd in self.files.pop(fru):
+                fd.close()
+        self.full.discard(fru)
+        self._forget(fru)
@@ -0,0 +1,211 @@
+#!/usr/bin/env python
+#
+# Copyright 2016-present Facebook. All Rights Reserved.
+#
+# This program file is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by the
+# Free Software Foundation; version 2 of the License.
+#
+# This program is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+# for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program in a file named COPYING; if not, write to the
+# Free Software Foundation, Inc.,
+# 51 Franklin Street, Fifth Floor,
+# Boston, MA 02110-1301 USA
+#
+
+# Benchmark of log-util over synthetic syslog files: the full scan every
+# run used to do against the event store.  Each scan run repeats the
+# per-line matching of the old --print; each store run is what log-util
+# does now, an incremental ingest plus a query.  Then the files are
+# rotated for a few months' worth of logs to show the store stays bounded.
+
+import getopt
+import os
+import random
+import re
+import shutil
+import sys
+import tempfile
+import time
+from datetime import datetime, timedelta
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                '..'))
+import log_store
+from log_store import LogStore
+
+DEFAULT_LINES = 60000
+DEFAULT_ROTATIONS = 30
+FRULIST = ['all', 'slot1', 'slot2', 'slot3', 'slot4', 'spb', 'nic', 'sys']
+APPS = ['sensord', 'gpiod', 'ipmid', 'kernel', 'healthd', 'dhclient']
+
+
+def generate(path, lines, t0):
+    ''' About 5% FRU events, 1% system events, the rest routine '''
+    with open(path, 'w') as fd:
+        for i in range(lines):
+            ts = (t0 + timedelta(seconds=i * 20)).strftime('%b %d %H:%M:%S')
+            r = random.random()
+            if r < 0.05:
+                fd.write('%s bmc user.crit %s: ASSERT Upper Critical '
+                         'threshold - raised - FRU: %d, num: 0x%02X '
+                         'curr_val: 81.00C\n' % (ts, random.choice(APPS[:3]),
+                         random.randint(1, 4), random.randint(0, 255)))
+            elif r < 0.06:
+                fd.write('%s bmc user.crit sensord: System power fault\n' %
+                         ts)
+            else:
+                fd.write('%s bmc user.info %s: some routine message number '
+                         '%d with padding text here\n' %
+                         (ts, random.choice(APPS), i))
+
+
+def row(fru_num, fruname, when, log):
+    temp = log_store.crit_re.split(log, 1)
+    temp2 = re.split(r': ', temp[1], 1)
+    return '%-4s %-8s %-22s %-16s %s' % (fru_num, fruname, when, temp2[0],
+                                         temp2[1].rstrip('\n'))
+
+
+def scan_print(logfiles, fru):
+    ''' The old --print: every line of every file, every run '''
+    out = []
+    for logfile in logfiles:
+        with open(logfile, 'r') as fd:
+            syslog = fd.readlines()
+        for log in syslog:
+            if not (re.search(r' bmc [a-z]*.crit ', log) or
+                    re.search(r'log-util:', log)):
+                continue
+            if re.search(r'FRU: [0-9]{1,2}', log, re.IGNORECASE):
+                fru_num = ''.join(re.findall(r'FRU: [0-9]{1,2}', log,
+                                             re.IGNORECASE))[5]
+            else:
+                fru_num = '0'
+            if fru == 'sys' and fru_num == '0':
+                fruname = 'sys'
+            else:
+                fruname = FRULIST[int(fru_num)]
+            if fru != 'all' and fru != fruname:
+                continue
+            ts = '%d %s' % (datetime.now().year,
+                            re.split(r' bmc [a-z]*.crit ', log)[0])
+            when = datetime.strptime(ts, '%Y %b %d %H:%M:%S')
+            out.append(row(fru_num, fruname,
+                           when.strftime('%Y-%m-%d %H:%M:%S'), log))
+    return out
+
+
+def store_print(store_dir, logfiles, fru):
+    ''' The new --print: new lines into the store, then one query '''
+    store = LogStore(store_dir)
+    store.ingest(logfiles)
+    if fru == 'all':
+        frus = range(0, log_store.MAX_FRU + 1)
+    else:
+        frus = [0, FRULIST.index(fru)]
+    out = []
+    for fru_id, ts, log in store.events(frus):
+        fruname = FRULIST[fru_id]
+        if fru != 'all' and fru != fruname:
+            continue
+        when = datetime.fromtimestamp(ts).strftime('%Y-%m-%d %H:%M:%S')
+        out.append(row(str(fru_id), fruname, when, log))
+    store.close()
+    return out
+
+
+def store_clear(store_dir, logfiles, fru):
+    store = LogStore(store_dir)
+    store.ingest(logfiles)
+    store.clear(FRULIST.index(fru))
+    store.close()
+
+
+def timed(func, *args):
+    start = time.time()
+    result = func(*args)
+    return (time.time() - start) * 1000, result
+
+
+def store_size(store_dir):
+    return sum(os.path.getsize(os.path.join(store_dir, name))
+               for name in os.listdir(store_dir))
+
+
+def usage():
+    sys.stderr.write('Usage: %s [-n lines] [-r rotations]\n' % sys.argv[0])
+    sys.exit(1)
+
+
+def main():
+    lines = DEFAULT_LINES
+    rotations = DEFAULT_ROTATIONS
+    try:
+        opts, args = getopt.getopt(sys.argv[1:], 'n:r:')
+        for opt, value in opts:
+            if opt == '-n':
+                lines = int(value)
+            else:
+                rotations = int(value)
+    except (getopt.GetoptError, ValueError):
+        usage()
+    if lines < 1 or rotations < 0:
+        usage()
+
+    random.seed(1)
+    tmp = tempfile.mkdtemp()
+    store_dir = os.path.join(tmp, 'store')
+    logfiles = [os.path.join(tmp, 'logfile.0'), os.path.join(tmp, 'logfile')]
+    # Two files ending about now
+    t0 = datetime.now() - timedelta(seconds=2 * lines * 20 + 3600)
+    generate(logfiles[0], lines, t0)
+    generate(logfiles[1], lines, t0 + timedelta(seconds=lines * 20))
+
+    size = sum(os.path.getsize(f) for f in logfiles)
+    print('%d lines, %.1f MB of syslog' % (2 * lines, size / 1048576.0))
+    print('%-28s %9s %9s' % ('run', 'scan_ms', 'store_ms'))
+
+    failed = False
+    ms, _ = timed(store_print, store_dir, logfiles, 'slot1')
+    print('%-28s %9s %9.0f' % ('first run (ingests all)', '', ms))
+    for fru in ('slot1', 'all'):
+        scan_ms, scan = timed(scan_print, logfiles, fru)
+        ms, out = timed(store_print, store_dir, logfiles, fru)
+        print('%-28s %9.0f %9.0f' % ('%s --print' % fru, scan_ms, ms))
+        if out != scan:
+            print('%s --print differs from the scan' % fru)
+            failed = True
+    ms, _ = timed(store_clear, store_dir, logfiles, 'slot2')
+    print('%-28s %9s %9.0f' % ('slot2 --clear', '', ms))
+
+    # A rotation every few days; each run sees one new file
+    t = t0 + timedelta(seconds=2 * lines * 20)
+    biggest = 0
+    worst = 0
+    for i in range(rotations):
+        os.rename(logfiles[1], logfiles[0])
+        generate(logfiles[1], lines, t)
+        t += timedelta(seconds=lines * 20)
+        ms, _ = timed(store_print, store_dir, logfiles, 'slot1')
+        worst = max(worst, ms)
+        biggest = max(biggest, store_size(store_dir))
+    if rotations:
+        print('%d rotations: store at most %.0f KB, slowest run %.0f ms' %
+              (rotations, biggest / 1024.0, worst))
+        if biggest > (log_store.MAX_FRU + 1) * log_store.MAX_FRU_SIZE + \
+           4096:
+            failed = True
+
+    shutil.rmtree(tmp)
+    print('FAILED' if failed else 'PASSED')
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
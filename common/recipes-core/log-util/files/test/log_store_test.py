@@ -0,0 +1,218 @@
+#!/usr/bin/env python
+#
+# Copyright 2016-present Facebook. All Rights Reserved.
+#
+# This program file is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by the
+# Free Software Foundation; version 2 of the License.
+#
+# This program is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+# for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program in a file named COPYING; if not, write to the
+# Free Software Foundation, Inc.,
+# 51 Franklin Street, Fifth Floor,
+# Boston, MA 02110-1301 USA
+#
+
+# Tests of log_store.LogStore against syslog files in a temporary
+# directory.
+
+import os
+import shutil
+import sys
+import tempfile
+from datetime import datetime, timedelta
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                '..'))
+import log_store
+from log_store import LogStore
+
+failed = False
+
+
+def check(name, ok):
+    global failed
+    print('%s: %s' % ('PASS' if ok else 'FAIL', name))
+    if not ok:
+        failed = True
+
+
+def crit(when, fru, n):
+    ''' A critical line for a FRU (0: none) logged at 'when' '''
+    name = ' - FRU: %d' % fru if fru else ''
+    return '%s bmc user.crit sensord: event %d%s\n' % (
+        when.strftime('%b %d %H:%M:%S'), n, name)
+
+
+def info(when, n):
+    return '%s bmc user.info gpiod: routine %d, FRU: 1\n' % (
+        when.strftime('%b %d %H:%M:%S'), n)
+
+
+class Sandbox(object):
+
+    def __init__(self):
+        self.dir = tempfile.mkdtemp()
+        self.store_dir = os.path.join(self.dir, 'store')
+        self.logs = [os.path.join(self.dir, 'logfile.0'),
+                     os.path.join(self.dir, 'logfile')]
+
+    def log(self, lines, which=1):
+        with open(self.logs[which], 'a') as fd:
+            fd.write(''.join(lines))
+
+    def rotate(self):
+        os.rename(self.logs[1], self.logs[0])
+
+    def ingest(self):
+        store = LogStore(self.store_dir)
+        count = store.ingest(self.logs)
+        store.close()
+        return count
+
+    def events(self, frus, start=None, end=None):
+        store = LogStore(self.store_dir)
+        events = list(store.events(frus, start, end))
+        store.close()
+        return events
+
+    def remove(self):
+        shutil.rmtree(self.dir)
+
+
+def epoch(when):
+    return log_store.line_time(when.strftime('%b %d %H:%M:%S'),
+                               datetime.now())
+
+
+def test_ingest():
+    sb = Sandbox()
+    t0 = datetime.now().replace(microsecond=0) - timedelta(hours=1)
+
+    sb.log([crit(t0, 1, 0), info(t0, 1), crit(t0, 2, 2), crit(t0, 0, 3)])
+    check('only critical lines are stored', sb.ingest() == 3)
+    saves = []
+    save_state = LogStore._save_state
+    LogStore._save_state = lambda self: saves.append(1) or save_state(self)
+    check('a second run reads nothing new', sb.ingest() == 0)
+    sb.events([0, 1, 2])
+    LogStore._save_state = save_state
+    check('and does not rewrite the state', not saves)
+
+    sb.log([crit(t0, 1, 4)[:20]])
+    check('a partly written line is left for later', sb.ingest() == 0)
+    sb.log([crit(t0, 1, 4)[20:]])
+    check('and read once it is complete', sb.ingest() == 1)
+
+    sb.rotate()
+    sb.log([crit(t0, 2, 5)])
+    check('a rotated file is not read again', sb.ingest() == 1)
+
+    got = [(fru, line) for fru, ts, line in sb.events([0, 1, 2])]
+    want = [(1, crit(t0, 1, 0)), (2, crit(t0, 2, 2)), (0, crit(t0, 0, 3)),
+            (1, crit(t0, 1, 4)), (2, crit(t0, 2, 5))]
+    check('events of several FRUs come in logging order', got == want)
+    sb.remove()
+
+
+def test_range():
+    sb = Sandbox()
+    t0 = datetime.now().replace(microsecond=0) - timedelta(hours=2)
+
+    sb.log([crit(t0 + timedelta(minutes=i), 1, i) for i in range(100)])
+    sb.ingest()
+    start = epoch(t0 + timedelta(minutes=20))
+    end = epoch(t0 + timedelta(minutes=30))
+    got = [line for fru, ts, line in sb.events([1], start, end)]
+    check('a time range returns just its events',
+          got == [crit(t0 + timedelta(minutes=i), 1, i)
+                  for i in range(20, 30)])
+    sb.remove()
+
+
+def test_out_of_order():
+    sb = Sandbox()
+    t0 = datetime.now().replace(microsecond=0) - timedelta(hours=3)
+
+    # The clock was set back an hour half way through
+    times = [t0 + timedelta(minutes=i) for i in range(60)] + \
+            [t0 + timedelta(minutes=i) for i in range(60)]
+    lines = [crit(t, 1, n) for n, t in enumerate(times)]
+    sb.log(lines)
+    sb.ingest()
+
+    start = epoch(t0 + timedelta(minutes=50))
+    end = epoch(t0 + timedelta(minutes=55))
+    got = [line for fru, ts, line in sb.events([1], start, end)]
+    want = [line for t, line in zip(times, lines)
+            if t0 + timedelta(minutes=50) <= t < t0 + timedelta(minutes=55)]
+    check('a FRU out of time order is scanned in full', got == want)
+
+    got = [line for fru, ts, line in sb.events([1])]
+    check('and still prints in logging order', got == lines)
+
+    store = LogStore(sb.store_dir)
+    store.clear(1)
+    store.close()
+    sb.log([crit(t0, 1, 200), crit(t0 + timedelta(minutes=1), 1, 201)])
+    sb.ingest()
+    store = LogStore(sb.store_dir)
+    check('a clear puts the FRU back in order',
+          1 not in store.state['unsorted'])
+    store.close()
+    sb.remove()
+
+
+def test_bound():
+    sb = Sandbox()
+    t0 = datetime.now().replace(microsecond=0) - timedelta(days=20)
+
+    # Twice the cap of FRU 1 events over several rotations
+    line_len = len(crit(t0, 1, 0))
+    total = 2 * log_store.MAX_FRU_SIZE // line_len + 1
+    n = 0
+    biggest = 0
+    while n < total:
+        batch = []
+        for i in range(500):
+            batch.append(crit(t0 + timedelta(minutes=n), 1, n))
+            n += 1
+        sb.log(batch)
+        sb.rotate()
+        sb.ingest()
+        biggest = max(biggest, os.path.getsize(
+            os.path.join(sb.store_dir, '1.dat')))
+    sb.log([crit(t0, 2, n)])
+    sb.ingest()
+
+    check('a FRU never keeps more than MAX_FRU_SIZE',
+          biggest <= log_store.MAX_FRU_SIZE)
+    got = [line for fru, ts, line in sb.events([1])]
+    want = [crit(t0 + timedelta(minutes=i), 1, i)
+            for i in range(n - len(got), n)]
+    check('the newest events are kept', len(got) > 0 and got == want)
+    check('other FRUs are untouched',
+          [line for fru, ts, line in sb.events([2])] == [crit(t0, 2, n)])
+
+    start = epoch(t0 + timedelta(minutes=n - 10))
+    got = [line for fru, ts, line in sb.events([1], start)]
+    check('ranges still work after a trim', got == want[-10:])
+    sb.remove()
+
+
+def main():
+    test_ingest()
+    test_range()
+    test_out_of_order()
+    test_bound()
+    print('FAILED' if failed else 'PASSED')
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -146,8 +146,13 @@ bufStore* createBuffer(const char *dev, int fsize) {
     return NULL;
   }
 
-  buf->buf_fd = open(buf->file, O_RDWR | O_APPEND | O_CREAT, 0666) ;
-  buf->maxSizeBytes = fsize;
+  buf->cb = cbuf_open(buf->file, buf->backupfile, fsize, 0);
+  if (buf->cb == NULL) {
+    perror("Cannot open the mTerm buffer log file");
+    free(buf);
+    return NULL;
+  }
+  cbuf_set_archives(buf->cb, FILE_ARCHIVES);
   return buf;
 }
 
@@ -155,95 +160,36 @@ void closeBuffer(bufStore* buf) {
   if (!buf) {
     return;
   }
-  close(buf->buf_fd);
+  cbuf_close(buf->cb);
   free(buf);
 }
 
 void writeToBuffer(bufStore *buf, char* data, int len) {
-   bool rotate = false;
-   struct stat file_stat;
-   int rc = stat(buf->file, &file_stat);
-   if (rc != 0) {
-     if (errno == ENOENT) {
-       // Maybe someone externally removed our buffer file. Force file rotation.
-       rotate = true;
-     } else {
-       // We couldn't figure out if the file needs to be rotated.
-       // Don't rotate the file.  Continue and log the data anyway, though.
-       syslog(LOG_WARNING, "Error determining existing buffer file size: "
-              "errno=%d", errno);
-     }
-   } else {
-     if (file_stat.st_size >= buf->maxSizeBytes) {
-       rotate = true;
-     }
-   }
-
-   // Rollover to a backup file when buffer hits filesize
-   if (rotate) {
-     close(buf->buf_fd);
-     rename(buf->file, buf->backupfile);
-     buf->buf_fd = open(buf->file, O_RDWR | O_APPEND | O_CREAT, 0666) ;
-     if (buf->buf_fd < 0) {
-       perror("Cannot open the mTerm buffer log file");
-       exit(-1);
-     }
-   }
-   writeData(buf->buf_fd, data, len, "buffer");
+  // Size tracking and rollover to the backup file happen in cbuf
+  cbuf_write(buf->cb, data, len);
 }
 
-long int bufferGetLines(char* fname, int clientfd, int nlines, long int curr) {
-  FILE* fd;
-  int count = 0;
-  int cursize = 0;
-  char ch;
-  char buf[SEND_SIZE];
+int bufferGetLines(bufStore *buf, int clientfd, int nlines) {
+  char data[SEND_SIZE];
+  off_t curr;
+  int len;
 
   if (nlines == 0) {
-    return curr;
-  }
-
-  fd = fopen(fname, "r");
-  if (fd == NULL) {
-    perror("fopen");
-    return -1;
-  }
-
-  if (curr) {
-    fseek(fd, curr, SEEK_END);
-  } else {
-    fseek(fd, 0, SEEK_END);
-    curr = ftell(fd);
-  }
-
-  while (curr) {
-    fseek(fd, --curr, SEEK_SET);
-    if (fgetc(fd) == '\n') {
-      if (count++ == nlines) {
-         break;
-      }
-    }
-  }
-  count = 0;
-  if (!curr) {
-    fseek(fd, -1, SEEK_CUR);
+    return 0;
   }
-  while (count < nlines) {
-    ch = fgetc(fd);
-    if(ch == '\n') {
-      count++;
-    }
-    buf[cursize++] = ch;
 
-    if(cursize == SEND_SIZE) {
-      send(clientfd, buf , SEND_SIZE, 0);
-      memset(buf, 0, sizeof(buf));
-      cursize = 0;
+  // The line index tells us where the last nlines begin; no need to scan
+  curr = cbuf_tail_offset(buf->cb, nlines);
+  while ((len = pread(buf->cb->fd, data, sizeof(data), curr)) > 0) {
+    if (send(clientfd, data, len, 0) < 0) {
+      perror("send");
+      return -1;
     }
+    curr += len;
   }
-  if (cursize) {
-    send(clientfd, buf, cursize, 0);
+  if (len < 0) {
+    perror("pread");
+    return -1;
   }
-  fclose(fd);
-  return curr;
+  return 0;
 }
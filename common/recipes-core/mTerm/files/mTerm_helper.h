@@ -18,6 +18,7 @@
 
 #include <sys/socket.h>
 #include <arpa/inet.h>
+#include <openbmc/cbuf.h>
 
 #define ASCII_DELETE  0177
 #define ESC_CHAR_HELP '?'
@@ -31,6 +32,7 @@
 #define PATH_SIZE 64
 #define SEND_SIZE 256
 #define FILE_SIZE_BYTES 300000
+#define FILE_ARCHIVES 4
 #define MAX_BYTE 255
 
 typedef enum escMode {
@@ -41,8 +43,7 @@ typedef enum escMode {
 } escMode;
 
 typedef struct bufStore {
-  int  buf_fd;
-  int  maxSizeBytes;
+  cbuf_t *cb;
   char file[PATH_SIZE];
   char backupfile[PATH_SIZE];
 } bufStore;
@@ -61,7 +62,7 @@ void charSend(int clientfd, char* c, int length);
 // buffer processing
 bufStore* createBuffer(const char *dev, int fsize);
 void closeBuffer(bufStore* buf);
-long int bufferGetLines(char* fname, int clientfd, int n, long int curr);
+int bufferGetLines(bufStore *buf, int clientfd, int n);
 void writeToBuffer(bufStore *buf, char* data, int len);
 // tx
 int sendTlv(int fd, uint16_t type, void* value, uint16_t valLen);
@@ -141,7 +141,7 @@ static void processClient(fd_set* master, int clientFd , int solFd,
             syslog(LOG_ERR, "mTerm_server: Received incorrect break char");
           }
         } else {
-          bufferGetLines(buf->file, clientFd, atoi(vec[1].iov_base), 0);
+          bufferGetLines(buf, clientFd, atoi(vec[1].iov_base));
         }
         break;
       case ASCII_DELETE:
@@ -191,6 +191,8 @@ static int processSol(fd_set* master, int serverfd, int fdmax,
 
 static void connectServer(const char *stty, const char *dev) {
   int fdmax, newfd;
+  int timeout;
+  struct timeval tv;
 
   fd_set master, read_fds;
   FD_ZERO(&master);
@@ -213,7 +215,7 @@ static void connectServer(const char *stty, const char *dev) {
 
   struct bufStore* buf;
   buf = createBuffer(dev, FILE_SIZE_BYTES);
-  if (!buf || (buf->buf_fd < 0)) {
+  if (!buf) {
     syslog(LOG_ERR, "mTerm_server: Failed to create the log file\n");
     closeTty(tty_sol);
     close(serverfd);
@@ -226,10 +228,16 @@ static void connectServer(const char *stty, const char *dev) {
 
   for(;;) {
     read_fds = master;
-    if (select(fdmax + 1, &read_fds, NULL, NULL, NULL) == -1) {
+    // Wake up in time to flush buffered console data
+    timeout = cbuf_timeout(buf->cb);
+    tv.tv_sec = timeout / 1000;
+    tv.tv_usec = (timeout % 1000) * 1000;
+    if (select(fdmax + 1, &read_fds, NULL, NULL,
+               (timeout < 0) ? NULL : &tv) == -1) {
       syslog(LOG_ERR, "mTerm_server: Server socket: select error\n");
       break;
     }
+    cbuf_sync(buf->cb);
     if (FD_ISSET(serverfd, &read_fds)) {
       newfd = acceptClient(serverfd);
       if (newfd < 0) {
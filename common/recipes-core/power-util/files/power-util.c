@@ -27,12 +27,18 @@
 #include <getopt.h>
 #include <stdbool.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
 #include <openbmc/pal.h>
 
 #define POWER_ON_STR        "on"
 #define POWER_OFF_STR       "off"
 
 #define MAX_RETRIES          10
+#define POWER_ON_WAIT_MS     3000  // Wait for power good before re-pressing
+#define POWER_POLL_MS        200
+#define STAGGER_MS           1000  // Default gap between slots powering on
 
 const char *pwr_option_list = "status, graceful-shutdown, off, on, cycle, "
   "12V-off, 12V-on, 12V-cycle";
@@ -49,10 +55,57 @@ enum {
   PWR_SLED_CYCLE
 };
 
+typedef struct {
+  uint8_t fru;
+  uint8_t opt;
+  int delay_ms;
+  int ret;
+  pthread_t pt;
+} power_job_t;
+
 static void
 print_usage() {
   printf("Usage: power-util [ %s ] [ %s ]\nUsage: power-util sled-cycle\n",
       pal_server_list, pwr_option_list);
+  printf("Usage: power-util [--stagger <ms>] <all | fru,fru,...> [ %s ]\n",
+      pwr_option_list);
+}
+
+static void
+sleep_ms(int msec) {
+  struct timespec req;
+
+  req.tv_sec = msec / 1000;
+  req.tv_nsec = (msec % 1000) * 1000 * 1000;
+
+  while(nanosleep(&req, &req) == -1 && errno == EINTR) {
+    continue;
+  }
+}
+
+static double
+now_sec(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Poll for the server to report power good, for up to timeout_ms */
+static int
+wait_power_on(uint8_t fru, int timeout_ms) {
+  uint8_t status;
+  int waited;
+
+  for (waited = 0; waited < timeout_ms; waited += POWER_POLL_MS) {
+    sleep_ms(POWER_POLL_MS);
+    if ((pal_get_server_power(fru, &status) >= 0) &&
+        (status == SERVER_POWER_ON)) {
+      return 0;
+    }
+  }
+
+  return -1;
 }
 
 static int
@@ -196,9 +249,8 @@ power_util(uint8_t fru, uint8_t opt) {
       }
 
       for (retries = 0; retries < MAX_RETRIES; retries++) {
-         sleep(3);
-         ret = pal_get_server_power(fru, &status);
-         if ((ret >= 0) && (status == SERVER_POWER_ON)) {
+         if (!wait_power_on(fru, POWER_ON_WAIT_MS)) {
+           ret = 0;
            syslog(LOG_CRIT, "SERVER_POWER_ON successful for FRU: %d", fru);
            break;
          }
@@ -349,6 +401,96 @@ power_util(uint8_t fru, uint8_t opt) {
   return ret;
 }
 
+static void *
+power_job(void *arg) {
+  power_job_t *job = (power_job_t *) arg;
+
+  if (job->delay_ms > 0) {
+    sleep_ms(job->delay_ms);
+  }
+  job->ret = power_util(job->fru, job->opt);
+
+  return NULL;
+}
+
+/*
+ * Run one option on several slots at once.  Operations that draw power
+ * (on, cycle, 12V-on, 12V-cycle) start stagger_ms apart to limit inrush.
+ */
+static int
+power_util_batch(char *frus, uint8_t opt, int stagger_ms) {
+
+  power_job_t jobs[MAX_NODES];
+  int njobs = 0;
+  int failed = 0;
+  int i;
+  uint8_t fru, status;
+  bool stagger;
+  char *str, *next;
+  double start;
+
+  if (!strcmp(frus, "all")) {
+    for (fru = 1; fru <= MAX_NODES; fru++) {
+      if (pal_is_fru_prsnt(fru, &status) < 0 || status == 0) {
+        continue;
+      }
+      jobs[njobs++].fru = fru;
+    }
+  } else {
+    for (str = strtok_r(frus, ",", &next); str;
+         str = strtok_r(NULL, ",", &next)) {
+      if (njobs == MAX_NODES) {
+        printf("Too many frus, at most %d\n", MAX_NODES);
+        return -1;
+      }
+      if (pal_get_fru_id(str, &fru) < 0) {
+        printf("Wrong fru: %s\n", str);
+        return -1;
+      }
+      for (i = 0; i < njobs; i++) {
+        if (jobs[i].fru == fru) {
+          printf("Duplicate fru: %s\n", str);
+          return -1;
+        }
+      }
+      if (pal_is_fru_prsnt(fru, &status) < 0 || status == 0) {
+        printf("%s is empty!\n", str);
+        return -1;
+      }
+      jobs[njobs++].fru = fru;
+    }
+  }
+
+  stagger = (opt == PWR_ON || opt == PWR_CYCLE || opt == PWR_12V_ON ||
+             opt == PWR_12V_CYCLE);
+
+  start = now_sec();
+  for (i = 0; i < njobs; i++) {
+    jobs[i].opt = opt;
+    jobs[i].delay_ms = stagger ? i * stagger_ms : 0;
+    jobs[i].ret = -1;
+    if (pthread_create(&jobs[i].pt, NULL, power_job, &jobs[i])) {
+      syslog(LOG_WARNING, "power_util: pthread_create failed for fru %u",
+          jobs[i].fru);
+      jobs[i].pt = 0;
+    }
+  }
+
+  for (i = 0; i < njobs; i++) {
+    if (jobs[i].pt) {
+      pthread_join(jobs[i].pt, NULL);
+    }
+    if (jobs[i].ret < 0) {
+      printf("fru %u failed\n", jobs[i].fru);
+      failed++;
+    }
+  }
+  printf("%d of %d frus done in %.1f seconds\n", njobs - failed, njobs,
+      now_sec() - start);
+
+  return failed ? -1 : 0;
+}
+
 int
 main(int argc, char **argv) {
 
@@ -356,6 +498,20 @@ main(int argc, char **argv) {
 
   uint8_t fru, status, opt;
   char *option;
+  int stagger_ms = STAGGER_MS;
+  bool stagger_set = false;
+
+  if (argc > 2 && !strcmp(argv[1], "--stagger")) {
+    stagger_set = true;
+    stagger_ms = atoi(argv[2]);
+    if (stagger_ms < 0) {
+      print_usage();
+      exit(-1);
+    }
+    argv[2] = argv[0];
+    argv += 2;
+    argc -= 2;
+  }
 
   /* Check for sled-cycle */
   if (argc < 2 || argc > 3) {
@@ -373,6 +529,19 @@ main(int argc, char **argv) {
     exit(-1);
   }
 
+  /* Several frus: run them concurrently */
+  if (argc > 2 && opt != PWR_SLED_CYCLE &&
+      (!strcmp(argv[1], "all") || strchr(argv[1], ','))) {
+    return power_util_batch(argv[1], opt, stagger_ms);
+  }
+
+  /* The gap only applies between frus of a batch */
+  if (stagger_set) {
+    printf("--stagger needs more than one fru\n");
+    print_usage();
+    exit(-1);
+  }
+
   if (argc > 2) {
     ret = pal_get_fru_id(argv[1], &fru);
     if (ret < 0) {
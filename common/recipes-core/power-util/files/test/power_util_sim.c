@@ -0,0 +1,424 @@
+/*
+ * Copyright 2015-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Runs power-util against a stub libpal that keeps each slot's power state
+ * in memory and takes as long as the Yosemite pal to press the buttons.
+ * Every command line runs in a child process; the simulated clock runs
+ * SIM_SCALE times faster than the wall clock.  Reports how long each batch
+ * takes and checks the stagger between slots and the argument checks.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define main power_util_main
+#include "../power-util.c"
+#undef main
+
+#define SIM_SCALE 50
+
+// Yosemite pal delays, seconds
+#define DELAY_BUTTON 1
+#define DELAY_GRACEFUL_SHUTDOWN 1
+#define DELAY_POWER_OFF 6
+#define DELAY_POWER_CYCLE 10
+#define DELAY_12V_CYCLE 5
+
+int __real_nanosleep(const struct timespec *req, struct timespec *rem);
+int __real_clock_gettime(clockid_t clk, struct timespec *ts);
+
+typedef struct {
+  bool power;
+  bool v12;
+  bool present;
+  int calls;              // pal_set_server_power calls
+  double first_call;      // Simulated time of the first one
+  char last_state[MAX_VALUE_LEN];
+} slot_sim_t;
+
+typedef struct {
+  pthread_mutex_t lock;
+  slot_sim_t slot[MAX_NODES + 1];
+} sled_sim_t;
+
+const char pal_server_list[] = "slot1, slot2, slot3, slot4";
+
+static sled_sim_t *sled;
+static struct timespec sim_base;
+static int failed;
+
+static void
+check(const char *name, int ok) {
+  printf("%s: %s\n", ok ? "PASS" : "FAIL", name);
+  if (!ok)
+    failed = 1;
+}
+
+int
+__wrap_clock_gettime(clockid_t clk, struct timespec *ts) {
+  struct timespec real;
+  uint64_t ns;
+
+  if (clk != CLOCK_MONOTONIC)
+    return __real_clock_gettime(clk, ts);
+
+  __real_clock_gettime(CLOCK_MONOTONIC, &real);
+  ns = ((real.tv_sec - sim_base.tv_sec) * 1000000000ULL +
+        real.tv_nsec - sim_base.tv_nsec) * SIM_SCALE;
+  ts->tv_sec = sim_base.tv_sec + ns / 1000000000ULL;
+  ts->tv_nsec = ns % 1000000000ULL;
+  return 0;
+}
+
+int
+__wrap_nanosleep(const struct timespec *req, struct timespec *rem) {
+  uint64_t ns = (req->tv_sec * 1000000000ULL + req->tv_nsec) / SIM_SCALE;
+  struct timespec real;
+
+  real.tv_sec = ns / 1000000000ULL;
+  real.tv_nsec = ns % 1000000000ULL;
+  return __real_nanosleep(&real, NULL);
+}
+
+unsigned int
+__wrap_sleep(unsigned int seconds) {
+  struct timespec req = {seconds, 0};
+
+  __wrap_nanosleep(&req, NULL);
+  return 0;
+}
+
+static double
+sim_now(void) {
+  struct timespec ts;
+
+  __wrap_clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec - sim_base.tv_sec) + ts.tv_nsec / 1e9 -
+         sim_base.tv_nsec / 1e9;
+}
+
+int
+pal_get_fru_id(char *str, uint8_t *fru) {
+  if (!strncmp(str, "slot", 4) && str[4] >= '1' && str[4] <= '4' &&
+      str[5] == '\0') {
+    *fru = str[4] - '0';
+  } else if (!strcmp(str, "spb")) {
+    *fru = FRU_SPB;
+  } else if (!strcmp(str, "nic")) {
+    *fru = FRU_NIC;
+  } else {
+    return -1;
+  }
+  return 0;
+}
+
+int
+pal_is_fru_prsnt(uint8_t fru, uint8_t *status) {
+  *status = (fru <= MAX_NODES) ? sled->slot[fru].present : 1;
+  return 0;
+}
+
+int
+pal_get_server_power(uint8_t slot_id, uint8_t *status) {
+  if (slot_id < 1 || slot_id > MAX_NODES)
+    return -1;
+  *status = sled->slot[slot_id].power ? SERVER_POWER_ON : SERVER_POWER_OFF;
+  return 0;
+}
+
+static void
+set_power(uint8_t slot_id, bool power, bool v12) {
+  pthread_mutex_lock(&sled->lock);
+  sled->slot[slot_id].power = power;
+  sled->slot[slot_id].v12 = v12;
+  pthread_mutex_unlock(&sled->lock);
+}
+
+int
+pal_set_server_power(uint8_t slot_id, uint8_t cmd) {
+  slot_sim_t *s;
+
+  if (slot_id < 1 || slot_id > MAX_NODES)
+    return -1;
+  s = &sled->slot[slot_id];
+
+  pthread_mutex_lock(&sled->lock);
+  if (s->calls++ == 0)
+    s->first_call = sim_now();
+  pthread_mutex_unlock(&sled->lock);
+
+  switch (cmd) {
+    case SERVER_POWER_ON:
+      if (s->power)
+        return 1;
+      sleep(DELAY_BUTTON);
+      set_power(slot_id, true, true);
+      return 0;
+
+    case SERVER_POWER_OFF:
+    case SERVER_GRACEFUL_SHUTDOWN:
+      if (!s->power)
+        return 1;
+      sleep(DELAY_BUTTON);
+      sleep((cmd == SERVER_POWER_OFF) ? DELAY_POWER_OFF :
+            DELAY_GRACEFUL_SHUTDOWN);
+      set_power(slot_id, false, true);
+      return 0;
+
+    case SERVER_POWER_CYCLE:
+      if (s->power) {
+        sleep(DELAY_BUTTON + DELAY_POWER_OFF);
+        set_power(slot_id, false, true);
+        sleep(DELAY_POWER_CYCLE);
+      }
+      sleep(DELAY_BUTTON);
+      set_power(slot_id, true, true);
+      return 0;
+
+    case SERVER_12V_OFF:
+      set_power(slot_id, false, false);
+      return 0;
+
+    case SERVER_12V_ON:
+      set_power(slot_id, false, true);
+      return 0;
+
+    case SERVER_12V_CYCLE:
+      set_power(slot_id, false, false);
+      sleep(DELAY_12V_CYCLE);
+      set_power(slot_id, false, true);
+      return 0;
+  }
+
+  return -1;
+}
+
+int
+pal_sled_cycle(void) {
+  return 0;
+}
+
+int
+pal_set_led(uint8_t slot, uint8_t status) {
+  return 0;
+}
+
+int
+pal_get_last_pwr_state(uint8_t fru, char *state) {
+  strcpy(state, sled->slot[fru].last_state);
+  return 0;
+}
+
+int
+pal_set_last_pwr_state(uint8_t fru, char *state) {
+  pthread_mutex_lock(&sled->lock);
+  snprintf(sled->slot[fru].last_state, MAX_VALUE_LEN, "%s", state);
+  pthread_mutex_unlock(&sled->lock);
+  return 0;
+}
+
+int
+pal_is_crashdump_ongoing(uint8_t slot) {
+  return 0;
+}
+
+/* Every slot present, powered as given */
+static void
+reset_sled(bool power) {
+  int i;
+
+  for (i = 1; i <= MAX_NODES; i++) {
+    memset(&sled->slot[i], 0, sizeof(sled->slot[i]));
+    sled->slot[i].present = true;
+    sled->slot[i].power = power;
+    sled->slot[i].v12 = true;
+    strcpy(sled->slot[i].last_state, power ? POWER_ON_STR : POWER_OFF_STR);
+  }
+}
+
+/*
+ * Run power-util with the arguments in line; returns its exit status and
+ * leaves what it printed in out.
+ */
+static int
+run(const char *line, char *out, size_t len, double *secs) {
+  char buf[256];
+  char *argv[16];
+  int argc = 0;
+  int fds[2];
+  int status;
+  size_t n = 0;
+  ssize_t r;
+  double start;
+  pid_t pid;
+
+  snprintf(buf, sizeof(buf), "power-util %s", line);
+  for (argv[argc] = strtok(buf, " "); argv[argc] && argc < 15;
+       argv[++argc] = strtok(NULL, " "))
+    ;
+
+  if (pipe(fds) < 0) {
+    perror("pipe");
+    exit(1);
+  }
+  fflush(stdout);
+  start = sim_now();
+  pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    dup2(fds[1], STDOUT_FILENO);
+    exit(power_util_main(argc, argv));
+  }
+  close(fds[1]);
+  while (n < len - 1 && (r = read(fds[0], out + n, len - 1 - n)) > 0)
+    n += r;
+  out[n] = '\0';
+  close(fds[0]);
+  waitpid(pid, &status, 0);
+  *secs = sim_now() - start;
+
+  return WIFEXITED(status) ? (int8_t)WEXITSTATUS(status) : -1;
+}
+
+static int
+calls(void) {
+  int i, n = 0;
+
+  for (i = 1; i <= MAX_NODES; i++)
+    n += sled->slot[i].calls;
+  return n;
+}
+
+static double
+gap(int a, int b) {
+  return sled->slot[b].first_call - sled->slot[a].first_call;
+}
+
+static void
+report(const char *line, double secs) {
+  printf("  %-36s %6.1f s\n", line, secs);
+}
+
+static void
+test_batches(void) {
+  char out[4096];
+  double secs;
+  bool ok;
+  int ret;
+  int i;
+
+  reset_sled(false);
+  ret = run("slot1,slot3 on", out, sizeof(out), &secs);
+  report("slot1,slot3 on", secs);
+  check("slot1,slot3 on powers on exactly those slots", ret == 0 &&
+        sled->slot[1].power && sled->slot[3].power &&
+        !sled->slot[2].power && !sled->slot[4].power);
+  check("the second slot starts one stagger later",
+        gap(1, 3) >= 0.95 && gap(1, 3) < 1.5);
+
+  reset_sled(true);
+  ret = run("all cycle", out, sizeof(out), &secs);
+  report("all cycle", secs);
+  ok = (ret == 0);
+  for (i = 1; i <= MAX_NODES; i++)
+    ok = ok && sled->slot[i].power;
+  check("all cycle leaves every slot on", ok);
+  check("all cycle overlaps the slots",
+        secs < 2 * (DELAY_BUTTON * 2 + DELAY_POWER_OFF + DELAY_POWER_CYCLE));
+  check("power-on slots start 1 s apart", gap(1, 2) >= 0.95 &&
+        gap(2, 3) >= 0.95 && gap(3, 4) >= 0.95);
+
+  reset_sled(true);
+  ret = run("all off", out, sizeof(out), &secs);
+  report("all off", secs);
+  check("all off starts every slot together", ret == 0 &&
+        gap(1, 4) < 0.5 && !sled->slot[1].power && !sled->slot[4].power);
+
+  reset_sled(false);
+  ret = run("--stagger 200 slot2,slot4 on", out, sizeof(out), &secs);
+  report("--stagger 200 slot2,slot4 on", secs);
+  check("--stagger sets the gap", ret == 0 &&
+        gap(2, 4) >= 0.19 && gap(2, 4) < 0.6);
+
+  reset_sled(false);
+  ret = run("slot2 on", out, sizeof(out), &secs);
+  report("slot2 on", secs);
+  check("a single fru still runs on its own", ret == 0 &&
+        sled->slot[2].power && calls() == 1);
+}
+
+static void
+test_rejected(void) {
+  char out[4096];
+  double secs;
+  int ret;
+
+  reset_sled(false);
+  ret = run("slot1,slot1 on", out, sizeof(out), &secs);
+  check("a duplicate fru is rejected", ret != 0 &&
+        strstr(out, "Duplicate fru: slot1") && calls() == 0);
+
+  reset_sled(false);
+  ret = run("slot1,slot2,slot3,slot4,spb on", out, sizeof(out), &secs);
+  check("more than MAX_NODES frus are rejected", ret != 0 &&
+        strstr(out, "Too many frus") && calls() == 0);
+
+  reset_sled(false);
+  ret = run("--stagger 500 slot1 on", out, sizeof(out), &secs);
+  check("--stagger with one fru is rejected", ret != 0 &&
+        strstr(out, "--stagger needs more than one fru") && calls() == 0);
+
+  reset_sled(false);
+  sled->slot[3].present = false;
+  ret = run("slot1,slot3 on", out, sizeof(out), &secs);
+  check("an empty slot is rejected", ret != 0 &&
+        strstr(out, "slot3 is empty!") && calls() == 0);
+}
+
+int
+main(void) {
+  pthread_mutexattr_t attr;
+
+  __real_clock_gettime(CLOCK_MONOTONIC, &sim_base);
+
+  sled = mmap(NULL, sizeof(*sled), PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (sled == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  pthread_mutex_init(&sled->lock, &attr);
+
+  printf("Simulated time per batch (%dx faster than real):\n", SIM_SCALE);
+  test_batches();
+  test_rejected();
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  return failed;
+}
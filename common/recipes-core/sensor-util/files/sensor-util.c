@@ -26,24 +26,42 @@
 #include <string.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <math.h>
 #include <openbmc/pal.h>
 #include <openbmc/sdr.h>
 
-#define STATUS_OK   "ok"
-#define STATUS_NS   "ns"
-#define STATUS_UNC  "unc"
-#define STATUS_UCR  "ucr"
-#define STATUS_UNR  "unr"
-#define STATUS_LNC  "lnc"
-#define STATUS_LCR  "lcr"
-#define STATUS_LNR  "lnr"
-
 #define MAX_HISTORY_PERIOD  3600
 
 static int
 print_usage() {
   printf("Usage: sensor-util [ %s ] <--threshold> <sensor num>\n", pal_fru_list);
   printf("Usage: sensor-util [ %s ] <--history> <period: 1 ~ %d (s)> <sensor num>\n", pal_fru_list, MAX_HISTORY_PERIOD);
+  printf("Usage: sensor-util [ %s ] <--json> <sensor num>\n", pal_fru_list);
+}
+
+static void
+print_json_str(const char *str) {
+
+  putchar('"');
+  for (; *str; str++) {
+    if (*str == '"' || *str == '\\') {
+      printf("\\%c", *str);
+    } else if ((unsigned char)*str < 0x20) {
+      printf("\\u%04x", *str);
+    } else {
+      putchar(*str);
+    }
+  }
+  putchar('"');
+}
+
+static void
+print_json_float(float fvalue) {
+
+  if (isfinite(fvalue))
+    printf("%.2f", fvalue);
+  else
+    printf("null");
 }
 
 static void
@@ -84,25 +102,103 @@ print_sensor_reading(float fvalue, uint8_t snr_num, thresh_sensor_t *thresh,
 }
 
 static void
-get_sensor_status(float fvalue, thresh_sensor_t *thresh, char *status) {
+print_json_sensor(snr_snapshot_t *snr) {
 
-  if (thresh->flag == 0)
-    sprintf(status, STATUS_NS);
+  int i;
+  bool first = true;
+  thresh_sensor_t *thresh = &snr->thresh;
+  static const struct {
+    const char *name;
+    uint8_t bit;
+  } bits[] = {
+    {"UCR", UCR_THRESH}, {"UNC", UNC_THRESH}, {"UNR", UNR_THRESH},
+    {"LCR", LCR_THRESH}, {"LNC", LNC_THRESH}, {"LNR", LNR_THRESH},
+  };
+  const float values[] = {
+    thresh->ucr_thresh, thresh->unc_thresh, thresh->unr_thresh,
+    thresh->lcr_thresh, thresh->lnc_thresh, thresh->lnr_thresh,
+  };
+
+  printf("{\"num\": %d, \"name\": ", snr->num);
+  print_json_str(thresh->name);
+  printf(", \"value\": ");
+  if (snr->valid)
+    print_json_float(snr->value);
   else
-    sprintf(status, STATUS_OK);
-
-  if (GETBIT(thresh->flag, UNC_THRESH) && (fvalue >= thresh->unc_thresh))
-    sprintf(status, STATUS_UNC);
-  if (GETBIT(thresh->flag, UCR_THRESH) && (fvalue >= thresh->ucr_thresh))
-    sprintf(status, STATUS_UCR);
-  if (GETBIT(thresh->flag, UNR_THRESH) && (fvalue >= thresh->unr_thresh))
-    sprintf(status, STATUS_UNR);
-  if (GETBIT(thresh->flag, LNC_THRESH) && (fvalue <= thresh->lnc_thresh))
-    sprintf(status, STATUS_LNC);
-  if (GETBIT(thresh->flag, LCR_THRESH) && (fvalue <= thresh->lcr_thresh))
-    sprintf(status, STATUS_LCR);
-  if (GETBIT(thresh->flag, LNR_THRESH) && (fvalue <= thresh->lnr_thresh))
-    sprintf(status, STATUS_LNR);
+    printf("null");
+  printf(", \"units\": ");
+  print_json_str(thresh->units);
+  printf(", \"status\": ");
+  print_json_str(snr->status);
+
+  printf(", \"thresholds\": {");
+  for (i = 0; i < sizeof(bits) / sizeof(bits[0]); i++) {
+    if (!(thresh->flag & GETMASK(bits[i].bit)))
+      continue;
+    printf("%s\"%s\": ", first ? "" : ", ", bits[i].name);
+    print_json_float(values[i]);
+    first = false;
+  }
+  printf("}}");
+}
+
+/*
+ * Emit one FRU as a JSON object. All of its sensors come from a single
+ * sdr_get_fru_snapshot() call, so the SDR is parsed once per FRU.
+ */
+static void
+print_json_fru(uint8_t fru, int num) {
+
+  int i, cnt;
+  uint8_t status;
+  char fruname[16];
+  const char *state = "ok";
+  bool first = true;
+  static snr_snapshot_t snrs[MAX_SENSOR_NUM];
+
+  if (pal_get_fru_name(fru, fruname))
+    sprintf(fruname, "fru%d", fru);
+
+  if ((pal_is_fru_prsnt(fru, &status) < 0) || (status == 0)) {
+    state = "empty";
+  } else if ((pal_is_fru_ready(fru, &status) < 0) || (status == 0)) {
+    state = "unavailable";
+  }
+
+  cnt = strcmp(state, "ok") ? 0 : sdr_get_fru_snapshot(fru, snrs, MAX_SENSOR_NUM);
+  if (cnt < 0) {
+    state = "unavailable";
+  }
+
+  printf("{\"fru\": %d, \"name\": ", fru);
+  print_json_str(fruname);
+  printf(", \"status\": \"%s\", \"sensors\": [", state);
+  for (i = 0; i < cnt; i++) {
+    /* If calculation is for a single sensor, ignore all others. */
+    if (num && snrs[i].num != num) {
+      continue;
+    }
+    printf("%s\n    ", first ? "" : ",");
+    print_json_sensor(&snrs[i]);
+    first = false;
+  }
+  printf("%s]}", first ? "" : "\n  ");
+}
+
+static void
+get_sensor_json(uint8_t fru, int num) {
+
+  printf("{\"frus\": [\n  ");
+  if (fru == 0) {
+    for (fru = 1; fru <= MAX_NUM_FRUS; fru++) {
+      if (fru > 1)
+        printf(",\n  ");
+      print_json_fru(fru, num);
+    }
+  } else {
+    print_json_fru(fru, num);
+  }
+  printf("\n]}\n");
 }
 
 static void
@@ -115,6 +211,28 @@ get_sensor_reading(uint8_t fru, uint8_t *sensor_list, int sensor_cnt, int num,
   char path[64];
   char status[8];
   thresh_sensor_t thresh;
+  char fruname[16];
+  static snr_snapshot_t snrs[MAX_SENSOR_NUM];
+
+  /* Read the whole FRU with one SDR load unless a single sensor was asked */
+  if (!num) {
+    sensor_cnt = sdr_get_fru_snapshot(fru, snrs, MAX_SENSOR_NUM);
+    if (sensor_cnt < 0) {
+      if (pal_get_fru_name(fru, fruname))
+        fruname[0] = '\0';
+      printf("%s is unavailable!\n", fruname);
+      return;
+    }
+    for (i = 0; i < sensor_cnt; i++) {
+      if (!snrs[i].valid) {
+        printf("%-18s (0x%X) : NA | (na)\n", snrs[i].thresh.name, snrs[i].num);
+      } else {
+        print_sensor_reading(snrs[i].value, snrs[i].num, &snrs[i].thresh,
+            threshold, snrs[i].status);
+      }
+    }
+    return;
+  }
 
   for (i = 0; i < sensor_cnt; i++) {
 
@@ -134,7 +252,7 @@ get_sensor_reading(uint8_t fru, uint8_t *sensor_list, int sensor_cnt, int num,
       printf("%-18s (0x%X) : NA | (na)\n", thresh.name, sensor_list[i]);
       continue;
     } else {
-      get_sensor_status(fvalue, &thresh, status);
+      sdr_get_snr_status(fvalue, &thresh, status);
       print_sensor_reading(fvalue, snr_num, &thresh, threshold, status);
     }
   }
@@ -183,6 +301,7 @@ main(int argc, char **argv) {
   char fruname[16];
   bool threshold = false;
   bool history = false;
+  bool json = false;
   long period = 60;
 
   if (argc < 2 || argc > 5) {
@@ -194,6 +313,8 @@ main(int argc, char **argv) {
   while (argc > 2 && i <= argc) {
     if (!(strcmp(argv[i-1], "--threshold"))) {
       threshold = true;
+    } else if (!strcmp(argv[i-1], "--json")) {
+      json = true;
     } else if (!strcmp(argv[i-1], "--history")) {
       history = true;
       if (argc > i) {
@@ -216,7 +337,7 @@ main(int argc, char **argv) {
     i++;
   }
 
-  if (threshold && history) {
+  if ((threshold && history) || (json && (threshold || history))) {
     print_usage();
     exit(-1);
   }
@@ -228,6 +349,11 @@ main(int argc, char **argv) {
     return ret;
   }
 
+  if (json) {
+    get_sensor_json(fru, num);
+    return 0;
+  }
+
   if (fru == 0) {
     fru = 1;
     while (fru <= MAX_NUM_FRUS) {
@@ -0,0 +1,183 @@
+/* Copyright 2016-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <openbmc/pal.h>
+
+/*
+ * Stub libpal for the sensor-util benchmark: a Yosemite sled with four
+ * slots of SLOT_SENSORS SDR-backed sensors and an SPB and NIC without
+ * SDRs.  SIM_READ_US and SIM_SDR_US add latency to every sensor read and
+ * SDR load.  When SIM_STATS names a file, the process appends its SDR
+ * load and sensor read counts to it on exit.  The FRU number in
+ * SIM_NOT_READY never gets its SDRs ready; libsdr's one-second retry sleeps
+ * return at once.
+ */
+
+#define SLOT_SENSORS 40
+#define BOARD_SENSORS 12
+
+const char pal_fru_list[] = "all, slot1, slot2, slot3, slot4, spb, nic";
+
+static const char *fru_names[] = {
+  "all", "slot1", "slot2", "slot3", "slot4", "spb", "nic",
+};
+static uint8_t sensor_list[SLOT_SENSORS];
+static int sdr_loads;
+static int sensor_reads;
+
+static int
+env_us(const char *name) {
+  char *value = getenv(name);
+
+  return value ? atoi(value) : 0;
+}
+
+static void __attribute__((destructor))
+save_stats(void) {
+  char *path = getenv("SIM_STATS");
+  FILE *fp;
+
+  if (path == NULL || (fp = fopen(path, "a")) == NULL)
+    return;
+  fprintf(fp, "%d %d\n", sdr_loads, sensor_reads);
+  fclose(fp);
+}
+
+unsigned int
+sleep(unsigned int seconds) {
+  return 0;
+}
+
+int
+pal_get_fru_id(char *str, uint8_t *fru) {
+  int i;
+
+  for (i = 0; i <= MAX_NUM_FRUS; i++) {
+    if (!strcmp(str, fru_names[i])) {
+      *fru = i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+int
+pal_get_fru_name(uint8_t fru, char *name) {
+  if (fru > MAX_NUM_FRUS)
+    return -1;
+  strcpy(name, fru_names[fru]);
+  return 0;
+}
+
+int
+pal_is_fru_prsnt(uint8_t fru, uint8_t *status) {
+  *status = 1;
+  return 0;
+}
+
+int
+pal_is_fru_ready(uint8_t fru, uint8_t *status) {
+  *status = 1;
+  return 0;
+}
+
+int
+pal_is_server_fru(uint8_t fru, uint8_t *status) {
+  *status = (fru >= FRU_SLOT1 && fru <= FRU_SLOT4);
+  return 0;
+}
+
+int
+pal_get_fru_sensor_list(uint8_t fru, uint8_t **list, int *cnt) {
+  int i;
+
+  for (i = 0; i < SLOT_SENSORS; i++)
+    sensor_list[i] = i + 1;
+  *list = sensor_list;
+  *cnt = (fru <= FRU_SLOT4) ? SLOT_SENSORS : BOARD_SENSORS;
+  return 0;
+}
+
+/* Slot SDRs: an upper critical threshold of 80 on every sensor */
+int
+pal_sensor_sdr_init(uint8_t fru, sensor_info_t *sinfo) {
+  sdr_full_t *sdr;
+  int i;
+
+  sdr_loads++;
+  if (env_us("SIM_SDR_US"))
+    usleep(env_us("SIM_SDR_US"));
+  if (getenv("SIM_NOT_READY") && fru == atoi(getenv("SIM_NOT_READY")))
+    return ERR_NOT_READY;
+  if (fru < FRU_SLOT1 || fru > FRU_SLOT4)
+    return -1;
+
+  for (i = 1; i <= SLOT_SENSORS; i++) {
+    sdr = &sinfo[i].sdr;
+    memset(sdr, 0, sizeof(*sdr));
+    sdr->sensor_num = i;
+    sdr->sensor_units2 = 1;          // degrees C
+    sdr->m_val = 1;
+    sdr->uc_thresh = 80;
+    /* 8-bit ASCII name */
+    sdr->str_type_len = 0xc0 | sprintf(sdr->str, "SOC_SENSOR_%d", i);
+    sinfo[i].valid = true;
+  }
+  return 0;
+}
+
+int
+pal_sensor_read(uint8_t fru, uint8_t sensor_num, void *value) {
+  sensor_reads++;
+  if (env_us("SIM_READ_US"))
+    usleep(env_us("SIM_READ_US"));
+  *(float *)value = 20.0 + sensor_num;
+  return 0;
+}
+
+int
+pal_get_sensor_name(uint8_t fru, uint8_t sensor_num, char *name) {
+  sprintf(name, "%s_SENSOR_%d", (fru <= FRU_SLOT4) ? "SOC" : "SP", sensor_num);
+  return 0;
+}
+
+int
+pal_get_sensor_units(uint8_t fru, uint8_t sensor_num, char *units) {
+  strcpy(units, "C");
+  return 0;
+}
+
+int
+pal_get_sensor_threshold(uint8_t fru, uint8_t sensor_num, uint8_t thresh,
+    void *value) {
+  *(float *)value = (thresh == UCR_THRESH) ? 80.0 : 0;
+  return 0;
+}
+
+int
+pal_sensor_threshold_flag(uint8_t fru, uint8_t snr_num, uint16_t *flag) {
+  return 0;
+}
+
+int
+pal_read_history(uint8_t fru, uint8_t sensor_num, float *min, float *average,
+    float *max, int start_time) {
+  return -1;
+}
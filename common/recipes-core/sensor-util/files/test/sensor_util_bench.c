@@ -0,0 +1,248 @@
+/* Copyright 2016-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/wait.h>
+
+/*
+ * A full-sled sensor dump the way consumers used to get it, one
+ * "sensor-util <fru> --threshold" per FRU, against one "sensor-util all
+ * --threshold" and one "sensor-util all --json".  Each mode runs the host
+ * build of sensor-util over the stub libpal in pal_stub.c and reports the
+ * time per dump, and the SDR loads and sensor reads it made.
+ */
+
+#define SENSOR_UTIL "./sensor-util"
+#define STATS_FILE "sensor-util-stats"
+#define DEFAULT_RUNS 20
+#define SLED_SENSORS (4 * 40 + 2 * 12)
+
+static const char *frus[] = {"slot1", "slot2", "slot3", "slot4", "spb", "nic"};
+#define NUM_FRUS (sizeof(frus) / sizeof(frus[0]))
+
+static int failed;
+
+static double
+now_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/* Run sensor-util with its output in 'out' */
+static int
+run(const char *fru, const char *opt, const char *out) {
+  int status;
+  pid_t pid;
+  int fd;
+
+  pid = fork();
+  if (pid == 0) {
+    fd = open(out, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0 || dup2(fd, STDOUT_FILENO) < 0)
+      exit(1);
+    execl(SENSOR_UTIL, SENSOR_UTIL, fru, opt, (char *)NULL);
+    exit(1);
+  }
+  if (pid < 0 || waitpid(pid, &status, 0) < 0)
+    return -1;
+  return (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? 0 : -1;
+}
+
+/* Sum and clear the counts the runs left in STATS_FILE */
+static void
+take_stats(int *loads, int *reads) {
+  FILE *fp;
+  int l, r;
+
+  *loads = *reads = 0;
+  fp = fopen(STATS_FILE, "r");
+  if (fp == NULL)
+    return;
+  while (fscanf(fp, "%d %d", &l, &r) == 2) {
+    *loads += l;
+    *reads += r;
+  }
+  fclose(fp);
+  unlink(STATS_FILE);
+}
+
+static void
+report(const char *name, double ms, int runs, int loads, int reads) {
+  printf("%-34s %9.2f %9d %9d\n", name, ms / runs, loads / runs,
+         reads / runs);
+  if (reads != runs * SLED_SENSORS) {
+    printf("%s: read %d sensors, not %d\n", name, reads / runs,
+           SLED_SENSORS);
+    failed = 1;
+  }
+}
+
+static int
+same_file(const char *a, const char *b) {
+  FILE *fa = fopen(a, "r");
+  FILE *fb = fopen(b, "r");
+  int ca, cb;
+  int same = (fa != NULL && fb != NULL);
+
+  while (same) {
+    ca = fgetc(fa);
+    cb = fgetc(fb);
+    if (ca != cb)
+      same = 0;
+    if (ca == EOF)
+      break;
+  }
+  if (fa)
+    fclose(fa);
+  if (fb)
+    fclose(fb);
+  return same;
+}
+
+/* One pass of each mode, checking the all-FRU text against the per-FRU runs */
+static void
+check_output(void) {
+  FILE *fp;
+  char line[256];
+  int i;
+
+  unlink("per-fru.out");
+  unlink("all.out");
+  unlink("json.out");
+  for (i = 0; i < NUM_FRUS; i++) {
+    run(frus[i], "--threshold", "per-fru.out");
+    /* "all" ends every FRU with a blank line */
+    fp = fopen("per-fru.out", "a");
+    if (fp) {
+      fputc('\n', fp);
+      fclose(fp);
+    }
+  }
+  run("all", "--threshold", "all.out");
+  run("all", "--json", "json.out");
+  unlink(STATS_FILE);
+
+  if (!same_file("per-fru.out", "all.out")) {
+    printf("all --threshold differs from the per-FRU runs\n");
+    failed = 1;
+  }
+  fp = fopen("json.out", "r");
+  if (fp == NULL || fgets(line, sizeof(line), fp) == NULL ||
+      strncmp(line, "{\"frus\": [", 10)) {
+    printf("all --json is not a sensor document\n");
+    failed = 1;
+  }
+  if (fp)
+    fclose(fp);
+
+  /* A slot whose SDRs never become ready is reported, not skipped */
+  unlink("per-fru.out");
+  setenv("SIM_NOT_READY", "2", 1);
+  run("slot2", "--threshold", "per-fru.out");
+  unsetenv("SIM_NOT_READY");
+  unlink(STATS_FILE);
+  fp = fopen("per-fru.out", "r");
+  while (fp && fgets(line, sizeof(line), fp) != NULL)
+    ;
+  if (fp == NULL || strcmp(line, "slot2 is unavailable!\n")) {
+    printf("a slot without SDRs is not reported unavailable\n");
+    failed = 1;
+  }
+  if (fp)
+    fclose(fp);
+
+  unlink("per-fru.out");
+  unlink("all.out");
+  unlink("json.out");
+}
+
+static void
+usage(const char *prog) {
+  fprintf(stderr, "Usage: %s [-n runs] [-l read_us] [-s sdr_us]\n", prog);
+  exit(1);
+}
+
+int
+main(int argc, char **argv) {
+  char value[16];
+  int runs = DEFAULT_RUNS;
+  int loads, reads;
+  double start, ms;
+  int opt;
+  int i, j;
+
+  setenv("SIM_STATS", STATS_FILE, 1);
+  while ((opt = getopt(argc, argv, "n:l:s:")) != -1) {
+    switch (opt) {
+      case 'n':
+        runs = atoi(optarg);
+        break;
+      case 'l':
+        snprintf(value, sizeof(value), "%d", atoi(optarg));
+        setenv("SIM_READ_US", value, 1);
+        break;
+      case 's':
+        snprintf(value, sizeof(value), "%d", atoi(optarg));
+        setenv("SIM_SDR_US", value, 1);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (runs < 1)
+    usage(argv[0]);
+
+  unlink(STATS_FILE);
+  check_output();
+
+  printf("%d full-sled dumps, %s us per sensor read, %s us per SDR load\n",
+         runs, getenv("SIM_READ_US") ? getenv("SIM_READ_US") : "0",
+         getenv("SIM_SDR_US") ? getenv("SIM_SDR_US") : "0");
+  printf("%-34s %9s %9s %9s\n", "mode", "ms", "sdr_loads", "reads");
+
+  start = now_ms();
+  for (i = 0; i < runs; i++) {
+    for (j = 0; j < NUM_FRUS; j++)
+      run(frus[j], "--threshold", "/dev/null");
+  }
+  ms = now_ms() - start;
+  take_stats(&loads, &reads);
+  report("6x \"sensor-util <fru> --threshold\"", ms, runs, loads, reads);
+
+  start = now_ms();
+  for (i = 0; i < runs; i++)
+    run("all", "--threshold", "/dev/null");
+  ms = now_ms() - start;
+  take_stats(&loads, &reads);
+  report("\"sensor-util all --threshold\"", ms, runs, loads, reads);
+
+  start = now_ms();
+  for (i = 0; i < runs; i++)
+    run("all", "--json", "/dev/null");
+  ms = now_ms() - start;
+  take_stats(&loads, &reads);
+  report("\"sensor-util all --json\"", ms, runs, loads, reads);
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  return failed;
+}
@@ -25,6 +25,8 @@
 #include <linux/hwmon.h>
 #include <linux/hwmon-sysfs.h>
 #include <linux/i2c.h>
+#include <linux/jiffies.h>
+#include <linux/kernel.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
 #include <linux/sysfs.h>
@@ -44,6 +46,101 @@
 
 #endif
 
+/*
+ * Read nbytes consecutive registers starting at reg. Uses I2C block reads
+ * when the attribute asks for them and the adapter supports them, and
+ * falls back to one SMBus byte read per register for whatever the block
+ * read did not return.
+ * Must be called with idd_lock held.
+ */
+static int i2c_dev_xfer_nbytes(struct i2c_client *client,
+                               int reg,
+                               int block_read,
+                               uint8_t values[],
+                               int nbytes)
+{
+  int i = 0;
+  int len;
+  int ret_val;
+
+  if (nbytes > 1 && block_read
+      && i2c_check_functionality(client->adapter,
+                                 I2C_FUNC_SMBUS_READ_I2C_BLOCK)) {
+    while (i < nbytes) {
+      len = min(nbytes - i, I2C_SMBUS_BLOCK_MAX);
+      ret_val = i2c_smbus_read_i2c_block_data(client, reg + i, len,
+                                              &values[i]);
+      if (ret_val != len) {
+        PP_DEBUG("Block read of 0x%x returned %d, falling back",
+                 reg + i, ret_val);
+        break;
+      }
+      i += len;
+    }
+  }
+
+  for (; i < nbytes; ++i) {
+    ret_val = i2c_smbus_read_byte_data(client, reg + i);
+    if (ret_val < 0) {
+      return ret_val;
+    }
+    if (ret_val > 255) {
+      return -EFAULT;
+    }
+    values[i] = ret_val;
+  }
+  return nbytes;
+}
+
+static int i2c_dev_read_cached(struct device *dev,
+                               struct device_attribute *attr,
+                               uint8_t values[],
+                               int nbytes)
+{
+  struct i2c_client *client = to_i2c_client(dev);
+  i2c_dev_data_st *data = i2c_get_clientdata(client);
+  i2c_sysfs_attr_st *i2c_attr = TO_I2C_SYSFS_ATTR(attr);
+  const i2c_dev_attr_st *dev_attr = i2c_attr->isa_i2c_attr;
+  int cacheable = (dev_attr->ida_cache_ms > 0
+                   && nbytes <= I2C_DEV_CACHE_MAX);
+  int ret_val;
+
+  mutex_lock(&data->idd_lock);
+
+  if (cacheable && i2c_attr->isa_cache_len == nbytes
+      && time_before(jiffies, i2c_attr->isa_cache_expires)) {
+    memcpy(values, i2c_attr->isa_cache, nbytes);
+    mutex_unlock(&data->idd_lock);
+    return nbytes;
+  }
+
+  ret_val = i2c_dev_xfer_nbytes(client, dev_attr->ida_reg,
+                                dev_attr->ida_block_read, values, nbytes);
+  if (cacheable) {
+    if (ret_val == nbytes) {
+      memcpy(i2c_attr->isa_cache, values, nbytes);
+      i2c_attr->isa_cache_len = nbytes;
+      i2c_attr->isa_cache_expires =
+        jiffies + msecs_to_jiffies(dev_attr->ida_cache_ms);
+    } else {
+      i2c_attr->isa_cache_len = 0;
+    }
+  }
+
+  mutex_unlock(&data->idd_lock);
+  return ret_val;
+}
+
+/* Must be called with idd_lock held */
+static void i2c_dev_cache_invalidate(i2c_dev_data_st *data)
+{
+  int i;
+
+  for (i = 0; i < data->idd_n_attrs; i++) {
+    data->idd_attrs[i].isa_cache_len = 0;
+  }
+}
+
 ssize_t i2c_dev_show_label(struct device *dev,
                            struct device_attribute *attr,
                            char *buf)
@@ -61,27 +158,21 @@ EXPORT_SYMBOL_GPL(i2c_dev_show_label);
 int i2c_dev_read_byte(struct device *dev,
                       struct device_attribute *attr)
 {
-  struct i2c_client *client = to_i2c_client(dev);
-  i2c_dev_data_st *data = i2c_get_clientdata(client);
   i2c_sysfs_attr_st *i2c_attr = TO_I2C_SYSFS_ATTR(attr);
   const i2c_dev_attr_st *dev_attr = i2c_attr->isa_i2c_attr;
+  uint8_t reg_val;
   int val;
   int val_mask;
 
   val_mask = ~(((-1) >> (dev_attr->ida_n_bits)) << (dev_attr->ida_n_bits));
 
-  mutex_lock(&data->idd_lock);
-
-  val = i2c_smbus_read_byte_data(client, dev_attr->ida_reg);
-
-  mutex_unlock(&data->idd_lock);
-
+  val = i2c_dev_read_cached(dev, attr, &reg_val, 1);
   if (val < 0) {
     /* error case */
     return val;
   }
 
-  val = (val >> dev_attr->ida_bit_offset) & val_mask;
+  val = (reg_val >> dev_attr->ida_bit_offset) & val_mask;
   return val;
 }
 EXPORT_SYMBOL_GPL(i2c_dev_read_byte);
@@ -91,28 +182,7 @@ int i2c_dev_read_nbytes(struct device *dev,
                         uint8_t values[],
                         int nbytes)
 {
-  struct i2c_client *client = to_i2c_client(dev);
-  i2c_dev_data_st *data = i2c_get_clientdata(client);
-  i2c_sysfs_attr_st *i2c_attr = TO_I2C_SYSFS_ATTR(attr);
-  const i2c_dev_attr_st *dev_attr = i2c_attr->isa_i2c_attr;
-  int i;
-  int ret_val;
-
-  mutex_lock(&data->idd_lock);
-  for (i = 0; i < nbytes; ++i) {
-    ret_val = i2c_smbus_read_byte_data(client, dev_attr->ida_reg + i);
-    if (ret_val < 0) {
-      mutex_unlock(&data->idd_lock);
-      return ret_val;
-    }
-    if (ret_val > 255) {
-      mutex_unlock(&data->idd_lock);
-      return EFAULT;
-    }
-    values[i] = ret_val;
-  }
-  mutex_unlock(&data->idd_lock);
-  return nbytes;
+  return i2c_dev_read_cached(dev, attr, values, nbytes);
 }
 EXPORT_SYMBOL_GPL(i2c_dev_read_nbytes);
 
@@ -171,12 +241,9 @@ static ssize_t i2c_dev_sysfs_show(struct device *dev,
                                   struct device_attribute *attr,
                                   char *buf)
 {
-  struct i2c_client *client = to_i2c_client(dev);
-  i2c_dev_data_st *data = i2c_get_clientdata(client);
   i2c_sysfs_attr_st *i2c_attr = TO_I2C_SYSFS_ATTR(attr);
   const i2c_dev_attr_st *dev_attr = i2c_attr->isa_i2c_attr;
   int val;
-  int val_mask;
 
   if (!dev_attr->ida_show) {
     return -EOPNOTSUPP;
@@ -186,22 +253,13 @@ static ssize_t i2c_dev_sysfs_show(struct device *dev,
     return dev_attr->ida_show(dev, attr, buf);
   }
 
-  val_mask = ~(((-1) >> (dev_attr->ida_n_bits)) << (dev_attr->ida_n_bits));
-
-  mutex_lock(&data->idd_lock);
-
   /* default handling */
-  val = i2c_smbus_read_byte_data(client, dev_attr->ida_reg);
-
-  mutex_unlock(&data->idd_lock);
-
+  val = i2c_dev_read_byte(dev, attr);
   if (val < 0) {
     /* error case */
     return val;
   }
 
-  val = (val >> dev_attr->ida_bit_offset) & val_mask;
-
   return scnprintf(buf, PAGE_SIZE, "0x%x%s%s\n", val,
                    (dev_attr->ida_help) ? "\n\nNote:\n" : "",
                    (dev_attr->ida_help) ? dev_attr->ida_help : "");
@@ -224,7 +282,11 @@ static ssize_t i2c_dev_sysfs_store(struct device *dev,
   }
 
   if (dev_attr->ida_store != I2C_DEV_ATTR_STORE_DEFAULT) {
-    return dev_attr->ida_store(dev, attr, buf, count);
+    val = dev_attr->ida_store(dev, attr, buf, count);
+    mutex_lock(&data->idd_lock);
+    i2c_dev_cache_invalidate(data);
+    mutex_unlock(&data->idd_lock);
+    return val;
   }
 
   /* parse the buffer */
@@ -250,6 +312,9 @@ static ssize_t i2c_dev_sysfs_store(struct device *dev,
 
   val = i2c_smbus_write_byte_data(client, dev_attr->ida_reg, val);
 
+  /* other attributes may share this register */
+  i2c_dev_cache_invalidate(data);
+
  unlock_out:
   mutex_unlock(&data->idd_lock);
 
@@ -305,6 +370,7 @@ int i2c_dev_sysfs_data_init(struct i2c_client *client,
     err = -ENOMEM;
     goto exit_cleanup;
   }
+  data->idd_n_attrs = n_attrs;
   PP_DEBUG("Allocated %u attributes", n_attrs);
 
   for (i = 0,
@@ -34,6 +34,9 @@ typedef ssize_t (*i2c_dev_attr_store_fn)(struct device *dev,
 #define I2C_DEV_ATTR_SHOW_DEFAULT (i2c_dev_attr_show_fn)(1)
 #define I2C_DEV_ATTR_STORE_DEFAULT (i2c_dev_attr_store_fn)(1)
 
+/* Largest value, in bytes, that an attribute cache can hold */
+#define I2C_DEV_CACHE_MAX 32
+
 typedef struct i2c_dev_attr_st_ {
   const char *ida_name;
   const char *ida_help;
@@ -42,11 +45,27 @@ typedef struct i2c_dev_attr_st_ {
   int ida_reg;
   int ida_bit_offset;
   int ida_n_bits;
+  /*
+   * If non-zero, register values read for this attribute are reused for
+   * this many milliseconds, so several readers within one polling period
+   * share a single bus transaction. Any store to the device drops them.
+   */
+  int ida_cache_ms;
+  /*
+   * If non-zero, multi-byte reads of this attribute use I2C block
+   * transfers when the adapter supports them. Only set it for devices
+   * known to auto-increment the register address; others return the
+   * first register over and over.
+   */
+  int ida_block_read;
 } i2c_dev_attr_st;
 
 typedef struct i2c_sysfs_attr_st_{
 	struct device_attribute isa_dev_attr;
   const i2c_dev_attr_st *isa_i2c_attr;
+  unsigned long isa_cache_expires;
+  int isa_cache_len;
+  uint8_t isa_cache[I2C_DEV_CACHE_MAX];
 } i2c_sysfs_attr_st;
 
 #define TO_I2C_SYSFS_ATTR(_attr) \
@@ -56,6 +75,7 @@ typedef struct i2c_dev_data_st_ {
   struct device *idd_hwmon_dev;
   struct mutex idd_lock;
   i2c_sysfs_attr_st *idd_attrs;
+  int idd_n_attrs;
   struct attribute_group idd_attr_group;
 } i2c_dev_data_st;
 
@@ -0,0 +1,144 @@
+/*
+ * i2c_dev_sysfs_test.c - Test client of the i2c device sysfs library
+ *
+ * Copyright 2015-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Test client of the i2c_dev_sysfs library, meant to be bound to an
+ * i2c-stub chip by run_test.sh. Not part of the image.
+ */
+
+#include <linux/errno.h>
+#include <linux/module.h>
+#include <linux/i2c.h>
+#include "../i2c_dev_sysfs.h"
+
+#define TEST_CACHE_MS 500
+
+static ssize_t test_word_show(struct device *dev,
+                              struct device_attribute *attr,
+                              char *buf)
+{
+  int val;
+
+  val = i2c_dev_read_word_littleendian(dev, attr);
+  if (val < 0) {
+    return val;
+  }
+  return scnprintf(buf, PAGE_SIZE, "0x%x\n", val);
+}
+
+static const i2c_dev_attr_st test_attr_table[] = {
+  {
+    "byte",
+    NULL,
+    I2C_DEV_ATTR_SHOW_DEFAULT,
+    I2C_DEV_ATTR_STORE_DEFAULT,
+    0x00, 0, 8,
+  },
+  {
+    "bits",
+    NULL,
+    I2C_DEV_ATTR_SHOW_DEFAULT,
+    I2C_DEV_ATTR_STORE_DEFAULT,
+    0x01, 4, 2,
+  },
+  {
+    "word_byte",
+    NULL,
+    test_word_show,
+    NULL,
+    0x10, 0, 16,
+  },
+  {
+    "word_block",
+    NULL,
+    test_word_show,
+    NULL,
+    0x10, 0, 16, 0, 1,
+  },
+  {
+    "ascii_byte",
+    NULL,
+    i2c_dev_show_ascii,
+    NULL,
+    0x20, 0, 64,
+  },
+  {
+    "ascii_block",
+    NULL,
+    i2c_dev_show_ascii,
+    NULL,
+    0x20, 0, 64, 0, 1,
+  },
+  {
+    "cached",
+    NULL,
+    I2C_DEV_ATTR_SHOW_DEFAULT,
+    NULL,
+    0x30, 0, 8, TEST_CACHE_MS,
+  },
+};
+
+static const struct i2c_device_id test_id[] = {
+  { "i2c_dev_test", 0 },
+  { },
+};
+MODULE_DEVICE_TABLE(i2c, test_id);
+
+static i2c_dev_data_st test_data;
+
+static int test_probe(struct i2c_client *client,
+                      const struct i2c_device_id *id)
+{
+  int n_attrs = sizeof(test_attr_table) / sizeof(test_attr_table[0]);
+  return i2c_dev_sysfs_data_init(client, &test_data,
+                                 test_attr_table, n_attrs);
+}
+
+static int test_remove(struct i2c_client *client)
+{
+  i2c_dev_sysfs_data_clean(client, &test_data);
+  return 0;
+}
+
+static struct i2c_driver test_driver = {
+  .class    = I2C_CLASS_HWMON,
+  .driver = {
+    .name = "i2c_dev_test",
+  },
+  .probe    = test_probe,
+  .remove   = test_remove,
+  .id_table = test_id,
+};
+
+static int __init test_mod_init(void)
+{
+  return i2c_add_driver(&test_driver);
+}
+
+static void __exit test_mod_exit(void)
+{
+  i2c_del_driver(&test_driver);
+}
+
+MODULE_DESCRIPTION("i2c_dev_sysfs test client");
+MODULE_LICENSE("GPL");
+
+module_init(test_mod_init);
+module_exit(test_mod_exit);
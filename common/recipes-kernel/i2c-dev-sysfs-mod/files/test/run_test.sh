@@ -0,0 +1,98 @@
+#!/bin/sh
+#
+# Copyright 2015-present Facebook. All Rights Reserved.
+#
+# This program file is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by the
+# Free Software Foundation; version 2 of the License.
+#
+# This program is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+# for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program in a file named COPYING; if not, write to the
+# Free Software Foundation, Inc.,
+# 51 Franklin Street, Fifth Floor,
+# Boston, MA 02110-1301 USA
+#
+
+# Exercise i2c_dev_sysfs against an i2c-stub chip: byte and bit-field
+# attributes, byte-wise vs. block multi-byte reads, and the attribute cache.
+# Needs root, i2c-tools, i2c-stub, and the modules built by "make" in ..
+# and in this directory.
+
+ADDR=0x33
+HERE=$(cd $(dirname $0) && pwd)
+FAILED=0
+
+check() {
+  if [ "$2" = "$3" ]; then
+    echo "PASS: $1"
+  else
+    echo "FAIL: $1: expected '$3', got '$2'"
+    FAILED=1
+  fi
+}
+
+attr() {
+  head -n 1 $DEV/$1
+}
+
+cleanup() {
+  [ -n "$BUS" ] && echo $ADDR > /sys/bus/i2c/devices/i2c-$BUS/delete_device
+  rmmod i2c_dev_sysfs_test i2c_dev_sysfs i2c-stub 2>/dev/null
+}
+
+modprobe i2c-stub chip_addr=$ADDR || exit 1
+trap cleanup EXIT
+
+for d in /sys/bus/i2c/devices/i2c-*; do
+  if [ "$(cat $d/name)" = "SMBus stub driver" ]; then
+    BUS=${d##*/i2c-}
+  fi
+done
+if [ -z "$BUS" ]; then
+  echo "i2c-stub adapter not found"
+  exit 1
+fi
+
+insmod $HERE/../i2c_dev_sysfs.ko || exit 1
+insmod $HERE/i2c_dev_sysfs_test.ko || exit 1
+
+i2cset -y -f $BUS $ADDR 0x00 0x5a
+i2cset -y -f $BUS $ADDR 0x01 0x00
+i2cset -y -f $BUS $ADDR 0x10 0xef
+i2cset -y -f $BUS $ADDR 0x11 0xbe
+reg=0x20
+for c in 0x4f 0x70 0x65 0x6e 0x42 0x4d 0x43 0x21; do   # "OpenBMC!"
+  i2cset -y -f $BUS $ADDR $reg $c
+  reg=$((reg + 1))
+done
+i2cset -y -f $BUS $ADDR 0x30 0x01
+
+echo i2c_dev_test $ADDR > /sys/bus/i2c/devices/i2c-$BUS/new_device
+DEV=/sys/bus/i2c/devices/$BUS-00${ADDR#0x}
+
+check "byte" "$(attr byte)" "0x5a"
+
+echo 3 > $DEV/bits
+check "bit-field store" "$(i2cget -y -f $BUS $ADDR 0x01)" "0x30"
+check "bit-field show" "$(attr bits)" "0x3"
+
+check "word, byte reads" "$(attr word_byte)" "0xbeef"
+check "word, block reads" "$(attr word_block)" "0xbeef"
+check "ascii, byte reads" "$(attr ascii_byte)" "OpenBMC!"
+check "ascii, block reads" "$(attr ascii_block)" "OpenBMC!"
+
+check "cache fill" "$(attr cached)" "0x1"
+i2cset -y -f $BUS $ADDR 0x30 0x02
+check "cache hit" "$(attr cached)" "0x1"
+sleep 1
+check "cache expiry" "$(attr cached)" "0x2"
+i2cset -y -f $BUS $ADDR 0x30 0x03
+echo 0x5a > $DEV/byte
+check "cache dropped on store" "$(attr cached)" "0x3"
+
+exit $FAILED
@@ -0,0 +1,372 @@
+/*
+ * Copyright 2016-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <syslog.h>
+#include <time.h>
+#include <zlib.h>
+#include "cbuf.h"
+
+static uint64_t
+now_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Returns the number of bytes written, which is short of len on an error
+static int
+write_all(int fd, const char *buf, int len, const char *fname) {
+  int done = 0;
+  int wlen;
+
+  while (done < len) {
+    wlen = write(fd, buf + done, len - done);
+    if (wlen < 0) {
+      if (errno == EINTR)
+        continue;
+      syslog(LOG_WARNING, "cbuf: write() failed to file %s | errno: %d",
+          fname, errno);
+      break;
+    }
+    done += wlen;
+  }
+  return done;
+}
+
+// Record the offset just past every newline in data, which starts at base
+static void
+index_lines(cbuf_t *cb, off_t base, const char *data, int len) {
+  const char *p = data;
+  const char *end = data + len;
+  int slot;
+
+  while (p < end && (p = memchr(p, '\n', end - p)) != NULL) {
+    p++;
+    slot = (cb->line_head + cb->line_cnt) % cb->line_cap;
+    cb->lines[slot] = base + (p - data);
+    if (cb->line_cnt < cb->line_cap) {
+      cb->line_cnt++;
+    } else {
+      cb->line_head = (cb->line_head + 1) % cb->line_cap;
+    }
+    cb->nlines++;
+  }
+}
+
+static int
+open_segment(cbuf_t *cb) {
+  cb->fd = open(cb->file, O_RDWR | O_APPEND | O_CREAT, 0666);
+  if (cb->fd < 0) {
+    syslog(LOG_WARNING, "cbuf: Cannot open the file %s", cb->file);
+    return -1;
+  }
+  cb->size = 0;
+  cb->nlines = 0;
+  cb->line_head = 0;
+  cb->line_cnt = 0;
+  return 0;
+}
+
+// Index whatever an earlier instance left in the current segment
+static void
+load_segment(cbuf_t *cb) {
+  char buf[1024];
+  int len;
+
+  while ((len = read(cb->fd, buf, sizeof(buf))) > 0) {
+    index_lines(cb, cb->size, buf, len);
+    cb->size += len;
+  }
+}
+
+static int
+compress_file(const char *src, const char *dst) {
+  char buf[1024];
+  gzFile gz;
+  int fd, len, ret = 0;
+
+  fd = open(src, O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+
+  gz = gzopen(dst, "wb");
+  if (gz == NULL) {
+    close(fd);
+    return -1;
+  }
+
+  while ((len = read(fd, buf, sizeof(buf))) > 0) {
+    if (gzwrite(gz, buf, len) != len) {
+      ret = -1;
+      break;
+    }
+  }
+
+  if (gzclose(gz) != Z_OK) {
+    ret = -1;
+  }
+  close(fd);
+  return ret;
+}
+
+// Push the segment about to be displaced into <old_file>.1.gz
+static void
+archive_old(cbuf_t *cb) {
+  char src[CBUF_PATH_SIZE + 16];
+  char dst[CBUF_PATH_SIZE + 16];
+  int i;
+
+  if (access(cb->old_file, F_OK)) {
+    return;
+  }
+
+  for (i = cb->archives - 1; i > 0; i--) {
+    snprintf(src, sizeof(src), "%s.%d.gz", cb->old_file, i);
+    snprintf(dst, sizeof(dst), "%s.%d.gz", cb->old_file, i + 1);
+    rename(src, dst);
+  }
+
+  snprintf(dst, sizeof(dst), "%s.1.gz", cb->old_file);
+  if (compress_file(cb->old_file, dst)) {
+    syslog(LOG_WARNING, "cbuf: Cannot archive the file %s", cb->old_file);
+    remove(dst);
+  }
+}
+
+/*
+ * On a failed write the unwritten bytes stay staged and are retried after
+ * another flush interval.
+ */
+static int
+write_pending(cbuf_t *cb) {
+  int done;
+
+  if (cb->pending) {
+    done = write_all(cb->fd, cb->ring, cb->pending, cb->file);
+    cb->size += done;
+    cb->pending -= done;
+    if (cb->pending) {
+      memmove(cb->ring, &cb->ring[done], cb->pending);
+      cb->deadline = now_ms() + ((cb->flush_ms > 0) ? cb->flush_ms :
+                                 CBUF_FLUSH_MS);
+      return -1;
+    }
+  }
+  cb->deadline = 0;
+  return 0;
+}
+
+static int
+over_budget(cbuf_t *cb) {
+  return (cb->max_size && cb->size + cb->pending >= cb->max_size) ||
+         (cb->max_lines && cb->nlines >= cb->max_lines);
+}
+
+static int
+rotate(cbuf_t *cb) {
+  close(cb->fd);
+  if (cb->archives > 0) {
+    archive_old(cb);
+  }
+  rename(cb->file, cb->old_file);
+  return open_segment(cb);
+}
+
+cbuf_t *
+cbuf_open(const char *file, const char *old_file, off_t max_size,
+          int max_lines) {
+  cbuf_t *cb;
+  int ret;
+
+  cb = (cbuf_t *)calloc(1, sizeof(cbuf_t));
+  if (cb == NULL) {
+    return NULL;
+  }
+
+  ret = snprintf(cb->file, sizeof(cb->file), "%s", file);
+  if ((ret < 0) || (ret >= sizeof(cb->file))) {
+    goto error_exit;
+  }
+  ret = snprintf(cb->old_file, sizeof(cb->old_file), "%s", old_file);
+  if ((ret < 0) || (ret >= sizeof(cb->old_file))) {
+    goto error_exit;
+  }
+
+  cb->max_size = max_size;
+  cb->max_lines = max_lines;
+  cb->flush_ms = CBUF_FLUSH_MS;
+  cb->line_cap = (max_lines > 0) ? max_lines + 1 : CBUF_MAX_INDEX;
+  cb->lines = (off_t *)calloc(cb->line_cap, sizeof(off_t));
+  if (cb->lines == NULL) {
+    goto error_exit;
+  }
+
+  if (open_segment(cb)) {
+    goto error_exit;
+  }
+  load_segment(cb);
+
+  return cb;
+
+error_exit:
+  free(cb->lines);
+  free(cb);
+  return NULL;
+}
+
+void
+cbuf_close(cbuf_t *cb) {
+  if (cb == NULL) {
+    return;
+  }
+  cbuf_flush(cb);
+  close(cb->fd);
+  free(cb->lines);
+  free(cb);
+}
+
+void
+cbuf_set_flush_interval(cbuf_t *cb, int msec) {
+  cb->flush_ms = msec;
+  if (msec <= 0) {
+    cbuf_flush(cb);
+  }
+}
+
+void
+cbuf_set_archives(cbuf_t *cb, int count) {
+  if (count > CBUF_MAX_ARCHIVES) {
+    count = CBUF_MAX_ARCHIVES;
+  }
+  cb->archives = count;
+}
+
+/*
+ * Write out staged data and rotate the segment if it is over its size or
+ * line budget.
+ */
+int
+cbuf_flush(cbuf_t *cb) {
+  int ret;
+
+  // Rotating would leave the still staged bytes' line offsets behind
+  ret = write_pending(cb);
+  if (ret == 0 && over_budget(cb)) {
+    if (rotate(cb)) {
+      return -1;
+    }
+  }
+
+  return ret;
+}
+
+int
+cbuf_write(cbuf_t *cb, const char *data, int len) {
+  int done;
+
+  if (len <= 0) {
+    return 0;
+  }
+
+  // Start a new segment once the current one has used up its budget
+  if ((cb->pending + len > CBUF_RING_SIZE) || over_budget(cb)) {
+    if (cbuf_flush(cb)) {
+      return -1;
+    }
+  }
+
+  if (len >= CBUF_RING_SIZE) {
+    // Too large to stage; write straight through, counting what landed
+    done = write_all(cb->fd, data, len, cb->file);
+    index_lines(cb, cb->size, data, done);
+    cb->size += done;
+    if (done < len) {
+      return -1;
+    }
+    return cbuf_flush(cb);
+  }
+
+  index_lines(cb, cb->size + cb->pending, data, len);
+  memcpy(&cb->ring[cb->pending], data, len);
+  cb->pending += len;
+
+  if (cb->flush_ms <= 0) {
+    return cbuf_flush(cb);
+  }
+  if (!cb->deadline) {
+    cb->deadline = now_ms() + cb->flush_ms;
+  }
+  return 0;
+}
+
+/*
+ * Milliseconds until staged data is due to be flushed, suitable as a poll()
+ * timeout; -1 when nothing is pending.
+ */
+int
+cbuf_timeout(cbuf_t *cb) {
+  uint64_t now;
+
+  if (!cb->pending) {
+    return -1;
+  }
+
+  now = now_ms();
+  return (now >= cb->deadline) ? 0 : (int)(cb->deadline - now);
+}
+
+// Flush staged data if its deadline has passed
+int
+cbuf_sync(cbuf_t *cb) {
+  if (cb->pending && now_ms() >= cb->deadline) {
+    return cbuf_flush(cb);
+  }
+  return 0;
+}
+
+/*
+ * Offset in the current segment where the last nlines lines begin. Staged
+ * data is flushed first so a reader sees everything received so far.
+ */
+off_t
+cbuf_tail_offset(cbuf_t *cb, int nlines) {
+  int n;
+
+  write_pending(cb);
+
+  n = cb->line_cnt;
+  if (nlines <= 0) {
+    return cb->size;
+  }
+  if (nlines < n) {
+    return cb->lines[(cb->line_head + n - 1 - nlines) % cb->line_cap];
+  }
+  // Asked for more than we indexed; start from the oldest known line
+  if (n < cb->nlines) {
+    return cb->lines[cb->line_head];
+  }
+  return 0;
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright 2016-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef __CBUF_H__
+#define __CBUF_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define CBUF_PATH_SIZE        64
+#define CBUF_RING_SIZE        4096  // In-memory bytes staged before a flush
+#define CBUF_MAX_INDEX        4096  // Line offsets kept when max_lines is 0
+#define CBUF_FLUSH_MS         1000  // Default flush interval
+#define CBUF_MAX_ARCHIVES     8
+
+/*
+ * Console ring buffer shared by consoled and mTerm.
+ *
+ * Console data is staged in memory and written out to <file> when the ring
+ * fills up or the flush interval expires.  The byte count and the offsets of
+ * every line in the current segment are tracked in memory, so rotation and
+ * "last N lines" lookups never have to stat or rescan the file.  When the
+ * segment reaches max_size bytes or max_lines lines it is renamed to
+ * <old_file>; with archiving enabled, the segment it displaces is gzipped
+ * into <old_file>.1.gz (shifting older archives up to .N.gz).
+ *
+ * Rotation is done with rename(), so concurrent readers holding the file
+ * open keep a consistent view of the segment they opened.
+ */
+typedef struct cbuf {
+  int fd;
+  char file[CBUF_PATH_SIZE];
+  char old_file[CBUF_PATH_SIZE];
+  off_t size;             // Bytes in the current segment on disk
+  off_t max_size;
+  int max_lines;
+  int flush_ms;
+  int archives;           // Number of compressed segments to keep
+  uint64_t deadline;      // Monotonic ms by which pending data is flushed
+  int pending;            // Bytes staged in ring
+  char ring[CBUF_RING_SIZE];
+  off_t *lines;           // Offsets just past each newline, circular
+  int line_cap;
+  int line_head;          // Slot of the oldest offset
+  int line_cnt;           // Offsets currently stored
+  int nlines;             // Newlines in the current segment
+} cbuf_t;
+
+cbuf_t *cbuf_open(const char *file, const char *old_file, off_t max_size,
+                  int max_lines);
+void cbuf_close(cbuf_t *cb);
+void cbuf_set_flush_interval(cbuf_t *cb, int msec);
+void cbuf_set_archives(cbuf_t *cb, int count);
+int cbuf_write(cbuf_t *cb, const char *data, int len);
+int cbuf_flush(cbuf_t *cb);
+int cbuf_timeout(cbuf_t *cb);
+int cbuf_sync(cbuf_t *cb);
+off_t cbuf_tail_offset(cbuf_t *cb, int nlines);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CBUF_H__ */
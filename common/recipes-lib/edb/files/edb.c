@@ -19,133 +19,609 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <syslog.h>
 #include <string.h>
+#include <pthread.h>
 #include <sys/file.h>
+#include <sys/stat.h>
 #include "unqlite.h"
 #include "edb.h"
 
 #define MAX_BUF 80
 
-int
-edb_cache_set(char *key, char *value) {
+/*
+ * Files in a store directory besides the keys themselves.  Key names may
+ * not start with '.', so these never collide with a key.
+ */
+#define EDB_LOCK        ".lock"     // flock()ed by writers and transactions
+#define EDB_NEW         ".new."     // Prefix of a value waiting for rename
+#define EDB_COMMIT      ".commit"   // Keys of a commit being installed
+#define EDB_COMMIT_NEW  ".commit.new"
 
-  FILE *fp;
-  int rc;
-  char kpath[MAX_KEY_PATH_LEN] = {0};
+// A write held back until the transaction commits
+typedef struct edb_staged {
+  struct edb_staged *next;
+  char key[MAX_KEY_LEN];
+  size_t len;
+  char value[];
+} edb_staged_t;
+
+struct edb_store {
+  char path[MAX_KEY_PATH_LEN];
+  pthread_mutex_t lock;     // Recursive; held by the txn owner until it ends
+  int in_txn;
+  int lock_fd;              // EDB_LOCK, opened on first use
+  edb_staged_t *staged;
+};
 
-  sprintf(kpath, CACHE_STORE, key);
+static int
+edb_path(edb_store_t *st, const char *prefix, const char *key, char *kpath) {
+  int ret;
 
-  if (access(CACHE_STORE_PATH, F_OK) == -1) {
-        mkdir(CACHE_STORE_PATH, 0777);
+  ret = snprintf(kpath, MAX_KEY_PATH_LEN, "%s/%s%s", st->path, prefix, key);
+  if ((ret < 0) || (ret >= MAX_KEY_PATH_LEN)) {
+    syslog(LOG_WARNING, "edb: key %s is too long", key);
+    return -1;
   }
+  return 0;
+}
 
-  fp = fopen(kpath, "r+");
-  if (!fp && (errno == ENOENT))
-      fp = fopen(kpath, "w");
-  if (!fp) {
-      int err = errno;
+static int
+edb_key_path(edb_store_t *st, const char *key, char *kpath) {
+  if ((key[0] == '.') || (key[0] == 0)) {
+    syslog(LOG_WARNING, "edb: invalid key %s", key);
+    return -1;
+  }
+  return edb_path(st, "", key, kpath);
+}
+
+// Take the store's lock file; the directory is created on first use
+static int
+edb_lock(edb_store_t *st, int op) {
+  char kpath[MAX_KEY_PATH_LEN];
+
+  if (st->lock_fd < 0) {
+    if (edb_path(st, "", EDB_LOCK, kpath)) {
+      return -1;
+    }
+    st->lock_fd = open(kpath, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if ((st->lock_fd < 0) && (errno == ENOENT)) {
+      mkdir(st->path, 0777);
+      st->lock_fd = open(kpath, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    }
+    if (st->lock_fd < 0) {
 #ifdef DEBUG
-      syslog(LOG_WARNING, "cache_set: failed to open %s", kpath);
+      syslog(LOG_WARNING, "edb: failed to open %s, err %d", kpath, errno);
 #endif
-      return err;
+      return -1;
+    }
   }
 
-  rc = flock(fileno(fp), LOCK_EX);
-  if (rc < 0) {
-     int err = errno;
+  while (flock(st->lock_fd, op) < 0) {
+    if (errno != EINTR) {
 #ifdef DEBUG
-    syslog(LOG_WARNING, "cache_set: failed to flock on %s, err %d", kpath, err);
+      syslog(LOG_WARNING, "edb: failed to flock %s, err %d", st->path, errno);
 #endif
-    fclose(fp);
-    return -1;
+      return -1;
+    }
   }
+  return 0;
+}
 
-  if (ftruncate(fileno(fp), 0) < 0) {  //truncate cache file after getting flock
-     fclose(fp);
-     return -1;
-  }
+static void
+edb_unlock(edb_store_t *st) {
+  flock(st->lock_fd, LOCK_UN);
+}
+
+// Write a whole new file; the caller renames it into place
+static int
+edb_write_file(const char *kpath, const void *value, size_t len) {
+  const char *buf = value;
+  ssize_t wlen;
+  int fd;
 
-  rc = fwrite(value, 1, strlen(value), fp);
-  if (rc < 0) {
+  fd = open(kpath, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0) {
+    int err = errno;
 #ifdef DEBUG
-     syslog(LOG_WARNING, "cache_set: failed to write to %s", kpath;
+    syslog(LOG_WARNING, "edb_set: failed to open %s", kpath);
 #endif
-     fclose(fp);
-     return ENOENT;
+    return err;
   }
-  fflush(fp);
 
-  rc = flock(fileno(fp), LOCK_UN);
-  if (rc < 0) {
-     int err = errno;
+  while (len > 0) {
+    wlen = write(fd, buf, len);
+    if (wlen < 0) {
+      if (errno == EINTR)
+        continue;
 #ifdef DEBUG
-     syslog(LOG_WARNING, "cache_set: failed to unlock flock on %s, err %d", kpath, err);
+      syslog(LOG_WARNING, "edb_set: failed to write to %s", kpath);
 #endif
-     fclose(fp);
-     return -1;
+      close(fd);
+      unlink(kpath);
+      return ENOENT;
+    }
+    buf += wlen;
+    len -= wlen;
   }
 
-  fclose(fp);
-
+  if (close(fd) < 0) {
+    unlink(kpath);
+    return ENOENT;
+  }
   return 0;
 }
 
-int
-edb_cache_get(char *key, char *value) {
+static int
+edb_write_new(edb_store_t *st, const char *key, const void *value,
+              size_t len) {
+  char kpath[MAX_KEY_PATH_LEN];
 
-  FILE *fp;
-  int rc;
-  char kpath[MAX_KEY_PATH_LEN] = {0};
+  if (edb_key_path(st, key, kpath) || edb_path(st, EDB_NEW, key, kpath)) {
+    return -1;
+  }
+  return edb_write_file(kpath, value, len);
+}
 
-  sprintf(kpath, CACHE_STORE, key);
+/*
+ * A plain set rewrites the key's file in place under its flock, which
+ * edb_get() also takes, so an edb reader never sees a partial value.
+ */
+static int
+edb_write_key(edb_store_t *st, const char *key, const void *value,
+              size_t len) {
+  char kpath[MAX_KEY_PATH_LEN];
+  const char *buf = value;
+  ssize_t wlen;
+  int fd;
+
+  if (edb_key_path(st, key, kpath)) {
+    return -1;
+  }
 
-  if (access(CACHE_STORE_PATH, F_OK) == -1) {
-     mkdir(CACHE_STORE_PATH, 0777);
+  fd = open(kpath, O_WRONLY | O_CREAT, 0666);
+  if (fd < 0) {
+    int err = errno;
+#ifdef DEBUG
+    syslog(LOG_WARNING, "edb_set: failed to open %s", kpath);
+#endif
+    return err;
   }
 
-  fp = fopen(kpath, "r");
-  if (!fp) {
-     int err = errno;
+  if (flock(fd, LOCK_EX) < 0) {
 #ifdef DEBUG
-    syslog(LOG_WARNING, "cache_get: failed to open %s, err %d", kpath, err);
+    syslog(LOG_WARNING, "edb_set: failed to flock on %s, err %d", kpath, errno);
 #endif
+    close(fd);
+    return -1;
+  }
+
+  if (ftruncate(fd, 0) < 0) {
+    close(fd);
     return -1;
   }
 
-  rc = flock(fileno(fp), LOCK_EX);
-  if (rc < 0) {
-     int err = errno;
+  while (len > 0) {
+    wlen = write(fd, buf, len);
+    if (wlen < 0) {
+      if (errno == EINTR)
+        continue;
 #ifdef DEBUG
-     syslog(LOG_WARNING, "cache_get: failed to flock %s, err %d", kpath, err);
+      syslog(LOG_WARNING, "edb_set: failed to write to %s", kpath);
 #endif
-    fclose(fp);
+      close(fd);
+      return ENOENT;
+    }
+    buf += wlen;
+    len -= wlen;
+  }
+
+  // Closing the descriptor drops the lock
+  close(fd);
+  return 0;
+}
+
+static int
+edb_install_new(edb_store_t *st, const char *key) {
+  char npath[MAX_KEY_PATH_LEN];
+  char kpath[MAX_KEY_PATH_LEN];
+
+  if (edb_path(st, EDB_NEW, key, npath) || edb_key_path(st, key, kpath)) {
     return -1;
   }
+  if (rename(npath, kpath) < 0) {
+    syslog(LOG_WARNING, "edb: failed to install %s, err %d", kpath, errno);
+    return -1;
+  }
+  return 0;
+}
+
+static void
+edb_discard_new(edb_store_t *st, const char *key) {
+  char npath[MAX_KEY_PATH_LEN];
+
+  if (!edb_path(st, EDB_NEW, key, npath)) {
+    unlink(npath);
+  }
+}
+
+/*
+ * Install the keys listed in EDB_COMMIT, left behind by a writer that died
+ * while committing.  Called with the lock held exclusively.
+ */
+static void
+edb_recover(edb_store_t *st) {
+  char kpath[MAX_KEY_PATH_LEN];
+  char *buf, *key, *next;
+  struct stat sb;
+  int fd;
+
+  if (edb_path(st, "", EDB_COMMIT, kpath)) {
+    return;
+  }
+  fd = open(kpath, O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+
+  buf = NULL;
+  if (!fstat(fd, &sb) && (buf = malloc(sb.st_size + 1)) != NULL &&
+      read(fd, buf, sb.st_size) == sb.st_size) {
+    buf[sb.st_size] = 0;
+    for (key = strtok_r(buf, "\n", &next); key != NULL;
+         key = strtok_r(NULL, "\n", &next)) {
+      edb_install_new(st, key);
+    }
+    syslog(LOG_WARNING, "edb: finished an interrupted commit in %s",
+           st->path);
+  }
+  free(buf);
+  close(fd);
+  unlink(kpath);
+}
+
+static edb_staged_t *
+edb_find_staged(edb_store_t *st, const char *key) {
+  edb_staged_t *sp;
+
+  for (sp = st->staged; sp != NULL; sp = sp->next) {
+    if (!strcmp(sp->key, key)) {
+      return sp;
+    }
+  }
+  return NULL;
+}
+
+static void
+edb_drop_staged(edb_store_t *st) {
+  edb_staged_t *sp;
+
+  while ((sp = st->staged) != NULL) {
+    st->staged = sp->next;
+    free(sp);
+  }
+}
+
+static int
+edb_stage(edb_store_t *st, const char *key, const void *value, size_t len) {
+  edb_staged_t *sp, **pp;
+
+  if (strlen(key) >= MAX_KEY_LEN) {
+    return -1;
+  }
+
+  sp = malloc(sizeof(edb_staged_t) + len);
+  if (sp == NULL) {
+    return -1;
+  }
+  strcpy(sp->key, key);
+  sp->len = len;
+  memcpy(sp->value, value, len);
+
+  // Replace an earlier write to the same key, keeping the original order
+  for (pp = &st->staged; *pp != NULL; pp = &(*pp)->next) {
+    if (!strcmp((*pp)->key, key)) {
+      sp->next = (*pp)->next;
+      free(*pp);
+      *pp = sp;
+      return 0;
+    }
+  }
+  sp->next = NULL;
+  *pp = sp;
+  return 0;
+}
+
+/*
+ * Apply the staged writes.  Every value is written to an EDB_NEW file
+ * first; only once all of them are on disk is the key list published as
+ * EDB_COMMIT and the files renamed over their keys, so a reader holding
+ * the old file still reads the old value.  A failure before that
+ * point leaves the store untouched, and a crash after it is finished by
+ * edb_recover() on the next write.
+ */
+static int
+edb_apply_staged(edb_store_t *st) {
+  char kpath[MAX_KEY_PATH_LEN];
+  char cpath[MAX_KEY_PATH_LEN];
+  edb_staged_t *sp, *failed = NULL;
+  char *list = NULL;
+  size_t len = 0;
+  int ret;
+
+  if (st->staged == NULL) {
+    return 0;
+  }
+
+  for (sp = st->staged; sp != NULL; sp = sp->next) {
+    if (edb_write_new(st, sp->key, sp->value, sp->len)) {
+      failed = sp;
+      goto apply_discard;
+    }
+    len += strlen(sp->key) + 1;
+  }
+
+  list = malloc(len + 1);
+  if ((list == NULL) || edb_path(st, "", EDB_COMMIT_NEW, kpath) ||
+      edb_path(st, "", EDB_COMMIT, cpath)) {
+    goto apply_discard;
+  }
+  len = 0;
+  for (sp = st->staged; sp != NULL; sp = sp->next) {
+    len += sprintf(list + len, "%s\n", sp->key);
+  }
+  if (edb_write_file(kpath, list, len) || (rename(kpath, cpath) < 0)) {
+    unlink(kpath);
+    goto apply_discard;
+  }
+  free(list);
+
+  ret = 0;
+  for (sp = st->staged; sp != NULL; sp = sp->next) {
+    if (edb_install_new(st, sp->key)) {
+      ret = -1;
+    }
+  }
+  unlink(cpath);
+  return ret;
+
+apply_discard:
+  for (sp = st->staged; sp != failed; sp = sp->next) {
+    edb_discard_new(st, sp->key);
+  }
+  free(list);
+  return -1;
+}
+
+edb_store_t *
+edb_open(const char *path) {
+  pthread_mutexattr_t attr;
+  edb_store_t *st;
+  int ret;
+
+  st = (edb_store_t *)calloc(1, sizeof(edb_store_t));
+  if (st == NULL) {
+    return NULL;
+  }
+
+  ret = snprintf(st->path, sizeof(st->path), "%s", path);
+  if ((ret < 0) || (ret >= sizeof(st->path))) {
+    free(st);
+    return NULL;
+  }
+  st->lock_fd = -1;
+
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&st->lock, &attr);
+  pthread_mutexattr_destroy(&attr);
+
+  return st;
+}
+
+void
+edb_close(edb_store_t *st) {
+  if (st == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&st->lock);
+  if (st->in_txn) {
+    edb_rollback(st);
+  }
+  if (st->lock_fd >= 0) {
+    close(st->lock_fd);
+  }
+  pthread_mutex_unlock(&st->lock);
+  pthread_mutex_destroy(&st->lock);
+  free(st);
+}
+
+int
+edb_get(edb_store_t *st, const char *key, void *value, size_t *len) {
+  char kpath[MAX_KEY_PATH_LEN];
+  edb_staged_t *sp;
+  ssize_t rlen;
+  int fd, ret = 0;
 
-  rc = (int) fread(value, 1, MAX_VALUE_LEN, fp);
-  if (rc <= 0) {
+  pthread_mutex_lock(&st->lock);
+  if (st->in_txn && (sp = edb_find_staged(st, key)) != NULL) {
+    if (*len > sp->len) {
+      *len = sp->len;
+    }
+    memcpy(value, sp->value, *len);
+    ret = (*len) ? 0 : ENOENT;
+    goto get_out;
+  }
+
+  if (edb_key_path(st, key, kpath)) {
+    ret = -1;
+    goto get_out;
+  }
+
+  fd = open(kpath, O_RDONLY);
+  if (fd < 0) {
 #ifdef DEBUG
-     syslog(LOG_INFO, "cache_get: failed to read %s", kpath);
+    syslog(LOG_WARNING, "edb_get: failed to open %s, err %d", kpath, errno);
 #endif
-    fclose(fp);
-    return ENOENT;
+    ret = -1;
+    goto get_out;
   }
-  value[(rc < MAX_VALUE_LEN)?(rc):(rc-1)] = 0;
 
-  rc = flock(fileno(fp), LOCK_UN);
-  if (rc < 0) {
-     int err = errno;
+  if (flock(fd, LOCK_EX) < 0) {
 #ifdef DEBUG
-     syslog(LOG_WARNING, "cache_get: failed to unlock flock on %s, err %d", kpath, err);
+    syslog(LOG_WARNING, "edb_get: failed to flock %s, err %d", kpath, errno);
 #endif
-    fclose(fp);
+    close(fd);
+    ret = -1;
+    goto get_out;
+  }
+
+  rlen = read(fd, value, *len);
+  close(fd);
+  if (rlen <= 0) {
+#ifdef DEBUG
+    syslog(LOG_INFO, "edb_get: failed to read %s", kpath);
+#endif
+    ret = ENOENT;
+    goto get_out;
+  }
+  *len = rlen;
+
+get_out:
+  pthread_mutex_unlock(&st->lock);
+  return ret;
+}
+
+int
+edb_set(edb_store_t *st, const char *key, const void *value, size_t len) {
+  int ret;
+
+  pthread_mutex_lock(&st->lock);
+  if (st->in_txn) {
+    ret = edb_stage(st, key, value, len);
+    goto set_out;
+  }
+
+  if (edb_lock(st, LOCK_EX)) {
+    ret = -1;
+    goto set_out;
+  }
+  edb_recover(st);
+  ret = edb_write_key(st, key, value, len);
+  edb_unlock(st);
+
+set_out:
+  pthread_mutex_unlock(&st->lock);
+  return ret;
+}
+
+/*
+ * Group several edb_set() calls so they are applied together by
+ * edb_commit() or discarded by edb_rollback().  The transaction holds the
+ * store's lock file exclusively, so gets inside it see no other writer,
+ * and it belongs to the calling thread: it keeps the store locked until
+ * the transaction ends, so other threads using the store wait rather than
+ * see or join it.
+ */
+int
+edb_begin(edb_store_t *st) {
+  pthread_mutex_lock(&st->lock);
+  if (st->in_txn || edb_lock(st, LOCK_EX)) {
+    pthread_mutex_unlock(&st->lock);
+    return -1;
+  }
+  edb_recover(st);
+  st->in_txn = 1;
+  return 0;
+}
+
+// Ends the transaction and releases the locks taken by edb_begin()
+static int
+edb_end(edb_store_t *st, int apply) {
+  int ret = 0;
+
+  pthread_mutex_lock(&st->lock);
+  if (!st->in_txn) {
+    pthread_mutex_unlock(&st->lock);
+    return -1;
+  }
+  st->in_txn = 0;
+  if (apply) {
+    ret = edb_apply_staged(st);
+  }
+  edb_drop_staged(st);
+  edb_unlock(st);
+  pthread_mutex_unlock(&st->lock);
+  pthread_mutex_unlock(&st->lock);
+  return ret;
+}
+
+int
+edb_commit(edb_store_t *st) {
+  return edb_end(st, 1);
+}
+
+int
+edb_rollback(edb_store_t *st) {
+  return edb_end(st, 0);
+}
+
+static edb_store_t *cache_store = NULL;
+static pthread_once_t cache_store_once = PTHREAD_ONCE_INIT;
+
+static void
+edb_cache_open(void) {
+  cache_store = edb_open(CACHE_STORE_PATH);
+}
+
+edb_store_t *
+edb_cache_store(void) {
+  pthread_once(&cache_store_once, edb_cache_open);
+  return cache_store;
+}
+
+int
+edb_cache_set_bin(char *key, void *value, size_t len) {
+  edb_store_t *st = edb_cache_store();
+
+  if (st == NULL) {
     return -1;
   }
+  return edb_set(st, key, value, len);
+}
+
+int
+edb_cache_get_bin(char *key, void *value, size_t *len) {
+  edb_store_t *st = edb_cache_store();
+
+  if (st == NULL) {
+    return -1;
+  }
+  return edb_get(st, key, value, len);
+}
 
-  fclose(fp);
+int
+edb_cache_set(char *key, char *value) {
+  return edb_cache_set_bin(key, value, strlen(value));
+}
+
+/*
+ * Callers of the string interface pass a MAX_VALUE_LEN buffer; values
+ * longer than that are truncated.  Use edb_cache_get_bin() for larger ones.
+ */
+int
+edb_cache_get(char *key, char *value) {
+  size_t len = MAX_VALUE_LEN - 1;
+  int rc;
+
+  rc = edb_cache_get_bin(key, value, &len);
+  if (rc) {
+    return rc;
+  }
+  value[len] = 0;
 
   return 0;
 }
@@ -23,6 +23,8 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
+
 #define MAX_KEY_PATH_LEN  96
 #define MAX_KEY_LEN       64
 #define MAX_VALUE_LEN     64
@@ -30,8 +32,32 @@ extern "C" {
 #define CACHE_STORE "/tmp/cache_store/%s"
 #define CACHE_STORE_PATH "/tmp/cache_store"
 
+typedef struct edb_store edb_store_t;
+
+/*
+ * A store is a directory with one file per key, so shell scripts can still
+ * cat a key.  Writers take a lock file in the directory, and readers flock
+ * the key's file; several processes can share a store, and threads of one
+ * process may share a store handle.  Keys may not start with '.'.
+ *
+ * edb_begin()/edb_commit() apply several keys at once: a commit either
+ * installs every key or, on error, none of them, and one cut short by a
+ * crash is completed by the next writer.  A transaction is owned by the
+ * thread that began it.
+ */
+edb_store_t *edb_open(const char *path);
+void edb_close(edb_store_t *st);
+int edb_get(edb_store_t *st, const char *key, void *value, size_t *len);
+int edb_set(edb_store_t *st, const char *key, const void *value, size_t len);
+int edb_begin(edb_store_t *st);
+int edb_commit(edb_store_t *st);
+int edb_rollback(edb_store_t *st);
+
 int edb_cache_get(char* key, char *value);
 int edb_cache_set(char* key, char *value);
+int edb_cache_get_bin(char *key, void *value, size_t *len);
+int edb_cache_set_bin(char *key, void *value, size_t len);
+edb_store_t *edb_cache_store(void);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,269 @@
+/*
+ * Copyright 2015-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Times get, set and 16-key transactions on an edb store in a scratch
+ * directory, then has several threads run transactions and reads on one
+ * shared store and checks that every transaction was applied whole.
+ * Finally checks that a commit that fails part way changes nothing and
+ * that one cut short by a crash is completed by the next writer.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "edb.h"
+
+#define TXN_KEYS     16
+#define NUM_THREADS  4
+#define THREAD_TXNS  50
+
+static edb_store_t *g_st;
+static int g_errors;
+static pthread_mutex_t g_err_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static double
+now_us(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void
+error(const char *what, int i) {
+  pthread_mutex_lock(&g_err_lock);
+  fprintf(stderr, "%s failed (%d)\n", what, i);
+  g_errors++;
+  pthread_mutex_unlock(&g_err_lock);
+}
+
+static void
+bench(int iters) {
+  char key[MAX_KEY_LEN], val[MAX_VALUE_LEN];
+  size_t len;
+  double t0;
+  int i, k;
+
+  t0 = now_us();
+  for (i = 0; i < iters; i++) {
+    sprintf(key, "key%d", i % 64);
+    len = sprintf(val, "%d", i);
+    if (edb_set(g_st, key, val, len))
+      error("edb_set", i);
+  }
+  printf("  set:     %8.1f us/op\n", (now_us() - t0) / iters);
+
+  t0 = now_us();
+  for (i = 0; i < iters; i++) {
+    sprintf(key, "key%d", i % 64);
+    len = sizeof(val);
+    if (edb_get(g_st, key, val, &len))
+      error("edb_get", i);
+  }
+  printf("  get:     %8.1f us/op\n", (now_us() - t0) / iters);
+
+  t0 = now_us();
+  for (i = 0; i < iters / TXN_KEYS; i++) {
+    if (edb_begin(g_st)) {
+      error("edb_begin", i);
+      continue;
+    }
+    for (k = 0; k < TXN_KEYS; k++) {
+      sprintf(key, "txn%d", k);
+      len = sprintf(val, "%d", i);
+      edb_set(g_st, key, val, len);
+    }
+    if (edb_commit(g_st))
+      error("edb_commit", i);
+  }
+  printf("  txn(%d): %8.1f us/txn\n", TXN_KEYS,
+         (now_us() - t0) / (iters / TXN_KEYS));
+}
+
+/*
+ * Each thread writes its own id to all of the txn keys in one transaction;
+ * a reader that takes the same lock must never see a mix of ids.
+ */
+static void *
+txn_worker(void *arg) {
+  int id = (int)(long)arg;
+  char key[MAX_KEY_LEN], val[MAX_VALUE_LEN], first[MAX_VALUE_LEN];
+  size_t len;
+  int i, k;
+
+  for (i = 0; i < THREAD_TXNS; i++) {
+    if (edb_begin(g_st)) {
+      error("edb_begin", id);
+      continue;
+    }
+    for (k = 0; k < TXN_KEYS; k++) {
+      sprintf(key, "txn%d", k);
+      len = sprintf(val, "%d", id);
+      edb_set(g_st, key, val, len);
+    }
+    if (edb_commit(g_st))
+      error("edb_commit", id);
+
+    if (edb_begin(g_st)) {
+      error("edb_begin", id);
+      continue;
+    }
+    for (k = 0; k < TXN_KEYS; k++) {
+      sprintf(key, "txn%d", k);
+      len = sizeof(val) - 1;
+      if (edb_get(g_st, key, val, &len)) {
+        error("edb_get", id);
+        break;
+      }
+      val[len] = 0;
+      if (k == 0)
+        strcpy(first, val);
+      else if (strcmp(first, val))
+        error("torn transaction", id);
+    }
+    edb_rollback(g_st);
+  }
+  return NULL;
+}
+
+static void
+thread_test(void) {
+  pthread_t tid[NUM_THREADS];
+  long i;
+
+  for (i = 0; i < NUM_THREADS; i++)
+    pthread_create(&tid[i], NULL, txn_worker, (void *)i);
+  for (i = 0; i < NUM_THREADS; i++)
+    pthread_join(tid[i], NULL);
+  printf("  threads: %d x %d transactions\n", NUM_THREADS, THREAD_TXNS);
+}
+
+static void
+check_value(const char *key, const char *want, const char *what) {
+  char val[MAX_VALUE_LEN];
+  size_t len = sizeof(val) - 1;
+
+  if (edb_get(g_st, key, val, &len)) {
+    error(what, 0);
+    return;
+  }
+  val[len] = 0;
+  if (strcmp(val, want)) {
+    fprintf(stderr, "%s: %s is %s, expected %s\n", what, key, val, want);
+    error(what, 0);
+  }
+}
+
+static void
+commit_test(const char *path) {
+  char kpath[MAX_KEY_PATH_LEN + 16];
+  FILE *fp;
+
+  edb_set(g_st, "a", "old", 3);
+  edb_set(g_st, "b", "old", 3);
+
+  // Make the second staged value unwritable: the commit must apply nothing
+  snprintf(kpath, sizeof(kpath), "%s/.new.b", path);
+  mkdir(kpath, 0777);
+  if (edb_begin(g_st)) {
+    error("edb_begin", 0);
+    return;
+  }
+  edb_set(g_st, "a", "new", 3);
+  edb_set(g_st, "b", "new", 3);
+  if (!edb_commit(g_st))
+    error("commit with an unwritable value", 0);
+  rmdir(kpath);
+  check_value("a", "old", "failed commit left a");
+  check_value("b", "old", "failed commit left b");
+
+  // A writer died after publishing its key list: the next set finishes it
+  snprintf(kpath, sizeof(kpath), "%s/.new.a", path);
+  fp = fopen(kpath, "w");
+  fputs("crash", fp);
+  fclose(fp);
+  snprintf(kpath, sizeof(kpath), "%s/.new.b", path);
+  fp = fopen(kpath, "w");
+  fputs("crash", fp);
+  fclose(fp);
+  snprintf(kpath, sizeof(kpath), "%s/.commit", path);
+  fp = fopen(kpath, "w");
+  fputs("a\nb\n", fp);
+  fclose(fp);
+  edb_set(g_st, "c", "new", 3);
+  check_value("a", "crash", "interrupted commit left a");
+  check_value("b", "crash", "interrupted commit left b");
+  if (access(kpath, F_OK) == 0)
+    error("journal left behind", 0);
+  printf("  commit:  failure and crash recovery\n");
+}
+
+int
+main(int argc, char **argv) {
+  char dir[] = "/tmp/edb_bench.XXXXXX";
+  char path[MAX_KEY_PATH_LEN], cmd[128];
+  int iters = 2000;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:")) != -1) {
+    switch (opt) {
+      case 'n':
+        iters = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-n iterations]\n",
+                argv[0]);
+        return 1;
+    }
+  }
+  if (iters < TXN_KEYS)
+    iters = TXN_KEYS;
+
+  if (mkdtemp(dir) == NULL) {
+    perror("mkdtemp");
+    return 1;
+  }
+  snprintf(path, sizeof(path), "%s/store", dir);
+
+  g_st = edb_open(path);
+  if (g_st == NULL) {
+    fprintf(stderr, "edb_open %s failed\n", path);
+    return 1;
+  }
+
+  printf("%d iterations\n", iters);
+  bench(iters);
+  thread_test();
+  commit_test(path);
+  edb_close(g_st);
+
+  snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+  system(cmd);
+
+  if (g_errors) {
+    printf("FAIL: %d errors\n", g_errors);
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
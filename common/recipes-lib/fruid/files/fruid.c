@@ -15,13 +15,15 @@
  * along with this program; if not, write to the Free Software
  * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
-
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
 #include <syslog.h>
 #include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "fruid.h"
 
 #define FIELD_TYPE(x)     ((x & (0x03 << 6)) >> 6)
@@ -43,42 +45,65 @@ const char * ascii_6bit[4] = {
   "PQRSTUVWXYZ[\\]^_"
 };
 
+/*
+ * All the strings decoded from one image are carved out of a single
+ * block, so a parse costs one allocation however many fields it has.
+ */
+typedef struct fruid_strtab_t {
+  char * buf;
+  size_t size;
+  size_t used;
+} fruid_strtab_t;
+
+static char * strtab_alloc(fruid_strtab_t * tab, size_t len)
+{
+  char * str;
+
+  if (tab->used + len > tab->size) {
+#ifdef DEBUG
+    syslog(LOG_WARNING, "fruid: string table exhausted\n");
+#endif
+    return NULL;
+  }
+
+  str = tab->buf + tab->used;
+  tab->used += len;
+  return str;
+}
+
+static char * strtab_dup(fruid_strtab_t * tab, const char * src, size_t len)
+{
+  char * str = strtab_alloc(tab, len + 1);
+
+  if (str) {
+    memcpy(str, src, len);
+    str[len] = '\0';
+  }
+  return str;
+}
+
 /*
  * calculate_time - calculate time from the unix time stamp stored
  *
+ * @tab         : string table to store the result in
  * @mfg_time    : Unix timestamp since 1996
  *
  * returns char * for mfg_time_str
- * returns NULL for memory allocation failure
+ * returns NULL if the string table is full
  */
-static char * calculate_time(uint8_t * mfg_time)
+static char * calculate_time(fruid_strtab_t * tab, uint8_t * mfg_time)
 {
-  int len;
-  struct tm * local;
+  struct tm local;
+  char str[32];
   time_t unix_time = 0;
   unix_time = ((mfg_time[2] << 16) + (mfg_time[1] << 8) + mfg_time[0]) * 60;
   unix_time += UNIX_TIMESTAMP_1996;
 
-  local = localtime(&unix_time);
-  char * str = asctime(local);
-
-  len = strlen(str);
-
-  char * mfg_time_str = (char *) malloc(len);
-  if (!mfg_time_str) {
-#ifdef DEBUG
-    syslog(LOG_WARNING, "fruid: malloc: memory allocation failed\n");
-#endif
-    return NULL;
-  }
-
-  memset(mfg_time_str, 0, len);
-
-  memcpy(mfg_time_str, str, len);
+  localtime_r(&unix_time, &local);
+  asctime_r(&local, str);
 
-  mfg_time_str[len - 1] = '\0';
-
-  return mfg_time_str;
+  /* Drop the trailing newline */
+  return strtab_dup(tab, str, strlen(str) - 1);
 }
 
 /*
@@ -91,7 +116,7 @@ static char * calculate_time(uint8_t * mfg_time)
  * returns 0 if chksum is verified
  * returns -1 if there exist a mismatch
  */
-static int verify_chksum(uint8_t * area, uint8_t len, uint8_t chksum_read)
+static int verify_chksum(const uint8_t * area, int len, uint8_t chksum_read)
 {
   int i;
   uint8_t chksum = 0;
@@ -108,58 +133,61 @@ static int verify_chksum(uint8_t * area, uint8_t len, uint8_t chksum_read)
 /*
  * get_chassis_type - get the Chassis type
  *
+ * @tab       : string table to store the result in
  * @type_hex  : type stored in the data
  *
  * returns char ptr for chassis type string
  * returns NULL if type not in the list
  */
-static char * get_chassis_type(uint8_t type_hex)
+static char * get_chassis_type(fruid_strtab_t * tab, uint8_t type_hex)
 {
-  int type, ret;
-  char type_int[4];
-
-  ret = sprintf(type_int, "%u", type_hex);
-  type = atoi(type_int) - 1;
+  int type = type_hex - 1;
 
   /* If the type is not in the list defined.*/
-  if (type > FRUID_CHASSIS_TYPECODE_MAX || type < FRUID_CHASSIS_TYPECODE_MIN) {
+  if (type >= FRUID_CHASSIS_TYPECODE_MAX || type < FRUID_CHASSIS_TYPECODE_MIN) {
 #ifdef DEBUG
     syslog(LOG_INFO, "fruid: chassis area: invalid chassis type\n");
 #endif
     return NULL;
   }
 
-  char * type_str = (char *) malloc(strlen(fruid_chassis_type[type]));
-  if (!type_str) {
-#ifdef DEBUG
-    syslog(LOG_WARNING, "fruid: malloc: memory allocation failed\n");
-#endif
-    return NULL;
-  }
-
-  memcpy(type_str, fruid_chassis_type[type], strlen(fruid_chassis_type[type]));
-
-  return type_str;
+  return strtab_dup(tab, fruid_chassis_type[type],
+                    strlen(fruid_chassis_type[type]));
 }
 
 /*
- * _fruid_area_field_read - read the field data
+ * _fruid_area_field_read - decode a field in place
  *
- * @offset    : offset of the field
+ * @tab       : string table to store the decoded string in
+ * @offset    : offset of the field's type/length byte
+ * @end       : end of the area holding the field
  *
  * returns char ptr for the field data string
+ * returns NULL if the field overruns its area or the table is full
  */
-static char * _fruid_area_field_read(uint8_t *offset)
+static char * _fruid_area_field_read(fruid_strtab_t * tab,
+      const uint8_t * offset, const uint8_t * end)
 {
   int field_type, field_len, field_len_eff;
   int idx, idx_eff, val;
   char * field;
 
+  if (offset >= end) {
+    return NULL;
+  }
+
   /* Bits 7:6 */
   field_type = FIELD_TYPE(offset[0]);
   /* Bits 5:0 */
   field_len = FIELD_LEN(offset[0]);
 
+  if (offset + 1 + field_len > end) {
+#ifdef DEBUG
+    syslog(LOG_ERR, "fruid: field overruns its area");
+#endif
+    return NULL;
+  }
+
   /* Calculate the effective length of the field data based on type stored. */
   switch (field_type) {
 
@@ -178,26 +206,21 @@ static char * _fruid_area_field_read(uint8_t *offset)
 
   case TYPE_BCD_PLUS:
   case TYPE_ASCII_8BIT:
+  default:
     field_len_eff = field_len;
     break;
   }
 
   /* If field data is zero, store 'N/A' for that field. */
-  field_len_eff > 0 ? (field = (char *) malloc(field_len_eff + 1)) :
-                      (field = (char *) malloc(strlen(FIELD_EMPTY)));
-  if (!field) {
-#ifdef DEBUG
-    syslog(LOG_WARNING, "fruid: malloc: memory allocation failed\n");
-#endif
-    return NULL;
+  if (field_len_eff < 1) {
+    return strtab_dup(tab, FIELD_EMPTY, strlen(FIELD_EMPTY));
   }
 
-  memset(field, 0, field_len + 1);
-
-  if (field_len_eff < 1) {
-    strcpy(field, FIELD_EMPTY);
-    return field;
+  field = strtab_alloc(tab, field_len_eff + 1);
+  if (!field) {
+    return NULL;
   }
+  memset(field, 0, field_len_eff + 1);
 
   /* Retrieve field data depending on the type it was stored. */
   switch (field_type) {
@@ -263,441 +286,242 @@ static char * _fruid_area_field_read(uint8_t *offset)
   return field;
 }
 
-/* Free all the memory allocated for fruid information */
-void free_fruid_info(fruid_info_t * fruid)
+/*
+ * Read the fields of an area in order into fields[], stopping early at the
+ * end-of-fields marker once the first n_required have been read.
+ */
+static int read_area_fields(fruid_strtab_t * tab, const uint8_t * area,
+      int index, int area_len, char ** fields[], int n_fields, int n_required)
 {
-  if (fruid->chassis.flag) {
-    free(fruid->chassis.type_str);
-    free(fruid->chassis.part);
-    free(fruid->chassis.serial);
-    free(fruid->chassis.custom1);
-    free(fruid->chassis.custom2);
-    free(fruid->chassis.custom3);
-  }
+  const uint8_t * end = area + area_len;
+  int i;
 
-  if (fruid->board.flag) {
-    free(fruid->board.mfg_time_str);
-    free(fruid->board.mfg);
-    free(fruid->board.name);
-    free(fruid->board.serial);
-    free(fruid->board.part);
-    free(fruid->board.fruid);
-    free(fruid->board.custom1);
-    free(fruid->board.custom2);
-    free(fruid->board.custom3);
-  }
+  for (i = 0; i < n_fields; i++) {
+    if (i >= n_required &&
+        (index >= area_len || area[index] == NO_MORE_DATA_BYTE))
+      return 0;
 
-  if (fruid->product.flag) {
-    free(fruid->product.mfg);
-    free(fruid->product.name);
-    free(fruid->product.part);
-    free(fruid->product.version);
-    free(fruid->product.serial);
-    free(fruid->product.asset_tag);
-    free(fruid->product.fruid);
-    free(fruid->product.custom1);
-    free(fruid->product.custom2);
-    free(fruid->product.custom3);
+    *fields[i] = _fruid_area_field_read(tab, &area[index], end);
+    if (*fields[i] == NULL)
+      return (tab->used >= tab->size) ? ENOMEM : EBADF;
+    index += FIELD_LEN(area[index]) + 1;
   }
-}
 
-/* Initialize the fruid information struct */
-static void init_fruid_info(fruid_info_t * fruid)
-{
-  fruid->chassis.flag = 0;
-  fruid->board.flag = 0;
-  fruid->product.flag = 0;
-  fruid->chassis.type_str = NULL;
-  fruid->chassis.part = NULL;
-  fruid->chassis.serial = NULL;
-  fruid->chassis.custom1 = NULL;
-  fruid->chassis.custom2 = NULL;
-  fruid->chassis.custom3 = NULL;
-  fruid->board.mfg_time_str = NULL;
-  fruid->board.mfg = NULL;
-  fruid->board.name = NULL;
-  fruid->board.serial = NULL;
-  fruid->board.part = NULL;
-  fruid->board.fruid = NULL;
-  fruid->board.custom1 = NULL;
-  fruid->board.custom2 = NULL;
-  fruid->board.custom3 = NULL;
-  fruid->product.mfg = NULL;
-  fruid->product.name = NULL;
-  fruid->product.part = NULL;
-  fruid->product.version = NULL;
-  fruid->product.serial = NULL;
-  fruid->product.asset_tag = NULL;
-  fruid->product.fruid = NULL;
-  fruid->product.custom1 = NULL;
-  fruid->product.custom2 = NULL;
-  fruid->product.custom3 = NULL;
+  return 0;
 }
 
-/* Parse the Product area data */
-int parse_fruid_area_product(uint8_t * product,
-      fruid_area_product_t * fruid_product)
+/*
+ * Validate the version, length and checksum of an area that starts at
+ * area and has avail bytes of the image after it.
+ */
+static int check_area(const uint8_t * area, size_t avail, const char * name)
 {
-  int ret, index;
-
-  index = 0;
+  int area_len;
 
-  /* Reset the struct to zero */
-  memset(fruid_product, 0, sizeof(fruid_area_product_t));
+  if (avail < 3) {
+    return EBADF;
+  }
 
   /* Check if the format version is as per IPMI FRUID v1.0 format spec */
-  fruid_product->format_ver = product[index++];
-  if (fruid_product->format_ver != FRUID_FORMAT_VER) {
+  if ((area[0] & 0x0F) != FRUID_FORMAT_VER) {
 #ifdef DEBUG
-    syslog(LOG_ERR, "fruid: product_area: format version not supported");
+    syslog(LOG_ERR, "fruid: %s_area: format version not supported", name);
 #endif
     return EPROTONOSUPPORT;
   }
 
-  fruid_product->area_len = product[index++] * FRUID_AREA_LEN_MULTIPLIER;
-  fruid_product->lang_code = product[index++];
-
-  fruid_product->chksum = product[fruid_product->area_len - 1];
-  ret = verify_chksum((uint8_t *) product,
-          fruid_product->area_len, fruid_product->chksum);
-
-  if (ret) {
+  area_len = area[1] * FRUID_AREA_LEN_MULTIPLIER;
+  if (area_len < 3 || area_len > avail) {
 #ifdef DEBUG
-    syslog(LOG_ERR, "fruid: product_area: chksum not verified.");
+    syslog(LOG_ERR, "fruid: %s_area: invalid length", name);
 #endif
     return EBADF;
   }
 
-  fruid_product->mfg = _fruid_area_field_read(&product[index]);
-  if (fruid_product->mfg == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(product[index]) + 1;
-
-  fruid_product->name = _fruid_area_field_read(&product[index]);
-  if (fruid_product->name == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(product[index]) + 1;
-
-  fruid_product->part = _fruid_area_field_read(&product[index]);
-  if (fruid_product->part == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(product[index]) + 1;
-
-  fruid_product->version = _fruid_area_field_read(&product[index]);
-  if (fruid_product->version == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(product[index]) + 1;
-
-  fruid_product->serial = _fruid_area_field_read(&product[index]);
-  if (fruid_product->serial == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(product[index]) + 1;
-
-  fruid_product->asset_tag = _fruid_area_field_read(&product[index]);
-  if (fruid_product->asset_tag == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(product[index]) + 1;
-
-  fruid_product->fruid = _fruid_area_field_read(&product[index]);
-  if (fruid_product->fruid == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(product[index]) + 1;
-
-  /* Check if this field was last and there is no more custom data */
-  if (product[index] == NO_MORE_DATA_BYTE)
-    return 0;
-  fruid_product->custom1 = _fruid_area_field_read(&product[index]);
-  if (fruid_product->custom1 == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(product[index]) + 1;
-
-  /* Check if this field was last and there is no more custom data */
-  if (product[index] == NO_MORE_DATA_BYTE)
-    return 0;
-  fruid_product->custom2 = _fruid_area_field_read(&product[index]);
-  if (fruid_product->custom2 == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(product[index]) + 1;
-
-  /* Check if this field was last and there is no more custom data */
-  if (product[index] == NO_MORE_DATA_BYTE)
-    return 0;
-  fruid_product->custom3 = _fruid_area_field_read(&product[index]);
-  if (fruid_product->custom3 == NULL)
-    return ENOMEM;
-
-  return 0;
-}
-
-/* Parse the Board area data */
-int parse_fruid_area_board(uint8_t * board,
-      fruid_area_board_t * fruid_board)
-{
-  int ret, index, i;
-  time_t unix_time;
-
-  index = 0;
-
-  /* Reset the struct to zero */
-  memset(fruid_board, 0, sizeof(fruid_area_board_t));
-
-  /* Check if the format version is as per IPMI FRUID v1.0 format spec */
-  fruid_board->format_ver = board[index++];
-  if (fruid_board->format_ver != FRUID_FORMAT_VER) {
-#ifdef DEBUG
-    syslog(LOG_ERR, "fruid: board_area: format version not supported");
-#endif
-    return EPROTONOSUPPORT;
-  }
-  fruid_board->area_len = board[index++] * FRUID_AREA_LEN_MULTIPLIER;
-  fruid_board->lang_code = board[index++];
-
-  fruid_board->chksum = board[fruid_board->area_len - 1];
-  ret = verify_chksum((uint8_t *) board,
-          fruid_board->area_len, fruid_board->chksum);
-
-  if (ret) {
+  if (verify_chksum(area, area_len, area[area_len - 1])) {
 #ifdef DEBUG
-    syslog(LOG_ERR, "fruid: board_area: chksum not verified.");
+    syslog(LOG_ERR, "fruid: %s_area: chksum not verified.", name);
 #endif
     return EBADF;
   }
 
-  for (i = 0; i < 3; i++) {
-    fruid_board->mfg_time[i] = board[index++];
-  }
-
-  fruid_board->mfg_time_str = calculate_time(fruid_board->mfg_time);
-  if (fruid_board->mfg_time_str == NULL)
-    return ENOMEM;
+  return 0;
+}
 
-  fruid_board->mfg = _fruid_area_field_read(&board[index]);
-  if (fruid_board->mfg == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(board[index]) + 1;
+/* Parse the Product area data */
+static int parse_fruid_area_product(fruid_strtab_t * tab,
+      const uint8_t * product, size_t avail, fruid_info_t * fruid)
+{
+  char ** fields[] = {
+    &fruid->product.mfg, &fruid->product.name, &fruid->product.part,
+    &fruid->product.version, &fruid->product.serial,
+    &fruid->product.asset_tag, &fruid->product.fruid,
+    &fruid->product.custom1, &fruid->product.custom2,
+    &fruid->product.custom3,
+  };
+  int ret;
 
-  fruid_board->name = _fruid_area_field_read(&board[index]);
-  if (fruid_board->name == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(board[index]) + 1;
+  ret = check_area(product, avail, "product");
+  if (ret)
+    return ret;
 
-  fruid_board->serial = _fruid_area_field_read(&board[index]);
-  if (fruid_board->serial == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(board[index]) + 1;
+  /* Fields start after version, length and language code */
+  ret = read_area_fields(tab, product, 3,
+          product[1] * FRUID_AREA_LEN_MULTIPLIER, fields, 10, 7);
+  if (ret)
+    return ret;
 
-  fruid_board->part = _fruid_area_field_read(&board[index]);
-  if (fruid_board->part == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(board[index]) + 1;
+  fruid->product.flag = 1;
+  return 0;
+}
 
-  fruid_board->fruid = _fruid_area_field_read(&board[index]);
-  if (fruid_board->fruid == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(board[index]) + 1;
+/* Parse the Board area data */
+static int parse_fruid_area_board(fruid_strtab_t * tab,
+      const uint8_t * board, size_t avail, fruid_info_t * fruid)
+{
+  char ** fields[] = {
+    &fruid->board.mfg, &fruid->board.name, &fruid->board.serial,
+    &fruid->board.part, &fruid->board.fruid, &fruid->board.custom1,
+    &fruid->board.custom2, &fruid->board.custom3,
+  };
+  uint8_t mfg_time[3];
+  int ret;
 
-  /* Check if this field was last and there is no more custom data */
-  if (board[index] == NO_MORE_DATA_BYTE)
-    return 0;
-  fruid_board->custom1 = _fruid_area_field_read(&board[index]);
-  if (fruid_board->custom1 == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(board[index]) + 1;
+  ret = check_area(board, avail, "board");
+  if (ret)
+    return ret;
 
-  /* Check if this field was last and there is no more custom data */
-  if (board[index] == NO_MORE_DATA_BYTE)
-    return 0;
-  fruid_board->custom2 = _fruid_area_field_read(&board[index]);
-  if (fruid_board->custom2 == NULL)
+  /* Manufacturing time follows version, length and language code */
+  memcpy(mfg_time, &board[3], sizeof(mfg_time));
+  fruid->board.mfg_time_str = calculate_time(tab, mfg_time);
+  if (fruid->board.mfg_time_str == NULL)
     return ENOMEM;
-  index += FIELD_LEN(board[index]) + 1;
 
-  /* Check if this field was last and there is no more custom data */
-  if (board[index] == NO_MORE_DATA_BYTE)
-    return 0;
-  fruid_board->custom3 = _fruid_area_field_read(&board[index]);
-  if (fruid_board->custom3 == NULL)
-    return ENOMEM;
+  ret = read_area_fields(tab, board, 6,
+          board[1] * FRUID_AREA_LEN_MULTIPLIER, fields, 8, 5);
+  if (ret)
+    return ret;
 
+  fruid->board.flag = 1;
   return 0;
 }
 
 /* Parse the Chassis area data */
-int parse_fruid_area_chassis(uint8_t * chassis,
-      fruid_area_chassis_t * fruid_chassis)
+static int parse_fruid_area_chassis(fruid_strtab_t * tab,
+      const uint8_t * chassis, size_t avail, fruid_info_t * fruid)
 {
-  int ret, index;
-
-  index = 0;
-
-  /* Reset the struct to zero */
-  memset(fruid_chassis, 0, sizeof(fruid_area_chassis_t));
-
-  /* Check if the format version is as per IPMI FRUID v1.0 format spec */
-  fruid_chassis->format_ver = chassis[index++];
-  if (fruid_chassis->format_ver != FRUID_FORMAT_VER) {
-#ifdef DEBUG
-    syslog(LOG_ERR, "fruid: chassis_area: format version not supported");
-#endif
-    return EPROTONOSUPPORT;
-  }
-
-  fruid_chassis->area_len = chassis[index++] * FRUID_AREA_LEN_MULTIPLIER;
-  fruid_chassis->type = chassis[index++];
+  char ** fields[] = {
+    &fruid->chassis.part, &fruid->chassis.serial, &fruid->chassis.custom1,
+    &fruid->chassis.custom2, &fruid->chassis.custom3,
+  };
+  int ret;
 
-  fruid_chassis->chksum = chassis[fruid_chassis->area_len - 1];
-  ret = verify_chksum((uint8_t *) chassis,
-          fruid_chassis->area_len, fruid_chassis->chksum);
-  if (ret) {
-#ifdef DEBUG
-    syslog(LOG_ERR, "fruid: chassis_area: chksum not verified.");
-#endif
-    return EBADF;
-  }
+  ret = check_area(chassis, avail, "chassis");
+  if (ret)
+    return ret;
 
-  fruid_chassis->type_str = get_chassis_type(fruid_chassis->type);
-  if (fruid_chassis->type_str == NULL)
+  fruid->chassis.type_str = get_chassis_type(tab, chassis[2]);
+  if (fruid->chassis.type_str == NULL)
     return ENOMSG;
 
-  fruid_chassis->part = _fruid_area_field_read(&chassis[index]);
-  if (fruid_chassis->part == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(chassis[index]) + 1;
-
-  fruid_chassis->serial = _fruid_area_field_read(&chassis[index]);
-  if (fruid_chassis->serial == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(chassis[index]) + 1;
-
-  /* Check if this field was last and there is no more custom data */
-  if (chassis[index] == NO_MORE_DATA_BYTE)
-    return 0;
-  fruid_chassis->custom1 = _fruid_area_field_read(&chassis[index]);
-  if (fruid_chassis->custom1 == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(chassis[index]) + 1;
-
-  /* Check if this field was last and there is no more custom data */
-  if (chassis[index] == NO_MORE_DATA_BYTE)
-    return 0;
-  fruid_chassis->custom2 = _fruid_area_field_read(&chassis[index]);
-  if (fruid_chassis->custom2 == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(chassis[index]) + 1;
-
-  /* Check if this field was last and there is no more custom data */
-  if (chassis[index] == NO_MORE_DATA_BYTE)
-    return 0;
-  fruid_chassis->custom3 = _fruid_area_field_read(&chassis[index]);
-  if (fruid_chassis->custom3 == NULL)
-    return ENOMEM;
+  /* Fields start after version, length and type */
+  ret = read_area_fields(tab, chassis, 3,
+          chassis[1] * FRUID_AREA_LEN_MULTIPLIER, fields, 5, 2);
+  if (ret)
+    return ret;
 
+  fruid->chassis.flag = 1;
   return 0;
 }
 
-/* Calculate the area offsets and populate the fruid_eeprom_t struct */
-void set_fruid_eeprom_offsets(uint8_t * eeprom, fruid_header_t * header,
-      fruid_eeprom_t * fruid_eeprom)
+/* Free all the memory allocated for fruid information */
+void free_fruid_info(fruid_info_t * fruid)
 {
-  fruid_eeprom->header = eeprom + 0x00;
-
-  header->offset_area.chassis ? (fruid_eeprom->chassis = eeprom + \
-    (header->offset_area.chassis * FRUID_OFFSET_MULTIPLIER)) : \
-    (fruid_eeprom->chassis = NULL);
-
-  header->offset_area.board ? (fruid_eeprom->board = eeprom + \
-    (header->offset_area.board * FRUID_OFFSET_MULTIPLIER)) : \
-    (fruid_eeprom->board = NULL);
-
-  header->offset_area.product ? (fruid_eeprom->product = eeprom + \
-    (header->offset_area.product * FRUID_OFFSET_MULTIPLIER)) : \
-    (fruid_eeprom->product = NULL);
-
-  header->offset_area.multirecord ? (fruid_eeprom->multirecord = eeprom + \
-    (header->offset_area.multirecord * FRUID_OFFSET_MULTIPLIER)) : \
-    (fruid_eeprom->multirecord = NULL);
+  free(fruid->strtab);
+  memset(fruid, 0, sizeof(fruid_info_t));
 }
 
-/* Populate the common header struct */
-int parse_fruid_header(uint8_t * eeprom, fruid_header_t * header)
+/*
+ * fruid_parse_buf - To parse an eeprom image held in memory and populate
+ *                   the fruid information in the struct
+ * @eeprom    : Eeprom image, which is only read
+ * @len       : Size of the image in bytes
+ * @fruid     : ptr to the struct that holds the fruid information
+ *
+ * returns 0 on success
+ * returns non-zero errno value on error
+ */
+int fruid_parse_buf(const uint8_t * eeprom, size_t len, fruid_info_t * fruid)
 {
-  int ret;
+  fruid_header_t header;
+  fruid_strtab_t tab;
+  size_t offset;
+  int ret = 0;
 
-  memcpy((uint8_t *)header, (uint8_t *)eeprom, sizeof(fruid_header_t));
-  ret = verify_chksum((uint8_t *) header,
-          sizeof(fruid_header_t), header->chksum);
-  if (ret) {
+  memset(fruid, 0, sizeof(fruid_info_t));
+
+  if (len < sizeof(fruid_header_t)) {
+#ifdef DEBUG
+    syslog(LOG_ERR, "fruid: image too short");
+#endif
+    return EBADF;
+  }
+
+  /* Parse the common header data */
+  memcpy(&header, eeprom, sizeof(fruid_header_t));
+  if (verify_chksum(eeprom, sizeof(fruid_header_t), header.chksum)) {
 #ifdef DEBUG
     syslog(LOG_ERR, "fruid: common_header: chksum not verified.");
 #endif
     return EBADF;
   }
 
-  return ret;
-}
+  /*
+   * Every raw byte decodes to at most four characters (an empty field
+   * becomes "N/A"), plus the manufacturing date and chassis type.
+   */
+  tab.size = len * 4 + 64;
+  tab.used = 0;
+  tab.buf = (char *) malloc(tab.size);
+  if (!tab.buf) {
+#ifdef DEBUG
+    syslog(LOG_WARNING, "fruid: malloc: memory allocation failed\n");
+#endif
+    return ENOMEM;
+  }
 
-/* Parse the eeprom dump and populate the fruid info in struct */
-int populate_fruid_info(fruid_eeprom_t * fruid_eeprom, fruid_info_t * fruid)
-{
-  int ret;
+  /* If Chassis area is present, parse it */
+  if (!ret && header.offset_area.chassis) {
+    offset = header.offset_area.chassis * FRUID_OFFSET_MULTIPLIER;
+    ret = (offset < len) ?
+      parse_fruid_area_chassis(&tab, eeprom + offset, len - offset, fruid) :
+      EBADF;
+  }
 
-  /* Initial all the required fruid structures */
-  fruid_area_chassis_t fruid_chassis;
-  fruid_area_board_t fruid_board;
-  fruid_area_product_t fruid_product;
-
-  /* If Chassis area is present, parse and print it */
-  if (fruid_eeprom->chassis) {
-    ret = parse_fruid_area_chassis(fruid_eeprom->chassis, &fruid_chassis);
-    if (!ret) {
-      fruid->chassis.flag = 1;
-      fruid->chassis.type_str = fruid_chassis.type_str;
-      fruid->chassis.part = fruid_chassis.part;
-      fruid->chassis.serial = fruid_chassis.serial;
-      fruid->chassis.custom1 = fruid_chassis.custom1;
-      fruid->chassis.custom2 = fruid_chassis.custom2;
-      fruid->chassis.custom3 = fruid_chassis.custom3;
-    } else
-      return ret;
+  /* If Board area is present, parse it */
+  if (!ret && header.offset_area.board) {
+    offset = header.offset_area.board * FRUID_OFFSET_MULTIPLIER;
+    ret = (offset < len) ?
+      parse_fruid_area_board(&tab, eeprom + offset, len - offset, fruid) :
+      EBADF;
   }
 
-  /* If Board area is present, parse and print it */
-  if (fruid_eeprom->board) {
-    ret = parse_fruid_area_board(fruid_eeprom->board, &fruid_board);
-    if (!ret) {
-      fruid->board.flag = 1;
-      fruid->board.mfg_time_str = fruid_board.mfg_time_str;
-      fruid->board.mfg = fruid_board.mfg;
-      fruid->board.name = fruid_board.name;
-      fruid->board.serial = fruid_board.serial;
-      fruid->board.part = fruid_board.part;
-      fruid->board.fruid = fruid_board.fruid;
-      fruid->board.custom1 = fruid_board.custom1;
-      fruid->board.custom2 = fruid_board.custom2;
-      fruid->board.custom3 = fruid_board.custom3;
-    } else
-      return ret;
+  /* If Product area is present, parse it */
+  if (!ret && header.offset_area.product) {
+    offset = header.offset_area.product * FRUID_OFFSET_MULTIPLIER;
+    ret = (offset < len) ?
+      parse_fruid_area_product(&tab, eeprom + offset, len - offset, fruid) :
+      EBADF;
   }
 
-  /* If Product area is present, parse and print it */
-  if (fruid_eeprom->product) {
-    ret = parse_fruid_area_product(fruid_eeprom->product, &fruid_product);
-    if (!ret) {
-      fruid->product.flag = 1;
-      fruid->product.mfg = fruid_product.mfg;
-      fruid->product.name = fruid_product.name;
-      fruid->product.part = fruid_product.part;
-      fruid->product.version = fruid_product.version;
-      fruid->product.serial = fruid_product.serial;
-      fruid->product.asset_tag = fruid_product.asset_tag;
-      fruid->product.fruid = fruid_product.fruid;
-      fruid->product.custom1 = fruid_product.custom1;
-      fruid->product.custom2 = fruid_product.custom2;
-      fruid->product.custom3 = fruid_product.custom3;
-    } else
-      return ret;
+  if (ret) {
+    free(tab.buf);
+    memset(fruid, 0, sizeof(fruid_info_t));
+    return ret;
   }
 
+  fruid->strtab = tab.buf;
+  fruid->strtab_len = tab.used;
   return 0;
 }
 
@@ -707,74 +531,49 @@ int populate_fruid_info(fruid_eeprom_t * fruid_eeprom, fruid_info_t * fruid)
  * @bin       : Eeprom binary file
  * @fruid     : ptr to the struct that holds the fruid information
  *
+ * The file is read with a single read() and parsed in place.
+ *
  * returns 0 on success
  * returns non-zero errno value on error
  */
 int fruid_parse(const char * bin, fruid_info_t * fruid)
 {
-  int fruid_len, ret;
-  FILE *fruid_fd;
+  struct stat st;
   uint8_t * eeprom;
-
-  /* Initial all the required fruid structures */
-  fruid_header_t fruid_header;
-  fruid_eeprom_t fruid_eeprom;
-
-  memset(&fruid_header, 0, sizeof(fruid_header_t));
-  memset(&fruid_eeprom, 0, sizeof(fruid_eeprom_t));
-
-  /* Reset parser return value */
-  ret = 0;
+  ssize_t len;
+  int fd, ret;
 
   /* Open the FRUID binary file */
-  fruid_fd = fopen(bin, "rb");
-  if (!fruid_fd) {
+  fd = open(bin, O_RDONLY);
+  if (fd < 0) {
 #ifdef DEBUG
     syslog(LOG_ERR, "fruid: unable to open the file");
 #endif
     return ENOENT;
   }
 
-  /* Get the size of the binary file */
-  fseek(fruid_fd, 0, SEEK_END);
-  fruid_len = (uint32_t) ftell(fruid_fd);
-
-  fseek(fruid_fd, 0, SEEK_SET);
+  if (fstat(fd, &st) || st.st_size <= 0) {
+    close(fd);
+    return ENOENT;
+  }
 
-  eeprom = (uint8_t *) malloc(fruid_len);
+  eeprom = (uint8_t *) malloc(st.st_size);
   if (!eeprom) {
-#ifdef DEBUG
-    syslog(LOG_WARNING, "fruid: malloc: memory allocation failed\n");
-#endif
+    close(fd);
     return ENOMEM;
   }
 
-  /* Read the binary file */
-  fread(eeprom, sizeof(uint8_t), fruid_len, fruid_fd);
-
-  /* Close the FRUID binary file */
-  fclose(fruid_fd);
-
-  /* Parse the common header data */
-  ret = parse_fruid_header(eeprom, &fruid_header);
-  if (ret) {
-    /* Free the eeprom malloc'ed memory */
+  len = read(fd, eeprom, st.st_size);
+  close(fd);
+  if (len != st.st_size) {
+#ifdef DEBUG
+    syslog(LOG_ERR, "fruid: unable to read the file");
+#endif
     free(eeprom);
-    return ret;
-  }
-
-  /* Calculate all the area offsets */
-  set_fruid_eeprom_offsets(eeprom, &fruid_header, &fruid_eeprom);
-
-  init_fruid_info(fruid);
-  /* Parse the eeprom and populate the fruid information */
-  ret = populate_fruid_info(&fruid_eeprom, fruid);
-  if (ret) {
-    /* Free the malloced memory for the fruid information */
-    free_fruid_info(fruid);
+    return EBADF;
   }
 
-  /* Free the eeprom malloced memory */
+  ret = fruid_parse_buf(eeprom, len, fruid);
   free(eeprom);
 
   return ret;
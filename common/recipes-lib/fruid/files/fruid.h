@@ -147,6 +147,9 @@ typedef struct fruid_info_t {
     char * custom2;
     char * custom3;
   } product;
+  /* Storage for all the strings above, released by free_fruid_info() */
+  char * strtab;
+  size_t strtab_len;
 } fruid_info_t;
 
 /* To hold the different area offsets. */
@@ -195,6 +198,7 @@ const char * fruid_chassis_type [] = {
 };
 
 int fruid_parse(const char * bin, fruid_info_t * fruid);
+int fruid_parse_buf(const uint8_t * eeprom, size_t len, fruid_info_t * fruid);
 void free_fruid_info(fruid_info_t * fruid);
 
 #ifdef __cplusplus
@@ -0,0 +1,172 @@
+/*
+ * Copyright 2015-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Builds a FRU image with chassis, board and product areas, writes it to a
+ * scratch file, checks that fruid_parse decodes it, and times repeated
+ * fruid_parse() calls on the file (as fruid-util and the REST API do) and
+ * fruid_parse_buf() calls on the image in memory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "fruid.h"
+
+#define IMAGE_SIZE 256
+
+static uint8_t image[IMAGE_SIZE];
+
+static double
+now_us(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void
+put_chksum(uint8_t *area, int len) {
+  uint8_t sum = 0;
+  int i;
+
+  for (i = 0; i < len - 1; i++)
+    sum += area[i];
+  area[len - 1] = -sum;
+}
+
+// Append 8-bit ASCII fields and the end marker; returns the next offset
+static int
+put_fields(uint8_t *area, int idx, const char **fields, int n) {
+  int i, len;
+
+  for (i = 0; i < n; i++) {
+    len = strlen(fields[i]);
+    area[idx++] = 0xC0 | len;
+    memcpy(&area[idx], fields[i], len);
+    idx += len;
+  }
+  area[idx++] = 0xC1;
+  return idx;
+}
+
+// Lay out an area of whole 8-byte blocks at off; returns its length
+static int
+put_area(int off, int idx) {
+  int len = (idx + 1 + 7) & ~7;
+
+  image[off + 1] = len / 8;
+  put_chksum(&image[off], len);
+  return len;
+}
+
+static void
+build_image(void) {
+  const char *chassis[] = { "CHS-PART-0001", "CHS-SERIAL-0001" };
+  const char *board[] = { "Facebook", "Yosemite", "BRD-SERIAL-0001",
+                          "BRD-PART-0001", "FRUID-1.0" };
+  const char *product[] = { "Facebook", "Yosemite-Server", "PRD-PART-0001",
+                            "1.0", "PRD-SERIAL-0001", "ASSET-0001",
+                            "FRUID-1.0" };
+  int off = 8, len;
+
+  image[0] = FRUID_FORMAT_VER;
+
+  image[2] = off / 8;
+  image[off] = FRUID_FORMAT_VER;
+  image[off + 2] = 0x17;                              // Rack mount chassis
+  len = put_area(off, put_fields(&image[off], 3, chassis, 2));
+  off += len;
+
+  image[3] = off / 8;
+  image[off] = FRUID_FORMAT_VER;
+  image[off + 3] = 0x10;                              // Manufacturing time
+  image[off + 4] = 0x20;
+  image[off + 5] = 0x30;
+  len = put_area(off, put_fields(&image[off], 6, board, 5));
+  off += len;
+
+  image[4] = off / 8;
+  image[off] = FRUID_FORMAT_VER;
+  put_area(off, put_fields(&image[off], 3, product, 7));
+
+  put_chksum(image, 8);
+}
+
+static int
+check(fruid_info_t *fruid) {
+  if (!fruid->chassis.flag || !fruid->board.flag || !fruid->product.flag ||
+      strcmp(fruid->chassis.serial, "CHS-SERIAL-0001") ||
+      strcmp(fruid->board.name, "Yosemite") ||
+      strcmp(fruid->product.asset_tag, "ASSET-0001")) {
+    return -1;
+  }
+  return 0;
+}
+
+int
+main(int argc, char **argv) {
+  char path[] = "/tmp/fruid_bench.XXXXXX";
+  fruid_info_t fruid;
+  int iters = 20000;
+  double t0;
+  int fd, i, ret;
+
+  if (argc > 1)
+    iters = atoi(argv[1]);
+  if (iters < 1)
+    iters = 1;
+
+  build_image();
+  fd = mkstemp(path);
+  if (fd < 0 || write(fd, image, sizeof(image)) != sizeof(image)) {
+    perror("fruid_bench");
+    return 1;
+  }
+  close(fd);
+
+  ret = fruid_parse(path, &fruid);
+  if (ret || check(&fruid)) {
+    printf("FAIL: parse returned %d\n", ret);
+    unlink(path);
+    return 1;
+  }
+  free_fruid_info(&fruid);
+
+  t0 = now_us();
+  for (i = 0; i < iters; i++) {
+    if (fruid_parse(path, &fruid) == 0)
+      free_fruid_info(&fruid);
+  }
+  printf("fruid_parse:     %6.2f us/parse\n", (now_us() - t0) / iters);
+  unlink(path);
+
+#ifndef NO_PARSE_BUF
+  t0 = now_us();
+  for (i = 0; i < iters; i++) {
+    if (fruid_parse_buf(image, sizeof(image), &fruid) == 0)
+      free_fruid_info(&fruid);
+  }
+  printf("fruid_parse_buf: %6.2f us/parse\n", (now_us() - t0) / iters);
+#endif
+
+  printf("PASS\n");
+  return 0;
+}
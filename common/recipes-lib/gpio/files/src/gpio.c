@@ -25,12 +25,17 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include <sys/epoll.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/errno.h>
 
 #include <openbmc/log.h>
 
+#ifndef GPIO_SYSFS_DIR
+#define GPIO_SYSFS_DIR "/sys/class/gpio"
+#endif
+
 void gpio_init_default(gpio_st *g) {
   g->gs_gpio = -1;
   g->gs_fd = -1;
@@ -41,7 +46,7 @@ int gpio_open(gpio_st *g, int gpio)
   char buf[128];
   int rc;
 
-  snprintf(buf, sizeof(buf), "/sys/class/gpio/gpio%u/value", gpio);
+  snprintf(buf, sizeof(buf), GPIO_SYSFS_DIR "/gpio%u/value", gpio);
   rc = open(buf, O_RDWR);
   if (rc == -1) {
     rc = errno;
@@ -86,7 +91,7 @@ int gpio_change_direction(gpio_st *g, gpio_direction_en dir)
   int fd = -1;
   int rc = 0;
 
-  snprintf(buf, sizeof(buf), "/sys/class/gpio/gpio%u/direction", g->gs_gpio);
+  snprintf(buf, sizeof(buf), GPIO_SYSFS_DIR "/gpio%u/direction", g->gs_gpio);
   fd = open(buf, O_WRONLY);
   if (fd == -1) {
     rc = errno;
@@ -105,3 +110,326 @@ int gpio_change_direction(gpio_st *g, gpio_direction_en dir)
   }
   return -rc;
 }
+
+static const char *gpio_edges[] = {"none", "rising", "falling", "both"};
+
+int gpio_get_edge(gpio_st *g, gpio_edge_en *edge)
+{
+  char buf[128];
+  char val[16] = {0};
+  int fd;
+  int i;
+
+  snprintf(buf, sizeof(buf), GPIO_SYSFS_DIR "/gpio%u/edge", g->gs_gpio);
+  fd = open(buf, O_RDONLY);
+  if (fd == -1) {
+    i = errno;
+    LOG_ERR(i, "Failed to open %s", buf);
+    return -i;
+  }
+  read(fd, val, sizeof(val) - 1);
+  close(fd);
+
+  for (i = 0; i < sizeof(gpio_edges) / sizeof(gpio_edges[0]); i++) {
+    if (!strncmp(val, gpio_edges[i], strlen(gpio_edges[i]))) {
+      *edge = i;
+      return 0;
+    }
+  }
+  return -EINVAL;
+}
+
+int gpio_change_edge(gpio_st *g, gpio_edge_en edge)
+{
+  char buf[128];
+  const char *val;
+  int fd;
+  int rc = 0;
+
+  snprintf(buf, sizeof(buf), GPIO_SYSFS_DIR "/gpio%u/edge", g->gs_gpio);
+  fd = open(buf, O_WRONLY);
+  if (fd == -1) {
+    rc = errno;
+    LOG_ERR(rc, "Failed to open %s", buf);
+    return -rc;
+  }
+
+  val = gpio_edges[edge];
+  if (write(fd, val, strlen(val)) == -1) {
+    rc = errno;
+    LOG_ERR(rc, "Failed to set gpio=%d edge=%s", g->gs_gpio, val);
+  }
+  LOG_VER("change gpio=%d edge=%s", g->gs_gpio, val);
+
+  close(fd);
+  return -rc;
+}
+
+#define GPIO_WATCH_EVENTS 16
+
+typedef struct gpio_watch {
+  gpio_st g;
+  int debounce_ms;
+  gpio_event_handler handler;
+  void *arg;
+  gpio_edge_en prev_edge;   /* edge setting to restore on removal */
+  gpio_value_en value;      /* last value reported */
+  int pending;              /* edge seen, waiting out the debounce window */
+  struct timespec edge_ts;  /* when the last edge was seen */
+  struct gpio_watch *next;
+} gpio_watch_st;
+
+struct gpio_watcher {
+  int epfd;
+  gpio_watch_st *watches;
+};
+
+static long ms_between(const struct timespec *from, const struct timespec *to)
+{
+  return (to->tv_sec - from->tv_sec) * 1000 +
+         (to->tv_nsec - from->tv_nsec) / 1000000;
+}
+
+static gpio_watch_st *find_watch(gpio_watcher_st *w, int gpio)
+{
+  gpio_watch_st *gw;
+
+  for (gw = w->watches; gw != NULL; gw = gw->next) {
+    if (gw->g.gs_gpio == gpio) {
+      return gw;
+    }
+  }
+  return NULL;
+}
+
+static void report(gpio_watch_st *gw, gpio_value_en curr,
+                   const struct timespec *ts)
+{
+  gpio_value_en last = gw->value;
+
+  gw->value = curr;
+  LOG_DBG("gpio=%d %d -> %d", gw->g.gs_gpio, last, curr);
+  if (gw->handler) {
+    gw->handler(gw->g.gs_gpio, last, curr, ts, gw->arg);
+  }
+}
+
+/* The value file signalled POLLPRI; reading it re-arms the notification */
+static int handle_edge(gpio_watch_st *gw, const struct timespec *now)
+{
+  gpio_value_en curr = gpio_read(&gw->g);
+
+  if (gw->debounce_ms > 0) {
+    gw->pending = 1;
+    gw->edge_ts = *now;
+    return 0;
+  }
+  if (curr != gw->value) {
+    report(gw, curr, now);
+    return 1;
+  }
+  /* Pin went and came back before we could read it */
+  report(gw, !curr, now);
+  report(gw, curr, now);
+  return 2;
+}
+
+/* Report pins that have been stable for their debounce window */
+static int settle(gpio_watcher_st *w, const struct timespec *now)
+{
+  gpio_watch_st *gw;
+  gpio_value_en curr;
+  int n = 0;
+
+  for (gw = w->watches; gw != NULL; gw = gw->next) {
+    if (!gw->pending || ms_between(&gw->edge_ts, now) < gw->debounce_ms) {
+      continue;
+    }
+    gw->pending = 0;
+    curr = gpio_read(&gw->g);
+    if (curr != gw->value) {
+      report(gw, curr, &gw->edge_ts);
+      n++;
+    }
+  }
+  return n;
+}
+
+gpio_watcher_st *gpio_watcher_create(void)
+{
+  gpio_watcher_st *w;
+
+  w = calloc(1, sizeof(*w));
+  if (w == NULL) {
+    return NULL;
+  }
+  w->epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (w->epfd == -1) {
+    LOG_ERR(errno, "Failed to create epoll instance");
+    free(w);
+    return NULL;
+  }
+  return w;
+}
+
+void gpio_watcher_destroy(gpio_watcher_st *w)
+{
+  if (w == NULL) {
+    return;
+  }
+  while (w->watches != NULL) {
+    gpio_watcher_remove(w, w->watches->g.gs_gpio);
+  }
+  close(w->epfd);
+  free(w);
+}
+
+int gpio_watcher_add(gpio_watcher_st *w, int gpio, gpio_edge_en edge,
+                     int debounce_ms, gpio_event_handler handler, void *arg)
+{
+  struct epoll_event ev;
+  gpio_watch_st *gw;
+  int rc;
+
+  if (find_watch(w, gpio) != NULL) {
+    return -EEXIST;
+  }
+  gw = calloc(1, sizeof(*gw));
+  if (gw == NULL) {
+    return -ENOMEM;
+  }
+  gpio_init_default(&gw->g);
+  rc = gpio_open(&gw->g, gpio);
+  if (rc) {
+    goto err_free;
+  }
+  rc = gpio_get_edge(&gw->g, &gw->prev_edge);
+  if (rc) {
+    goto err_close;
+  }
+  rc = gpio_change_edge(&gw->g, edge);
+  if (rc) {
+    goto err_close;
+  }
+  gw->debounce_ms = debounce_ms;
+  gw->handler = handler;
+  gw->arg = arg;
+  /* Read before registering so the initial state is not seen as an edge */
+  gw->value = gpio_read(&gw->g);
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLPRI;
+  ev.data.ptr = gw;
+  if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, gw->g.gs_fd, &ev) == -1) {
+    rc = -errno;
+    LOG_ERR(-rc, "Failed to watch gpio=%d", gpio);
+    gpio_change_edge(&gw->g, gw->prev_edge);
+    goto err_close;
+  }
+
+  gw->next = w->watches;
+  w->watches = gw;
+  LOG_VER("watch gpio=%d value=%d debounce=%dms", gpio, gw->value,
+          debounce_ms);
+  return 0;
+
+ err_close:
+  gpio_close(&gw->g);
+ err_free:
+  free(gw);
+  return rc;
+}
+
+int gpio_watcher_remove(gpio_watcher_st *w, int gpio)
+{
+  gpio_watch_st **pp;
+  gpio_watch_st *gw;
+
+  for (pp = &w->watches; *pp != NULL; pp = &(*pp)->next) {
+    if ((*pp)->g.gs_gpio == gpio) {
+      break;
+    }
+  }
+  if (*pp == NULL) {
+    return -ENOENT;
+  }
+  gw = *pp;
+  *pp = gw->next;
+  epoll_ctl(w->epfd, EPOLL_CTL_DEL, gw->g.gs_fd, NULL);
+  gpio_change_edge(&gw->g, gw->prev_edge);
+  gpio_close(&gw->g);
+  free(gw);
+  return 0;
+}
+
+int gpio_watcher_value(gpio_watcher_st *w, int gpio, gpio_value_en *value)
+{
+  gpio_watch_st *gw = find_watch(w, gpio);
+
+  if (gw == NULL) {
+    return -ENOENT;
+  }
+  *value = gw->value;
+  return 0;
+}
+
+int gpio_watcher_fd(gpio_watcher_st *w)
+{
+  return w->epfd;
+}
+
+int gpio_watcher_timeout(gpio_watcher_st *w)
+{
+  struct timespec now;
+  gpio_watch_st *gw;
+  long left;
+  int timeout = -1;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  for (gw = w->watches; gw != NULL; gw = gw->next) {
+    if (!gw->pending) {
+      continue;
+    }
+    left = gw->debounce_ms - ms_between(&gw->edge_ts, &now);
+    if (left < 0) {
+      left = 0;
+    }
+    if (timeout == -1 || left < timeout) {
+      timeout = left;
+    }
+  }
+  return timeout;
+}
+
+/*
+ * Wait up to timeout_ms (-1 forever, 0 to just collect what is ready) for
+ * pin changes and call their handlers.  Returns the number of transitions
+ * reported or a negative errno.
+ */
+int gpio_watcher_dispatch(gpio_watcher_st *w, int timeout_ms)
+{
+  struct epoll_event evs[GPIO_WATCH_EVENTS];
+  struct timespec now;
+  int wait = timeout_ms;
+  int debounce = gpio_watcher_timeout(w);
+  int n, i;
+  int reported = 0;
+
+  if (debounce >= 0 && (wait < 0 || debounce < wait)) {
+    wait = debounce;
+  }
+  n = epoll_wait(w->epfd, evs, GPIO_WATCH_EVENTS, wait);
+  if (n == -1) {
+    n = errno;
+    if (n == EINTR) {
+      return 0;
+    }
+    LOG_ERR(n, "Failed to wait for gpio events");
+    return -n;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  for (i = 0; i < n; i++) {
+    reported += handle_edge((gpio_watch_st *)evs[i].data.ptr, &now);
+  }
+  return reported + settle(w, &now);
+}
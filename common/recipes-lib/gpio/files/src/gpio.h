@@ -18,6 +18,8 @@
 #ifndef GPIO_H
 #define GPIO_H
 
+#include <time.h>
+
 typedef struct {
   int gs_gpio;
   int gs_fd;
@@ -39,4 +41,52 @@ gpio_value_en gpio_read(gpio_st *g);
 void gpio_write(gpio_st *g, gpio_value_en v);
 int gpio_change_direction(gpio_st *g, gpio_direction_en dir);
 
+typedef enum {
+  GPIO_EDGE_NONE,
+  GPIO_EDGE_RISING,
+  GPIO_EDGE_FALLING,
+  GPIO_EDGE_BOTH,
+} gpio_edge_en;
+
+int gpio_get_edge(gpio_st *g, gpio_edge_en *edge);
+int gpio_change_edge(gpio_st *g, gpio_edge_en edge);
+
+/*
+ * Edge-triggered GPIO watcher.
+ *
+ * Each watched pin has its sysfs "edge" attribute set and its value file
+ * registered with epoll for POLLPRI, so the caller sleeps until a pin
+ * actually changes instead of polling.  The edge setting the pin had
+ * before is put back when it is removed.  Handlers are called from
+ * gpio_watcher_dispatch() with the previous and new value and the
+ * CLOCK_MONOTONIC time the change was seen.
+ *
+ * With a debounce window, a change is only reported once the pin has been
+ * stable for debounce_ms; the timestamp is that of the last edge.  Without
+ * one, a pulse too short to be seen in the value file is still reported as
+ * two transitions with the same timestamp.
+ *
+ * gpio_watcher_fd() returns the epoll descriptor so a daemon with its own
+ * event loop can poll it alongside other fds and call
+ * gpio_watcher_dispatch(w, 0) when it is readable; gpio_watcher_timeout()
+ * gives the ms until a debounce window expires (-1 if none).
+ *
+ * A watcher is not thread safe; use it from one thread.
+ */
+typedef struct gpio_watcher gpio_watcher_st;
+
+typedef void (*gpio_event_handler)(int gpio, gpio_value_en last,
+                                   gpio_value_en curr,
+                                   const struct timespec *ts, void *arg);
+
+gpio_watcher_st *gpio_watcher_create(void);
+void gpio_watcher_destroy(gpio_watcher_st *w);
+int gpio_watcher_add(gpio_watcher_st *w, int gpio, gpio_edge_en edge,
+                     int debounce_ms, gpio_event_handler handler, void *arg);
+int gpio_watcher_remove(gpio_watcher_st *w, int gpio);
+int gpio_watcher_value(gpio_watcher_st *w, int gpio, gpio_value_en *value);
+int gpio_watcher_fd(gpio_watcher_st *w);
+int gpio_watcher_timeout(gpio_watcher_st *w);
+int gpio_watcher_dispatch(gpio_watcher_st *w, int timeout_ms);
+
 #endif
@@ -0,0 +1,284 @@
+/*
+ * Copyright 2014-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Test of the GPIO watcher against a fake sysfs tree under
+ * ./gpio-test-sysfs (see GPIO_SYSFS_DIR in the Makefile).
+ *
+ * Regular files cannot be watched with epoll, so epoll_ctl() is wrapped:
+ * each value file is registered through an edge-triggered eventfd, and
+ * the test raises an "edge" by rewriting the value file and signalling
+ * that eventfd, the way the kernel's sysfs_notify() would.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+
+#include "gpio.h"
+
+#define SYSFS        "gpio-test-sysfs"
+#define MAX_FDS      256
+#define MAX_EVENTS   8
+
+static int g_efd[MAX_FDS];        // value fd -> eventfd
+static int g_efd_gpio[MAX_FDS];   // value fd -> gpio
+static int g_failed;
+
+static struct {
+  int gpio;
+  gpio_value_en last;
+  gpio_value_en curr;
+  struct timespec ts;
+} g_events[MAX_EVENTS];
+static int g_nevents;
+
+int __real_epoll_ctl(int epfd, int op, int fd, struct epoll_event *ev);
+
+int __wrap_epoll_ctl(int epfd, int op, int fd, struct epoll_event *ev)
+{
+  struct epoll_event eev;
+  char link[64], path[256];
+  char *p;
+  ssize_t n;
+  int efd;
+
+  if (fd < 0 || fd >= MAX_FDS) {
+    errno = EBADF;
+    return -1;
+  }
+  if (op == EPOLL_CTL_DEL) {
+    efd = g_efd[fd];
+    g_efd[fd] = -1;
+    __real_epoll_ctl(epfd, op, efd, NULL);
+    close(efd);
+    return 0;
+  }
+
+  snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+  n = readlink(link, path, sizeof(path) - 1);
+  if (n < 0) {
+    return -1;
+  }
+  path[n] = 0;
+  p = strstr(path, SYSFS "/gpio");
+  if (p == NULL) {
+    errno = EPERM;
+    return -1;
+  }
+
+  efd = eventfd(0, EFD_NONBLOCK);
+  if (efd < 0) {
+    return -1;
+  }
+  g_efd[fd] = efd;
+  g_efd_gpio[fd] = atoi(p + strlen(SYSFS "/gpio"));
+  eev = *ev;
+  eev.events = EPOLLIN | EPOLLET;
+  return __real_epoll_ctl(epfd, op, efd, &eev);
+}
+
+static void write_file(int gpio, const char *attr, const char *val)
+{
+  char path[128];
+  FILE *fp;
+
+  snprintf(path, sizeof(path), SYSFS "/gpio%d/%s", gpio, attr);
+  fp = fopen(path, "w");
+  if (fp == NULL) {
+    perror(path);
+    exit(1);
+  }
+  fputs(val, fp);
+  fclose(fp);
+}
+
+// First word of an attribute; sysfs-style writes do not truncate the file
+static int attr_is(int gpio, const char *attr, const char *val)
+{
+  char path[128], buf[32] = {0};
+  FILE *fp;
+
+  snprintf(path, sizeof(path), SYSFS "/gpio%d/%s", gpio, attr);
+  fp = fopen(path, "r");
+  if (fp == NULL) {
+    return 0;
+  }
+  fread(buf, 1, sizeof(buf) - 1, fp);
+  fclose(fp);
+  return !strncmp(buf, val, strlen(val));
+}
+
+static void make_pin(int gpio, const char *edge, int value)
+{
+  char path[128];
+
+  snprintf(path, sizeof(path), SYSFS "/gpio%d", gpio);
+  mkdir(SYSFS, 0755);
+  mkdir(path, 0755);
+  write_file(gpio, "edge", edge);
+  write_file(gpio, "value", value ? "1\n" : "0\n");
+}
+
+// Set the pin's value and, if notify, raise the edge notification
+static void set_pin(int gpio, int value, int notify)
+{
+  uint64_t one = 1;
+  int fd;
+
+  write_file(gpio, "value", value ? "1\n" : "0\n");
+  if (!notify) {
+    return;
+  }
+  for (fd = 0; fd < MAX_FDS; fd++) {
+    if (g_efd[fd] >= 0 && g_efd_gpio[fd] == gpio) {
+      write(g_efd[fd], &one, sizeof(one));
+    }
+  }
+}
+
+static void handler(int gpio, gpio_value_en last, gpio_value_en curr,
+                    const struct timespec *ts, void *arg)
+{
+  if (g_nevents < MAX_EVENTS) {
+    g_events[g_nevents].gpio = gpio;
+    g_events[g_nevents].last = last;
+    g_events[g_nevents].curr = curr;
+    g_events[g_nevents].ts = *ts;
+  }
+  g_nevents++;
+}
+
+static void check(const char *name, int ok)
+{
+  printf("%s: %s\n", ok ? "PASS" : "FAIL", name);
+  if (!ok) {
+    g_failed = 1;
+  }
+}
+
+static int event_is(int i, int gpio, int last, int curr)
+{
+  return i < g_nevents && g_events[i].gpio == gpio &&
+         g_events[i].last == last && g_events[i].curr == curr;
+}
+
+static void test_edge_restore(void)
+{
+  gpio_watcher_st *w = gpio_watcher_create();
+
+  make_pin(10, "falling\n", 0);
+  make_pin(11, "none\n", 0);
+  check("add", gpio_watcher_add(w, 10, GPIO_EDGE_BOTH, 0, handler, NULL) == 0 &&
+               gpio_watcher_add(w, 11, GPIO_EDGE_RISING, 0, handler, NULL) == 0);
+  check("edge set while watched",
+        attr_is(10, "edge", "both") && attr_is(11, "edge", "rising"));
+  gpio_watcher_remove(w, 10);
+  check("previous edge restored on remove", attr_is(10, "edge", "falling"));
+  gpio_watcher_destroy(w);
+  check("previous edge restored on destroy", attr_is(11, "edge", "none"));
+}
+
+static void test_transitions(void)
+{
+  gpio_watcher_st *w = gpio_watcher_create();
+  gpio_value_en v;
+  int n;
+
+  make_pin(20, "none\n", 0);
+  gpio_watcher_add(w, 20, GPIO_EDGE_BOTH, 0, handler, NULL);
+
+  g_nevents = 0;
+  check("no event without an edge", gpio_watcher_dispatch(w, 0) == 0);
+
+  set_pin(20, 1, 1);
+  n = gpio_watcher_dispatch(w, 100);
+  check("rising transition", n == 1 && event_is(0, 20, 0, 1));
+  check("value tracked",
+        gpio_watcher_value(w, 20, &v) == 0 && v == GPIO_VALUE_HIGH);
+
+  // Pin dropped and came back before it could be read
+  g_nevents = 0;
+  set_pin(20, 1, 1);
+  n = gpio_watcher_dispatch(w, 100);
+  check("short pulse reported as two transitions",
+        n == 2 && event_is(0, 20, 1, 0) && event_is(1, 20, 0, 1));
+
+  gpio_watcher_destroy(w);
+}
+
+static void test_debounce(void)
+{
+  gpio_watcher_st *w = gpio_watcher_create();
+  struct timespec last_edge;
+  int n, total = 0;
+
+  make_pin(30, "none\n", 0);
+  gpio_watcher_add(w, 30, GPIO_EDGE_BOTH, 50, handler, NULL);
+  g_nevents = 0;
+
+  // Bounce: 1, 0, 1 within the window
+  set_pin(30, 1, 1);
+  total += gpio_watcher_dispatch(w, 0);
+  set_pin(30, 0, 1);
+  total += gpio_watcher_dispatch(w, 0);
+  set_pin(30, 1, 1);
+  total += gpio_watcher_dispatch(w, 0);
+  clock_gettime(CLOCK_MONOTONIC, &last_edge);
+  check("nothing reported inside the window", total == 0 && g_nevents == 0);
+  check("timeout covers the window", gpio_watcher_timeout(w) > 0 &&
+                                     gpio_watcher_timeout(w) <= 50);
+
+  n = gpio_watcher_dispatch(w, -1);
+  check("one transition after settling", n == 1 && g_nevents == 1 &&
+                                         event_is(0, 30, 0, 1));
+  check("stamped with the last edge",
+        g_events[0].ts.tv_sec < last_edge.tv_sec ||
+        (g_events[0].ts.tv_sec == last_edge.tv_sec &&
+         g_events[0].ts.tv_nsec <= last_edge.tv_nsec));
+
+  // Bounce that ends where it started reports nothing
+  g_nevents = 0;
+  set_pin(30, 0, 1);
+  gpio_watcher_dispatch(w, 0);
+  set_pin(30, 1, 1);
+  gpio_watcher_dispatch(w, 0);
+  gpio_watcher_dispatch(w, -1);
+  check("glitch filtered", g_nevents == 0);
+
+  gpio_watcher_destroy(w);
+}
+
+int main(int argc, char **argv)
+{
+  memset(g_efd, -1, sizeof(g_efd));
+
+  test_edge_restore();
+  test_transitions();
+  test_debounce();
+
+  system("rm -rf " SYSFS);
+  printf("%s\n", g_failed ? "FAILED" : "PASSED");
+  return g_failed;
+}
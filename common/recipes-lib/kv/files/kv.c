@@ -19,131 +19,65 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
-#include <fcntl.h>
-#include <errno.h>
-#include <syslog.h>
 #include <string.h>
-#include <sys/file.h>
+#include <pthread.h>
 #include "kv.h"
 
-int
-kv_set(char *key, char *value) {
-
-  FILE *fp;
-  int rc;
-  char kpath[MAX_KEY_PATH_LEN] = {0};
-
-  sprintf(kpath, KV_STORE, key);
+/*
+ * Persistent settings live in an edb store; see edb.h.
+ * Use kv_store() with edb_begin()/edb_commit() to update several keys
+ * together.
+ */
+static edb_store_t *store = NULL;
+static pthread_once_t store_once = PTHREAD_ONCE_INIT;
 
-  if (access(KV_STORE_PATH, F_OK) == -1) {
-    mkdir(KV_STORE_PATH, 0777);
-  }
+static void
+kv_open(void) {
+  store = edb_open(KV_STORE_PATH);
+}
 
-  fp = fopen(kpath, "r+");
-  if (!fp && (errno == ENOENT))
-    fp = fopen(kpath, "w");
-  if (!fp) {
-    int err = errno;
-#ifdef DEBUG
-    syslog(LOG_WARNING, "kv_set: failed to open %s", kpath);
-#endif
-    return err;
-  }
+edb_store_t *
+kv_store(void) {
+  pthread_once(&store_once, kv_open);
+  return store;
+}
 
-  rc = flock(fileno(fp), LOCK_EX);
-  if (rc < 0) {
-    int err = errno;
-#ifdef DEBUG
-    syslog(LOG_WARNING, "kv_set: failed to flock on %s, err %d", kpath, err);
-#endif
-    fclose(fp);
-    return -1;
-  }
+int
+kv_set_bin(char *key, void *value, size_t len) {
+  edb_store_t *st = kv_store();
 
-  if (ftruncate(fileno(fp), 0) < 0) {  //truncate cache file after getting flock
-    fclose(fp);
+  if (st == NULL) {
     return -1;
   }
+  return edb_set(st, key, value, len);
+}
 
-  rc = fwrite(value, 1, strlen(value), fp);
-  if (rc < 0) {
-#ifdef DEBUG
-    syslog(LOG_WARNING, "kv_set: failed to write to %s", kpath;
-#endif
-    fclose(fp);
-    return ENOENT;
-  }
-  fflush(fp);
+int
+kv_get_bin(char *key, void *value, size_t *len) {
+  edb_store_t *st = kv_store();
 
-  rc = flock(fileno(fp), LOCK_UN);
-  if (rc < 0) {
-    int err = errno;
-#ifdef DEBUG
-    syslog(LOG_WARNING, "kv_set: failed to unlock flock on %s, err %d", kpath, err);
-#endif
-    fclose(fp);
+  if (st == NULL) {
     return -1;
   }
-
-  fclose(fp);
-
-  return 0;
+  return edb_get(st, key, value, len);
 }
 
+int
+kv_set(char *key, char *value) {
+  return kv_set_bin(key, value, strlen(value));
+}
 
+// value is a MAX_VALUE_LEN buffer; use kv_get_bin() for larger values
 int
 kv_get(char *key, char *value) {
-
-  FILE *fp;
+  size_t len = MAX_VALUE_LEN - 1;
   int rc;
-  char kpath[MAX_KEY_PATH_LEN] = {0};
-
-  sprintf(kpath, KV_STORE, key);
-
-  if (access(KV_STORE_PATH, F_OK) == -1) {
-    mkdir(KV_STORE_PATH, 0777);
-  }
-
-  fp = fopen(kpath, "r");
-  if (!fp) {
-    int err = errno;
-#ifdef DEBUG
-    syslog(LOG_WARNING, "kv_get: failed to open %s, err %d", kpath, err);
-#endif
-    return -1;
-  }
-
-  rc = flock(fileno(fp), LOCK_EX);
-  if (rc < 0) {
-    int err = errno;
-#ifdef DEBUG
-    syslog(LOG_WARNING, "kv_get: failed to flock %s, err %d", kpath, err);
-#endif
-    fclose(fp);
-    return -1;
-  }
 
-  rc = (int) fread(value, 1, MAX_VALUE_LEN, fp);
-  if (rc <= 0) {
-#ifdef DEBUG
-    syslog(LOG_INFO, "kv_get: failed to read %s", kpath);
-#endif
-    fclose(fp);
-    return ENOENT;
+  rc = kv_get_bin(key, value, &len);
+  if (rc) {
+    return rc;
   }
-  value[(rc < MAX_VALUE_LEN)?(rc):(rc-1)] = 0;
-
-  rc = flock(fileno(fp), LOCK_UN);
-  if (rc < 0) {
-    int err = errno;
-#ifdef DEBUG
-    syslog(LOG_WARNING, "kv_get: failed to unlock flock on %s, err %d", kpath, err);
-#endif
-    fclose(fp);
-    return -1;
-  }
-
-  fclose(fp);
+  value[len] = 0;
 
   return 0;
 }
@@ -25,16 +25,16 @@ extern "C" {
 
 #include <stdlib.h>
 #include <stdint.h>
-
-#define MAX_KEY_PATH_LEN  96
-#define MAX_KEY_LEN       64
-#define MAX_VALUE_LEN     64
+#include <openbmc/edb.h>
 
 #define KV_STORE "/mnt/data/kv_store/%s"
 #define KV_STORE_PATH "/mnt/data/kv_store"
 
 int kv_get(char* key, char *value);
 int kv_set(char* key, char *value);
+int kv_get_bin(char *key, void *value, size_t *len);
+int kv_set_bin(char *key, void *value, size_t len);
+edb_store_t *kv_store(void);
 
 #ifdef __cplusplus
 }
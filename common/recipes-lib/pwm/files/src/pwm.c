@@ -0,0 +1,166 @@
+/*
+ * Copyright 2015-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+//#define DEBUG
+
+#include "pwm.h"
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef PWM_SYSFS_DIR
+#define PWM_SYSFS_DIR "/sys/devices/platform/ast_pwm_tacho.0"
+#endif
+
+#define PWM_ATTR_LEN 120
+
+/*
+ * Each attribute is opened once and accessed with pread/pwrite at offset
+ * 0.  A failed access closes it, and the next one reopens it.
+ */
+typedef struct {
+  bool opened;
+  int fd;
+  bool valid;
+  int value;
+  uint64_t stamp;
+} pwm_attr_t;
+
+static const char *pwm_attr_name[PWM_ATTR_CNT] = {
+  "pwm%d_type",
+  "pwm%d_rising",
+  "pwm%d_falling",
+  "pwm%d_en",
+};
+
+static pwm_attr_t pwm_attr[MAX_PWM_NUM][PWM_ATTR_CNT];
+static pwm_attr_t tach_attr[MAX_TACH_NUM];
+
+static uint64_t
+now_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int
+attr_open(pwm_attr_t *attr, const char *name, int num, int flags) {
+  char device_name[32];
+  char full_name[PWM_ATTR_LEN];
+
+  if (attr->opened)
+    return 0;
+
+  snprintf(device_name, sizeof(device_name), name, num);
+  snprintf(full_name, sizeof(full_name), "%s/%s", PWM_SYSFS_DIR,
+           device_name);
+  attr->fd = open(full_name, flags | O_CLOEXEC);
+  if (attr->fd < 0) {
+#ifdef DEBUG
+    syslog(LOG_INFO, "failed to open device %s", full_name);
+#endif
+    return -1;
+  }
+  attr->opened = true;
+
+  return 0;
+}
+
+static void
+attr_close(pwm_attr_t *attr) {
+  close(attr->fd);
+  attr->opened = false;
+  attr->valid = false;
+}
+
+static int
+attr_read(pwm_attr_t *attr, const char *name, int num, int flags, int base,
+          int *value) {
+  char buf[PWM_ATTR_LEN];
+  int len;
+
+  if (attr_open(attr, name, num, flags))
+    return -1;
+
+  len = pread(attr->fd, buf, sizeof(buf) - 1, 0);
+  if (len <= 0) {
+    attr_close(attr);
+    return -1;
+  }
+  buf[len] = '\0';
+  *value = strtol(buf, NULL, base);
+
+  return 0;
+}
+
+/* A value already written less than PWM_CACHE_MS ago is not written again */
+static int
+attr_write(pwm_attr_t *attr, const char *name, int num, int value) {
+  char buf[PWM_ATTR_LEN];
+  int len;
+  uint64_t now = now_ms();
+
+  if (attr->valid && attr->value == value &&
+      now - attr->stamp < PWM_CACHE_MS)
+    return 0;
+
+  if (attr_open(attr, name, num, O_RDWR))
+    return -1;
+
+  len = snprintf(buf, sizeof(buf), "%d", value);
+  if (pwrite(attr->fd, buf, len, 0) != len) {
+    attr_close(attr);
+    return -1;
+  }
+  attr->value = value;
+  attr->valid = true;
+  attr->stamp = now;
+
+  return 0;
+}
+
+int
+pwm_write_attr(int pwm, int id, int value) {
+  if (pwm < 0 || pwm >= MAX_PWM_NUM || id < 0 || id >= PWM_ATTR_CNT)
+    return -1;
+
+  return attr_write(&pwm_attr[pwm][id], pwm_attr_name[id], pwm, value);
+}
+
+int
+pwm_read_attr(int pwm, int id, int base, int *value) {
+  if (pwm < 0 || pwm >= MAX_PWM_NUM || id < 0 || id >= PWM_ATTR_CNT)
+    return -1;
+
+  return attr_read(&pwm_attr[pwm][id], pwm_attr_name[id], pwm, O_RDWR,
+                   base, value);
+}
+
+int
+tach_read_rpm(int tach, int *rpm) {
+  if (tach < 0 || tach >= MAX_TACH_NUM)
+    return -1;
+
+  return attr_read(&tach_attr[tach], "fan%d_input", tach, O_RDONLY, 10, rpm);
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright 2015-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#ifndef PWM_H
+#define PWM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MAX_PWM_NUM 8
+#define MAX_TACH_NUM 16
+
+/*
+ * How long a value written is trusted.  An unchanged setting is rewritten
+ * after this, so one changed by another process is put back.
+ */
+#define PWM_CACHE_MS 10000
+
+enum {
+  PWM_ATTR_TYPE = 0,
+  PWM_ATTR_RISING,
+  PWM_ATTR_FALLING,
+  PWM_ATTR_EN,
+  PWM_ATTR_CNT,
+};
+
+int pwm_write_attr(int pwm, int id, int value);
+int pwm_read_attr(int pwm, int id, int base, int *value);
+int tach_read_rpm(int tach, int *rpm);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif /* PWM_H */
@@ -0,0 +1,258 @@
+/*
+ * Copyright 2015-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Test of the PWM and tach attribute cache against a fake sysfs tree under
+ * ./pwm-test-sysfs (see PWM_SYSFS_DIR in the Makefile).  open, pread and
+ * pwrite are wrapped to count the calls, and clock_gettime to move time
+ * past PWM_CACHE_MS.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "pwm.h"
+
+#define SYSFS "pwm-test-sysfs"
+#define CYCLES 10
+#define FANS 2
+
+int __real_open(const char *path, int flags, ...);
+ssize_t __real_pread(int fd, void *buf, size_t count, off_t offset);
+ssize_t __real_pwrite(int fd, const void *buf, size_t count, off_t offset);
+int __real_clock_gettime(clockid_t clk, struct timespec *ts);
+
+static int g_opens;
+static int g_reads;
+static int g_writes;
+static int g_fail_writes;
+static long g_skew_ms;
+static int g_failed;
+
+static void
+check(const char *name, int ok) {
+  printf("%s: %s\n", ok ? "PASS" : "FAIL", name);
+  if (!ok)
+    g_failed = 1;
+}
+
+int
+__wrap_open(const char *path, int flags, ...) {
+  va_list ap;
+  mode_t mode;
+
+  va_start(ap, flags);
+  mode = va_arg(ap, mode_t);
+  va_end(ap);
+
+  g_opens++;
+  return __real_open(path, flags, mode);
+}
+
+ssize_t
+__wrap_pread(int fd, void *buf, size_t count, off_t offset) {
+  g_reads++;
+  return __real_pread(fd, buf, count, offset);
+}
+
+ssize_t
+__wrap_pwrite(int fd, const void *buf, size_t count, off_t offset) {
+  g_writes++;
+  if (g_fail_writes) {
+    g_fail_writes--;
+    errno = EIO;
+    return -1;
+  }
+  /* sysfs stores the value written; a regular file keeps any longer tail */
+  if (ftruncate(fd, 0) < 0)
+    return -1;
+  return __real_pwrite(fd, buf, count, offset);
+}
+
+int
+__wrap_clock_gettime(clockid_t clk, struct timespec *ts) {
+  int ret = __real_clock_gettime(clk, ts);
+
+  ts->tv_sec += g_skew_ms / 1000;
+  return ret;
+}
+
+static void
+write_attr(const char *name, const char *value) {
+  char path[128];
+  FILE *fp;
+
+  snprintf(path, sizeof(path), SYSFS "/%s", name);
+  fp = fopen(path, "w");
+  if (fp == NULL) {
+    perror(path);
+    exit(1);
+  }
+  fputs(value, fp);
+  fclose(fp);
+}
+
+static int
+attr_is(const char *name, const char *value) {
+  char path[128];
+  char buf[32] = {0};
+  FILE *fp;
+
+  snprintf(path, sizeof(path), SYSFS "/%s", name);
+  fp = fopen(path, "r");
+  if (fp == NULL)
+    return 0;
+  if (fgets(buf, sizeof(buf), fp) == NULL)
+    buf[0] = '\0';
+  fclose(fp);
+  return !strcmp(buf, value);
+}
+
+/* The attribute writes of pal_set_fan_speed() */
+static int
+set_fan(int pwm, int unit) {
+  if (pwm_write_attr(pwm, PWM_ATTR_TYPE, 0) ||
+      pwm_write_attr(pwm, PWM_ATTR_RISING, 0) ||
+      pwm_write_attr(pwm, PWM_ATTR_FALLING, unit) ||
+      pwm_write_attr(pwm, PWM_ATTR_EN, 1))
+    return -1;
+  return 0;
+}
+
+static void
+make_sysfs(void) {
+  char name[32];
+  int i;
+
+  mkdir(SYSFS, 0755);
+  for (i = 0; i < FANS; i++) {
+    snprintf(name, sizeof(name), "pwm%d_type", i);
+    write_attr(name, "0");
+    snprintf(name, sizeof(name), "pwm%d_rising", i);
+    write_attr(name, "0");
+    snprintf(name, sizeof(name), "pwm%d_falling", i);
+    write_attr(name, "0");
+    snprintf(name, sizeof(name), "pwm%d_en", i);
+    write_attr(name, "0");
+  }
+  write_attr("fan3_input", "5400\n");
+}
+
+/*
+ * A control loop setting two fans and reading one PWM back each cycle;
+ * fan 0 changes speed once.  Per call this used to be an fopen and fclose.
+ */
+static void
+test_control_loop(void) {
+  int en, falling;
+  int ok = 1;
+  int i;
+
+  g_opens = g_reads = g_writes = 0;
+  for (i = 0; i < CYCLES; i++) {
+    if (set_fan(0, (i < CYCLES / 2) ? 0x30 : 0x40) || set_fan(1, 0x30))
+      ok = 0;
+    /* The driver shows falling in hex; the fake files hold what was written */
+    if (pwm_read_attr(0, PWM_ATTR_EN, 10, &en) ||
+        pwm_read_attr(0, PWM_ATTR_FALLING, 10, &falling))
+      ok = 0;
+    if (en != 1 || falling != ((i < CYCLES / 2) ? 0x30 : 0x40))
+      ok = 0;
+  }
+
+  printf("%d cycles: %d opens, %d writes, %d preads\n", CYCLES, g_opens,
+         g_writes, g_reads);
+  check("every call succeeds and reads back what was set", ok);
+  check("each attribute is opened once", g_opens == FANS * PWM_ATTR_CNT);
+  check("only changed values are written",
+        g_writes == FANS * PWM_ATTR_CNT + 1);
+  check("the files hold the settings", attr_is("pwm0_falling", "64") &&
+        attr_is("pwm1_falling", "48") && attr_is("pwm0_en", "1"));
+}
+
+/* Another process turns a fan off; the setting comes back after the cache */
+static void
+test_foreign_change(void) {
+  write_attr("pwm1_en", "0");
+
+  g_writes = 0;
+  set_fan(1, 0x30);
+  check("a setting is trusted within PWM_CACHE_MS",
+        g_writes == 0 && attr_is("pwm1_en", "0"));
+
+  g_skew_ms += PWM_CACHE_MS;
+  set_fan(1, 0x30);
+  check("it is written again after PWM_CACHE_MS",
+        g_writes == PWM_ATTR_CNT && attr_is("pwm1_en", "1"));
+}
+
+static void
+test_failed_write(void) {
+  int ret;
+
+  g_opens = g_writes = 0;
+  g_fail_writes = 1;
+  ret = pwm_write_attr(0, PWM_ATTR_FALLING, 0x50);
+  check("a failed write is reported", ret < 0);
+
+  ret = pwm_write_attr(0, PWM_ATTR_FALLING, 0x50);
+  check("the next write reopens the attribute", ret == 0 && g_opens == 1 &&
+        g_writes == 2 && attr_is("pwm0_falling", "80"));
+}
+
+static void
+test_tach(void) {
+  int rpm = 0;
+  int ret;
+
+  g_opens = 0;
+  ret = tach_read_rpm(3, &rpm);
+  check("a tach reads its speed", ret == 0 && rpm == 5400);
+
+  write_attr("fan3_input", "6000\n");
+  ret = tach_read_rpm(3, &rpm);
+  check("later reads see new speeds without reopening", ret == 0 &&
+        rpm == 6000 && g_opens == 1);
+
+  check("a missing tach fails", tach_read_rpm(4, &rpm) < 0);
+  check("out of range numbers fail", tach_read_rpm(MAX_TACH_NUM, &rpm) < 0 &&
+        pwm_write_attr(MAX_PWM_NUM, PWM_ATTR_EN, 1) < 0 &&
+        pwm_write_attr(0, PWM_ATTR_CNT, 1) < 0);
+}
+
+int
+main(void) {
+  system("rm -rf " SYSFS);
+  make_sysfs();
+
+  test_control_loop();
+  test_foreign_change();
+  test_failed_write();
+  test_tach();
+
+  system("rm -rf " SYSFS);
+  printf("%s\n", g_failed ? "FAILED" : "PASSED");
+  return g_failed;
+}
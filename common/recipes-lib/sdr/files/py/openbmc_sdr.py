@@ -0,0 +1,87 @@
+#!/usr/bin/env python
+#
+# Copyright 2015-present Facebook. All Rights Reserved.
+#
+# This program file is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by the
+# Free Software Foundation; version 2 of the License.
+#
+# This program is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+# for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program in a file named COPYING; if not, write to the
+# Free Software Foundation, Inc.,
+# 51 Franklin Street, Fifth Floor,
+# Boston, MA 02110-1301 USA
+#
+
+# ctypes binding of libsdr's bulk sensor snapshot, shared by the REST API
+# and fscd.
+
+from ctypes import *
+
+lpal_hndl = CDLL("libpal.so")
+lsdr_hndl = CDLL("libsdr.so")
+
+MAX_SENSOR_NUM = 0xFF
+
+# Threshold bits of thresh_sensor_t.flag, as named by sensor-util
+SENSOR_THRESH_BITS = [('UCR', 1), ('UNC', 2), ('UNR', 3),
+                      ('LCR', 4), ('LNC', 5), ('LNR', 6)]
+
+class thresh_sensor_t(Structure):
+    _fields_ = [('flag', c_ushort),
+                ('ucr_thresh', c_float),
+                ('unc_thresh', c_float),
+                ('unr_thresh', c_float),
+                ('lcr_thresh', c_float),
+                ('lnc_thresh', c_float),
+                ('lnr_thresh', c_float),
+                ('pos_hyst', c_float),
+                ('neg_hyst', c_float),
+                ('curr_state', c_int),
+                ('name', c_char * 17),
+                ('units', c_char * 64)]
+
+class snr_snapshot_t(Structure):
+    _fields_ = [('num', c_ubyte),
+                ('valid', c_ubyte),
+                ('value', c_float),
+                ('status', c_char * 8),
+                ('thresh', thresh_sensor_t)]
+
+def pal_get_fru_id(fru_name):
+    fru = c_ubyte()
+    p_fru = pointer(fru)
+    ret = lpal_hndl.pal_get_fru_id(c_char_p(fru_name), p_fru)
+    if ret:
+        return None
+    else:
+        return fru.value
+
+# Read all sensors of a FRU in-process through libsdr's bulk snapshot,
+# rather than forking sensor-util and parsing its output.
+def pal_get_fru_sensors(fru_name):
+    fru = pal_get_fru_id(fru_name)
+    if fru is None:
+        return None
+    snrs = (snr_snapshot_t * MAX_SENSOR_NUM)()
+    cnt = lsdr_hndl.sdr_get_fru_snapshot(fru, snrs, MAX_SENSOR_NUM)
+    if cnt < 0:
+        return None
+    result = []
+    for snr in snrs[:cnt]:
+        thresh = {}
+        for (tname, bit) in SENSOR_THRESH_BITS:
+            if snr.thresh.flag & (1 << bit):
+                thresh[tname] = getattr(snr.thresh, tname.lower() + '_thresh')
+        result.append({'num': snr.num,
+                       'name': snr.thresh.name,
+                       'value': snr.value if snr.valid else None,
+                       'units': snr.thresh.units,
+                       'status': snr.status,
+                       'thresholds': thresh})
+    return result
@@ -457,25 +457,23 @@ _sdr_get_snr_thresh(uint8_t fru, sdr_full_t *sdr, uint8_t snr_num,
   return 0;
 }
 
-int
-sdr_get_snr_thresh(uint8_t fru, uint8_t snr_num, thresh_sensor_t *snr) {
+/* Load the FRU's SDRs, waiting for them to become available. */
+static int
+sdr_init_retry(uint8_t fru, sensor_info_t *sinfo) {
 
-  int ret = 0;
-  sdr_full_t *sdr;
+  int ret;
 #ifdef DEBUG
   int cnt = 0;
 #endif /* DEBUG */
   int retry = 0;
 
-  sensor_info_t sinfo[MAX_SENSOR_NUM] = {0};
-
   ret = pal_sensor_sdr_init(fru, sinfo);
 
   while (ret == ERR_NOT_READY) {
 
     if (retry++ > MAX_RETRIES_SDR_INIT) {
       syslog(LOG_INFO, "sdr_get_snr_thresh: failed for fru: %d", fru);
-      return -1;
+      return ERR_NOT_READY;
     }
 #ifdef DEBUG
     syslog(LOG_INFO, "sdr_get_snr_thresh: fru: %d, ret: %d cnt: %d", fru, ret, cnt++);
@@ -484,11 +482,18 @@ sdr_get_snr_thresh(uint8_t fru, uint8_t snr_num, thresh_sensor_t *snr) {
     ret = pal_sensor_sdr_init(fru, sinfo);
   }
 
-  if (ret < 0) {
-    sdr = NULL;
-  } else {
-    sdr = &sinfo[snr_num].sdr;
-  }
+  return ret;
+}
+
+/*
+ * Fill thresh_sensor_t from an SDR already loaded by the caller, or from
+ * the PAL when the FRU has no SDR.
+ */
+static int
+fill_snr_thresh(uint8_t fru, sdr_full_t *sdr, uint8_t snr_num,
+    thresh_sensor_t *snr) {
+
+  int ret;
 
   /* Set all the threshold options set in the flag */
   snr->flag = GETMASK(SENSOR_VALID) | GETMASK(UCR_THRESH) |
@@ -540,3 +545,108 @@ sdr_get_snr_thresh(uint8_t fru, uint8_t snr_num, thresh_sensor_t *snr) {
 
   return ret;
 }
+
+int
+sdr_get_snr_thresh(uint8_t fru, uint8_t snr_num, thresh_sensor_t *snr) {
+
+  int ret = 0;
+  sdr_full_t *sdr;
+
+  sensor_info_t sinfo[MAX_SENSOR_NUM] = {0};
+
+  ret = sdr_init_retry(fru, sinfo);
+  if (ret == ERR_NOT_READY) {
+    return -1;
+  }
+
+  if (ret < 0) {
+    sdr = NULL;
+  } else {
+    sdr = &sinfo[snr_num].sdr;
+  }
+
+  return fill_snr_thresh(fru, sdr, snr_num, snr);
+}
+
+/* Get the threshold status string (ok, ucr, lnc...) of a reading */
+void
+sdr_get_snr_status(float fvalue, thresh_sensor_t *thresh, char *status) {
+
+  if (thresh->flag == 0)
+    sprintf(status, STATUS_NS);
+  else
+    sprintf(status, STATUS_OK);
+
+  if (GETBIT(thresh->flag, UNC_THRESH) && (fvalue >= thresh->unc_thresh))
+    sprintf(status, STATUS_UNC);
+  if (GETBIT(thresh->flag, UCR_THRESH) && (fvalue >= thresh->ucr_thresh))
+    sprintf(status, STATUS_UCR);
+  if (GETBIT(thresh->flag, UNR_THRESH) && (fvalue >= thresh->unr_thresh))
+    sprintf(status, STATUS_UNR);
+  if (GETBIT(thresh->flag, LNC_THRESH) && (fvalue <= thresh->lnc_thresh))
+    sprintf(status, STATUS_LNC);
+  if (GETBIT(thresh->flag, LCR_THRESH) && (fvalue <= thresh->lcr_thresh))
+    sprintf(status, STATUS_LCR);
+  if (GETBIT(thresh->flag, LNR_THRESH) && (fvalue <= thresh->lnr_thresh))
+    sprintf(status, STATUS_LNR);
+}
+
+/*
+ * Read every sensor of a FRU along with its name, units, thresholds and
+ * status in one call. The SDRs are loaded once for the whole FRU instead of
+ * once per sensor. Returns the number of entries filled in, or -1 if the FRU
+ * is absent or not ready.
+ */
+int
+sdr_get_fru_snapshot(uint8_t fru, snr_snapshot_t *snrs, int max_cnt) {
+
+  int i, ret;
+  int sensor_cnt;
+  uint8_t status;
+  uint8_t *sensor_list;
+  sdr_full_t *sdr;
+  snr_snapshot_t *snr;
+
+  sensor_info_t sinfo[MAX_SENSOR_NUM] = {0};
+
+  ret = pal_is_fru_prsnt(fru, &status);
+  if ((ret < 0) || (status == 0)) {
+    return -1;
+  }
+
+  ret = pal_is_fru_ready(fru, &status);
+  if ((ret < 0) || (status == 0)) {
+    return -1;
+  }
+
+  if (pal_get_fru_sensor_list(fru, &sensor_list, &sensor_cnt) < 0) {
+    return -1;
+  }
+
+  ret = sdr_init_retry(fru, sinfo);
+  if (ret == ERR_NOT_READY) {
+    return -1;
+  }
+
+  for (i = 0; i < sensor_cnt && i < max_cnt; i++) {
+    snr = &snrs[i];
+    memset(snr, 0, sizeof(snr_snapshot_t));
+    snr->num = sensor_list[i];
+
+    sdr = (ret < 0) ? NULL : &sinfo[snr->num].sdr;
+    if (fill_snr_thresh(fru, sdr, snr->num, &snr->thresh)) {
+      syslog(LOG_ERR, "sdr_init_snr_thresh failed for FRU %d num: 0x%X",
+          fru, snr->num);
+    }
+
+    if (pal_sensor_read(fru, snr->num, &snr->value) < 0) {
+      snr->valid = 0;
+      sprintf(snr->status, STATUS_NA);
+    } else {
+      snr->valid = 1;
+      sdr_get_snr_status(snr->value, &snr->thresh, snr->status);
+    }
+  }
+
+  return i;
+}
@@ -41,6 +41,16 @@ extern "C" {
 #define CLEARBIT(x, y)      (x & (~(1 << y)))
 #define GETMASK(y)          (1 << y)
 
+#define STATUS_OK   "ok"
+#define STATUS_NS   "ns"
+#define STATUS_NA   "na"
+#define STATUS_UNC  "unc"
+#define STATUS_UCR  "ucr"
+#define STATUS_UNR  "unr"
+#define STATUS_LNC  "lnc"
+#define STATUS_LCR  "lcr"
+#define STATUS_LNR  "lnr"
+
 /* To hold the sensor info and calculated threshold values from the SDR */
 typedef struct {
   uint16_t flag;
@@ -58,6 +68,15 @@ typedef struct {
 
 } thresh_sensor_t;
 
+/* A sensor reading together with its SDR info, as returned in bulk */
+typedef struct {
+  uint8_t num;
+  uint8_t valid;    // 0 if the sensor could not be read
+  float value;
+  char status[8];
+  thresh_sensor_t thresh;
+} snr_snapshot_t;
+
 /* List of all the Sensor Rate Units types. */
 const char * sensor_rate_units[] = {
   "",             /* 0x00 */
@@ -172,6 +191,8 @@ const char * sensor_base_units[] = {
 int sdr_get_sensor_name(uint8_t fru, uint8_t snr_num, char *name);
 int sdr_get_sensor_units(uint8_t fru, uint8_t snr_num, char *units);
 int sdr_get_snr_thresh(uint8_t fru, uint8_t snr_num, thresh_sensor_t *snr);
+void sdr_get_snr_status(float fvalue, thresh_sensor_t *thresh, char *status);
+int sdr_get_fru_snapshot(uint8_t fru, snr_snapshot_t *snrs, int max_cnt);
 
 #ifdef __cplusplus
 } // extern "C"
@@ -0,0 +1,94 @@
+#!/usr/bin/env python
+#
+# Copyright 2016-present Facebook. All Rights Reserved.
+#
+# This program file is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by the
+# Free Software Foundation; version 2 of the License.
+#
+# This program is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+# for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program in a file named COPYING; if not, write to the
+# Free Software Foundation, Inc.,
+# 51 Franklin Street, Fifth Floor,
+# Boston, MA 02110-1301 USA
+#
+
+import hashlib
+import json
+import threading
+import time
+
+# Cache of node.getInformation() results, keyed by node.
+#
+# A node declares how long its information stays fresh through the class
+# attribute cache_ttl (seconds, 0 disables caching). Nodes that are expensive
+# to query can also set cache_refresh; once their entry expires the old
+# result keeps being served while a background thread gathers a new one.
+
+class cacheEntry:
+    def __init__(self):
+        self.info = None
+        self.etag = None
+        self.stamp = 0
+        self.refreshing = False
+        self.lock = threading.Lock()
+
+entries = {}
+entries_lock = threading.Lock()
+
+def make_etag(data):
+    digest = hashlib.md5(json.dumps(data, sort_keys=True)).hexdigest()
+    return '"' + digest + '"'
+
+def get_entry(n):
+    with entries_lock:
+        entry = entries.get(id(n))
+        if entry == None:
+            entry = cacheEntry()
+            entries[id(n)] = entry
+        return entry
+
+def refresh(n, entry):
+    try:
+        info = n.getInformation()
+        etag = make_etag(info)
+    finally:
+        with entry.lock:
+            entry.refreshing = False
+    with entry.lock:
+        entry.info = info
+        entry.etag = etag
+        entry.stamp = time.time()
+    return (info, etag)
+
+# Return (information, etag) for a node, from the cache when still fresh
+def get_information(n):
+    ttl = getattr(n, 'cache_ttl', 0)
+    if not ttl:
+        info = n.getInformation()
+        return (info, make_etag(info))
+
+    entry = get_entry(n)
+    with entry.lock:
+        if entry.info != None:
+            if (time.time() - entry.stamp) < ttl:
+                return (entry.info, entry.etag)
+            if getattr(n, 'cache_refresh', False):
+                if not entry.refreshing:
+                    entry.refreshing = True
+                    t = threading.Thread(target=refresh, args=(n, entry))
+                    t.daemon = True
+                    t.start()
+                return (entry.info, entry.etag)
+
+    return refresh(n, entry)
+
+# Drop a node's cached information, e.g. after an action changed its state
+def invalidate(n):
+    with entries_lock:
+        entries.pop(id(n), None)
@@ -21,6 +21,12 @@
 # Class Definition for Resource
 
 class node:
+    # Seconds a getInformation() result may be served from cache (see
+    # cache.py); 0 disables caching
+    cache_ttl = 0
+    # Refresh an expired entry in the background, serving the old one
+    cache_refresh = False
+
     def __init__(self, info = None, actions = None):
         if info == None:
             self.info = {}
@@ -25,6 +25,10 @@ from pal import *
 from uuid import getnode as get_mac
 
 class bmcNode(node):
+    # Forks several commands per query; serve a recent copy instead
+    cache_ttl = 10
+    cache_refresh = True
+
     def __init__(self, info = None, actions = None):
         if info == None:
             self.info = {}
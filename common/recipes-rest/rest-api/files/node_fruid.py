@@ -22,6 +22,9 @@ from subprocess import *
 from node import node
 
 class fruidNode(node):
+    # FRU contents only change on a FRU update
+    cache_ttl = 60
+
     def __init__(self, name, info = None, actions = None):
         self.name = name
 
@@ -18,13 +18,15 @@
 # Boston, MA 02110-1301 USA
 #
 
-from subprocess import *
 import json
 import os
-import re
 from node import node
+from pal import *
 
 class sensorsNode(node):
+    # sensord samples far less often than collectors poll
+    cache_ttl = 2
+
     def __init__(self, name, info = None, actions = None):
         self.name = name
         if info == None:
@@ -38,21 +40,19 @@ class sensorsNode(node):
 
     def getInformation(self):
         result = {}
-        cmd = '/usr/local/bin/sensor-util ' + self.name
-        data = Popen(cmd, shell=True, stdout=PIPE).stdout.read()
-        sdata = data.split('\n')
-        for line in sdata:
-            # skip lines with " or startin with FRU
-            if line.find("bic_read_sensor_wrapper") != -1:
-                continue
-            if line.find("failed") != -1:
-                continue
-
-            kv = line.split(':')
-            if (len(kv) < 2):
-                continue
+        sensors = pal_get_fru_sensors(self.name)
+        if sensors is None:
+            return result
 
-            result[kv[0].strip()] = kv[1].strip()
+        # Keep the "NAME (0xNUM)": "VALUE UNITS | (status)" layout that was
+        # parsed out of sensor-util before
+        for snr in sensors:
+            key = ('%-18s (0x%X)' % (snr['name'], snr['num'])).strip()
+            if snr['value'] is None:
+                result[key] = 'NA | (na)'
+            else:
+                result[key] = ('%.2f %-5s | (%s)' %
+                    (snr['value'], snr['units'], snr['status'])).strip()
 
         return result
 
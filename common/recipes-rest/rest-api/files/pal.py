@@ -19,6 +19,7 @@
 #
 
 from ctypes import *
+from openbmc_sdr import pal_get_fru_id, pal_get_fru_sensors
 from subprocess import *
 
 lpal_hndl = CDLL("libpal.so")
@@ -27,6 +27,7 @@ import rest_modbus
 import rest_slotid
 import rest_psu_update
 import rest_fcpresent
+from rest_cache import cached
 import bottle
 
 commonApp = bottle.Bottle()
@@ -74,12 +75,14 @@ def rest_mb_sys():
 
 # Handler for sys/mb/fruid resource endpoint
 @commonApp.route('/api/sys/mb/fruid')
+@cached(60)
 def rest_fruid_hdl():
     return rest_fruid.get_fruid()
 
 
 # Handler for sys/bmc resource endpoint
 @commonApp.route('/api/sys/bmc')
+@cached(10, refresh=True)
 def rest_bmc_hdl():
     return rest_bmc.get_bmc()
 
@@ -99,6 +102,7 @@ def rest_server_act_hdl():
 
 # Handler for sensors resource endpoint
 @commonApp.route('/api/sys/sensors')
+@cached(2)
 def rest_sensors_hdl():
     return rest_sensors.get_sensors()
 
@@ -0,0 +1,85 @@
+#!/usr/bin/env python
+#
+# Copyright 2016-present Facebook. All Rights Reserved.
+#
+# This program file is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by the
+# Free Software Foundation; version 2 of the License.
+#
+# This program is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+# for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program in a file named COPYING; if not, write to the
+# Free Software Foundation, Inc.,
+# 51 Franklin Street, Fifth Floor,
+# Boston, MA 02110-1301 USA
+#
+import bottle
+import functools
+import hashlib
+import json
+import threading
+import time
+
+
+# Cache the result of an expensive GET handler for ttl seconds and answer
+# If-None-Match requests with 304 when the result has not changed. With
+# refresh set, an expired result keeps being served while a background
+# thread gathers a new one.
+class cachedHandler(object):
+    def __init__(self, handler, ttl, refresh):
+        self.handler = handler
+        self.ttl = ttl
+        self.refresh = refresh
+        self.result = None
+        self.etag = None
+        self.stamp = 0
+        self.refreshing = False
+        self.lock = threading.Lock()
+
+    def update(self):
+        try:
+            result = self.handler()
+            digest = hashlib.md5(json.dumps(result, sort_keys=True))
+            etag = '"' + digest.hexdigest() + '"'
+        finally:
+            with self.lock:
+                self.refreshing = False
+        with self.lock:
+            self.result = result
+            self.etag = etag
+            self.stamp = time.time()
+        return (result, etag)
+
+    def get(self):
+        with self.lock:
+            if self.result is not None:
+                if (time.time() - self.stamp) < self.ttl:
+                    return (self.result, self.etag)
+                if self.refresh:
+                    if not self.refreshing:
+                        self.refreshing = True
+                        t = threading.Thread(target=self.update)
+                        t.daemon = True
+                        t.start()
+                    return (self.result, self.etag)
+        return self.update()
+
+
+def cached(ttl, refresh=False):
+    def decorator(handler):
+        entry = cachedHandler(handler, ttl, refresh)
+
+        @functools.wraps(handler)
+        def wrapper():
+            (result, etag) = entry.get()
+            bottle.response.set_header('ETag', etag)
+            bottle.response.set_header('Cache-Control', 'max-age=%d' % ttl)
+            if bottle.request.headers.get('If-None-Match') == etag:
+                return bottle.HTTPResponse(status=304, headers={'ETag': etag})
+            return result
+        return wrapper
+    return decorator
@@ -20,22 +20,90 @@
 
 from ctypes import *
 from bottle import route, run, template, request, response, ServerAdapter
-from bottle import abort
+from bottle import abort, default_app
 from wsgiref.simple_server import make_server, WSGIRequestHandler, WSGIServer
+from wsgiref.simple_server import ServerHandler
+import Queue
 import json
 import ssl
 import socket
 import os
+import signal
+import threading
+import time
 from tree import tree
 from node import node
 from plat_tree import init_plat_tree
+import cache
 
 CONSTANTS = {
     'certificate': '/usr/lib/ssl/certs/rest_server.pem',
+    # TODO: Test the https connection with proper certificates
+    'ssl': False,
+    # 'thread' serves connections from a pool of worker threads; 'fork'
+    # runs that many single-threaded server processes on one socket
+    'server_mode': 'thread',
+    'workers': 4,
+    # Seconds an idle keep-alive connection may hold on to a worker
+    'keepalive_timeout': 5,
 }
 
 root = init_plat_tree()
 
+# Request count and latency per endpoint, since this process started.
+# Endpoints are tree nodes or route rules, never the raw request path, so
+# the table cannot grow past the size of the tree.
+class endpointMetrics:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.stats = {}
+
+    def record(self, path, elapsed):
+        with self.lock:
+            s = self.stats.get(path)
+            if s == None:
+                s = self.stats[path] = [0, 0.0, 0.0]
+            s[0] += 1
+            s[1] += elapsed
+            s[2] = max(s[2], elapsed)
+
+    def report(self):
+        result = {}
+        with self.lock:
+            for path, (count, total, worst) in self.stats.items():
+                result[path] = {'count': count,
+                                'avg_ms': round(total * 1000 / count, 2),
+                                'max_ms': round(worst * 1000, 2)}
+        return result
+
+metrics = endpointMetrics()
+
+class MetricsMiddleware(object):
+    def __init__(self, app):
+        self.app = app
+
+    def __call__(self, environ, start_response):
+        start = time.time()
+        try:
+            return self.app(environ, start_response)
+        finally:
+            metrics.record(endpoint_of(environ), time.time() - start)
+
+def endpoint_of(environ):
+    endpoint = environ.get('rest.endpoint')
+    if endpoint:
+        return endpoint
+    route = environ.get('bottle.route')
+    if route and route.rule != '/<path:path>':
+        return route.rule
+    return '<unmatched>'
+
+@route('/metrics')
+def metrics_handler():
+    return {'Information': metrics.report(),
+            'Actions': [],
+            'Resources': []}
+
 # Generic router for incoming requests
 @route('/<path:path>', method='ANY')
 def url_router(path):
@@ -47,13 +115,24 @@ def url_router(path):
         if r == None:
             return r
     c = r.data
+    request.environ['rest.endpoint'] = '/' + path.strip('/')
 
     # Handle GET request
     if request.method == 'GET':
-        # Gather info/actions directly from respective node
-        info = c.getInformation()
+        # Gather info/actions from respective node, or its cached copy
+        (info, etag) = cache.get_information(c)
         actions = c.getActions()
 
+        # Information is the only part that changes, so it alone makes
+        # up the ETag
+        response.set_header('ETag', etag)
+        ttl = getattr(c, 'cache_ttl', 0)
+        if ttl:
+            response.set_header('Cache-Control', 'max-age=%d' % ttl)
+        if request.headers.get('If-None-Match') == etag:
+            response.status = 304
+            return ''
+
         # Create list of resources from tree structure
         resources = []
         ca = r.getChildren()
@@ -67,39 +146,166 @@ def url_router(path):
 
     # Handle POST request
     if request.method == 'POST':
-        return c.doAction(json.load(request.body))
+        result = c.doAction(json.load(request.body))
+        cache.invalidate(c)
+        return result
 
     return None
 
-run(host = "::", port = 8080)
+class KeepAliveServerHandler(ServerHandler):
+    http_version = '1.1'
+
+    def cleanup_headers(self):
+        ServerHandler.cleanup_headers(self)
+        # Without a length the client can only find the end of the body by
+        # seeing the connection close
+        if 'Content-Length' not in self.headers:
+            self.request_handler.close_connection = 1
+        if self.request_handler.close_connection:
+            self.headers['Connection'] = 'close'
+
+# Serve HTTP/1.1 requests on a connection until the client closes it or it
+# sits idle for keepalive_timeout
+class KeepAliveRequestHandler(WSGIRequestHandler):
+    protocol_version = 'HTTP/1.1'
+    timeout = CONSTANTS['keepalive_timeout']
+
+    def handle(self):
+        self.close_connection = 1
+        self.handle_one_request()
+        while not self.close_connection:
+            self.handle_one_request()
+
+    def handle_one_request(self):
+        try:
+            self.raw_requestline = self.rfile.readline(65537)
+        except (socket.timeout, ssl.SSLError):
+            self.close_connection = 1
+            return
+        if not self.raw_requestline:
+            self.close_connection = 1
+            return
+        if len(self.raw_requestline) > 65536:
+            self.send_error(414)
+            return
+        if not self.parse_request():
+            return
+
+        handler = KeepAliveServerHandler(self.rfile, self.wfile,
+                                         self.get_stderr(), self.get_environ())
+        handler.request_handler = self
+        handler.run(self.server.get_app())
+        self.wfile.flush()
 
-# TODO: Test the https connection with proper certificates
-# SSL Wrapper for Rest API
-class SSLWSGIRefServer(ServerAdapter):
+# WSGIServer handing accepted connections to a bounded pool of worker
+# threads, so one slow request no longer holds up every other client
+class PooledWSGIServer(WSGIServer):
+    workers = CONSTANTS['workers']
+    ssl_wrap = None
+
+    def start_workers(self):
+        # Accepting stops once every worker is busy and the backlog is full
+        self.requests = Queue.Queue(self.workers * 4)
+        for i in range(self.workers):
+            t = threading.Thread(target=self.worker)
+            t.daemon = True
+            t.start()
+
+    def serve_forever(self):
+        self.start_workers()
+        WSGIServer.serve_forever(self)
+
+    def process_request(self, request, client_address):
+        self.requests.put((request, client_address))
+
+    def worker(self):
+        while True:
+            (request, client_address) = self.requests.get()
+            try:
+                # TLS handshake happens here rather than in the accept loop
+                if self.ssl_wrap:
+                    request.settimeout(CONSTANTS['keepalive_timeout'])
+                    request = self.ssl_wrap(request)
+                self.finish_request(request, client_address)
+            except Exception:
+                self.handle_error(request, client_address)
+            self.shutdown_request(request)
+
+# One SSL context for all connections, so OpenSSL's server session cache
+# lets returning clients resume instead of doing a full handshake
+def make_ssl_wrap():
+    if hasattr(ssl, 'SSLContext'):
+        ctx = ssl.SSLContext(ssl.PROTOCOL_SSLv23)
+        ctx.load_cert_chain(CONSTANTS['certificate'])
+        return lambda sock: ctx.wrap_socket(sock, server_side=True)
+
+    return lambda sock: ssl.wrap_socket(sock,
+                                        certfile=CONSTANTS['certificate'],
+                                        server_side=True)
+
+# Run the workers as separate processes sharing the listening socket, and
+# restart any that exit
+def serve_prefork(srv, nproc):
+    children = set()
+
+    def spawn():
+        pid = os.fork()
+        if pid == 0:
+            # The supervisor's handlers would kill our siblings
+            signal.signal(signal.SIGTERM, signal.SIG_DFL)
+            signal.signal(signal.SIGINT, signal.SIG_DFL)
+            srv.workers = 1
+            srv.serve_forever()
+            os._exit(0)
+        children.add(pid)
+
+    def stop(signum, frame):
+        for pid in children:
+            try:
+                os.kill(pid, signal.SIGTERM)
+            except OSError:
+                pass
+        os._exit(0)
+
+    signal.signal(signal.SIGTERM, stop)
+    signal.signal(signal.SIGINT, stop)
+    for i in range(nproc):
+        spawn()
+    while True:
+        try:
+            (pid, status) = os.wait()
+        except OSError:
+            time.sleep(1)
+            continue
+        if pid in children:
+            children.discard(pid)
+            time.sleep(1)
+            spawn()
+
+class PooledWSGIRefServer(ServerAdapter):
     def run(self, handler):
-        if self.quiet:
-            class QuietHandler(WSGIRequestHandler):
-                def log_request(*args, **kw): pass
-            self.options['handler_class'] = QuietHandler
+        server_cls = PooledWSGIServer
 
         # IPv6 Support
-        server_cls = self.options.get('server_class', WSGIServer)
-
         if ':' in self.host:
-            if getattr(server_cls, 'address_family') == socket.AF_INET:
-                class server_cls(server_cls):
-                    address_family = socket.AF_INET6
+            class server_cls(PooledWSGIServer):
+                address_family = socket.AF_INET6
 
         srv = make_server(self.host, self.port, handler,
-                server_class=server_cls, **self.options)
-        srv.socket = ssl.wrap_socket (
-                srv.socket,
-                certfile=CONSTANTS['certificate'],
-                server_side=True)
-        srv.serve_forever()
-
-# Use SSL if the certificate exists. Otherwise, run without SSL.
-if os.access(CONSTANTS['certificate'], os.R_OK):
-    run(server=SSLWSGIRefServer(host="::", port=8443))
+                server_class=server_cls,
+                handler_class=KeepAliveRequestHandler)
+        if self.options.get('ssl'):
+            srv.ssl_wrap = make_ssl_wrap()
+
+        if CONSTANTS['server_mode'] == 'fork':
+            serve_prefork(srv, CONSTANTS['workers'])
+        else:
+            srv.serve_forever()
+
+app = MetricsMiddleware(default_app())
+
+# Use SSL if enabled and the certificate exists. Otherwise, run without SSL.
+if CONSTANTS['ssl'] and os.access(CONSTANTS['certificate'], os.R_OK):
+    run(app=app, server=PooledWSGIRefServer(host="::", port=8443, ssl=True))
 else:
-    run(host = "::", port = 8080)
+    run(app=app, server=PooledWSGIRefServer(host="::", port=8080))
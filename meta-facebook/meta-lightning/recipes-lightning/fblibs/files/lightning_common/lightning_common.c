@@ -29,6 +29,8 @@
 #include <syslog.h>
 #include <pthread.h>
 #include <string.h>
+#include <unistd.h>
+#include <facebook/i2c-dev.h>
 #include "lightning_common.h"
 
 #define CRASHDUMP_BIN       "/usr/local/bin/dump.sh"
@@ -38,6 +40,23 @@
 #define SSD_SKU_INFO        "/tmp/ssd_sku_info"
 #define SSD_VENDOR_INFO     "/tmp/ssd_vendor"
 #define PATH_LENGTH         16
+#define I2C_DEV             "/dev/i2c-%d"
+
+/*
+ * One descriptor per I2C bus, opened on first use and kept for the life of
+ * the process.  The slave address last selected on it is remembered so the
+ * I2C_SLAVE ioctl is only issued when the address changes.  The lock is
+ * held from lightning_i2c_get() to lightning_i2c_put() so threads sharing
+ * a bus cannot retarget each other's transfers.
+ */
+typedef struct {
+  pthread_mutex_t lock;
+  int fd;
+  int addr;
+} i2c_handle_t;
+
+static i2c_handle_t i2c_handles[LIGHTNING_MAX_I2C_BUS];
+static pthread_once_t i2c_handles_once = PTHREAD_ONCE_INIT;
 
 int
 lightning_common_fru_name(uint8_t fru, char *str) {
@@ -193,3 +212,63 @@ lightning_ssd_vendor(uint8_t *ssd_vendor) {
   return 0;
 }
 
+static void
+i2c_handles_init(void) {
+  int i;
+
+  for (i = 0; i < LIGHTNING_MAX_I2C_BUS; i++) {
+    pthread_mutex_init(&i2c_handles[i].lock, NULL);
+    i2c_handles[i].fd = -1;
+    i2c_handles[i].addr = -1;
+  }
+}
+
+/*
+ * Get the descriptor for an I2C bus with the given slave address selected.
+ * On success the bus stays locked until lightning_i2c_put(); on failure
+ * -1 is returned and nothing needs to be released.
+ */
+int
+lightning_i2c_get(uint8_t bus, uint8_t addr) {
+  i2c_handle_t *h;
+  char path[PATH_LENGTH];
+
+  if (bus >= LIGHTNING_MAX_I2C_BUS) {
+    syslog(LOG_DEBUG, "%s(): invalid bus %d", __func__, bus);
+    return -1;
+  }
+
+  pthread_once(&i2c_handles_once, i2c_handles_init);
+  h = &i2c_handles[bus];
+  pthread_mutex_lock(&h->lock);
+
+  if (h->fd < 0) {
+    snprintf(path, sizeof(path), I2C_DEV, bus);
+    h->fd = open(path, O_RDWR | O_CLOEXEC);
+    if (h->fd < 0) {
+      syslog(LOG_DEBUG, "%s(): open() %s failed", __func__, path);
+      pthread_mutex_unlock(&h->lock);
+      return -1;
+    }
+    h->addr = -1;
+  }
+
+  if (h->addr != addr) {
+    if (ioctl(h->fd, I2C_SLAVE, addr) < 0) {
+      syslog(LOG_DEBUG, "%s(): ioctl() assigning i2c addr 0x%x failed",
+          __func__, addr);
+      h->addr = -1;
+      pthread_mutex_unlock(&h->lock);
+      return -1;
+    }
+    h->addr = addr;
+  }
+
+  return h->fd;
+}
+
+/* Release a bus obtained with lightning_i2c_get() */
+void
+lightning_i2c_put(uint8_t bus) {
+  pthread_mutex_unlock(&i2c_handles[bus].lock);
+}
@@ -51,11 +51,15 @@ enum {
   SAMSUNG,
 };
 
+#define LIGHTNING_MAX_I2C_BUS 16
+
 int lightning_common_fru_name(uint8_t fru, char *str);
 int lightning_common_fru_id(char *str, uint8_t *fru);
 int lightning_pcie_switch(uint8_t fru, uint8_t *pcie_sw);
 int lightning_ssd_sku(uint8_t *ssd_sku);
 int lightning_ssd_vendor(uint8_t *ssd_vendor);
+int lightning_i2c_get(uint8_t bus, uint8_t addr);
+void lightning_i2c_put(uint8_t bus);
 
 #ifdef __cplusplus
 } // extern "C"
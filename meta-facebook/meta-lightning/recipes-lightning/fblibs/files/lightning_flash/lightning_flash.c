@@ -22,10 +22,11 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <facebook/i2c-dev.h>
+#include <facebook/lightning_common.h>
 #include "lightning_flash.h"
 
-#define I2C_DEV_FLASH1 "/dev/i2c-7"
-#define I2C_DEV_FLASH2 "/dev/i2c-8"
+#define I2C_BUS_FLASH1 7
+#define I2C_BUS_FLASH2 8
 #define I2C_FLASH_ADDR 0x1b
 #define NVME_STATUS_CMD 0x5
 #define I2C_M2CARD_AMB_ADDR 0x4c
@@ -56,6 +57,29 @@ const uint8_t lightning_flash_list[] = {
 
 size_t lightning_flash_cnt = sizeof(lightning_flash_list) / sizeof(uint8_t);
 
+/* Get the bus behind a flash mux with the given slave selected on it */
+static int
+flash_i2c_get(uint8_t mux, uint8_t addr, uint8_t *bus) {
+  int dev;
+
+  if (mux == I2C_MUX_FLASH1)
+    *bus = I2C_BUS_FLASH1;
+  else if (mux == I2C_MUX_FLASH2)
+    *bus = I2C_BUS_FLASH2;
+  else {
+    syslog(LOG_DEBUG, "%s(): unknown mux", __func__);
+    return -1;
+  }
+
+  dev = lightning_i2c_get(*bus, addr);
+  if (dev < 0) {
+    syslog(LOG_DEBUG, "%s(): selecting i2c device 0x%x failed", __func__, addr);
+    return -1;
+  }
+
+  return dev;
+}
+
 // TODO: Need to change the lightning_flash_status_read to read SSD status
 // data and not just Temperature Data.
 
@@ -68,7 +92,7 @@ lightning_flash_status_read(uint8_t i2c_map, uint16_t *status) {
   int32_t res;
   uint8_t mux;
   uint8_t chan;
-  char bus[32];
+  uint8_t bus;
 
   mux = i2c_map / 10;
   chan = i2c_map % 10;
@@ -79,33 +103,15 @@ lightning_flash_status_read(uint8_t i2c_map, uint16_t *status) {
     return -1;
   }
 
-  if (mux == I2C_MUX_FLASH1)
-    sprintf(bus, "%s", I2C_DEV_FLASH1);
-  else if (mux == I2C_MUX_FLASH2)
-    sprintf(bus, "%s", I2C_DEV_FLASH2);
-  else {
-    syslog(LOG_DEBUG, "%s(): unknown mux", __func__);
-    return -1;
-  }
-
-  dev = open(bus, O_RDWR);
+  dev = flash_i2c_get(mux, I2C_FLASH_ADDR, &bus);
   if (dev < 0) {
-    syslog(LOG_DEBUG, "%s(): open() failed", __func__);
-    return -1;
-  }
-
-  /* Assign the i2c device address */
-  ret = ioctl(dev, I2C_SLAVE, I2C_FLASH_ADDR);
-  if (ret < 0) {
-    syslog(LOG_DEBUG, "%s(): ioctl() assigning i2c addr failed", __func__);
-    close(dev);
     return -1;
   }
 
   /* Read the Status from the NVMe device */
   res = i2c_smbus_read_word_data(dev, NVME_STATUS_CMD);
+  lightning_i2c_put(bus);
   if (res < 0) {
-    close(dev);
     syslog(LOG_DEBUG, "%s(): i2c_smbus_read_block_data failed", __func__);
     return -1;
   }
@@ -113,8 +119,6 @@ lightning_flash_status_read(uint8_t i2c_map, uint16_t *status) {
   // Return only the word
   *status = (res & 0xFF00) >> 8 | (res & 0xFF) << 8;
 
-  close(dev);
-
   return 0;
 }
 
@@ -148,22 +152,14 @@ lightning_flash_temp_read(uint8_t i2c_map, float *temp) {
   return 0;
 }
 
-int 
-lightning_u2_flash_temp_read(uint8_t i2c_map, float *temp) {
+/* U.2 temperature, with the 1-level mux already on the flash's channel */
+static int
+u2_flash_temp_read(uint8_t i2c_map, float *temp) {
 
   int ret;
   uint8_t mux;
-  uint8_t chan;
   uint8_t vendor;
   mux = i2c_map / 10;
-  chan = i2c_map % 10;
-  
-  /* Set 1-level mux */
-  ret = lightning_flash_mux_sel_chan(mux, chan);
-  if(ret < 0) {
-    syslog(LOG_DEBUG, "%s(): lightning_flash_mux_sel_chan on Mux %d failed", __func__, mux);
-    return -1;
-  }
 
   // Get temp reading via NVME
   ret = lightning_nvme_temp_read(mux, temp);
@@ -196,6 +192,25 @@ lightning_u2_flash_temp_read(uint8_t i2c_map, float *temp) {
   return 0;
 }
 
+int 
+lightning_u2_flash_temp_read(uint8_t i2c_map, float *temp) {
+
+  int ret;
+  uint8_t mux;
+  uint8_t chan;
+  mux = i2c_map / 10;
+  chan = i2c_map % 10;
+  
+  /* Set 1-level mux */
+  ret = lightning_flash_mux_sel_chan(mux, chan);
+  if(ret < 0) {
+    syslog(LOG_DEBUG, "%s(): lightning_flash_mux_sel_chan on Mux %d failed", __func__, mux);
+    return -1;
+  }
+
+  return u2_flash_temp_read(i2c_map, temp);
+}
+
 /* Enable the mux to select a particular channel */
 int
 lightning_flash_mux_sel_chan(uint8_t mux, uint8_t channel) {
@@ -204,22 +219,7 @@ lightning_flash_mux_sel_chan(uint8_t mux, uint8_t channel) {
   int ret;
   uint8_t addr;
   uint8_t chan_en;
-  char bus[32];
-
-  if (mux == I2C_MUX_FLASH1)
-    sprintf(bus, "%s", I2C_DEV_FLASH1);
-  else if (mux == I2C_MUX_FLASH2)
-    sprintf(bus, "%s", I2C_DEV_FLASH2);
-  else {
-    syslog(LOG_DEBUG, "%s(): unknown mux", __func__);
-    return -1;
-  }
-
-  dev = open(bus, O_RDWR);
-  if (dev < 0) {
-    syslog(LOG_DEBUG, "%s(): open() failed", __func__);
-    return -1;
-  }
+  uint8_t bus;
 
   switch(mux) {
     case I2C_MUX_FLASH1:
@@ -231,26 +231,25 @@ lightning_flash_mux_sel_chan(uint8_t mux, uint8_t channel) {
       addr = I2C_MUX_FLASH2_ADDR,
       chan_en = (1 << 3) | channel;
       break;
+
+    default:
+      syslog(LOG_DEBUG, "%s(): unknown mux", __func__);
+      return -1;
   }
 
-  /* Assign the i2c device address */
-  ret = ioctl(dev, I2C_SLAVE, addr);
-  if (ret < 0) {
-    syslog(LOG_DEBUG, "%s(): ioctl() assigning i2c addr failed", __func__);
-    close(dev);
+  dev = flash_i2c_get(mux, addr, &bus);
+  if (dev < 0) {
     return -1;
   }
 
   /* Write the channel number to enable it */
   ret = i2c_smbus_write_byte(dev, chan_en);
+  lightning_i2c_put(bus);
   if (ret < 0) {
     syslog(LOG_DEBUG, "%s(): i2c_smbus_write_byte failed", __func__);
-    close(dev);
     return -1;
   }
 
-  close(dev);
-
   return 0;
 }
 
@@ -259,96 +258,45 @@ lightning_flash_sec_mux_sel_chan(uint8_t mux, uint8_t channel) {
 
   int dev;
   int ret;
-  char bus[32];
+  uint8_t bus;
 
-  if (mux == I2C_MUX_FLASH1)
-    sprintf(bus, "%s", I2C_DEV_FLASH1);
-  else if (mux == I2C_MUX_FLASH2)
-    sprintf(bus, "%s", I2C_DEV_FLASH2);
-  else {
-    syslog(LOG_DEBUG, "%s(): unknown mux", __func__);
-    return -1;
-  }
-
-  dev = open(bus, O_RDWR);
+  /* Select the 2-level mux */
+  dev = flash_i2c_get(mux, I2C_M2_MUX_ADDR, &bus);
   if (dev < 0) {
-    syslog(LOG_DEBUG, "%s(): open() failed", __func__);
     return -1;
   }
 
-  /* Assign the 2-level mux address */
-  ret = ioctl(dev, I2C_SLAVE, I2C_M2_MUX_ADDR);
-  if (ret < 0) {
-    syslog(LOG_DEBUG, "%s(): ioctl() assigning i2c addr failed", __func__);
-    close(dev);
-    return -1;
-  }
-
-
   /* Write the channel number to enable it */
   ret = i2c_smbus_write_byte(dev, channel);
+  lightning_i2c_put(bus);
   if (ret < 0) {
     syslog(LOG_DEBUG, "%s(): i2c_smbus_write_byte failed", __func__);
-    close(dev);
     return -1;
   }
 
-  close(dev);
-
   return 0;
 }
 
-int 
-lightning_m2_amb_temp_read(uint8_t i2c_map, float *temp) {
+/* M.2 card ambient temperature, with the 1-level mux already selected */
+static int
+m2_amb_temp_read(uint8_t mux, float *temp) {
 
   int dev;
-  int ret;
   int32_t res;
-  uint8_t mux;
-  uint8_t chan;
-  char bus[32];
+  uint8_t bus;
 
-  mux = i2c_map / 10;
-  chan = i2c_map % 10;
-
-  ret = lightning_flash_mux_sel_chan(mux, chan);
-  if(ret < 0) {
-    syslog(LOG_DEBUG, "%s(): lightning_flash_mux_sel_chan on Mux %d failed", __func__, mux);
-    return -1;
-  }
-
-  if (mux == I2C_MUX_FLASH1)
-    sprintf(bus, "%s", I2C_DEV_FLASH1);
-  else if (mux == I2C_MUX_FLASH2)
-    sprintf(bus, "%s", I2C_DEV_FLASH2);
-  else {
-    syslog(LOG_DEBUG, "%s(): unknown mux", __func__);
-    return -1;
-  }
-
-  dev = open(bus, O_RDWR);
+  dev = flash_i2c_get(mux, I2C_M2CARD_AMB_ADDR, &bus);
   if (dev < 0) {
-    syslog(LOG_DEBUG, "%s(): open() failed", __func__);
-    return -1;
-  }
-
-  /* Assign the i2c device address */
-  ret = ioctl(dev, I2C_SLAVE, I2C_M2CARD_AMB_ADDR);
-  if (ret < 0) {
-    syslog(LOG_DEBUG, "%s(): ioctl() assigning i2c addr failed", __func__);
-    close(dev);
     return -1;
   }
 
   /* Read the ambient temp */
   res = i2c_smbus_read_word_data(dev, M2CARD_AMB_TEMP_REG);
+  lightning_i2c_put(bus);
   if (res < 0) {
-    close(dev);
     syslog(LOG_DEBUG, "%s(): i2c_smbus_read_block_data failed", __func__);
     return -1;
   }
-  
-  close(dev);
 
   /* Result is read as MSB byte first and LSB byte second.
    * Result is 12bit with res[11:4]  == MSB[7:0] and res[3:0] = LSB */
@@ -371,20 +319,63 @@ lightning_m2_amb_temp_read(uint8_t i2c_map, float *temp) {
 }
 
 int 
-lightning_m2_flash_temp_read(uint8_t i2c_map, float *temp) {
+lightning_m2_amb_temp_read(uint8_t i2c_map, float *temp) {
+
+  int ret;
+  uint8_t mux;
+  uint8_t chan;
+
+  mux = i2c_map / 10;
+  chan = i2c_map % 10;
+
+  ret = lightning_flash_mux_sel_chan(mux, chan);
+  if(ret < 0) {
+    syslog(LOG_DEBUG, "%s(): lightning_flash_mux_sel_chan on Mux %d failed", __func__, mux);
+    return -1;
+  }
+
+  return m2_amb_temp_read(mux, temp);
+}
+
+/* Temperature of one M.2 device, with the 1-level mux already selected */
+static int
+m2_temp_read(uint8_t mux, uint8_t m2_mux_chan, float *temp) {
+
+  int ret;
+
+  /* Set 2-level mux */
+  ret = lightning_flash_sec_mux_sel_chan(mux, m2_mux_chan);
+  if(ret < 0) {
+    syslog(LOG_DEBUG, "%s(): lightning_flash_sec_mux_sel_chan on Mux %d failed", __func__, mux);
+    return -1;
+  }
+
+  ret = lightning_nvme_temp_read(mux, temp);
+  
+  if(ret < 0) {
+    syslog(LOG_DEBUG, "%s(): lightning_nvme_temp_read failed", __func__);
+    return -1;
+  }
+
+  return 0;
+}
+
+/* Hotter of the two M.2 devices on a card, 1-level mux already selected */
+static int
+m2_flash_temp_read(uint8_t mux, float *temp) {
 
   float temp1;
   float temp2;
   int ret;
 
   /* read the M.2 temp on channel 0 */
-  ret = lightning_m2_temp_read(i2c_map, M2_MUX_CHANNEL_0, &temp1);
+  ret = m2_temp_read(mux, M2_MUX_CHANNEL_0, &temp1);
   if(ret < 0) {
     syslog(LOG_DEBUG, "%s(): lightning_m2_temp_read on channel 0 failed", __func__);
     return -1;
   }
   /* read the M.2 temp on channel 1 */
-  ret = lightning_m2_temp_read(i2c_map, M2_MUX_CHANNEL_1, &temp2);
+  ret = m2_temp_read(mux, M2_MUX_CHANNEL_1, &temp2);
    if(ret < 0) {
     syslog(LOG_DEBUG, "%s(): lightning_m2_temp_read on channel 1 failed", __func__);
     return -1;
@@ -397,80 +388,124 @@ lightning_m2_flash_temp_read(uint8_t i2c_map, float *temp) {
 }
 
 int 
-lightning_m2_temp_read(uint8_t i2c_map, uint8_t m2_mux_chan, float *temp) {
+lightning_m2_flash_temp_read(uint8_t i2c_map, float *temp) {
 
   int ret;
   uint8_t mux;
   uint8_t chan;
-  char bus[32];
 
   mux = i2c_map / 10;
   chan = i2c_map % 10;
 
-  /* Set 1-level mux */
+  /* Set 1-level mux once for both devices on the card */
   ret = lightning_flash_mux_sel_chan(mux, chan);
   if(ret < 0) {
     syslog(LOG_DEBUG, "%s(): lightning_flash_mux_sel_chan on Mux %d failed", __func__, mux);
     return -1;
   }
 
-  /* Set 2-level mux */
-  ret = lightning_flash_sec_mux_sel_chan(mux, m2_mux_chan);
+  return m2_flash_temp_read(mux, temp);
+}
+
+int 
+lightning_m2_temp_read(uint8_t i2c_map, uint8_t m2_mux_chan, float *temp) {
+
+  int ret;
+  uint8_t mux;
+  uint8_t chan;
+
+  mux = i2c_map / 10;
+  chan = i2c_map % 10;
+
+  /* Set 1-level mux */
+  ret = lightning_flash_mux_sel_chan(mux, chan);
   if(ret < 0) {
-    syslog(LOG_DEBUG, "%s(): lightning_flash_sec_mux_sel_chan on Mux %d failed", __func__, mux);
+    syslog(LOG_DEBUG, "%s(): lightning_flash_mux_sel_chan on Mux %d failed", __func__, mux);
     return -1;
   }
 
-  ret = lightning_nvme_temp_read(mux, temp);
-  
-  if(ret < 0) {
-    syslog(LOG_DEBUG, "%s(): lightning_nvme_temp_read failed", __func__);
+  return m2_temp_read(mux, m2_mux_chan, temp);
+}
+
+/*
+ * Read every flash temperature and, on M.2 SKUs, every card's ambient
+ * temperature in one pass.  Flashes are visited in mux/channel order and
+ * each 1-level channel is selected once; every device behind it is read
+ * before moving on.  readings[] is indexed like lightning_flash_list[].
+ */
+int
+lightning_flash_sweep(uint8_t sku, lightning_flash_reading_t *readings) {
+
+  uint8_t order[LIGHTNING_MAX_FLASH];
+  int sel_chan[I2C_MUX_FLASH2 + 1] = {-1, -1};
+  lightning_flash_reading_t *r;
+  uint8_t mux;
+  uint8_t chan;
+  uint8_t tmp;
+  int i, j;
+
+  if (sku != U2_SKU && sku != M2_SKU) {
+    syslog(LOG_DEBUG, "%s(): unknown ssd sku", __func__);
     return -1;
   }
 
+  for (i = 0; i < lightning_flash_cnt; i++) {
+    order[i] = i;
+    for (j = i; j > 0 &&
+         lightning_flash_list[order[j]] < lightning_flash_list[order[j-1]]; j--) {
+      tmp = order[j];
+      order[j] = order[j-1];
+      order[j-1] = tmp;
+    }
+  }
+
+  for (i = 0; i < lightning_flash_cnt; i++) {
+    r = &readings[order[i]];
+    r->temp_ret = -1;
+    r->amb_ret = -1;
+
+    mux = lightning_flash_list[order[i]] / 10;
+    chan = lightning_flash_list[order[i]] % 10;
+
+    if (sel_chan[mux] != chan) {
+      if (lightning_flash_mux_sel_chan(mux, chan) < 0) {
+        syslog(LOG_DEBUG, "%s(): lightning_flash_mux_sel_chan on Mux %d failed", __func__, mux);
+        sel_chan[mux] = -1;
+        continue;
+      }
+      sel_chan[mux] = chan;
+    }
+
+    if (sku == U2_SKU) {
+      r->temp_ret = u2_flash_temp_read(lightning_flash_list[order[i]], &r->temp);
+    } else {
+      r->amb_ret = m2_amb_temp_read(mux, &r->amb);
+      r->temp_ret = m2_flash_temp_read(mux, &r->temp);
+    }
+  }
+
   return 0;
 }
 
 int 
 lightning_nvme_temp_read(uint8_t mux, float *temp) {
   int dev;
-  int ret;
   int32_t res;
-  char bus[32];
+  uint8_t bus;
 
-  if (mux == I2C_MUX_FLASH1)
-    sprintf(bus, "%s", I2C_DEV_FLASH1);
-  else if (mux == I2C_MUX_FLASH2)
-    sprintf(bus, "%s", I2C_DEV_FLASH2);
-  else {
-    syslog(LOG_DEBUG, "%s(): unknown mux", __func__);
-    return -1;
-  }
-
-  dev = open(bus, O_RDWR);
+  dev = flash_i2c_get(mux, I2C_NVME_INTF_ADDR, &bus);
   if (dev < 0) {
-    syslog(LOG_DEBUG, "%s(): open() failed", __func__);
-    return -1;
-  }
-
-  /* Assign the i2c device address */
-  ret = ioctl(dev, I2C_SLAVE, I2C_NVME_INTF_ADDR);
-  if (ret < 0) {
-    syslog(LOG_DEBUG, "%s(): ioctl() assigning i2c addr failed", __func__);
-    close(dev);
     return -1;
   }
 
   res = i2c_smbus_read_byte_data(dev, NVME_TEMP_REG);
+  lightning_i2c_put(bus);
   if (res < 0) {
     syslog(LOG_DEBUG, "%s(): i2c_smbus_read_byte_data failed", __func__);
-    close(dev);
     return -1;
   }
 
   *temp = (float) res;
-  
-  close(dev);
 
   return 0;
 }
@@ -63,6 +63,16 @@ enum i2c_flash_map {
 };
 
 
+#define LIGHTNING_MAX_FLASH 15
+
+/* One flash's results from lightning_flash_sweep() */
+typedef struct {
+  int temp_ret;   // 0 when temp is valid
+  float temp;
+  int amb_ret;    // 0 when amb is valid; M.2 SKU only
+  float amb;
+} lightning_flash_reading_t;
+
 extern const uint8_t lightning_flash_list[];
 
 extern size_t lightning_flash_cnt;
@@ -75,6 +85,7 @@ int lightning_m2_flash_temp_read(uint8_t i2c_map, float *temp);
 int lightning_m2_temp_read(uint8_t i2c_map, uint8_t sec_chan, float *temp);
 int lightning_u2_flash_temp_read(uint8_t i2c_map, float *temp);
 int lightning_nvme_temp_read(uint8_t mux, float *temp);
+int lightning_flash_sweep(uint8_t sku, lightning_flash_reading_t *readings);
 
 #ifdef __cplusplus
 } // extern "C"
@@ -28,14 +28,16 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <syslog.h>
+#include <time.h>
+#include <pthread.h>
 #include <facebook/i2c-dev.h>
 #include "lightning_sensor.h"
 
 #define LARGEST_DEVICE_NAME 128
 
-#define I2C_DEV_PEB       "/dev/i2c-4"
-#define I2C_DEV_PDPB      "/dev/i2c-6"
-#define I2C_DEV_FCB       "/dev/i2c-5"
+#define I2C_BUS_PEB       4
+#define I2C_BUS_PDPB      6
+#define I2C_BUS_FCB       5
 
 #define I2C_BUS_PEB_DIR "/sys/class/i2c-adapter/i2c-4/"
 #define I2C_BUS_PDPB_DIR "/sys/class/i2c-adapter/i2c-6/"
@@ -55,7 +57,20 @@
 
 #define TPM75_TEMP_RESOLUTION 0.0625
 
+#define SSD_SWEEP_INTERVAL_MS 1000
+
+#define NCT7904_LEASE_WAIT_MS 300   // Longest wait for the peer tray
+#define NCT7904_LEASE_POLL_MS 10
+#define NCT7904_LEASE_CONFIRM_MS 2  // > the peer's flag read-to-write gap
+#define NCT7904_SNAPSHOT_MS 1000
+
 #define ADS1015_DEFAULT_CONFIG 0xe383
+#define ADS1015_MODE_SINGLE 0x0001
+#define ADS1015_CONT_CONFIG (ADS1015_DEFAULT_CONFIG & ~ADS1015_MODE_SINGLE)
+#define ADS1015_MUX_MODE_MASK 0x0071
+#define ADS1015_SETTLE_MS 1       // > one conversion at 3300 SPS
+#define ADS1015_MAX_AGE_MS 2000   // Oldest sample served: one sensord period
+#define ADS1015_MAX_CHANNELS 8
 
 #define MAX_SENSOR_NUM 0xFF
 #define ALL_BYTES 0xFF
@@ -128,6 +143,70 @@ enum ads1015_channels {
   ADS1015_CHANNEL7,
 };
 
+/*
+ * An ADS1015 left in continuous-conversion mode.  The multiplexer cycles
+ * through the channels in use; every read banks the conversion of the
+ * channel currently selected and moves on to the next one.
+ */
+typedef struct {
+  uint8_t bus;
+  uint8_t addr;
+  const uint8_t *channels;    // Channels in use, in the order they are read
+  int channel_cnt;
+  int cur;                    // Channel being converted, -1 if unknown
+  uint64_t switched;          // When cur was selected
+  float value[ADS1015_MAX_CHANNELS];
+  uint64_t stamp[ADS1015_MAX_CHANNELS];
+  pthread_mutex_t lock;
+} ads1015_sampler_t;
+
+static const uint8_t pdpb_adc_channels[] = {
+  ADS1015_CHANNEL4,   // P12V
+  ADS1015_CHANNEL6,   // P3V3
+};
+
+static ads1015_sampler_t pdpb_adc = {
+  .bus = I2C_BUS_PDPB,
+  .addr = I2C_ADDR_PDPB_ADC,
+  .channels = pdpb_adc_channels,
+  .channel_cnt = sizeof(pdpb_adc_channels) / sizeof(uint8_t),
+  .cur = -1,
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/* Raw NCT7904 registers from the last lease */
+typedef struct {
+  uint8_t reg;
+  bool fresh;
+  int res_h;
+  int res_l;
+} nct7904_reading_t;
+
+static nct7904_reading_t nct7904_block[] = {
+  {NCT7904_TEMP_CH1},
+  {NCT7904_TEMP_CH2},
+  {NCT7904_VSEN6},
+  {NCT7904_VSEN7},
+  {NCT7904_VSEN9},
+  {NCT7904_3VDD},
+  {FAN_REGISTER},
+  {FAN_REGISTER+2},
+  {FAN_REGISTER+4},
+  {FAN_REGISTER+6},
+  {FAN_REGISTER+8},
+  {FAN_REGISTER+10},
+  {FAN_REGISTER+12},
+  {FAN_REGISTER+14},
+  {FAN_REGISTER+16},
+  {FAN_REGISTER+18},
+  {FAN_REGISTER+20},
+  {FAN_REGISTER+22},
+};
+
+#define NCT7904_BLOCK_CNT (sizeof(nct7904_block) / sizeof(nct7904_reading_t))
+
+static uint64_t nct7904_taken;
+
 enum adc_pins {
   ADC_PIN0 = 0,
   ADC_PIN1,
@@ -494,6 +573,15 @@ msleep(int msec) {
   }
 }
 
+// Monotonic time in milliseconds
+static uint64_t
+now_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 int32_t signextend32(uint32_t val, int idx) {
     uint8_t shift = 31 - idx;
       return (int32_t)(val << shift) >> shift;
@@ -585,6 +673,65 @@ read_m2_amb_temp(uint8_t flash_num, float *value) {
   return lightning_m2_amb_temp_read(lightning_flash_list[flash_num], value);
 }
 
+/*
+ * Serve a flash or M.2 ambient temperature from one mux-ordered sweep of
+ * all flashes.  A sweep runs when the requested value has not been handed
+ * out since the last sweep and that sweep is at least SSD_SWEEP_INTERVAL_MS
+ * old; every value from it is handed out once.  A second request for the
+ * same sensor within the interval (e.g. sensord confirming a threshold
+ * crossing) reads the device directly.
+ */
+static int
+read_ssd_sweep(uint8_t flash_num, bool amb, float *value) {
+
+  static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  static lightning_flash_reading_t readings[LIGHTNING_MAX_FLASH];
+  static bool temp_fresh[LIGHTNING_MAX_FLASH];
+  static bool amb_fresh[LIGHTNING_MAX_FLASH];
+  static uint64_t last_sweep;
+  bool *fresh;
+  uint8_t sku;
+  uint64_t now;
+  int ret = -1;
+  int i;
+
+  if (flash_num >= LIGHTNING_MAX_FLASH)
+    return -1;
+
+  fresh = amb ? &amb_fresh[flash_num] : &temp_fresh[flash_num];
+
+  pthread_mutex_lock(&lock);
+  now = now_ms();
+  if (!*fresh && (!last_sweep || now - last_sweep >= SSD_SWEEP_INTERVAL_MS)) {
+    if (lightning_ssd_sku(&sku) == 0 &&
+        lightning_flash_sweep(sku, readings) == 0) {
+      for (i = 0; i < lightning_flash_cnt; i++) {
+        temp_fresh[i] = true;
+        amb_fresh[i] = (sku == M2_SKU);
+      }
+    }
+    last_sweep = now;
+  }
+
+  if (*fresh) {
+    *fresh = false;
+    if (amb) {
+      ret = readings[flash_num].amb_ret;
+      *value = readings[flash_num].amb;
+    } else {
+      ret = readings[flash_num].temp_ret;
+      *value = readings[flash_num].temp;
+    }
+    pthread_mutex_unlock(&lock);
+    return ret;
+  }
+  pthread_mutex_unlock(&lock);
+
+  if (amb)
+    return read_m2_amb_temp(flash_num, value);
+  return read_flash_temp(flash_num, value);
+}
+
 static int
 read_adc_value(const int pin, const char *device, float *value) {
   char device_name[LARGEST_DEVICE_NAME];
@@ -613,35 +760,24 @@ read_tmp75_temp_value(const char *device, float *value) {
 
 /* Function to read the temp directly from the i2c dev */
 static int
-read_temp_value(char *device, uint8_t addr, uint8_t type, float *value) {
+read_temp_value(uint8_t bus, uint8_t addr, uint8_t type, float *value) {
 
   int dev;
-  int ret;
   int32_t res;
 
-  dev = open(device, O_RDWR);
+  dev = lightning_i2c_get(bus, addr);
   if (dev < 0) {
-    syslog(LOG_ERR, "read_temp_value: open() failed");
-    return -1;
-  }
-
-  /* Assign the i2c device address */
-  ret = ioctl(dev, I2C_SLAVE, addr);
-  if (ret < 0) {
-    syslog(LOG_ERR, "read_temp_value: ioctl() assigning i2c addr failed");
-    close(dev);
+    syslog(LOG_ERR, "read_temp_value: selecting i2c device failed");
     return -1;
   }
 
   /* Read the Temperature Register result based on whether it is internal or external sensor */
   res = i2c_smbus_read_word_data(dev, type);
+  lightning_i2c_put(bus);
   if (res < 0) {
-    close(dev);
     syslog(LOG_ERR, "read_temp_value: i2c_smbus_read_word_data failed");
     return -1;
   }
-
-  close(dev);
   /* Result is read as MSB byte first and LSB byte second.
    * Result is 12bit with res[11:4]  == MSB[7:0] and res[3:0] = LSB */
   res = ((res & 0x0FF) << 4) | ((res & 0xF000) >> 12);
@@ -679,36 +815,25 @@ read_temp(const char *device, float *value) {
 }
 
 static int
-read_hsc_value(uint8_t reg, char *device, uint8_t addr, uint8_t cntlr, float *value) {
+read_hsc_value(uint8_t reg, uint8_t bus, uint8_t addr, uint8_t cntlr, float *value) {
 
   int dev;
-  int ret;
   int32_t res;
 
-  dev = open(device, O_RDWR);
+  dev = lightning_i2c_get(bus, addr);
   if (dev < 0) {
-    syslog(LOG_ERR, "read_hsc_value: open() failed");
-    return -1;
-  }
-
-  /* Assign the i2c device address */
-  ret = ioctl(dev, I2C_SLAVE, addr);
-  if (ret < 0) {
-    syslog(LOG_ERR, "read_hsc_value: ioctl() assigning i2c addr failed");
-    close(dev);
+    syslog(LOG_ERR, "read_hsc_value: selecting i2c device failed");
     return -1;
   }
 
   /* Read the er result based on whether it is internal or external sensor */
   res = i2c_smbus_read_word_data(dev, reg);
+  lightning_i2c_put(bus);
   if (res < 0) {
-    close(dev);
     syslog(LOG_ERR, "read_hsc_value: i2c_smbus_read_word_data failed");
     return -1;
   }
 
-  close(dev);
-
 
   switch(reg) {
     case HSC_IN_VOLT:
@@ -750,33 +875,99 @@ read_hsc_value(uint8_t reg, char *device, uint8_t addr, uint8_t cntlr, float *va
 }
 
 
+/*
+ * The NCT7904 on the FCB is shared with the BMC of the other tray.  The
+ * MONITOR_FLAG register holds the DONE token of the tray that finished with
+ * it last, or the TAKEN token of the tray reading it now.  A tray takes the
+ * device once the peer's DONE token is there, or once the peer has not
+ * handed it over within NCT7904_LEASE_WAIT_MS.  Taking means writing our
+ * TAKEN token and reading it back NCT7904_LEASE_CONFIRM_MS later; if the
+ * peer wrote its own in between, the peer keeps the device.  The owner
+ * reads every register it monitors in that one window, then writes its
+ * DONE token.  Readings are served from that snapshot.
+ */
 static int
-read_nct7904_value(uint8_t reg, char *device, uint8_t addr, float *value) {
+nct7904_lease_acquire(int dev, uint8_t location) {
+
+  static bool peer_idle = false;
+  uint8_t peer_done;
+  uint8_t peer_taken;
+  uint8_t taken;
+  int monitor_flag;
+  int waited = 0;
+
+  if (location == UPPER_TRAY) {
+    peer_done = LOWER_TRAY_DONE;
+    peer_taken = LOWER_TRAY_TAKEN;
+    taken = UPPER_TRAY_TAKEN;
+  } else {
+    peer_done = UPPER_TRAY_DONE;
+    peer_taken = UPPER_TRAY_TAKEN;
+    taken = LOWER_TRAY_TAKEN;
+  }
+
+  while (1) {
+    monitor_flag = i2c_smbus_read_byte_data(dev, NCT7904_MONITOR_FLAG);
+    if (monitor_flag < 0) {
+      syslog(LOG_ERR, "read_nct7904_value: reading the monitor flag failed");
+      return -1;
+    }
+    if (monitor_flag == peer_done || monitor_flag == peer_taken)
+      peer_idle = false;
+
+    /*
+     * A peer that missed its last window only gets one look per lease,
+     * unless it is reading right now.
+     */
+    if (monitor_flag == peer_done || waited >= NCT7904_LEASE_WAIT_MS ||
+        (peer_idle && monitor_flag != peer_taken)) {
+      if (i2c_smbus_write_byte_data(dev, NCT7904_MONITOR_FLAG, taken) < 0) {
+        syslog(LOG_ERR, "read_nct7904_value: taking the monitor flag failed");
+        return -1;
+      }
+      msleep(NCT7904_LEASE_CONFIRM_MS);
+      monitor_flag = i2c_smbus_read_byte_data(dev, NCT7904_MONITOR_FLAG);
+      if (monitor_flag == taken)
+        break;
+      if (monitor_flag < 0) {
+        syslog(LOG_ERR, "read_nct7904_value: reading the monitor flag failed");
+        return -1;
+      }
+      /* The peer took it at the same time; give it a full window */
+      peer_idle = false;
+      waited = 0;
+      continue;
+    }
+
+    msleep(NCT7904_LEASE_POLL_MS);
+    waited += NCT7904_LEASE_POLL_MS;
+  }
+
+  if (waited >= NCT7904_LEASE_WAIT_MS) {
+    syslog(LOG_DEBUG, "%s(): peer tray did not release the NCT7904", __func__);
+    peer_idle = true;
+  }
+
+  return 0;
+}
+
+static int
+nct7904_snapshot(uint8_t bus, uint8_t addr) {
 
   int dev;
   int ret;
-  int res_h;
-  int res_l;
   int bank;
   int retry;
-  uint8_t peer_tray_exist;
+  int i;
   uint8_t location;
-  uint8_t monitor_flag;
-  uint16_t res;
-  float multipler;
+  nct7904_reading_t *r;
 
-  dev = open(device, O_RDWR);
+  dev = lightning_i2c_get(bus, addr);
   if (dev < 0) {
-    syslog(LOG_ERR, "read_nct7904_value: open() failed");
+    syslog(LOG_ERR, "read_nct7904_value: selecting i2c device failed");
     return -1;
   }
 
-  /* Assign the i2c device address */
-  ret = ioctl(dev, I2C_SLAVE, addr);
-  if (ret < 0) {
-    syslog(LOG_ERR, "read_nct7904_value: ioctl() assigning i2c addr failed");
-  }
-
   /* Read the Bank Register and set it to 0 */
   bank = i2c_smbus_read_byte_data(dev, NCT7904_BANK_SEL);
   if (bank != 0x0) {
@@ -784,88 +975,98 @@ read_nct7904_value(uint8_t reg, char *device, uint8_t addr, float *value) {
     if (i2c_smbus_write_byte_data(dev, NCT7904_BANK_SEL, 0) < 0) {
       syslog(LOG_ERR, "read_nct7904_value: i2c_smbus_write_byte_data: "
           "selecting Bank 0 failed");
-      close(dev);
+      lightning_i2c_put(bus);
       return -1;
     }
   }
 
-  if (peer_tray_exist) {
   /* Determine this tray located on upper or lower tray; 0:Upper, 1:Lower*/
-    ret = pal_self_tray_location(&location);
-    if(ret < 0) {
-      syslog(LOG_ERR, "read_nct7904_value: pal_self_tray_location failed");
-      return -1;
-    }
-    retry = 0;
-    while(retry < MAX_RETRY_TIMES) {
-      monitor_flag = i2c_smbus_read_byte_data(dev, NCT7904_MONITOR_FLAG);
+  ret = pal_self_tray_location(&location);
+  if(ret < 0) {
+    syslog(LOG_ERR, "read_nct7904_value: pal_self_tray_location failed");
+    lightning_i2c_put(bus);
+    return -1;
+  }
 
-      if (UPPER_TRAY == location) {
-        /* BMC can query sensor only when peer BMC's queries are done. */
-        if (LOWER_TRAY_DONE == monitor_flag) {
-          break;
-        } else {
-          retry++;
-        }
-      } else if (LOWER_TRAY == location) {
-        if (UPPER_TRAY_DONE == monitor_flag) {
-          break;
-        } else {
-          retry++;
-        }
-      }
-      msleep(100);
-    }
+  if (nct7904_lease_acquire(dev, location) < 0) {
+    lightning_i2c_put(bus);
+    return -1;
   }
 
-  retry = 0;
-  while (retry < MAX_RETRY_TIMES) {
-    /* Read the MSB byte for the value */
-    res_h = i2c_smbus_read_byte_data(dev, reg);
+  for (i = 0; i < NCT7904_BLOCK_CNT; i++) {
+    r = &nct7904_block[i];
+    retry = 0;
+    while (retry < MAX_RETRY_TIMES) {
+      /* Read the MSB byte for the value */
+      r->res_h = i2c_smbus_read_byte_data(dev, r->reg);
 
-    /* Read the LSB byte for the value */
-    res_l = i2c_smbus_read_byte_data(dev, reg + 1);
+      /* Read the LSB byte for the value */
+      r->res_l = i2c_smbus_read_byte_data(dev, r->reg + 1);
 
-    /* Read failed */
-    if ((res_h == -1) || (res_l == -1)) 
-      retry++;
-    else
-      break;
-    
-    msleep(100);
+      /* Read failed */
+      if ((r->res_h == -1) || (r->res_l == -1))
+        retry++;
+      else
+        break;
+
+      msleep(100);
+    }
+    r->fresh = true;
   }
 
-  if ( (retry >= MAX_RETRY_TIMES) && ((res_h == -1) || (res_l == -1)) ) {
-    syslog(LOG_DEBUG, "%s() i2c_smbus_read_byte_data failed, high byte: 0x%x, low byte: 0x%x", __func__, res_h, res_l);
-    return -1;
+  /* Hand the device over to the peer tray */
+  if (i2c_smbus_write_byte_data(dev, NCT7904_MONITOR_FLAG,
+        (location == UPPER_TRAY) ? UPPER_TRAY_DONE : LOWER_TRAY_DONE) < 0) {
+    syslog(LOG_ERR, "read_nct7904_value: i2c_smbus_write_byte_data: "
+        "%s tray monitor failed", (location == UPPER_TRAY) ? "upper" : "lower");
   }
-  
 
-  /* Modify the monitor_flag when the last sensor query finish in this query interval */
-  if (FAN_REGISTER+2 == reg) {
+  lightning_i2c_put(bus);
+  nct7904_taken = now_ms();
 
-    if (location == UPPER_TRAY) {
+  return 0;
+}
 
-      if (i2c_smbus_write_byte_data(dev, NCT7904_MONITOR_FLAG, UPPER_TRAY_DONE) < 0) {
-        syslog(LOG_ERR, "read_nct7904_value: i2c_smbus_write_byte_data: "
-            "upper tray monitor failed");
-        close(dev);
-        return -1;
-      }
+/*
+ * Each snapshot value is handed out once; asking for it again, or after
+ * NCT7904_SNAPSHOT_MS, takes a new lease.
+ */
+static int
+read_nct7904_value(uint8_t reg, uint8_t bus, uint8_t addr, float *value) {
 
-    } else {
+  static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  nct7904_reading_t *r = NULL;
+  int res_h;
+  int res_l;
+  int i;
+  uint16_t res;
+  float multipler;
 
-      if (i2c_smbus_write_byte_data(dev, NCT7904_MONITOR_FLAG, LOWER_TRAY_DONE) < 0) {
-        syslog(LOG_ERR, "read_nct7904_value: i2c_smbus_write_byte_data: "
-            "lower tray monitor failed");
-        close(dev);
-        return -1;
-      }
+  for (i = 0; i < NCT7904_BLOCK_CNT; i++) {
+    if (nct7904_block[i].reg == reg) {
+      r = &nct7904_block[i];
+      break;
+    }
+  }
+  if (r == NULL)
+    return -1;
 
+  pthread_mutex_lock(&lock);
+  if (!r->fresh || now_ms() - nct7904_taken > NCT7904_SNAPSHOT_MS) {
+    if (nct7904_snapshot(bus, addr) < 0) {
+      pthread_mutex_unlock(&lock);
+      return -1;
     }
   }
+  r->fresh = false;
+  res_h = r->res_h;
+  res_l = r->res_l;
+  pthread_mutex_unlock(&lock);
 
-  close(dev);
+  if ((res_h == -1) || (res_l == -1)) {
+    syslog(LOG_DEBUG, "%s() i2c_smbus_read_byte_data failed, high byte: 0x%x, low byte: 0x%x", __func__, res_h, res_l);
+    return -1;
+  }
 
   /*
    * Fan speed reading is 13 bits
@@ -924,85 +1125,58 @@ read_nct7904_value(uint8_t reg, char *device, uint8_t addr, float *value) {
   return 0;
 }
 
+/*
+ * config
+ * Byte 0: OS[7]  CHANNEL[6:4] PGA[3:1] MODE [0]
+ * Byte 1: Data Rate[7:5] COMPARATOR[4:0]
+ */
 static int
-read_ads1015_value(uint8_t channel, char *device, uint8_t addr, float *value) {
+ads1015_select(ads1015_sampler_t *adc, int dev, uint8_t channel) {
 
-  int dev;
   int ret;
-  int32_t config, config2;
-  int32_t res;
 
-  dev = open(device, O_RDWR);
-  if (dev < 0) {
-    syslog(LOG_ERR, "read_ads1015_value: open() failed");
-    return -1;
-  }
-
-  /* Assign the i2c device address */
-  ret = ioctl(dev, I2C_SLAVE, addr);
+  ret = i2c_smbus_write_word_data(dev, ADS1015_CONFIG,
+                                  ADS1015_CONT_CONFIG | ((channel & 0x7) << 4));
   if (ret < 0) {
-    syslog(LOG_ERR, "read_ads1015_value: ioctl() assigning i2c addr failed");
-    close(dev);
+    syslog(LOG_ERR, "read_ads1015_value: i2c_smbus_write_word_data failed");
+    adc->cur = -1;
     return -1;
   }
 
-  /*
-   * config
-   * Byte 0: OS[7]  CHANNEL[6:4] PGA[3:1] MODE [0]
-   * Byte 1: Data Rate[7:5] COMPARATOR[4:0]
-   */
-  config = ADS1015_DEFAULT_CONFIG;
-  config |= (channel & 0x7) << 4;
+  adc->cur = channel;
+  adc->switched = now_ms();
+  return 0;
+}
 
-  /* Write the config in the CONFIG register */
-  ret = i2c_smbus_write_word_data(dev, ADS1015_CONFIG, config);
-  if (ret < 0) {
-    syslog(LOG_ERR, "read_ads1015_value: i2c_smbus_write_word_data failed");
-    close(dev);
-    return -1;
-  }
-  /* Wait for the conversion to finish */
-  msleep(5);
+/* Bank the latest conversion of the channel currently selected */
+static int
+ads1015_sample(ads1015_sampler_t *adc, int dev) {
 
-  /* Read the CONFIG register to check if the conversion completed. */
-  config = i2c_smbus_read_word_data(dev, ADS1015_CONFIG);
-  if (!(config & (1 << 15))) {
-    close(dev);
-    return -1;
-  } else if (config < 0) {
-    close(dev);
-    syslog(LOG_ERR, "read_ads1015_value: i2c_smbus_read_word_data failed");
-    return -1;
-  }
+  int32_t config;
+  int32_t res;
 
-  /* Read the CONVERSION result */
   res = i2c_smbus_read_word_data(dev, ADS1015_CONVERSION);
   if (res < 0) {
-    close(dev);
     syslog(LOG_ERR, "read_ads1015_value: i2c_smbus_read_word_data failed");
+    adc->cur = -1;
     return -1;
   }
 
-  /* Read the CONFIG register to check if the conversion completed. */
-  config2 = i2c_smbus_read_word_data(dev, ADS1015_CONFIG);
+  /*
+   * Another process may have moved the multiplexer; only keep the result
+   * if the device is still converting our channel.
+   */
+  config = i2c_smbus_read_word_data(dev, ADS1015_CONFIG);
   if (config < 0) {
-    close(dev);
     syslog(LOG_ERR, "read_ads1015_value: i2c_smbus_read_word_data failed");
+    adc->cur = -1;
     return -1;
   }
-
-  /*
-   * If the config register value changed after conversion result read,
-   * the result is invalid
-   */
-  if (config2 != config) {
-    close(dev);
-    syslog(LOG_ERR, "read_ads1015_value: config changed while conversion result read");
+  if ((config & ADS1015_MUX_MODE_MASK) != ((adc->cur & 0x7) << 4)) {
+    adc->cur = -1;
     return -1;
   }
 
-  close(dev);
-
   /* Result is read as MSB byte first and LSB byte second. */
   res = ((res & 0x0FF) << 8) | ((res & 0xFF00) >> 8);
 
@@ -1010,11 +1184,68 @@ read_ads1015_value(uint8_t channel, char *device, uint8_t addr, float *value) {
    * Based on the config PGA, COMP MODE, DATA RATE value,
    * Voltage in Volts = res [15:4] * Reference volt / 2048
    */
-  *value = (float) (res >> 4) * (4.096 / 2048);
+  adc->value[adc->cur] = (float) (res >> 4) * (4.096 / 2048);
+  adc->stamp[adc->cur] = now_ms();
 
   return 0;
 }
 
+static int
+read_ads1015_value(ads1015_sampler_t *adc, uint8_t channel, float *value) {
+
+  int dev;
+  int ret = -1;
+  int i;
+
+  channel &= 0x7;
+
+  pthread_mutex_lock(&adc->lock);
+
+  dev = lightning_i2c_get(adc->bus, adc->addr);
+  if (dev < 0) {
+    syslog(LOG_ERR, "read_ads1015_value: selecting i2c device failed");
+    pthread_mutex_unlock(&adc->lock);
+    return -1;
+  }
+
+  /* Stamps are in whole ms, so only a difference above SETTLE_MS is safe */
+  if (adc->cur >= 0 && (adc->cur == channel ||
+                        now_ms() - adc->switched > ADS1015_SETTLE_MS)) {
+    if (now_ms() - adc->switched <= ADS1015_SETTLE_MS)
+      msleep(ADS1015_SETTLE_MS);
+    ads1015_sample(adc, dev);
+  }
+
+  /* Nothing recent for this channel: convert it now */
+  if (!adc->stamp[channel] ||
+      now_ms() - adc->stamp[channel] > ADS1015_MAX_AGE_MS) {
+    if (ads1015_select(adc, dev, channel) == 0) {
+      msleep(ADS1015_SETTLE_MS);
+      ads1015_sample(adc, dev);
+    }
+  }
+
+  if (adc->stamp[channel] &&
+      now_ms() - adc->stamp[channel] <= ADS1015_MAX_AGE_MS) {
+    *value = adc->value[channel];
+    ret = 0;
+  }
+
+  /* Let the channel expected next convert until it is asked for */
+  for (i = 0; i < adc->channel_cnt; i++) {
+    if (adc->channels[i] == channel)
+      break;
+  }
+  i = (i + 1) % adc->channel_cnt;
+  if (adc->cur != adc->channels[i])
+    ads1015_select(adc, dev, adc->channels[i]);
+
+  lightning_i2c_put(adc->bus);
+  pthread_mutex_unlock(&adc->lock);
+
+  return ret;
+}
+
 int
 lightning_sensor_sdr_path(uint8_t fru, char *path) {
   return 0;
@@ -1331,17 +1562,17 @@ lightning_sensor_read(uint8_t fru, uint8_t sensor_num, void *value) {
       switch(sensor_num) {
         // Temperature Sensors
         case PEB_SENSOR_PCIE_SW_TEMP:
-          return read_temp_value(I2C_DEV_PEB, PEB_MAX6654_U4, REMOTE_SENSOR, (float*) value);
+          return read_temp_value(I2C_BUS_PEB, PEB_MAX6654_U4, REMOTE_SENSOR, (float*) value);
         case PEB_SENSOR_SYS_INLET_TEMP:
-          return read_temp_value(I2C_DEV_PEB, PEB_TMP421_U15, REMOTE_SENSOR, (float*) value);
+          return read_temp_value(I2C_BUS_PEB, PEB_TMP421_U15, REMOTE_SENSOR, (float*) value);
 
         // Hot Swap Controller
         case PEB_SENSOR_HSC_IN_VOLT:
-          return read_hsc_value(HSC_IN_VOLT, I2C_DEV_PEB, I2C_ADDR_PEB_HSC, HSC_ADM1278, (float*) value);
+          return read_hsc_value(HSC_IN_VOLT, I2C_BUS_PEB, I2C_ADDR_PEB_HSC, HSC_ADM1278, (float*) value);
         case PEB_SENSOR_HSC_OUT_CURR:
-          return read_hsc_value(HSC_OUT_CURR, I2C_DEV_PEB, I2C_ADDR_PEB_HSC, HSC_ADM1278, (float*) value);
+          return read_hsc_value(HSC_OUT_CURR, I2C_BUS_PEB, I2C_ADDR_PEB_HSC, HSC_ADM1278, (float*) value);
         case PEB_SENSOR_HSC_IN_POWER:
-          return read_hsc_value(HSC_IN_POWER, I2C_DEV_PEB, I2C_ADDR_PEB_HSC, HSC_ADM1278, (float*) value);
+          return read_hsc_value(HSC_IN_POWER, I2C_BUS_PEB, I2C_ADDR_PEB_HSC, HSC_ADM1278, (float*) value);
 
         // ADC Voltages
         case PEB_SENSOR_ADC_P12V:
@@ -1369,7 +1600,7 @@ lightning_sensor_read(uint8_t fru, uint8_t sensor_num, void *value) {
 
         if (sensor_num >= PDPB_SENSOR_FLASH_TEMP_0 &&
             sensor_num < (PDPB_SENSOR_FLASH_TEMP_0 + lightning_flash_cnt)) {
-          ret = read_flash_temp(sensor_num - PDPB_SENSOR_FLASH_TEMP_0, (float*) value);
+          ret = read_ssd_sweep(sensor_num - PDPB_SENSOR_FLASH_TEMP_0, false, (float*) value);
 
           if (ret < 0) {
             if (pal_reset_ssd_switch() < 0) {
@@ -1382,7 +1613,7 @@ lightning_sensor_read(uint8_t fru, uint8_t sensor_num, void *value) {
 
         if (sensor_num >= PDPB_SENSOR_AMB_TEMP_0 &&
             sensor_num < (PDPB_SENSOR_AMB_TEMP_0 + lightning_flash_cnt)) {
-          ret = read_m2_amb_temp(sensor_num - PDPB_SENSOR_AMB_TEMP_0, (float*) value);
+          ret = read_ssd_sweep(sensor_num - PDPB_SENSOR_AMB_TEMP_0, true, (float*) value);
 
           if (ret < 0) {
             if (pal_reset_ssd_switch() < 0) {
@@ -1396,28 +1627,28 @@ lightning_sensor_read(uint8_t fru, uint8_t sensor_num, void *value) {
       switch(sensor_num) {
         // Temp
         case PDPB_SENSOR_LEFT_REAR_TEMP:
-          //return read_temp_value(I2C_DEV_PDPB, PDPB_TMP75_U47, LOCAL_SENSOR, (float*) value);
+          //return read_temp_value(I2C_BUS_PDPB, PDPB_TMP75_U47, LOCAL_SENSOR, (float*) value);
           return read_tmp75_temp_value(PDPB_TMP75_U47_DEVICE, (float*) value);
         case PDPB_SENSOR_LEFT_FRONT_TEMP:
-          //return read_temp_value(I2C_DEV_PDPB, PDPB_TMP75_U49, LOCAL_SENSOR, (float*) value);
+          //return read_temp_value(I2C_BUS_PDPB, PDPB_TMP75_U49, LOCAL_SENSOR, (float*) value);
           return read_tmp75_temp_value(PDPB_TMP75_U49_DEVICE, (float*) value);
         case PDPB_SENSOR_RIGHT_REAR_TEMP:
-          //return read_temp_value(I2C_DEV_PDPB, PDPB_TMP75_U48, LOCAL_SENSOR, (float*) value);
+          //return read_temp_value(I2C_BUS_PDPB, PDPB_TMP75_U48, LOCAL_SENSOR, (float*) value);
           return read_tmp75_temp_value(PDPB_TMP75_U48_DEVICE, (float*) value);
         case PDPB_SENSOR_RIGHT_FRONT_TEMP:
-          //return read_temp_value(I2C_DEV_PDPB, PDPB_TMP75_U51, LOCAL_SENSOR, (float*) value);
+          //return read_temp_value(I2C_BUS_PDPB, PDPB_TMP75_U51, LOCAL_SENSOR, (float*) value);
           return read_tmp75_temp_value(PDPB_TMP75_U51_DEVICE, (float*) value);
 
         // Voltage
         case PDPB_SENSOR_P12V:
-          if (read_ads1015_value(ADS1015_CHANNEL4, I2C_DEV_PDPB, I2C_ADDR_PDPB_ADC, (float*) value) < 0) {
+          if (read_ads1015_value(&pdpb_adc, ADS1015_CHANNEL4, (float*) value) < 0) {
             return -1;
           }
           *((float *) value) = *((float *) value) * ((10 + 2) / 2); // Voltage Divider Circuit
           return 0;
 
         case PDPB_SENSOR_P3V3:
-          if (read_ads1015_value(ADS1015_CHANNEL6, I2C_DEV_PDPB, I2C_ADDR_PDPB_ADC, (float*) value) < 0) {
+          if (read_ads1015_value(&pdpb_adc, ADS1015_CHANNEL6, (float*) value) < 0) {
             return -1;
           }
           // NOTE: DVT system has the Voltage Divider Circuit not populated
@@ -1434,51 +1665,51 @@ lightning_sensor_read(uint8_t fru, uint8_t sensor_num, void *value) {
       switch(sensor_num) {
         // Voltage
         case FCB_SENSOR_P12V_AUX:
-          return read_nct7904_value(NCT7904_VSEN9, I2C_DEV_FCB, I2C_ADDR_NCT7904, (float*) value);
+          return read_nct7904_value(NCT7904_VSEN9, I2C_BUS_FCB, I2C_ADDR_NCT7904, (float*) value);
         case FCB_SENSOR_P12VL:
-          return read_nct7904_value(NCT7904_VSEN6, I2C_DEV_FCB, I2C_ADDR_NCT7904, (float*) value);
+          return read_nct7904_value(NCT7904_VSEN6, I2C_BUS_FCB, I2C_ADDR_NCT7904, (float*) value);
         case FCB_SENSOR_P12VU:
-          return read_nct7904_value(NCT7904_VSEN7, I2C_DEV_FCB, I2C_ADDR_NCT7904, (float*) value);
+          return read_nct7904_value(NCT7904_VSEN7, I2C_BUS_FCB, I2C_ADDR_NCT7904, (float*) value);
         case FCB_SENSOR_P3V3:
-          return read_nct7904_value(NCT7904_3VDD, I2C_DEV_FCB, I2C_ADDR_NCT7904, (float*) value);
+          return read_nct7904_value(NCT7904_3VDD, I2C_BUS_FCB, I2C_ADDR_NCT7904, (float*) value);
 
         // Hot Swap Controller
         case FCB_SENSOR_HSC_IN_VOLT:
-          return read_hsc_value(HSC_IN_VOLT, I2C_DEV_FCB, I2C_ADDR_FCB_HSC, HSC_ADM1276, (float*) value);
+          return read_hsc_value(HSC_IN_VOLT, I2C_BUS_FCB, I2C_ADDR_FCB_HSC, HSC_ADM1276, (float*) value);
         case FCB_SENSOR_HSC_OUT_CURR:
-          return read_hsc_value(HSC_OUT_CURR, I2C_DEV_FCB, I2C_ADDR_FCB_HSC, HSC_ADM1276, (float*) value);
+          return read_hsc_value(HSC_OUT_CURR, I2C_BUS_FCB, I2C_ADDR_FCB_HSC, HSC_ADM1276, (float*) value);
         case FCB_SENSOR_HSC_IN_POWER:
-          return read_hsc_value(HSC_IN_POWER, I2C_DEV_FCB, I2C_ADDR_FCB_HSC, HSC_ADM1276, (float*) value);
+          return read_hsc_value(HSC_IN_POWER, I2C_BUS_FCB, I2C_ADDR_FCB_HSC, HSC_ADM1276, (float*) value);
         case FCB_SENSOR_BJT_TEMP_1:
-          return read_nct7904_value(NCT7904_TEMP_CH1, I2C_DEV_FCB, I2C_ADDR_NCT7904, (float*) value);
+          return read_nct7904_value(NCT7904_TEMP_CH1, I2C_BUS_FCB, I2C_ADDR_NCT7904, (float*) value);
         case FCB_SENSOR_BJT_TEMP_2:
-          return read_nct7904_value(NCT7904_TEMP_CH2, I2C_DEV_FCB, I2C_ADDR_NCT7904, (float*) value);
+          return read_nct7904_value(NCT7904_TEMP_CH2, I2C_BUS_FCB, I2C_ADDR_NCT7904, (float*) value);
 
         // Fan Speed
         case FCB_SENSOR_FAN6_FRONT_SPEED:
-          return read_nct7904_value(FAN_REGISTER, I2C_DEV_FCB, I2C_ADDR_NCT7904, (float*) value);
+          return read_nct7904_value(FAN_REGISTER, I2C_BUS_FCB, I2C_ADDR_NCT7904, (float*) value);
         case FCB_SENSOR_FAN6_REAR_SPEED:
-          return read_nct7904_value(FAN_REGISTER+2, I2C_DEV_FCB, I2C_ADDR_NCT7904, (float*) value);
+          return read_nct7904_value(FAN_REGISTER+2, I2C_BUS_FCB, I2C_ADDR_NCT7904, (float*) value);
         case FCB_SENSOR_FAN5_FRONT_SPEED:
-          return read_nct7904_value(FAN_REGISTER+4, I2C_DEV_FCB, I2C_ADDR_NCT7904, (float*) value);
+          return read_nct7904_value(FAN_REGISTER+4, I2C_BUS_FCB, I2C_ADDR_NCT7904, (float*) value);
         case FCB_SENSOR_FAN5_REAR_SPEED:
-          return read_nct7904_value(FAN_REGISTER+6, I2C_DEV_FCB, I2C_ADDR_NCT7904, (float*) value);
+          return read_nct7904_value(FAN_REGISTER+6, I2C_BUS_FCB, I2C_ADDR_NCT7904, (float*) value);
         case FCB_SENSOR_FAN4_FRONT_SPEED:
-          return read_nct7904_value(FAN_REGISTER+8, I2C_DEV_FCB, I2C_ADDR_NCT7904, (float*) value);
+          return read_nct7904_value(FAN_REGISTER+8, I2C_BUS_FCB, I2C_ADDR_NCT7904, (float*) value);
         case FCB_SENSOR_FAN4_REAR_SPEED:
-          return read_nct7904_value(FAN_REGISTER+10, I2C_DEV_FCB, I2C_ADDR_NCT7904, (float*) value);
+          return read_nct7904_value(FAN_REGISTER+10, I2C_BUS_FCB, I2C_ADDR_NCT7904, (float*) value);
         case FCB_SENSOR_FAN3_FRONT_SPEED:
-          return read_nct7904_value(FAN_REGISTER+12, I2C_DEV_FCB, I2C_ADDR_NCT7904, (float*) value);
+          return read_nct7904_value(FAN_REGISTER+12, I2C_BUS_FCB, I2C_ADDR_NCT7904, (float*) value);
         case FCB_SENSOR_FAN3_REAR_SPEED:
-          return read_nct7904_value(FAN_REGISTER+14, I2C_DEV_FCB, I2C_ADDR_NCT7904, (float*) value);
+          return read_nct7904_value(FAN_REGISTER+14, I2C_BUS_FCB, I2C_ADDR_NCT7904, (float*) value);
         case FCB_SENSOR_FAN2_FRONT_SPEED:
-          return read_nct7904_value(FAN_REGISTER+16, I2C_DEV_FCB, I2C_ADDR_NCT7904, (float*) value);
+          return read_nct7904_value(FAN_REGISTER+16, I2C_BUS_FCB, I2C_ADDR_NCT7904, (float*) value);
         case FCB_SENSOR_FAN2_REAR_SPEED:
-          return read_nct7904_value(FAN_REGISTER+18, I2C_DEV_FCB, I2C_ADDR_NCT7904, (float*) value);
+          return read_nct7904_value(FAN_REGISTER+18, I2C_BUS_FCB, I2C_ADDR_NCT7904, (float*) value);
         case FCB_SENSOR_FAN1_FRONT_SPEED:
-          return read_nct7904_value(FAN_REGISTER+20, I2C_DEV_FCB, I2C_ADDR_NCT7904, (float*) value);
+          return read_nct7904_value(FAN_REGISTER+20, I2C_BUS_FCB, I2C_ADDR_NCT7904, (float*) value);
         case FCB_SENSOR_FAN1_REAR_SPEED:
-          return read_nct7904_value(FAN_REGISTER+22, I2C_DEV_FCB, I2C_ADDR_NCT7904, (float*) value);
+          return read_nct7904_value(FAN_REGISTER+22, I2C_BUS_FCB, I2C_ADDR_NCT7904, (float*) value);
         default:
           return -1;
       }
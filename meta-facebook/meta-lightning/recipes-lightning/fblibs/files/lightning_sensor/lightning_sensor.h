@@ -42,6 +42,8 @@ extern "C" {
 
 #define LOWER_TRAY_DONE 0x00
 #define UPPER_TRAY_DONE 0x01
+#define LOWER_TRAY_TAKEN 0x10
+#define UPPER_TRAY_TAKEN 0x11
 
 #define MAX_RETRY_TIMES 3
 
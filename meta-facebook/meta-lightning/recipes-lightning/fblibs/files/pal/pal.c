@@ -28,7 +28,9 @@
 #include <sys/mman.h>
 #include <string.h>
 #include <pthread.h>
+#include <unistd.h>
 #include <facebook/i2c-dev.h>
+#include <openbmc/pwm.h>
 #include "pal.h"
 
 #define BIT(value, index) ((value >> index) & 1)
@@ -61,8 +63,6 @@
 #define FAN_REGISTER_L 0x81
 #define I2C_ADDR_FAN_LED 0x60
 
-#define LARGEST_DEVICE_NAME 120
-#define PWM_DIR "/sys/devices/platform/ast_pwm_tacho.0"
 #define PWM_UNIT_MAX 96
 
 const char pal_fru_list[] = "all, peb, pdpb, fcb";
@@ -146,31 +146,6 @@ write_device(const char *device, const char *value) {
   }
 }
 
-static int
-read_device_hex(const char *device, int *value) {
-  FILE *fp;
-  int rc;
-
-  fp = fopen(device, "r");
-  if (!fp) {
-#ifdef DEBUG
-    syslog(LOG_INFO, "failed to open device %s", device);
-#endif
-    return errno;
-  }
-
-  rc = fscanf(fp, "%x", value);
-  fclose(fp);
-  if (rc != 1) {
-#ifdef DEBUG
-    syslog(LOG_INFO, "failed to read device %s", device);
-#endif
-    return ENOENT;
-  } else {
-    return 0;
-  }
-}
-
 // Platform Abstraction Layer (PAL) Functions
 int
 pal_get_platform_name(char *name) {
@@ -365,6 +340,13 @@ pal_post_handle(uint8_t slot, uint8_t status) {
   return 0;
 }
 
+// Handle a GPIO interrupt reported by a server's bridge IC
+int
+pal_gpio_intr_handle(uint8_t slot, uint8_t gpio) {
+
+  return 0;
+}
+
 
 static int
 read_kv(char *key, char *value) {
@@ -934,18 +916,6 @@ pal_get_fan_name(uint8_t num, char *name) {
   return 0;
 }
 
-static int
-write_fan_value(const int fan, const char *device, const int value) {
-  char full_name[LARGEST_DEVICE_NAME];
-  char device_name[LARGEST_DEVICE_NAME];
-  char output_value[LARGEST_DEVICE_NAME];
-
-  snprintf(device_name, LARGEST_DEVICE_NAME, device, fan);
-  snprintf(full_name, LARGEST_DEVICE_NAME, "%s/%s", PWM_DIR, device_name);
-  snprintf(output_value, LARGEST_DEVICE_NAME, "%d", value);
-  return write_device(full_name, output_value);
-}
-
 int
 pal_set_fan_speed(uint8_t fan, uint8_t pwm) {
   int unit;
@@ -961,9 +931,9 @@ pal_set_fan_speed(uint8_t fan, uint8_t pwm) {
 
   // For 0%, turn off the PWM entirely
   if (unit == 0) {
-    write_fan_value(fan, "pwm%d_en", 0);
+    ret = pwm_write_attr(fan, PWM_ATTR_EN, 0);
     if (ret < 0) {
-      syslog(LOG_INFO, "set_fan_speed: write_fan_value failed");
+      syslog(LOG_INFO, "set_fan_speed: pwm_write_attr failed");
       return -1;
     }
 
@@ -974,27 +944,27 @@ pal_set_fan_speed(uint8_t fan, uint8_t pwm) {
     unit = 0;
   }
 
-  ret = write_fan_value(fan, "pwm%d_type", 0);
+  ret = pwm_write_attr(fan, PWM_ATTR_TYPE, 0);
   if (ret < 0) {
-    syslog(LOG_INFO, "set_fan_speed: write_fan_value failed");
+    syslog(LOG_INFO, "set_fan_speed: pwm_write_attr failed");
     return -1;
   }
 
-  ret = write_fan_value(fan, "pwm%d_rising", 0);
+  ret = pwm_write_attr(fan, PWM_ATTR_RISING, 0);
   if (ret < 0) {
-    syslog(LOG_INFO, "set_fan_speed: write_fan_value failed");
+    syslog(LOG_INFO, "set_fan_speed: pwm_write_attr failed");
     return -1;
   }
 
-  ret = write_fan_value(fan, "pwm%d_falling", unit);
+  ret = pwm_write_attr(fan, PWM_ATTR_FALLING, unit);
   if (ret < 0) {
-    syslog(LOG_INFO, "set_fan_speed: write_fan_value failed");
+    syslog(LOG_INFO, "set_fan_speed: pwm_write_attr failed");
     return -1;
   }
 
-  ret = write_fan_value(fan, "pwm%d_en", 1);
+  ret = pwm_write_attr(fan, PWM_ATTR_EN, 1);
   if (ret < 0) {
-    syslog(LOG_INFO, "set_fan_speed: write_fan_value failed");
+    syslog(LOG_INFO, "set_fan_speed: pwm_write_attr failed");
     return -1;
   }
 
@@ -1036,32 +1006,26 @@ pal_is_fru_ready(uint8_t fru, uint8_t *status) {
 
 int
 pal_get_pwm_value(uint8_t fan_num, uint8_t *value) {
-  char path[64] = {0};
-  char device_name[64] = {0};
   int val = 0;
   int pwm_enable = 0;
 
-  snprintf(device_name, LARGEST_DEVICE_NAME, "pwm%d_en", fanid2pwmid_mapping[fan_num]);
-  snprintf(path, LARGEST_DEVICE_NAME, "%s/%s", PWM_DIR, device_name);
-  if (read_device(path, &pwm_enable)) {
-    syslog(LOG_INFO, "pal_get_pwm_value: read %s failed", path);
+  // fan number should in this range
+  if(fan_num >= pal_tach_cnt) {
+    syslog(LOG_INFO, "pal_get_pwm_value: fan number is invalid - %d", fan_num);
+    return -1;
+  }
+
+  if (pwm_read_attr(fanid2pwmid_mapping[fan_num], PWM_ATTR_EN, 10, &pwm_enable)) {
+    syslog(LOG_INFO, "pal_get_pwm_value: read pwm%d_en failed",
+        fanid2pwmid_mapping[fan_num]);
     return -1;
   }
 
   // Check the PWM is enable or not
   if(pwm_enable) {
-    // fan number should in this range
-    if(fan_num >= 0 && fan_num <= 11)
-      snprintf(device_name, LARGEST_DEVICE_NAME, "pwm%d_falling", fanid2pwmid_mapping[fan_num]);
-    else {
-      syslog(LOG_INFO, "pal_get_pwm_value: fan number is invalid - %d", fan_num);
-      return -1;
-    }
-
-    snprintf(path, LARGEST_DEVICE_NAME, "%s/%s", PWM_DIR, device_name);
-
-    if (read_device_hex(path, &val)) {
-      syslog(LOG_INFO, "pal_get_pwm_value: read %s failed", path);
+    if (pwm_read_attr(fanid2pwmid_mapping[fan_num], PWM_ATTR_FALLING, 16, &val)) {
+      syslog(LOG_INFO, "pal_get_pwm_value: read pwm%d_falling failed",
+          fanid2pwmid_mapping[fan_num]);
       return -1;
     }
     if(val)
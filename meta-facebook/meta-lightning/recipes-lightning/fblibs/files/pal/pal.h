@@ -152,6 +152,7 @@ int pal_post_enable(uint8_t slot);
 int pal_post_disable(uint8_t slot);
 int pal_post_get_last(uint8_t slot, uint8_t *post);
 int pal_post_handle(uint8_t slot, uint8_t status);
+int pal_gpio_intr_handle(uint8_t slot, uint8_t gpio);
 int pal_get_pwr_btn(uint8_t *status);
 int pal_get_rst_btn(uint8_t *status);
 int pal_set_rst_btn(uint8_t slot, uint8_t status);
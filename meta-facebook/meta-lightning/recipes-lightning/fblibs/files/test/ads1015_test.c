@@ -0,0 +1,175 @@
+/* Copyright 2016-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <facebook/lightning_sensor.h>
+#include "lightning_sim.h"
+
+/*
+ * The PDPB ADS1015 sampler against a register-level model of the ADC:
+ * conversions take ADS1015_SIM_CONV_US and the conversion register keeps
+ * the previous channel's result until the new one is done.
+ */
+
+#define POLL_MS 2000    // sensord's polling period
+
+int lightning_sensor_read(uint8_t fru, uint8_t sensor_num, void *value);
+
+static ads1015_sim_t *adc;
+static int failed;
+
+static void
+check(const char *name, int ok) {
+  printf("%s: %s\n", ok ? "PASS" : "FAIL", name);
+  if (!ok)
+    failed = 1;
+}
+
+static int
+read_volts(uint8_t snr_num, float *value) {
+  return lightning_sensor_read(FRU_PDPB, snr_num, value);
+}
+
+static int
+near(float a, float b) {
+  return fabsf(a - b) < 0.01;
+}
+
+static void
+test_values(void) {
+  float p12v = 0, p3v3 = 0;
+  int ret;
+
+  ret = read_volts(PDPB_SENSOR_P12V, &p12v);
+  ret |= read_volts(PDPB_SENSOR_P3V3, &p3v3);
+  check("first reads return both rails", ret == 0 &&
+        near(p12v, 12.0) && near(p3v3, 3.3));
+}
+
+/* A switch is only sampled once it has converted the new channel */
+static void
+test_back_to_back(void) {
+  float p12v, p3v3;
+  int ok = 1;
+  int i;
+
+  for (i = 0; i < 20; i++) {
+    if (read_volts(PDPB_SENSOR_P12V, &p12v) < 0 || !near(p12v, 12.0))
+      ok = 0;
+    if (read_volts(PDPB_SENSOR_P3V3, &p3v3) < 0 || !near(p3v3, 3.3))
+      ok = 0;
+  }
+  check("back-to-back reads never see the other channel", ok);
+}
+
+static void
+test_steady_state(void) {
+  i2c_sim_stats_t before;
+  float p12v = 0, p3v3 = 0;
+  int ok = 1;
+  int i;
+
+  /* One sweep to get the sampler in step with the poll order */
+  i2c_sim_advance_ms(POLL_MS);
+  read_volts(PDPB_SENSOR_P12V, &p12v);
+  read_volts(PDPB_SENSOR_P3V3, &p3v3);
+
+  before = i2c_sim_stats;
+  for (i = 0; i < 10; i++) {
+    adc->volts[4] = 2.0 + 0.01 * i;
+    i2c_sim_advance_ms(POLL_MS);
+    if (read_volts(PDPB_SENSOR_P12V, &p12v) < 0 ||
+        !near(p12v, (2.0 + 0.01 * i) * 6))
+      ok = 0;
+    if (read_volts(PDPB_SENSOR_P3V3, &p3v3) < 0 || !near(p3v3, 3.3))
+      ok = 0;
+  }
+  adc->volts[4] = 2.0;
+
+  check("every poll sees the input as of that poll", ok);
+  check("a poll of both rails costs at most 6 transfers",
+        i2c_sim_stats.xfers - before.xfers <= 6 * 10);
+  /* The second rail is selected just before it is asked for */
+  check("a poll sleeps for at most one conversion",
+        i2c_sim_stats.slept_ms - before.slept_ms <= 10);
+}
+
+/* Another process left the multiplexer on a channel we do not use */
+static void
+test_moved_mux(void) {
+  float p12v = 0;
+  int ret;
+
+  i2c_sim_lock();
+  adc->volts[5] = 1.0;
+  adc->config = 0xe3d2;                 // Continuous, AIN1
+  adc->started = i2c_sim_now_us();
+  adc->converting = true;
+  i2c_sim_unlock();
+
+  i2c_sim_advance_ms(POLL_MS);
+  ret = read_volts(PDPB_SENSOR_P12V, &p12v);
+  check("a foreign channel is not banked as ours", ret == 0 &&
+        near(p12v, 12.0));
+}
+
+static void
+test_max_age(void) {
+  float p12v = 0, p3v3 = 0;
+  int ret;
+
+  i2c_sim_advance_ms(POLL_MS);
+  read_volts(PDPB_SENSOR_P12V, &p12v);
+  read_volts(PDPB_SENSOR_P3V3, &p3v3);
+
+  i2c_sim_advance_ms(POLL_MS);
+  ret = read_volts(PDPB_SENSOR_P12V, &p12v);
+  check("read before the device stops answering", ret == 0);
+
+  adc->nack = true;
+  i2c_sim_advance_ms(POLL_MS / 2);
+  ret = read_volts(PDPB_SENSOR_P12V, &p12v);
+  check("a sample younger than one poll is still served", ret == 0 &&
+        near(p12v, 12.0));
+
+  i2c_sim_advance_ms(POLL_MS);
+  ret = read_volts(PDPB_SENSOR_P12V, &p12v);
+  check("a sample older than one poll is not served", ret < 0);
+
+  adc->nack = false;
+  ret = read_volts(PDPB_SENSOR_P12V, &p12v);
+  check("reads recover with the device", ret == 0 && near(p12v, 12.0));
+}
+
+int
+main(void) {
+  if (lightning_sim_init(U2_SKU) < 0) {
+    perror("lightning_sim_init");
+    return 1;
+  }
+  adc = lightning_sim_ads1015->priv;
+
+  test_values();
+  test_back_to_back();
+  test_steady_state();
+  test_moved_mux();
+  test_max_age();
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  return failed;
+}
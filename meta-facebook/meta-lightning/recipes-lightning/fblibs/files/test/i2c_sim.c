@@ -0,0 +1,346 @@
+/* Copyright 2016-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "i2c_sim.h"
+
+#define MAX_FDS 1024
+#define MAX_FILES 32
+
+typedef struct {
+  pthread_mutex_t lock;
+  int dev_cnt;
+  i2c_sim_dev_t devs[I2C_SIM_MAX_DEVS];
+} i2c_sim_bus_t;
+
+typedef struct {
+  const char *prefix;
+  const char *contents;
+} i2c_sim_file_t;
+
+i2c_sim_stats_t i2c_sim_stats;
+int i2c_sim_latency_us;
+
+static i2c_sim_bus_t *sim;
+static int fd_bus[MAX_FDS];     // bus + 1, 0 if not a simulated bus
+static int fd_addr[MAX_FDS];
+static i2c_sim_file_t files[MAX_FILES];
+static int file_cnt;
+static uint64_t skew_us;
+
+int __real_open(const char *path, int flags, ...);
+int __real_close(int fd);
+int __real_ioctl(int fd, unsigned long request, ...);
+FILE *__real_fopen(const char *path, const char *mode);
+int __real_nanosleep(const struct timespec *req, struct timespec *rem);
+int __real_clock_gettime(clockid_t clk, struct timespec *ts);
+
+int
+i2c_sim_init(void) {
+  pthread_mutexattr_t attr;
+
+  sim = mmap(NULL, sizeof(*sim), PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (sim == MAP_FAILED) {
+    sim = NULL;
+    return -1;
+  }
+
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  pthread_mutex_init(&sim->lock, &attr);
+  pthread_mutexattr_destroy(&attr);
+
+  return 0;
+}
+
+i2c_sim_dev_t *
+i2c_sim_add(uint8_t bus, uint8_t addr) {
+  i2c_sim_dev_t *dev;
+
+  if (sim->dev_cnt >= I2C_SIM_MAX_DEVS) {
+    fprintf(stderr, "i2c_sim: too many devices\n");
+    exit(1);
+  }
+
+  dev = &sim->devs[sim->dev_cnt++];
+  dev->bus = bus;
+  dev->addr = addr;
+
+  return dev;
+}
+
+i2c_sim_dev_t *
+i2c_sim_add_mux(uint8_t bus, uint8_t addr) {
+  i2c_sim_dev_t *dev = i2c_sim_add(bus, addr);
+
+  dev->mux = true;
+  return dev;
+}
+
+void
+i2c_sim_behind(i2c_sim_dev_t *dev, i2c_sim_dev_t *mux, uint8_t sel) {
+  dev->parent = mux;
+  dev->parent_sel = sel;
+}
+
+void
+i2c_sim_lock(void) {
+  pthread_mutex_lock(&sim->lock);
+}
+
+void
+i2c_sim_unlock(void) {
+  pthread_mutex_unlock(&sim->lock);
+}
+
+int
+i2c_sim_file(const char *prefix, const char *contents) {
+  int i;
+
+  for (i = 0; i < file_cnt; i++) {
+    if (!strcmp(files[i].prefix, prefix)) {
+      files[i].contents = contents;
+      return 0;
+    }
+  }
+  if (file_cnt >= MAX_FILES)
+    return -1;
+
+  files[file_cnt].prefix = prefix;
+  files[file_cnt].contents = contents;
+  file_cnt++;
+
+  return 0;
+}
+
+void
+i2c_sim_advance_ms(unsigned int ms) {
+  skew_us += (uint64_t)ms * 1000;
+}
+
+uint64_t
+i2c_sim_now_us(void) {
+  struct timespec ts;
+
+  __real_clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 + skew_us;
+}
+
+/* Plain register file; a byte write to a mux selects its channel */
+int
+i2c_sim_regs_xfer(i2c_sim_dev_t *dev, char read_write, uint8_t command,
+                  int size, union i2c_smbus_data *data) {
+
+  switch (size) {
+    case I2C_SMBUS_QUICK:
+      return 0;
+    case I2C_SMBUS_BYTE:
+      if (read_write == I2C_SMBUS_WRITE) {
+        if (dev->mux) {
+          dev->sel = command;
+          i2c_sim_stats.mux_writes++;
+        } else {
+          dev->byte[0] = command;
+        }
+      } else {
+        data->byte = dev->mux ? dev->sel : dev->byte[0];
+      }
+      return 0;
+    case I2C_SMBUS_BYTE_DATA:
+      if (read_write == I2C_SMBUS_WRITE)
+        dev->byte[command] = data->byte;
+      else
+        data->byte = dev->byte[command];
+      return 0;
+    case I2C_SMBUS_WORD_DATA:
+      if (read_write == I2C_SMBUS_WRITE)
+        dev->word[command] = data->word;
+      else
+        data->word = dev->word[command];
+      return 0;
+  }
+
+  errno = EINVAL;
+  return -1;
+}
+
+static bool
+reachable(i2c_sim_dev_t *dev) {
+  for (; dev->parent; dev = dev->parent) {
+    if (dev->parent->sel != dev->parent_sel)
+      return false;
+  }
+  return true;
+}
+
+static int
+smbus_xfer(int fd, struct i2c_smbus_ioctl_data *args) {
+  i2c_sim_dev_t *dev = NULL;
+  uint64_t until;
+  int ret;
+  int i;
+
+  i2c_sim_stats.xfers++;
+
+  pthread_mutex_lock(&sim->lock);
+  for (i = 0; i < sim->dev_cnt; i++) {
+    if (sim->devs[i].bus == fd_bus[fd] - 1 &&
+        sim->devs[i].addr == fd_addr[fd] && reachable(&sim->devs[i])) {
+      dev = &sim->devs[i];
+      break;
+    }
+  }
+
+  if (dev == NULL) {
+    ret = -1;
+    errno = ENXIO;
+  } else if (dev->xfer) {
+    ret = dev->xfer(dev, args->read_write, args->command, args->size,
+                    args->data);
+  } else {
+    ret = i2c_sim_regs_xfer(dev, args->read_write, args->command, args->size,
+                            args->data);
+  }
+
+  /* The transfer holds the bus for its whole duration */
+  if (i2c_sim_latency_us) {
+    until = i2c_sim_now_us() + i2c_sim_latency_us;
+    while (i2c_sim_now_us() < until)
+      ;
+  }
+  pthread_mutex_unlock(&sim->lock);
+
+  return ret;
+}
+
+int
+__wrap_open(const char *path, int flags, ...) {
+  va_list ap;
+  mode_t mode = 0;
+  int bus;
+  int fd;
+
+  if (flags & O_CREAT) {
+    va_start(ap, flags);
+    mode = va_arg(ap, mode_t);
+    va_end(ap);
+  }
+
+  if (sscanf(path, "/dev/i2c-%d", &bus) != 1)
+    return __real_open(path, flags, mode);
+
+  i2c_sim_stats.opens++;
+  fd = __real_open("/dev/null", O_RDWR | (flags & O_CLOEXEC));
+  if (fd < 0 || fd >= MAX_FDS) {
+    errno = EMFILE;
+    return -1;
+  }
+  fd_bus[fd] = bus + 1;
+  fd_addr[fd] = -1;
+
+  return fd;
+}
+
+int
+__wrap_close(int fd) {
+  if (fd >= 0 && fd < MAX_FDS && fd_bus[fd]) {
+    i2c_sim_stats.closes++;
+    fd_bus[fd] = 0;
+  }
+  return __real_close(fd);
+}
+
+int
+__wrap_ioctl(int fd, unsigned long request, ...) {
+  va_list ap;
+  void *arg;
+
+  va_start(ap, request);
+  arg = va_arg(ap, void *);
+  va_end(ap);
+
+  if (fd < 0 || fd >= MAX_FDS || !fd_bus[fd])
+    return __real_ioctl(fd, request, arg);
+
+  switch (request) {
+    case I2C_SLAVE:
+    case I2C_SLAVE_FORCE:
+      i2c_sim_stats.slave_sel++;
+      fd_addr[fd] = (int)(long)arg;
+      return 0;
+    case I2C_SMBUS:
+      return smbus_xfer(fd, arg);
+  }
+
+  errno = ENOTTY;
+  return -1;
+}
+
+FILE *
+__wrap_fopen(const char *path, const char *mode) {
+  const char *contents;
+  int i;
+
+  for (i = 0; i < file_cnt; i++) {
+    if (!strncmp(path, files[i].prefix, strlen(files[i].prefix))) {
+      i2c_sim_stats.files++;
+      contents = files[i].contents;
+      if (contents == NULL) {
+        errno = ENOENT;
+        return NULL;
+      }
+      return fmemopen((void *)contents, strlen(contents), "r");
+    }
+  }
+
+  /* Never fall through to the host's own sysfs */
+  if (!strncmp(path, "/sys/", 5)) {
+    errno = ENOENT;
+    return NULL;
+  }
+
+  return __real_fopen(path, mode);
+}
+
+int
+__wrap_nanosleep(const struct timespec *req, struct timespec *rem) {
+  i2c_sim_stats.slept_ms += req->tv_sec * 1000 + req->tv_nsec / 1000000;
+  return __real_nanosleep(req, rem);
+}
+
+int
+__wrap_clock_gettime(clockid_t clk, struct timespec *ts) {
+  uint64_t us;
+
+  if (clk != CLOCK_MONOTONIC)
+    return __real_clock_gettime(clk, ts);
+
+  us = i2c_sim_now_us();
+  ts->tv_sec = us / 1000000;
+  ts->tv_nsec = (us % 1000000) * 1000;
+
+  return 0;
+}
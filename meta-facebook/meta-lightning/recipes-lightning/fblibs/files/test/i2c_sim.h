@@ -0,0 +1,87 @@
+/* Copyright 2016-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef __I2C_SIM_H__
+#define __I2C_SIM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <facebook/i2c-dev.h>
+
+/*
+ * Simulated /dev/i2c-N buses for host-side tests of the Lightning libraries.
+ * Programs are linked with
+ *   -Wl,--wrap=open,--wrap=close,--wrap=ioctl,--wrap=fopen,
+ *   -Wl,--wrap=nanosleep,--wrap=clock_gettime
+ * so the libraries' own syscalls land here.  Devices live in a shared
+ * mapping, so processes forked after i2c_sim_init() see one bus.
+ */
+
+#define I2C_SIM_MAX_DEVS 128
+
+typedef struct i2c_sim_dev i2c_sim_dev_t;
+
+/* Returns 0, or -1 with errno set; see i2c_sim_regs_xfer() */
+typedef int (*i2c_sim_xfer_fn)(i2c_sim_dev_t *dev, char read_write,
+                               uint8_t command, int size,
+                               union i2c_smbus_data *data);
+
+struct i2c_sim_dev {
+  uint8_t bus;
+  uint8_t addr;
+  bool mux;                 // Writes select a channel of the mux
+  uint8_t sel;              // Last byte written to a mux
+  i2c_sim_dev_t *parent;    // Mux the device sits behind, NULL if none
+  uint8_t parent_sel;       // Parent's sel value that connects the device
+  uint8_t byte[256];        // Byte registers
+  uint16_t word[256];       // Word registers
+  i2c_sim_xfer_fn xfer;     // NULL to serve byte[] and word[]
+  void *priv;
+};
+
+typedef struct {
+  unsigned long opens;      // of /dev/i2c-N
+  unsigned long closes;
+  unsigned long slave_sel;  // I2C_SLAVE ioctls
+  unsigned long xfers;      // I2C_SMBUS ioctls
+  unsigned long mux_writes;
+  unsigned long files;      // Canned sysfs and /tmp files opened
+  unsigned long slept_ms;   // Requested through nanosleep()
+} i2c_sim_stats_t;
+
+extern i2c_sim_stats_t i2c_sim_stats;
+
+/* Time each transfer holds the bus, in microseconds */
+extern int i2c_sim_latency_us;
+
+int i2c_sim_init(void);
+i2c_sim_dev_t *i2c_sim_add(uint8_t bus, uint8_t addr);
+i2c_sim_dev_t *i2c_sim_add_mux(uint8_t bus, uint8_t addr);
+void i2c_sim_behind(i2c_sim_dev_t *dev, i2c_sim_dev_t *mux, uint8_t sel);
+int i2c_sim_regs_xfer(i2c_sim_dev_t *dev, char read_write, uint8_t command,
+                      int size, union i2c_smbus_data *data);
+void i2c_sim_lock(void);
+void i2c_sim_unlock(void);
+
+/* Serve fopen() of any path starting with prefix from contents */
+int i2c_sim_file(const char *prefix, const char *contents);
+
+/* Move CLOCK_MONOTONIC forward without sleeping */
+void i2c_sim_advance_ms(unsigned int ms);
+uint64_t i2c_sim_now_us(void);
+
+#endif /* __I2C_SIM_H__ */
@@ -0,0 +1,294 @@
+/* Copyright 2016-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <facebook/lightning_common.h>
+#include <facebook/lightning_flash.h>
+#include "lightning_sim.h"
+
+#define I2C_BUS_PEB 4
+#define I2C_BUS_FCB 5
+#define I2C_BUS_PDPB 6
+#define I2C_BUS_FLASH1 7
+#define I2C_BUS_FLASH2 8
+
+#define NCT7904_MONITOR_FLAG 0xBA
+#define NCT7904_BANK_SEL 0xFF
+
+typedef struct {
+  ads1015_sim_t ads1015;
+  nct7904_sim_t nct7904;
+} lightning_sim_models_t;
+
+uint8_t lightning_sim_tray;
+i2c_sim_dev_t *lightning_sim_ads1015;
+i2c_sim_dev_t *lightning_sim_nct7904;
+
+static uint8_t sim_sku;
+
+int
+pal_self_tray_location(uint8_t *value) {
+  *value = lightning_sim_tray;
+  return 0;
+}
+
+int
+pal_reset_ssd_switch(void) {
+  return 0;
+}
+
+static uint16_t
+swap16(uint16_t v) {
+  return (v >> 8) | (v << 8);
+}
+
+/* Bring the conversion register up to date with the time now */
+static void
+ads1015_update(ads1015_sim_t *adc) {
+  uint64_t now = i2c_sim_now_us();
+  uint8_t mux;
+  int code;
+
+  if (!adc->converting || now - adc->started < ADS1015_SIM_CONV_US)
+    return;
+
+  /* Full scale is +/-4.096V over 12 bits, left aligned */
+  mux = (adc->config >> 4) & 0x7;
+  code = (int)(adc->volts[mux] * 500 + 0.5);
+  adc->result = swap16((uint16_t)(code << 4));
+  adc->conversions++;
+
+  if (adc->config & 0x1) {
+    /* Single-shot: power down after one conversion */
+    adc->converting = false;
+  } else {
+    adc->started += ADS1015_SIM_CONV_US *
+                    ((now - adc->started) / ADS1015_SIM_CONV_US);
+  }
+}
+
+static int
+ads1015_xfer(i2c_sim_dev_t *dev, char read_write, uint8_t command, int size,
+             union i2c_smbus_data *data) {
+  ads1015_sim_t *adc = dev->priv;
+
+  if (adc->nack || size != I2C_SMBUS_WORD_DATA || command > 1) {
+    errno = EIO;
+    return -1;
+  }
+
+  ads1015_update(adc);
+
+  if (command == 0) {
+    if (read_write == I2C_SMBUS_WRITE) {
+      errno = EIO;
+      return -1;
+    }
+    data->word = adc->result;
+    return 0;
+  }
+
+  if (read_write == I2C_SMBUS_READ) {
+    /* OS reads back 1 while no conversion is running */
+    data->word = (adc->config & ~0x80) | (adc->converting ? 0 : 0x80);
+    return 0;
+  }
+
+  /* Any config write restarts the conversion */
+  adc->config = data->word;
+  adc->started = i2c_sim_now_us();
+  adc->converting = !(adc->config & 0x1) || (adc->config & 0x80);
+
+  return 0;
+}
+
+static int
+nct7904_xfer(i2c_sim_dev_t *dev, char read_write, uint8_t command, int size,
+             union i2c_smbus_data *data) {
+  nct7904_sim_t *nct = dev->priv;
+  pid_t pid = getpid();
+
+  if (size != I2C_SMBUS_BYTE_DATA) {
+    errno = EIO;
+    return -1;
+  }
+
+  if (read_write == I2C_SMBUS_READ) {
+    if (command != NCT7904_MONITOR_FLAG && command != NCT7904_BANK_SEL) {
+      if (nct->window == 0)
+        nct->window = pid;
+      else if (nct->window != pid)
+        nct->overlaps++;
+    }
+    data->byte = dev->byte[command];
+    return 0;
+  }
+
+  dev->byte[command] = data->byte;
+  if (command == NCT7904_MONITOR_FLAG && data->byte <= 1) {
+    /* A DONE token closes the writer's window */
+    if (nct->window == pid)
+      nct->window = 0;
+    if (nct->peer == NCT7904_PEER_IDLE)
+      dev->byte[command] = data->byte ^ 1;
+  }
+
+  return 0;
+}
+
+/* NCT7904 11-bit value at reg, 13-bit for the fan counts */
+static void
+nct7904_set(i2c_sim_dev_t *dev, uint8_t reg, int res, bool fan) {
+  if (fan) {
+    dev->byte[reg] = res >> 5;
+    dev->byte[reg + 1] = res & 0x1f;
+  } else {
+    dev->byte[reg] = res >> 3;
+    dev->byte[reg + 1] = res & 0x7;
+  }
+}
+
+float
+lightning_sim_flash_temp(int flash) {
+  uint8_t map = lightning_flash_list[flash];
+  float base = 20 + (map / 10) * 8 + map % 10;
+
+  /* The second device on an M.2 card runs one degree hotter */
+  return (sim_sku == M2_SKU) ? base + 1 : base;
+}
+
+float
+lightning_sim_amb_temp(int flash) {
+  uint8_t map = lightning_flash_list[flash];
+
+  return 40 + (map / 10) * 8 + map % 10;
+}
+
+static void
+flash_init(void) {
+  i2c_sim_dev_t *mux[2];
+  i2c_sim_dev_t *dev;
+  i2c_sim_dev_t *sec;
+  uint8_t map;
+  uint8_t sel;
+  uint8_t base;
+  int i;
+
+  mux[I2C_MUX_FLASH1] = i2c_sim_add_mux(I2C_BUS_FLASH1, I2C_MUX_FLASH1_ADDR);
+  mux[I2C_MUX_FLASH2] = i2c_sim_add_mux(I2C_BUS_FLASH2, I2C_MUX_FLASH2_ADDR);
+
+  for (i = 0; i < lightning_flash_cnt; i++) {
+    map = lightning_flash_list[i];
+    sel = (1 << 3) | (map % 10);
+    base = 20 + (map / 10) * 8 + map % 10;
+
+    if (sim_sku == U2_SKU) {
+      /* NVMe-MI basic management command */
+      dev = i2c_sim_add(mux[map / 10]->bus, 0x6a);
+      dev->byte[3] = base;
+      i2c_sim_behind(dev, mux[map / 10], sel);
+
+      /* Legacy status read */
+      dev = i2c_sim_add(mux[map / 10]->bus, 0x1b);
+      dev->word[5] = swap16(base << 4);
+      i2c_sim_behind(dev, mux[map / 10], sel);
+      continue;
+    }
+
+    dev = i2c_sim_add(mux[map / 10]->bus, 0x4c);
+    dev->word[0] = 40 + (map / 10) * 8 + map % 10;
+    i2c_sim_behind(dev, mux[map / 10], sel);
+
+    sec = i2c_sim_add_mux(mux[map / 10]->bus, 0x73);
+    i2c_sim_behind(sec, mux[map / 10], sel);
+
+    dev = i2c_sim_add(mux[map / 10]->bus, 0x6a);
+    dev->byte[3] = base;
+    i2c_sim_behind(dev, sec, M2_MUX_CHANNEL_0);
+
+    dev = i2c_sim_add(mux[map / 10]->bus, 0x6a);
+    dev->byte[3] = base + 1;
+    i2c_sim_behind(dev, sec, M2_MUX_CHANNEL_1);
+  }
+}
+
+int
+lightning_sim_init(uint8_t sku) {
+  lightning_sim_models_t *models;
+  i2c_sim_dev_t *dev;
+  int i;
+
+  if (i2c_sim_init() < 0)
+    return -1;
+
+  models = mmap(NULL, sizeof(*models), PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (models == MAP_FAILED)
+    return -1;
+  memset(models, 0, sizeof(*models));
+
+  sim_sku = sku;
+  i2c_sim_file("/tmp/ssd_sku_info", (sku == M2_SKU) ? "M2\n" : "U2\n");
+  i2c_sim_file("/tmp/ssd_vendor", "samsung\n");
+  i2c_sim_file("/tmp/pcie_switch_vendor", "PMC\n");
+  i2c_sim_file("/sys/devices/platform/ast_adc.0/", "12.0\n");
+  i2c_sim_file("/sys/class/i2c-adapter/i2c-6/", "25000\n");
+
+  /* PEB: MAX6654, TMP421 and the ADM1278 */
+  dev = i2c_sim_add(I2C_BUS_PEB, 0x18);
+  dev->word[1] = 60;
+  dev = i2c_sim_add(I2C_BUS_PEB, 0x4c);
+  dev->word[1] = 30;
+  dev = i2c_sim_add(I2C_BUS_PEB, 0x11);
+  for (i = 0; i < 256; i++)
+    dev->word[i] = 0x0800;
+
+  /* FCB: the ADM1276 and the NCT7904 shared with the other tray */
+  dev = i2c_sim_add(I2C_BUS_FCB, 0x22);
+  for (i = 0; i < 256; i++)
+    dev->word[i] = 0x0800;
+
+  dev = i2c_sim_add(I2C_BUS_FCB, 0x2d);
+  dev->xfer = nct7904_xfer;
+  dev->priv = &models->nct7904;
+  nct7904_set(dev, 0x42, 25 * 8, false);      // 25C
+  nct7904_set(dev, 0x46, 27 * 8, false);      // 27C
+  nct7904_set(dev, 0x4a, 500, false);         // 12V
+  nct7904_set(dev, 0x4c, 500, false);
+  nct7904_set(dev, 0x50, 500, false);
+  nct7904_set(dev, 0x5c, 550, false);         // 3.3V
+  for (i = 0; i < 12; i++)
+    nct7904_set(dev, 0x80 + i * 2, 225, true); // 6000 RPM
+  lightning_sim_nct7904 = dev;
+
+  /* PDPB: ADS1015 with P12V on AIN0 and P3V3 on AIN2 (mux 4 and 6) */
+  dev = i2c_sim_add(I2C_BUS_PDPB, 0x48);
+  dev->xfer = ads1015_xfer;
+  dev->priv = &models->ads1015;
+  models->ads1015.config = 0x8385;    // Power-on default, bytes swapped
+  models->ads1015.volts[4] = 2.0;     // P12V through the 6:1 divider
+  models->ads1015.volts[6] = 3.3;
+  lightning_sim_ads1015 = dev;
+
+  flash_init();
+
+  return 0;
+}
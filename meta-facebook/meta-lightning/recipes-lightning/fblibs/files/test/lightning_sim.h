@@ -0,0 +1,64 @@
+/* Copyright 2016-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef __LIGHTNING_SIM_H__
+#define __LIGHTNING_SIM_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "i2c_sim.h"
+
+/*
+ * The Lightning I2C devices read by liblightning-sensor and
+ * liblightning-flash, on top of i2c_sim.  pal_self_tray_location() and
+ * pal_reset_ssd_switch() are stubbed here as well.
+ */
+
+#define ADS1015_SIM_CONV_US 303     // One conversion at 3300 SPS
+
+/* Register-level ADS1015 */
+typedef struct {
+  float volts[8];         // Input on each multiplexer setting
+  uint16_t config;        // As written over SMBus, bytes swapped
+  uint16_t result;        // Conversion register, bytes swapped
+  uint64_t started;       // When the current conversion started, us
+  bool converting;
+  bool nack;              // Fail every transfer
+  unsigned long conversions;
+} ads1015_sim_t;
+
+enum {
+  NCT7904_PEER_NONE = 0,  // Nobody else touches the monitor flag
+  NCT7904_PEER_IDLE,      // The peer tray takes its turn instantly
+};
+
+/* NCT7904, with a check that two processes never read it in one window */
+typedef struct {
+  int peer;
+  pid_t window;           // Process reading since the last DONE, 0 if none
+  unsigned long overlaps; // Reads by one tray inside the other's window
+} nct7904_sim_t;
+
+extern uint8_t lightning_sim_tray;
+extern i2c_sim_dev_t *lightning_sim_ads1015;
+extern i2c_sim_dev_t *lightning_sim_nct7904;
+
+int lightning_sim_init(uint8_t sku);
+float lightning_sim_flash_temp(int flash);
+float lightning_sim_amb_temp(int flash);
+
+#endif /* __LIGHTNING_SIM_H__ */
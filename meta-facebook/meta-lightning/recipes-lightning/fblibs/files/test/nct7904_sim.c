@@ -0,0 +1,204 @@
+/* Copyright 2016-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <facebook/lightning_sensor.h>
+#include "lightning_sim.h"
+
+/*
+ * Two processes, one per tray, poll the FCB sensors through
+ * lightning_sensor_read() against one simulated NCT7904.  Reports the
+ * time each FCB sweep takes and how much of it is spent waiting for the
+ * lease, and counts register reads one tray made inside the other's
+ * window.
+ */
+
+#define DEFAULT_SWEEPS 20
+#define DEFAULT_PERIOD_MS 100
+#define DEFAULT_LATENCY_US 300
+
+int lightning_sensor_read(uint8_t fru, uint8_t sensor_num, void *value);
+
+typedef struct {
+  int sweeps;
+  uint64_t total_us;
+  uint64_t max_us;
+  unsigned long waited_ms;
+  unsigned long failed;
+} tray_result_t;
+
+typedef struct {
+  const char *name;
+  int peer;               // NCT7904_PEER_*
+  int trays;              // 1: upper tray only, 2: both
+  int lower_start_ms;     // Lower tray starts polling this much later...
+  bool lower_in_window;   // ...and then inside the upper tray's window
+} scenario_t;
+
+static int sweeps = DEFAULT_SWEEPS;
+static int period_ms = DEFAULT_PERIOD_MS;
+
+static void
+run_tray(uint8_t location, scenario_t *sc, tray_result_t *res) {
+  nct7904_sim_t *nct = lightning_sim_nct7904->priv;
+  unsigned long slept;
+  uint64_t start;
+  uint64_t us;
+  float value;
+  int i, j;
+
+  lightning_sim_tray = location;
+  if (location == LOWER_TRAY) {
+    usleep(sc->lower_start_ms * 1000);
+    while (sc->lower_in_window && nct->window == 0)
+      ;
+  }
+
+  for (i = 0; i < sweeps; i++) {
+    slept = i2c_sim_stats.slept_ms;
+    start = i2c_sim_now_us();
+    for (j = 0; j < fcb_sensor_cnt; j++) {
+      if (lightning_sensor_read(FRU_FCB, fcb_sensor_list[j], &value) < 0)
+        res->failed++;
+    }
+    us = i2c_sim_now_us() - start;
+
+    res->sweeps++;
+    res->total_us += us;
+    if (us > res->max_us)
+      res->max_us = us;
+    res->waited_ms += i2c_sim_stats.slept_ms - slept;
+
+    usleep(period_ms * 1000);
+  }
+}
+
+static void
+report(const char *name, const char *tray, tray_result_t *res) {
+  printf("%-22s %-6s %9.2f %9.2f %9.2f %7lu\n", name, tray,
+         (double)res->total_us / res->sweeps / 1000,
+         (double)res->max_us / 1000,
+         (double)res->waited_ms / res->sweeps, res->failed);
+}
+
+/* Runs in its own process so every scenario starts from a fresh library */
+static int
+run_scenario(scenario_t *sc) {
+  tray_result_t *res;
+  nct7904_sim_t *nct;
+  pid_t pid[2];
+  int failed = 0;
+  int i;
+
+  res = mmap(NULL, 2 * sizeof(*res), PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (res == MAP_FAILED || lightning_sim_init(M2_SKU) < 0) {
+    perror(sc->name);
+    return 1;
+  }
+  memset(res, 0, 2 * sizeof(*res));
+  nct = lightning_sim_nct7904->priv;
+  nct->peer = sc->peer;
+
+  for (i = 0; i < sc->trays; i++) {
+    pid[i] = fork();
+    if (pid[i] == 0) {
+      run_tray((i == 0) ? UPPER_TRAY : LOWER_TRAY, sc, &res[i]);
+      exit(0);
+    }
+  }
+  for (i = 0; i < sc->trays; i++)
+    waitpid(pid[i], NULL, 0);
+
+  for (i = 0; i < sc->trays; i++) {
+    report(sc->name, (i == 0) ? "upper" : "lower", &res[i]);
+    if (res[i].failed)
+      failed = 1;
+  }
+  if (nct->overlaps) {
+    printf("%-22s %lu reads inside the other tray's window\n", sc->name,
+           nct->overlaps);
+    failed = 1;
+  }
+
+  return failed;
+}
+
+static void
+usage(const char *prog) {
+  fprintf(stderr, "Usage: %s [-n sweeps] [-p period_ms] [-l latency_us]\n",
+          prog);
+  exit(1);
+}
+
+int
+main(int argc, char **argv) {
+  scenario_t scenarios[] = {
+    {"one tray, idle peer", NCT7904_PEER_IDLE, 1, 0, false},
+    {"one tray, no peer", NCT7904_PEER_NONE, 1, 0, false},
+    {"two trays", NCT7904_PEER_NONE, 2, 37, false},
+    /* The upper tray has given up on its peer before the peer appears */
+    {"two trays, late peer", NCT7904_PEER_NONE, 2, 500, true},
+  };
+  int nscenarios = sizeof(scenarios) / sizeof(scenarios[0]);
+  int failed = 0;
+  int status;
+  int opt;
+  pid_t pid;
+  int i;
+
+  i2c_sim_latency_us = DEFAULT_LATENCY_US;
+  while ((opt = getopt(argc, argv, "n:p:l:")) != -1) {
+    switch (opt) {
+      case 'n':
+        sweeps = atoi(optarg);
+        break;
+      case 'p':
+        period_ms = atoi(optarg);
+        break;
+      case 'l':
+        i2c_sim_latency_us = atoi(optarg);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (sweeps < 1)
+    usage(argv[0]);
+
+  printf("%d FCB sweeps %d ms apart per tray, %d us per transfer\n",
+         sweeps, period_ms, i2c_sim_latency_us);
+  printf("%-22s %-6s %9s %9s %9s %7s\n", "scenario", "tray", "avg_ms",
+         "max_ms", "wait_ms", "failed");
+
+  for (i = 0; i < nscenarios; i++) {
+    fflush(stdout);
+    pid = fork();
+    if (pid == 0)
+      exit(run_scenario(&scenarios[i]));
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status))
+      failed = 1;
+  }
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  return failed;
+}
@@ -0,0 +1,239 @@
+/* Copyright 2016-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <facebook/lightning_sensor.h>
+#include "lightning_sim.h"
+
+/*
+ * Read every sensor of the PEB, PDPB and FCB through lightning_sensor_read()
+ * the way sensord does, against the simulated buses, and report the
+ * syscalls, transfers, mux writes and time one full sweep costs.
+ *
+ * Fails if a flash reading does not match its device, or if the PDPB sweep
+ * selects a mux channel more than once: one 1-level write per flash, plus
+ * one 2-level write per M.2 device.
+ */
+
+#define DEFAULT_SWEEPS 20
+#define DEFAULT_PERIOD_MS 2000
+
+int lightning_sensor_read(uint8_t fru, uint8_t sensor_num, void *value);
+
+typedef struct {
+  const char *name;
+  uint8_t fru;
+  const uint8_t *list;
+  size_t cnt;
+  i2c_sim_stats_t stats;
+  uint64_t us;
+  unsigned long failed;
+} fru_sweep_t;
+
+static int mismatches;
+
+static void
+check_pdpb(uint8_t snr_num, float value) {
+  float want;
+  int flash;
+
+  if (snr_num >= PDPB_SENSOR_FLASH_TEMP_0 &&
+      snr_num < PDPB_SENSOR_FLASH_TEMP_0 + lightning_flash_cnt) {
+    flash = snr_num - PDPB_SENSOR_FLASH_TEMP_0;
+    want = lightning_sim_flash_temp(flash);
+  } else if (snr_num >= PDPB_SENSOR_AMB_TEMP_0 &&
+             snr_num < PDPB_SENSOR_AMB_TEMP_0 + lightning_flash_cnt) {
+    flash = snr_num - PDPB_SENSOR_AMB_TEMP_0;
+    want = lightning_sim_amb_temp(flash);
+  } else {
+    return;
+  }
+
+  if (fabsf(value - want) > 0.01) {
+    if (mismatches++ < 10)
+      printf("MISMATCH: sensor 0x%02x read %.2f, device has %.2f\n",
+             snr_num, value, want);
+  }
+}
+
+static void
+sweep(fru_sweep_t *f) {
+  i2c_sim_stats_t before = i2c_sim_stats;
+  uint64_t start;
+  float value;
+  int i;
+
+  start = i2c_sim_now_us();
+  for (i = 0; i < f->cnt; i++) {
+    if (lightning_sensor_read(f->fru, f->list[i], &value) < 0) {
+      f->failed++;
+      continue;
+    }
+    if (f->fru == FRU_PDPB)
+      check_pdpb(f->list[i], value);
+  }
+  f->us += i2c_sim_now_us() - start;
+
+  f->stats.opens += i2c_sim_stats.opens - before.opens;
+  f->stats.closes += i2c_sim_stats.closes - before.closes;
+  f->stats.slave_sel += i2c_sim_stats.slave_sel - before.slave_sel;
+  f->stats.xfers += i2c_sim_stats.xfers - before.xfers;
+  f->stats.mux_writes += i2c_sim_stats.mux_writes - before.mux_writes;
+  f->stats.files += i2c_sim_stats.files - before.files;
+  f->stats.slept_ms += i2c_sim_stats.slept_ms - before.slept_ms;
+}
+
+static void
+report(const char *name, size_t sensors, i2c_sim_stats_t *s, uint64_t us,
+       unsigned long failed, int n) {
+  unsigned long syscalls = s->opens + s->closes + s->slave_sel + s->xfers;
+
+  printf("%-6s %7zu %7.1f %7.1f %7.1f %7.1f %7.1f %8.1f %7.1f %9.2f %6.1f\n",
+         name, sensors, (double)s->opens / n, (double)s->closes / n,
+         (double)s->slave_sel / n, (double)s->xfers / n,
+         (double)s->mux_writes / n, (double)syscalls / n,
+         (double)s->slept_ms / n, (double)us / n / 1000,
+         (double)failed / n);
+}
+
+static void
+usage(const char *prog) {
+  fprintf(stderr, "Usage: %s [-m | -u] [-n sweeps] [-p period_ms] "
+          "[-l latency_us]\n", prog);
+  fprintf(stderr, "  -m/-u       M.2 (default) or U.2 SSD SKU\n");
+  fprintf(stderr, "  -n          sweeps to run (default %d)\n",
+          DEFAULT_SWEEPS);
+  fprintf(stderr, "  -p          time between sweeps (default %d)\n",
+          DEFAULT_PERIOD_MS);
+  fprintf(stderr, "  -l          bus time of one SMBus transfer (default 0)\n");
+  exit(1);
+}
+
+int
+main(int argc, char **argv) {
+  fru_sweep_t frus[] = {
+    {"PEB", FRU_PEB, peb_sensor_pmc_list, peb_sensor_pmc_cnt},
+    {"PDPB", FRU_PDPB, pdpb_m2_sensor_list, pdpb_m2_sensor_cnt},
+    {"FCB", FRU_FCB, fcb_sensor_list, fcb_sensor_cnt},
+  };
+  int nfrus = sizeof(frus) / sizeof(frus[0]);
+  i2c_sim_stats_t total;
+  uint64_t total_us;
+  unsigned long total_failed;
+  size_t total_sensors;
+  size_t mux_budget;
+  uint8_t sku = M2_SKU;
+  int sweeps = DEFAULT_SWEEPS;
+  int period = DEFAULT_PERIOD_MS;
+  int opt;
+  int i, j;
+
+  while ((opt = getopt(argc, argv, "mun:p:l:")) != -1) {
+    switch (opt) {
+      case 'm':
+        sku = M2_SKU;
+        break;
+      case 'u':
+        sku = U2_SKU;
+        break;
+      case 'n':
+        sweeps = atoi(optarg);
+        break;
+      case 'p':
+        period = atoi(optarg);
+        break;
+      case 'l':
+        i2c_sim_latency_us = atoi(optarg);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (sweeps < 2)
+    usage(argv[0]);
+
+  if (sku == U2_SKU) {
+    frus[1].list = pdpb_u2_sensor_list;
+    frus[1].cnt = pdpb_u2_sensor_cnt;
+  }
+
+  if (lightning_sim_init(sku) < 0) {
+    perror("lightning_sim_init");
+    return 1;
+  }
+  ((nct7904_sim_t *)lightning_sim_nct7904->priv)->peer = NCT7904_PEER_IDLE;
+  lightning_sim_tray = UPPER_TRAY;
+
+  /* The first sweep opens the buses; leave it out of the averages */
+  for (i = 0; i < sweeps; i++) {
+    if (i == 1) {
+      for (j = 0; j < nfrus; j++) {
+        memset(&frus[j].stats, 0, sizeof(frus[j].stats));
+        frus[j].us = 0;
+        frus[j].failed = 0;
+      }
+    }
+    for (j = 0; j < nfrus; j++)
+      sweep(&frus[j]);
+    i2c_sim_advance_ms(period);
+  }
+
+  printf("%s SKU, %d sweeps %d ms apart, %d us per transfer; "
+         "per sweep after the first:\n",
+         (sku == M2_SKU) ? "M.2" : "U.2", sweeps, period, i2c_sim_latency_us);
+  printf("%-6s %7s %7s %7s %7s %7s %7s %8s %7s %9s %6s\n", "fru", "sensors",
+         "open", "close", "slave", "xfer", "mux", "syscall", "sleep",
+         "wall_ms", "failed");
+
+  memset(&total, 0, sizeof(total));
+  total_us = 0;
+  total_failed = 0;
+  total_sensors = 0;
+  for (j = 0; j < nfrus; j++) {
+    report(frus[j].name, frus[j].cnt, &frus[j].stats, frus[j].us,
+           frus[j].failed, sweeps - 1);
+    total.opens += frus[j].stats.opens;
+    total.closes += frus[j].stats.closes;
+    total.slave_sel += frus[j].stats.slave_sel;
+    total.xfers += frus[j].stats.xfers;
+    total.mux_writes += frus[j].stats.mux_writes;
+    total.slept_ms += frus[j].stats.slept_ms;
+    total_us += frus[j].us;
+    total_failed += frus[j].failed;
+    total_sensors += frus[j].cnt;
+  }
+  report("total", total_sensors, &total, total_us, total_failed, sweeps - 1);
+
+  if (mismatches) {
+    printf("FAILED: %d flash readings did not match the devices\n",
+           mismatches);
+    return 1;
+  }
+
+  mux_budget = lightning_flash_cnt * ((sku == M2_SKU) ? 3 : 1);
+  if (frus[1].stats.mux_writes > mux_budget * (sweeps - 1)) {
+    printf("FAILED: %.1f mux writes per PDPB sweep, expected at most %zu\n",
+           (double)frus[1].stats.mux_writes / (sweeps - 1), mux_budget);
+    return 1;
+  }
+
+  printf("PASSED\n");
+  return 0;
+}
@@ -25,28 +25,33 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
+#include <unistd.h>
 #include <syslog.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 
+#ifndef SOCK_PATH
 #define SOCK_PATH "/tmp/ipmi_socket"
+#endif
+
 #define MAX_IPMI_RES_LEN 100
 
 /*
- * Function to handle IPMI messages
+ * The connection to ipmid is kept open across requests; ipmid serves
+ * requests on it until we close it.  If ipmid went away in the meantime
+ * the request is retried once on a fresh connection.
  */
-void
-ipmi_handle(unsigned char *request, unsigned char req_len,
-            unsigned char *response, unsigned char *res_len) {
+static int g_sock = -1;
 
-  int s, t, len;
+static int
+ipmi_connect(void) {
+  int s, len;
   struct sockaddr_un remote;
 
-  // TODO: Need to update to reuse the socket instead of creating new
   if ((s = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
     syslog(LOG_ALERT, "ipmi_handle: socket() failed\n");
-    return;
+    return -1;
   }
 
   remote.sun_family = AF_UNIX;
@@ -55,27 +60,52 @@ ipmi_handle(unsigned char *request, unsigned char req_len,
 
   if (connect(s, (struct sockaddr *)&remote, len) == -1) {
     syslog(LOG_ALERT, "ipmi_handle: connect() failed\n");
-    return;
+    close(s);
+    return -1;
   }
 
-  if (send(s, request, req_len, 0) == -1) {
-    syslog(LOG_ALERT, "ipmi_handle: send() failed\n");
-    return;
+  return s;
+}
+
+static void
+ipmi_disconnect(void) {
+  if (g_sock >= 0) {
+    close(g_sock);
+    g_sock = -1;
   }
+}
+
+/*
+ * Function to handle IPMI messages
+ */
+void
+ipmi_handle(unsigned char *request, unsigned char req_len,
+            unsigned char *response, unsigned char *res_len) {
+
+  int t, retry;
+
+  for (retry = 0; retry < 2; retry++) {
+    if (g_sock < 0 && (g_sock = ipmi_connect()) < 0) {
+      return;
+    }
 
-  if ((t=recv(s, response, MAX_IPMI_RES_LEN, 0)) > 0) {
-    *res_len = t;
-  } else {
+    if (send(g_sock, request, req_len, MSG_NOSIGNAL) == -1) {
+      ipmi_disconnect();
+      continue;
+    }
+
+    if ((t=recv(g_sock, response, MAX_IPMI_RES_LEN, 0)) > 0) {
+      *res_len = t;
+      return;
+    }
+
+    ipmi_disconnect();
     if (t < 0) {
       syslog(LOG_ALERT, "ipmi_handle: recv() failed\n");
-    } else {
-      printf("Server closed connection");
+      return;
     }
-
-    return;
+    // ipmid closed the connection, e.g. it was restarted; reconnect
   }
 
-  close(s);
-
-  return;
+  syslog(LOG_ALERT, "ipmi_handle: no response from ipmid\n");
 }
@@ -1394,19 +1394,21 @@ void
   unsigned char res_buf[MAX_IPMI_MSG_SIZE];
   unsigned char res_len = 0;
 
-  n = recv (sock, req_buf, sizeof(req_buf), 0);
-  if (n <= 0) {
-      syslog(LOG_ALERT, "ipmid: recv() failed with %d\n", n);
-      goto conn_cleanup;
-  }
+  // Serve requests until the client closes the connection; sms-kcsd keeps
+  // one open for all KCS traffic
+  while ((n = recv (sock, req_buf, sizeof(req_buf), 0)) > 0) {
+    ipmi_handle(req_buf, n, res_buf, &res_len);
 
-  ipmi_handle(req_buf, n, res_buf, &res_len);
+    if (send (sock, res_buf, res_len, MSG_NOSIGNAL) < 0) {
+      syslog(LOG_ALERT, "ipmid: send() failed\n");
+      break;
+    }
+  }
 
-  if (send (sock, res_buf, res_len, 0) < 0) {
-    syslog(LOG_ALERT, "ipmid: send() failed\n");
+  if (n < 0) {
+      syslog(LOG_ALERT, "ipmid: recv() failed with %d\n", n);
   }
 
-conn_cleanup:
   close(sock);
 
   pthread_exit(NULL);
@@ -21,7 +21,8 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <errno.h>
-#include <fcntl.h>
+#include <time.h>
+#include <openbmc/gpio.h>
 
 #define CHECK(x) { if((x) < 0) { \
     error = x;  \
@@ -33,55 +34,44 @@
     goto cleanup; \
 } }
 
-typedef struct {
-  int fd;
-  int gpio;
-  char value;
-} wgpio;
+static void print_change(int gpio, gpio_value_en last, gpio_value_en curr,
+                         const struct timespec *ts, void *arg) {
+    printf("GPIO%d: %d -> %d at %ld.%06ld\n", gpio, last, curr,
+           (long)ts->tv_sec, ts->tv_nsec / 1000);
+    fflush(stdout);
+}
 
 int main(int argc, char **argv) {
     int error = 0;
-    int nfds =  argc - 1;
     int i = 0;
-    int polliv = 10000;
-    wgpio* wgpios = NULL;
+    int debounce_ms = 0;
+    gpio_watcher_st* watcher = NULL;
 
     if(argc < 2) {
       fprintf(stderr, "Usage: %s <gpio num> [gpio num] [gpio num...]\n", argv[0]);
+      fprintf(stderr, "Set DEBOUNCE_MS to ignore changes shorter than that\n");
       exit(1);
     }
-    if(getenv("POLL_US")) {
-      polliv = atoi(getenv("POLL_US"));
+    if(getenv("DEBOUNCE_MS")) {
+      debounce_ms = atoi(getenv("DEBOUNCE_MS"));
     }
 
-    wgpios = calloc(nfds, sizeof(wgpio));
-    CHECKNULL(wgpios)
+    watcher = gpio_watcher_create();
+    CHECKNULL(watcher)
 
-    fprintf(stderr, "Watching %d gpios:", nfds);
+    fprintf(stderr, "Watching %d gpios:", argc - 1);
     for(i = 1; i < argc; i++) {
-      char filename[255];
       int gpio_num = atoi(argv[i]);
-      wgpios[i - 1].gpio = gpio_num;
-      snprintf(filename, 255, "/sys/class/gpio/gpio%d/value", gpio_num);
-      wgpios[i - 1].fd = open(filename, O_RDONLY);
-      CHECK(wgpios[i - 1].fd);
-      CHECK(read(wgpios[i - 1].fd, &(wgpios[i - 1].value), 1));
-      fprintf(stderr, " %d (currently: %c)", gpio_num, wgpios[i - 1].value);
+      gpio_value_en value;
+      CHECK(gpio_watcher_add(watcher, gpio_num, GPIO_EDGE_BOTH, debounce_ms,
+                             print_change, NULL));
+      gpio_watcher_value(watcher, gpio_num, &value);
+      fprintf(stderr, " %d (currently: %d)", gpio_num, value);
     }
     fprintf(stderr, "\n");
 
     do {
-      usleep(polliv);
-      for(i = 0; i < nfds; i++) {
-          wgpio* w = &wgpios[i];
-          char value;
-          lseek(w->fd, 0, SEEK_SET);
-          CHECK(read(w->fd, &value, 1));
-          if(value != w->value) {
-            printf("GPIO%d: %c -> %c\n", w->gpio, w->value, value);
-            w->value = value;
-          }
-      }
+      CHECK(gpio_watcher_dispatch(watcher, -1));
     } while (1);
 
 cleanup:
@@ -89,5 +79,6 @@ cleanup:
       fprintf(stderr, "Error %d: %s\n", errno, strerror(errno));
       error = 1;
     }
+    gpio_watcher_destroy(watcher);
     return error;
 }
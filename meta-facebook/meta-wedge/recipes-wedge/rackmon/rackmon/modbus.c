@@ -27,6 +27,7 @@
 #include <string.h>
 #include <errno.h>
 #include <sys/ioctl.h>
+#include <poll.h>
 #include <sched.h>
 #include <pthread.h>
 
@@ -39,6 +40,11 @@ int waitfd(int fd, int gpio) {
   while(1) {
     int lsr;
     int ret = ioctl(fd, TIOCSERGETLSR, &lsr);
+    if(ret == -1 && (errno == ENOTTY || errno == EINVAL)) {
+      // Not a UART (e.g. the modbussim pty); just drain the output
+      tcdrain(fd);
+      break;
+    }
     if(ret == -1) {
       fprintf(stderr, "Error checking ioctl: %s\n", strerror(errno));
       break;
@@ -66,40 +72,38 @@ void append_modbus_crc16(char* buf, size_t* len) {
 
 void print_hex(FILE* f, char* buf, size_t len) {
   for(int i = 0; i < len; i++)
-    fprintf(f, "%02x ", buf[i]);
+    fprintf(f, "%02x ", (uint8_t)buf[i]);
 }
 
 size_t read_wait(int fd, char* dst, size_t maxlen, int mdelay_us) {
-  fd_set fdset;
-  struct timeval timeout;
-  char read_buf[16];
-  size_t read_size = 0;
+  struct pollfd pfd;
+  int wait_us = mdelay_us;
   size_t pos = 0;
   memset(dst, 0, maxlen);
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  // Take whatever the driver has buffered on each wakeup; once the reply has
+  // started, the first inter-frame gap marks its end.
   while(pos < maxlen) {
-    FD_ZERO(&fdset);
-    FD_SET(fd, &fdset);
-    timeout.tv_sec = 0;
-    timeout.tv_usec = mdelay_us;
-    int rv = select(fd + 1, &fdset, NULL, NULL, &timeout);
+    int rv = poll(&pfd, 1, (wait_us + 999) / 1000);
     if(rv == -1) {
-      perror("select()");
+      if(errno == EINTR) continue;
+      perror("poll()");
+      break;
     } else if (rv == 0) {
       break;
     }
-    read_size = read(fd, read_buf, 16);
+    ssize_t read_size = read(fd, dst + pos, maxlen - pos);
     if(read_size < 0) {
-      if(errno == EAGAIN) continue;
+      if(errno == EAGAIN || errno == EINTR) continue;
       fprintf(stderr, "read error: %s\n", strerror(errno));
       exit(1);
     }
-    if((pos + read_size) <= maxlen) {
-      memcpy(dst + pos, read_buf, read_size);
-      pos += read_size;
-    } else {
-      return pos;
-      fprintf(stderr, "Response buffer overflowed!\n");
+    if(read_size == 0) {
+      break;
     }
+    pos += read_size;
+    wait_us = MODBUS_FRAME_GAP_US;
   }
   return pos;
 }
@@ -187,31 +191,91 @@ double ts_diff (struct timespec* begin, struct timespec* end) {
     - (1000.0 * (begin->tv_sec) + (1e-6 * begin->tv_nsec));
 }
 
+// A pty (modbussim -p) has no parity and forces CS8|CREAD; some C libraries
+// report that as EINVAL even though every other setting took effect.
+static int set_tty_attr(int fd, struct termios *tio) {
+  struct termios cur;
+  tcflag_t mask = ~(tcflag_t)(PARENB | PARODD | CSIZE | CREAD);
+
+  if (tcsetattr(fd, TCSANOW, tio) == 0) {
+    return 0;
+  }
+  if (errno != EINVAL || tcgetattr(fd, &cur) < 0 ||
+      (cur.c_cflag & mask) != (tio->c_cflag & mask)) {
+    return -1;
+  }
+  return 0;
+}
+
+int modbus_tty_setup(int fd) {
+  struct termios tio;
+
+  if (verbose)
+    fprintf(stderr, "[*] Setting TTY flags!\n");
+  memset(&tio, 0, sizeof(tio));
+  cfsetspeed(&tio,B19200);
+  tio.c_cflag |= PARENB;
+  tio.c_cflag |= CLOCAL;
+  tio.c_cflag |= CS8;
+  tio.c_cflag |= CREAD;
+  tio.c_iflag |= INPCK;
+  tio.c_cc[VMIN] = 1;
+  tio.c_cc[VTIME] = 0;
+  return set_tty_attr(fd, &tio);
+}
+
+int modbus_set_realtime(int on) {
+  // hoped adding the ioctl to do the switching would have alleviated the
+  // need to do SCHED_FIFO, but we still get preempted between the write and
+  // ioctl syscalls w/o it often enough to break f/w updates.
+  struct sched_param sp;
+  sp.sched_priority = on ? 50 : 0;
+  int rc = pthread_setschedparam(pthread_self(),
+                                 on ? SCHED_FIFO : SCHED_OTHER, &sp);
+  if (rc != 0) {
+    fprintf(stderr, "Cannot change scheduling policy: %s\n", strerror(rc));
+    return -1;
+  }
+  return 0;
+}
+
 static long success = 0;
 static long crcfail = 0;
 static long timeout = 0;
 static long stat_wait = 0;
 
+static const int latency_bounds_ms[MODBUS_LATENCY_BUCKETS - 1] = {
+  1, 2, 5, 10, 20, 50, 100, 200, 500,
+};
+static long latency_counts[MODBUS_LATENCY_BUCKETS];
+
+static void record_latency(double ms) {
+  int b = 0;
+  while (b < MODBUS_LATENCY_BUCKETS - 1 && ms >= latency_bounds_ms[b]) {
+    b++;
+  }
+  latency_counts[b]++;
+}
+
+int modbus_latency_histogram(char *buf, size_t len) {
+  int pos = 0;
+  for (int b = 0; b < MODBUS_LATENCY_BUCKETS && pos < len; b++) {
+    if (b < MODBUS_LATENCY_BUCKETS - 1) {
+      pos += snprintf(buf + pos, len - pos, "<%dms: %ld ",
+                      latency_bounds_ms[b], latency_counts[b]);
+    } else {
+      pos += snprintf(buf + pos, len - pos, ">=%dms: %ld",
+                      latency_bounds_ms[b - 1], latency_counts[b]);
+    }
+  }
+  return pos < len ? pos : len - 1;
+}
+
 int modbuscmd(modbus_req *req) {
     int error = 0;
-    struct termios tio;
     char modbus_cmd[req->cmd_len + 2];
     size_t cmd_len = req->cmd_len;
 
-    if (verbose)
-      fprintf(stderr, "[*] Setting TTY flags!\n");
-    memset(&tio, 0, sizeof(tio));
-    // CREAD should be left *off* until we've confirmed THRE
-    // to avoid catching false character starts
-    cfsetspeed(&tio,B19200);
-    tio.c_cflag |= PARENB;
-    tio.c_cflag |= CLOCAL;
-    tio.c_cflag |= CS8;
-    tio.c_iflag |= INPCK;
-    tio.c_cc[VMIN] = 1;
-    tio.c_cc[VTIME] = 0;
-    CHECK(tcsetattr(req->tty_fd,TCSANOW,&tio));
-
     memcpy(modbus_cmd, req->modbus_cmd, cmd_len);
     append_modbus_crc16(modbus_cmd, &cmd_len);
 
@@ -224,13 +288,6 @@ int modbuscmd(modbus_req *req) {
 
     dbg("[*] Writing!\n");
 
-    // hoped adding the ioctl to do the switching would have alleviated the
-    // need to do SCHED_FIFO, but we still get preempted between the write and
-    // ioctl syscalls w/o it often enough to break f/w updates.
-    struct sched_param sp;
-    sp.sched_priority = 50;
-    int policy = SCHED_FIFO;
-    CHECKP(sched, pthread_setschedparam(pthread_self(), policy, &sp));
     // gpio on, write, wait, gpio off
     gpio_write(req->gpio, GPIO_VALUE_HIGH);
     struct timespec write_begin;
@@ -238,17 +295,15 @@ int modbuscmd(modbus_req *req) {
     struct timespec wait_end;
     struct timespec read_end;
     clock_gettime(CLOCK_MONOTONIC_RAW, &write_begin);
-    write(req->tty_fd, modbus_cmd, cmd_len);
+    int written = write(req->tty_fd, modbus_cmd, cmd_len);
     clock_gettime(CLOCK_MONOTONIC_RAW, &wait_begin);
     int waitloops = waitfd(req->tty_fd, req->gpio->gs_gpio);
     clock_gettime(CLOCK_MONOTONIC_RAW, &wait_end);
     gpio_write(req->gpio, GPIO_VALUE_LOW);
-    sp.sched_priority = 0;
-    // Enable UART read
-    tio.c_cflag |= CREAD;
-    CHECK(tcsetattr(req->tty_fd,TCSANOW,&tio));
-    policy = SCHED_OTHER;
-    CHECKP(sched, pthread_setschedparam(pthread_self(), policy, &sp));
+    // Drop anything the receiver picked up while we were driving the bus
+    // (echo, false character starts) instead of toggling CREAD around it
+    tcflush(req->tty_fd, TCIFLUSH);
+    CHECKP(write, written);
 
     dbg("[*] waitfd loops: %d\n", waitloops);
     dbg("[*] reading any response...\n");
@@ -267,8 +322,8 @@ int modbuscmd(modbus_req *req) {
     if(mb_pos >= 4) {
       uint16_t crc = modbus_crc16(req->dest_buf, mb_pos - 2);
       dbg("Modbus response CRC: %04X\n ", crc);
-      if((req->dest_buf[mb_pos - 2] == (crc >> 8)) &&
-          (req->dest_buf[mb_pos - 1] == (crc & 0x00FF))) {
+      if(((uint8_t)req->dest_buf[mb_pos - 2] == (crc >> 8)) &&
+          ((uint8_t)req->dest_buf[mb_pos - 1] == (crc & 0x00FF))) {
         dbg("CRC OK!\n");
       } else {
         dbg("BAD CRC :(\n");
@@ -317,14 +372,18 @@ cleanup:
         fprintf(stderr, "  wait: %.2f ms", ts_diff(&wait_begin, &wait_end));
         fprintf(stderr, "  wait: %d iters", waitloops);
         fprintf(stderr, "  read: %.2f ms\n", ts_diff(&wait_end, &read_end));
+        char hist[256];
+        modbus_latency_histogram(hist, sizeof(hist));
+        fprintf(stderr, "transaction latency: %s\n", hist);
       } else if (!req->scan) {
         stat_wait--;
       }
       if(!req->scan) {
         success++;
+        record_latency(ts_diff(&write_begin, &read_end));
       }
     }
-    return 0;
+    return error;
 }
 
 const char* modbus_strerror(int mb_err) {
@@ -21,6 +21,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <time.h>
 #include <openbmc/gpio.h>
 uint16_t modbus_crc16(char* buffer, size_t length);
 
@@ -51,10 +52,27 @@ int waitfd(int fd, int gpio);
 void decode_hex_in_place(char* buf, size_t* len);
 void append_modbus_crc16(char* buf, size_t* len);
 void print_hex(FILE* f, char* buf, size_t len);
+// Milliseconds from begin to end
+double ts_diff(struct timespec* begin, struct timespec* end);
 
-// Read until maxlen bytes or no bytes in mdelay_us microseconds
+// 3.5 characters at 19200 baud is 2ms; leave room for tty buffer latency
+#define MODBUS_FRAME_GAP_US 5000
+
+// Wait up to mdelay_us for data, then read until maxlen bytes or the line
+// has been silent for MODBUS_FRAME_GAP_US
 size_t read_wait(int fd, char* dst, size_t maxlen, int mdelay_us);
 
+// Session setup, done once instead of around every transaction:
+// put the tty in Modbus RTU mode (19200 8E1, raw, receiver on)
+int modbus_tty_setup(int fd);
+// move the calling thread to or from the real-time priority transactions
+// need; a thread that mostly talks to the bus can stay there
+int modbus_set_realtime(int on);
+
+// Latency of successful transactions, bucketed by upper bound
+#define MODBUS_LATENCY_BUCKETS 10
+int modbus_latency_histogram(char *buf, size_t len);
+
 
 typedef struct _modbus_req {
   int tty_fd;
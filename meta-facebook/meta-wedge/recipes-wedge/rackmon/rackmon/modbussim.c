@@ -26,78 +26,475 @@
 #include <errno.h>
 #include <sys/ioctl.h>
 #include <getopt.h>
+#include <poll.h>
+#include <time.h>
 #include "modbus.h"
 
+
+#define SIM_MAX_PSUS      32
+#define SIM_NUM_REGS      0x200
+// Silence that ends a request frame in simulator mode (usecs)
+#define SIM_FRAME_GAP     5000
+#define SIM_MAX_LINE      512
+
+typedef struct sim_psu {
+  uint8_t addr;
+  uint16_t regs[SIM_NUM_REGS];
+  long requests;
+  long replies;
+  long crc_errors;
+  long dropped;
+} sim_psu;
+
+static sim_psu psus[SIM_MAX_PSUS];
+static int num_psus = 0;
+static int latency_us = 0;
+static int jitter_us = 0;
+static int crc_error_pct = 0;
+static int drop_pct = 0;
+static int stats_interval = 10;
+static unsigned int seed = 1;
+static long unknown_addr = 0;
+static long bad_frames = 0;
+
 void usage() {
   fprintf(stderr,
       "modbussim [-v] [-t <tty>] [-g <gpio>] modbus_request modbus_reply\n"
       "\ttty defaults to %s\n"
       "\tgpio defaults to %d\n"
       "\tmodbus request/reply should be specified in hex\n"
-      "\teg:\ta40300000008\n",
+      "\teg:\ta40300000008\n"
+      "\n"
+      "modbussim [-v] [-t <tty> [-g <gpio>] | -p] [-a <addr,...>] [-r <regmap>]\n"
+      "          [-l <latency ms>] [-j <jitter ms>] [-c <crc error %%>]\n"
+      "          [-d <drop %%>] [-s <stats secs>] [-S <seed>]\n"
+      "\tsimulate a shelf of PSUs answering read/write register requests\n"
+      "\t-p: create a pty instead of opening a tty, its path is printed first\n"
+      "\t-a: addresses to simulate in hex, defaults to all 18 rack addresses;\n"
+      "\t    any other address is a missing device and never answers\n"
+      "\t-r: register map, lines of \"[addr:]reg value...\" in hex; values\n"
+      "\t    fill consecutive registers, a \"quoted string\" packs 2 chars\n"
+      "\t    per register.  Without addr the line applies to every PSU\n"
+      "\t-l/-j: delay every reply by latency plus up to jitter\n"
+      "\t-c: percentage of replies sent with a corrupted CRC\n"
+      "\t-d: percentage of requests silently dropped\n"
+      "\t-s: print request counters every N seconds (0 disables)\n"
+      "\t-S: random seed for jitter, CRC errors and drops\n",
       DEFAULT_TTY, DEFAULT_GPIO);
   exit(1);
 }
 
-int main(int argc, char **argv) {
-    int error = 0;
-    int fd;
-    struct termios tio;
-    gpio_st gs;
-    int gpio_n = DEFAULT_GPIO;
-    char *tty = DEFAULT_TTY;
-    char *modbus_cmd = NULL;
-    char *modbus_reply = NULL;
-    size_t cmd_len = 0;
-    size_t reply_len = 0;
-    verbose = 0;
+static int sim_rand_pct(int pct) {
+  return pct > 0 && (rand_r(&seed) % 100) < pct;
+}
 
-    int opt;
-    while((opt = getopt(argc, argv, "t:g:v"))) {
-      if (opt == -1) break;
-      switch (opt) {
-      case 't':
-        tty = optarg;
-        break;
-      case 'g':
-        gpio_n = atoi(optarg);
-        break;
-      case 'v':
-        verbose = 1;
-        break;
-      default:
-        usage();
+static sim_psu* find_psu(uint8_t addr) {
+  for (int i = 0; i < num_psus; i++) {
+    if (psus[i].addr == addr) {
+      return &psus[i];
+    }
+  }
+  return NULL;
+}
+
+static int add_psu(uint8_t addr) {
+  sim_psu *p;
+
+  if (find_psu(addr) != NULL) {
+    return 0;
+  }
+  if (num_psus >= SIM_MAX_PSUS) {
+    fprintf(stderr, "Too many PSUs, max is %d\n", SIM_MAX_PSUS);
+    return -1;
+  }
+  p = &psus[num_psus++];
+  memset(p, 0, sizeof(*p));
+  p->addr = addr;
+  // Recognisable defaults: address in the high byte, register in the low
+  for (int r = 0; r < SIM_NUM_REGS; r++) {
+    p->regs[r] = (addr << 8) | (r & 0xFF);
+  }
+  return 0;
+}
+
+// Same addressing as rackmond: racks 0-2, shelves 0-1, PSUs 0-2
+static int add_default_psus(void) {
+  for (int rack = 0; rack < 3; rack++) {
+    for (int shelf = 0; shelf < 2; shelf++) {
+      for (int psu = 0; psu < 3; psu++) {
+        if (add_psu(0xA0 | (rack << 3) | (shelf << 2) | psu)) {
+          return -1;
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+static int parse_addrs(char *list) {
+  char *tok;
+  char *save = NULL;
+
+  for (tok = strtok_r(list, ",", &save); tok != NULL;
+       tok = strtok_r(NULL, ",", &save)) {
+    if (add_psu(strtoul(tok, NULL, 16))) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static void set_reg(sim_psu *p, int reg, uint16_t value) {
+  if (reg >= 0 && reg < SIM_NUM_REGS) {
+    p->regs[reg] = value;
+  }
+}
+
+// Apply "value value ..." tokens starting at reg to one PSU
+static void apply_values(sim_psu *p, int reg, char *vals) {
+  char *s = vals;
+
+  while (*s) {
+    if (*s == ' ' || *s == '\t' || *s == '\n' || *s == '\r') {
+      s++;
+    } else if (*s == '"') {
+      char *e = strchr(++s, '"');
+      size_t len = e ? (size_t)(e - s) : strlen(s);
+      for (size_t i = 0; i < len; i += 2) {
+        uint8_t hi = s[i];
+        uint8_t lo = (i + 1 < len) ? s[i + 1] : ' ';
+        set_reg(p, reg++, (hi << 8) | lo);
+      }
+      s += len + (e ? 1 : 0);
+    } else {
+      char *end;
+      unsigned long v = strtoul(s, &end, 16);
+      if (end == s) {
         break;
       }
+      set_reg(p, reg++, v & 0xFFFF);
+      s = end;
     }
-    if(optind < argc) {
-      modbus_cmd = argv[optind++];
-      modbus_reply = argv[optind++];
+  }
+}
+
+static int load_regmap(const char *path) {
+  FILE *f;
+  char line[SIM_MAX_LINE];
+  int lineno = 0;
+
+  f = fopen(path, "r");
+  if (f == NULL) {
+    fprintf(stderr, "Cannot open register map %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+  while (fgets(line, sizeof(line), f) != NULL) {
+    char *s = line;
+    char *end;
+    char *colon;
+    int all = 1;
+    uint8_t addr = 0;
+    int reg;
+
+    lineno++;
+    while (*s == ' ' || *s == '\t') {
+      s++;
     }
-    if(modbus_cmd == NULL || modbus_reply == NULL) {
-      usage();
+    if (*s == '#' || *s == '\n' || *s == '\0') {
+      continue;
+    }
+    colon = strchr(s, ':');
+    if (colon != NULL && colon < strpbrk(s, " \t\n")) {
+      addr = strtoul(s, NULL, 16);
+      all = 0;
+      s = colon + 1;
+    }
+    reg = strtoul(s, &end, 16);
+    if (end == s) {
+      fprintf(stderr, "%s:%d: expected a register\n", path, lineno);
+      continue;
+    }
+    if (all) {
+      for (int i = 0; i < num_psus; i++) {
+        apply_values(&psus[i], reg, end);
+      }
+    } else if (find_psu(addr) != NULL) {
+      apply_values(find_psu(addr), reg, end);
     }
+  }
+  fclose(f);
+  return 0;
+}
 
-    if (verbose)
-      fprintf(stderr, "[*] Opening TTY\n");
-    fd = open(tty, O_RDWR | O_NOCTTY);
-    CHECK(fd);
+static void print_stats(struct timespec *start) {
+  struct timespec now;
+  long total = 0;
+  double secs;
 
-    if (verbose)
-      fprintf(stderr, "[*] Opening GPIO %d\n", gpio_n);
-    CHECK(gpio_open(&gs, gpio_n));
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  secs = ts_diff(start, &now) / 1000.0;
+  for (int i = 0; i < num_psus; i++) {
+    total += psus[i].requests;
+  }
+  total += unknown_addr;
+  printf("stats: %.1fs requests %ld (%.1f/s) missing-addr %ld bad-frames %ld\n",
+         secs, total, secs > 0 ? total / secs : 0.0, unknown_addr, bad_frames);
+  for (int i = 0; i < num_psus; i++) {
+    sim_psu *p = &psus[i];
+    printf("psu %02x: requests %ld replies %ld crc-errors %ld dropped %ld\n",
+           p->addr, p->requests, p->replies, p->crc_errors, p->dropped);
+  }
+  fflush(stdout);
+}
 
-    if (verbose)
-      fprintf(stderr, "[*] Setting TTY flags!\n");
-    memset(&tio, 0, sizeof(tio));
-    cfsetspeed(&tio,B19200);
-    tio.c_cflag |= PARENB;
-    tio.c_cflag |= CLOCAL;
-    tio.c_cflag |= CS8;
-    tio.c_iflag |= INPCK;
-    tio.c_cc[VMIN] = 1;
-    tio.c_cc[VTIME] = 0;
-    CHECK(tcsetattr(fd,TCSANOW,&tio));
+// Expected length of the request at buf, so back-to-back frames can be split
+static size_t request_len(const char *buf, size_t len) {
+  if (len < 2) {
+    return len;
+  }
+  switch ((uint8_t)buf[1]) {
+    case 0x03:
+    case 0x06:
+      return 8;
+    case 0x10:
+      return len >= 7 ? 9 + (uint8_t)buf[6] : len;
+    default:
+      return len;
+  }
+}
+
+static size_t exception_reply(const char *req, char *reply, uint8_t code) {
+  reply[0] = req[0];
+  reply[1] = req[1] | 0x80;
+  reply[2] = code;
+  return 3;
+}
+
+// Build the reply (without CRC) to a CRC-checked request
+static size_t build_reply(sim_psu *p, const char *req, size_t len, char *reply) {
+  uint16_t reg = ((uint8_t)req[2] << 8) | (uint8_t)req[3];
+  uint16_t count = ((uint8_t)req[4] << 8) | (uint8_t)req[5];
+  size_t pos;
+
+  switch ((uint8_t)req[1]) {
+    case 0x03:
+      if (count == 0 || count > 125 || reg + count > SIM_NUM_REGS) {
+        return exception_reply(req, reply, 0x02);
+      }
+      reply[0] = req[0];
+      reply[1] = req[1];
+      reply[2] = count * 2;
+      pos = 3;
+      for (int i = 0; i < count; i++) {
+        reply[pos++] = p->regs[reg + i] >> 8;
+        reply[pos++] = p->regs[reg + i] & 0xFF;
+      }
+      return pos;
+    case 0x06:
+      if (reg >= SIM_NUM_REGS) {
+        return exception_reply(req, reply, 0x02);
+      }
+      p->regs[reg] = count;
+      memcpy(reply, req, 6);
+      return 6;
+    case 0x10:
+      if (count == 0 || reg + count > SIM_NUM_REGS || len < 7 + count * 2) {
+        return exception_reply(req, reply, 0x02);
+      }
+      for (int i = 0; i < count; i++) {
+        p->regs[reg + i] = ((uint8_t)req[7 + i * 2] << 8) |
+                           (uint8_t)req[8 + i * 2];
+      }
+      memcpy(reply, req, 6);
+      return 6;
+    default:
+      return exception_reply(req, reply, 0x01);
+  }
+}
+
+static int send_reply(int fd, gpio_st *gs, struct termios *tio,
+                      char *reply, size_t len) {
+  int error = 0;
+
+  if (gs == NULL) {
+    CHECK(write(fd, reply, len));
+    return 0;
+  }
+  // Disable UART read, gpio on, write, wait, gpio off
+  tio->c_cflag &= ~CREAD;
+  CHECK(tcsetattr(fd, TCSANOW, tio));
+  gpio_write(gs, GPIO_VALUE_HIGH);
+  CHECK(write(fd, reply, len));
+  waitfd(fd, gs->gs_gpio);
+  gpio_write(gs, GPIO_VALUE_LOW);
+  tio->c_cflag |= CREAD;
+  CHECK(tcsetattr(fd, TCSANOW, tio));
+cleanup:
+  return error;
+}
+
+static int handle_request(int fd, gpio_st *gs, struct termios *tio,
+                          char *req, size_t len) {
+  char reply[260];
+  size_t reply_len;
+  sim_psu *p;
+  uint16_t crc;
+  int delay;
+
+  if (verbose) {
+    fprintf(stderr, "Received: ");
+    print_hex(stderr, req, len);
+    fprintf(stderr, "\n");
+  }
+  crc = modbus_crc16(req, len - 2);
+  if ((uint8_t)req[len - 2] != (crc >> 8) ||
+      (uint8_t)req[len - 1] != (crc & 0x00FF)) {
+    bad_frames++;
+    return 0;
+  }
+  p = find_psu(req[0]);
+  if (p == NULL) {
+    unknown_addr++;
+    return 0;
+  }
+  p->requests++;
+  if (sim_rand_pct(drop_pct)) {
+    p->dropped++;
+    return 0;
+  }
+
+  reply_len = build_reply(p, req, len, reply);
+  append_modbus_crc16(reply, &reply_len);
+  if (sim_rand_pct(crc_error_pct)) {
+    reply[reply_len - 1] ^= 0xFF;
+    p->crc_errors++;
+  }
+
+  delay = latency_us;
+  if (jitter_us > 0) {
+    delay += rand_r(&seed) % jitter_us;
+  }
+  if (delay > 0) {
+    usleep(delay);
+  }
+  p->replies++;
+  return send_reply(fd, gs, tio, reply, reply_len);
+}
+
+static int open_pty(int *slave_fd) {
+  struct termios tio;
+  char *name;
+  int fd;
+
+  fd = posix_openpt(O_RDWR | O_NOCTTY);
+  if (fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0 ||
+      (name = ptsname(fd)) == NULL) {
+    fprintf(stderr, "Cannot create pty: %s\n", strerror(errno));
+    return -1;
+  }
+  // Hold the slave open so the master never sees a hangup between clients,
+  // and keep it raw until the client configures it.
+  *slave_fd = open(name, O_RDWR | O_NOCTTY);
+  if (*slave_fd < 0) {
+    fprintf(stderr, "Cannot open %s: %s\n", name, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  tcgetattr(*slave_fd, &tio);
+  cfmakeraw(&tio);
+  tcsetattr(*slave_fd, TCSANOW, &tio);
+  printf("%s\n", name);
+  fflush(stdout);
+  return fd;
+}
+
+static int open_tty(const char *tty, int gpio_n, gpio_st *gs,
+                    struct termios *tio) {
+  int error = 0;
+  int fd;
+
+  if (verbose)
+    fprintf(stderr, "[*] Opening TTY\n");
+  fd = open(tty, O_RDWR | O_NOCTTY);
+  CHECK(fd);
+
+  if (verbose)
+    fprintf(stderr, "[*] Opening GPIO %d\n", gpio_n);
+  CHECK(gpio_open(gs, gpio_n));
+
+  if (verbose)
+    fprintf(stderr, "[*] Setting TTY flags!\n");
+  memset(tio, 0, sizeof(*tio));
+  cfsetspeed(tio,B19200);
+  tio->c_cflag |= PARENB;
+  tio->c_cflag |= CLOCAL;
+  tio->c_cflag |= CS8;
+  tio->c_iflag |= INPCK;
+  tio->c_cc[VMIN] = 1;
+  tio->c_cc[VTIME] = 0;
+  // Enable UART read
+  tio->c_cflag |= CREAD;
+  CHECK(tcsetattr(fd,TCSANOW,tio));
+  gpio_write(gs, GPIO_VALUE_LOW);
+cleanup:
+  if (error != 0) {
+    return error;
+  }
+  return fd;
+}
+
+static int run_sim(int fd, gpio_st *gs, struct termios *tio) {
+  int error = 0;
+  char buf[512];
+  struct timespec start, now, last_stats;
+  struct pollfd pfd;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  last_stats = start;
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  while (1) {
+    int rv = poll(&pfd, 1, 1000);
+    if (rv < 0 && errno != EINTR) {
+      BAIL("poll: %s\n", strerror(errno));
+    }
+    if (rv > 0) {
+      size_t len = read_wait(fd, buf, sizeof(buf), SIM_FRAME_GAP);
+      size_t pos = 0;
+      while (len - pos >= 4) {
+        size_t flen = request_len(buf + pos, len - pos);
+        if (flen > len - pos) {
+          flen = len - pos;
+        }
+        CHECK(handle_request(fd, gs, tio, buf + pos, flen));
+        pos += flen;
+      }
+      if (len > pos) {
+        bad_frames++;
+      }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (stats_interval > 0 &&
+        ts_diff(&last_stats, &now) >= stats_interval * 1000.0) {
+      print_stats(&start);
+      last_stats = now;
+    }
+  }
+cleanup:
+  return error;
+}
+
+static int run_oneshot(const char *tty, int gpio_n,
+                       char *modbus_cmd, char *modbus_reply) {
+    int error = 0;
+    int fd;
+    struct termios tio;
+    gpio_st gs;
+    size_t cmd_len = 0;
+    size_t reply_len = 0;
+
+    fd = open_tty(tty, gpio_n, &gs, &tio);
+    CHECK(fd);
 
     //convert hex to bytes
     cmd_len = strlen(modbus_cmd);
@@ -122,11 +519,6 @@ int main(int argc, char **argv) {
       fprintf(stderr, "\n");
     }
 
-    // Enable UART read
-    tio.c_cflag |= CREAD;
-    CHECK(tcsetattr(fd,TCSANOW,&tio));
-    gpio_write(&gs, GPIO_VALUE_LOW);
-
     if(verbose)
       fprintf(stderr, "[*] Wait for matching command...\n");
 
@@ -138,8 +530,8 @@ wait_for_command:
       printf("Received: ");
       print_hex(stdout, modbus_buf, mb_pos);
       uint16_t crc = modbus_crc16(modbus_buf, mb_pos - 2);
-      if((modbus_buf[mb_pos - 2] == (crc >> 8)) &&
-          (modbus_buf[mb_pos - 1] == (crc & 0x00FF))) {
+      if(((uint8_t)modbus_buf[mb_pos - 2] == (crc >> 8)) &&
+          ((uint8_t)modbus_buf[mb_pos - 1] == (crc & 0x00FF))) {
         if(verbose)
           fprintf(stderr, "CRC OK!\n");
         if(memcmp(modbus_buf, modbus_cmd, cmd_len) == 0) {
@@ -160,19 +552,105 @@ wait_for_command:
     if (verbose)
       fprintf(stderr, "[*] Writing reply!\n");
 
-    // Disable UART read
-    tio.c_cflag &= ~CREAD;
-    CHECK(tcsetattr(fd,TCSANOW,&tio));
-    // gpio on, write, wait, gpio off
-    gpio_write(&gs, GPIO_VALUE_HIGH);
-    write(fd, modbus_reply, reply_len);
-    waitfd(fd, gs.gs_gpio);
-    gpio_write(&gs, GPIO_VALUE_LOW);
+    CHECK(send_reply(fd, &gs, &tio, modbus_reply, reply_len));
+
+cleanup:
+    return error;
+}
+
+int main(int argc, char **argv) {
+    int error = 0;
+    int fd;
+    int slave_fd = -1;
+    struct termios tio;
+    gpio_st gs;
+    int gpio_n = DEFAULT_GPIO;
+    char *tty = DEFAULT_TTY;
+    char *regmap = NULL;
+    char *addrs = NULL;
+    int use_pty = 0;
+    verbose = 0;
+
+    int opt;
+    while((opt = getopt(argc, argv, "t:g:vpa:r:l:j:c:d:s:S:"))) {
+      if (opt == -1) break;
+      switch (opt) {
+      case 't':
+        tty = optarg;
+        break;
+      case 'g':
+        gpio_n = atoi(optarg);
+        break;
+      case 'v':
+        verbose = 1;
+        break;
+      case 'p':
+        use_pty = 1;
+        break;
+      case 'a':
+        addrs = optarg;
+        break;
+      case 'r':
+        regmap = optarg;
+        break;
+      case 'l':
+        latency_us = atoi(optarg) * 1000;
+        break;
+      case 'j':
+        jitter_us = atoi(optarg) * 1000;
+        break;
+      case 'c':
+        crc_error_pct = atoi(optarg);
+        break;
+      case 'd':
+        drop_pct = atoi(optarg);
+        break;
+      case 's':
+        stats_interval = atoi(optarg);
+        break;
+      case 'S':
+        seed = strtoul(optarg, NULL, 0);
+        break;
+      default:
+        usage();
+        break;
+      }
+    }
+
+    // Legacy mode: answer one matching request with a canned reply
+    if(argc - optind == 2 && !use_pty) {
+      error = run_oneshot(tty, gpio_n, argv[optind], argv[optind + 1]);
+      goto cleanup;
+    }
+    if(optind != argc) {
+      usage();
+    }
+
+    if(addrs != NULL) {
+      CHECK(parse_addrs(addrs));
+    } else {
+      CHECK(add_default_psus());
+    }
+    if(regmap != NULL) {
+      CHECK(load_regmap(regmap));
+    }
+
+    if(use_pty) {
+      fd = open_pty(&slave_fd);
+      CHECK(fd);
+      error = run_sim(fd, NULL, NULL);
+    } else {
+      fd = open_tty(tty, gpio_n, &gs, &tio);
+      CHECK(fd);
+      error = run_sim(fd, &gs, &tio);
+    }
 
 cleanup:
     if(error != 0) {
       error = 1;
-      fprintf(stderr, "%s\n", strerror(errno));
+      if(errno != 0) {
+        fprintf(stderr, "%s\n", strerror(errno));
+      }
     }
     return error;
 }
@@ -0,0 +1,256 @@
+#!/usr/bin/env python
+#
+# Copyright 2016-present Facebook. All Rights Reserved.
+#
+# This program file is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by the
+# Free Software Foundation; version 2 of the License.
+#
+# This program is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+# for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program in a file named COPYING; if not, write to the
+# Free Software Foundation, Inc.,
+# 51 Franklin Street, Fifth Floor,
+# Boston, MA 02110-1301 USA
+#
+
+# Run the real rackmond against modbussim on a pty and measure the Modbus
+# request rate, how fresh each PSU's data is, and how long DUMP_DATA_JSON and
+# raw modbuscmd requests take while several clients poll concurrently.
+#
+# This is a developer tool and is not installed in the image.  Run it from
+# the directory where rackmond, modbussim and modbuscmd were built, or point
+# --bindir at them.  rackmond always listens on /var/run/rackmond.sock, so
+# stop the service first (sv stop rackmond) when running this on a BMC.
+
+from __future__ import print_function
+import argparse
+import json
+import os
+import os.path
+import runpy
+import socket
+import struct
+import subprocess
+import sys
+import threading
+import time
+
+SOCK_PATH = "/var/run/rackmond.sock"
+COMMAND_TYPE_DUMP_DATA_JSON = 3
+COMMAND_TYPE_DUMP_STATUS = 6
+
+
+def percentile(samples, pct):
+    if not samples:
+        return 0.0
+    s = sorted(samples)
+    return s[min(len(s) - 1, int(len(s) * pct / 100.0))]
+
+
+def rackmond_command(cmd_type):
+    cmd = struct.pack("@H", cmd_type)
+    client = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    client.connect(SOCK_PATH)
+    client.send(struct.pack("H", len(cmd)) + cmd)
+    chunks = []
+    while True:
+        data = client.recv(65536)
+        if not data:
+            break
+        chunks.append(data)
+    client.close()
+    return b"".join(chunks).decode()
+
+
+def dump_json():
+    return json.loads(rackmond_command(COMMAND_TYPE_DUMP_DATA_JSON))
+
+
+class SimReader(threading.Thread):
+    """Keep the latest request counters modbussim prints."""
+
+    def __init__(self, stream):
+        threading.Thread.__init__(self)
+        self.daemon = True
+        self.stream = stream
+        self.lock = threading.Lock()
+        self.total = 0
+        self.stamp = time.time()
+        self.psus = {}
+
+    def run(self):
+        for line in iter(self.stream.readline, b""):
+            f = line.decode().split()
+            with self.lock:
+                if f and f[0] == "stats:":
+                    self.total = int(f[3])
+                    self.stamp = time.time()
+                elif f and f[0] == "psu":
+                    self.psus[f[1].rstrip(":")] = dict(
+                        zip(f[2::2], [int(v) for v in f[3::2]]))
+
+    def snapshot(self):
+        with self.lock:
+            return self.stamp, self.total, dict(self.psus)
+
+
+class Client(threading.Thread):
+    def __init__(self, stop, fn):
+        threading.Thread.__init__(self)
+        self.daemon = True
+        self.stop = stop
+        self.fn = fn
+        self.latencies = []
+        self.errors = 0
+
+    def run(self):
+        while not self.stop.is_set():
+            begin = time.time()
+            try:
+                self.fn()
+                self.latencies.append((time.time() - begin) * 1000.0)
+            except Exception:
+                self.errors += 1
+                time.sleep(0.1)
+
+
+def report(name, clients):
+    lat = [l for c in clients for l in c.latencies]
+    errors = sum(c.errors for c in clients)
+    print("%-12s %6d calls %4d errors  p50 %7.1f  p90 %7.1f  p99 %7.1f  "
+          "max %7.1f ms" % (name, len(lat), errors, percentile(lat, 50),
+                            percentile(lat, 90), percentile(lat, 99),
+                            max(lat) if lat else 0.0))
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    ap = argparse.ArgumentParser(
+        description="Benchmark rackmond against simulated PSUs")
+    ap.add_argument("--bindir", default=here,
+                    help="directory with rackmond, modbussim and modbuscmd")
+    ap.add_argument("--config",
+                    default=os.path.join(here, "rackmon-config.py"),
+                    help="rackmon-config.py providing the register list")
+    ap.add_argument("--duration", type=int, default=60)
+    ap.add_argument("--warmup", type=int, default=10,
+                    help="seconds to let rackmond discover PSUs first")
+    ap.add_argument("--clients", type=int, default=4,
+                    help="concurrent DUMP_DATA_JSON clients")
+    ap.add_argument("--raw-interval", type=float, default=1.0,
+                    help="seconds between modbuscmd requests, 0 disables")
+    ap.add_argument("--timeout", type=int, default=0,
+                    help="RACKMOND_TIMEOUT in usecs, 0 keeps the default")
+    ap.add_argument("--log", default="/tmp/rackmon-sim-bench.log",
+                    help="where rackmond's output goes")
+    ap.add_argument("sim_args", nargs=argparse.REMAINDER,
+                    help="extra modbussim options after --, "
+                         "e.g. -- -a a0,a1,a2 -l 5 -c 1 -d 1")
+    args = ap.parse_args()
+    sim_args = [a for a in args.sim_args if a != "--"]
+
+    sys.path.insert(0, os.path.dirname(args.config))
+    rackmon_config = runpy.run_path(args.config, run_name="rackmon_config")
+
+    sim = subprocess.Popen([os.path.join(args.bindir, "modbussim"), "-p",
+                            "-s", "1"] + sim_args, stdout=subprocess.PIPE)
+    pty = sim.stdout.readline().decode().strip()
+    sim_stats = SimReader(sim.stdout)
+    sim_stats.start()
+
+    env = dict(os.environ)
+    env["RACKMOND_FOREGROUND"] = "1"
+    env["RACKMOND_TTY"] = pty
+    env["RACKMOND_GPIO"] = "-1"
+    if args.timeout:
+        env["RACKMOND_TIMEOUT"] = str(args.timeout)
+    log = open(args.log, "w")
+    rackmond = subprocess.Popen([os.path.join(args.bindir, "rackmond")],
+                                env=env, stdout=log, stderr=log)
+    stop = threading.Event()
+    clients = []
+    raw = []
+    try:
+        for _ in range(50):
+            if os.path.exists(SOCK_PATH):
+                break
+            time.sleep(0.1)
+        time.sleep(0.5)
+        rackmon_config["configure_rackmond"](rackmon_config["reglist"])
+        time.sleep(args.warmup)
+
+        active = [d["addr"] for d in dump_json()]
+        print("simulator on %s, rackmond sees %d PSUs: %s" %
+              (pty, len(active), " ".join("%02x" % a for a in active)))
+
+        freshness = {}
+
+        def poll_json():
+            for psu in dump_json():
+                last = 0
+                for r in psu["ranges"]:
+                    for reading in r["readings"]:
+                        last = max(last, reading["time"])
+                if last:
+                    freshness.setdefault(psu["addr"], []).append(
+                        psu["now"] - last)
+
+        def poll_raw():
+            # Read MFR_MODEL from the first PSU rackmond found
+            subprocess.check_call(
+                [os.path.join(args.bindir, "modbuscmd"), "-x", "21",
+                 "%02x0300000008" % (active[0] if active else 0xa0)],
+                stdout=open(os.devnull, "w"), stderr=open(os.devnull, "w"))
+            time.sleep(args.raw_interval)
+
+        clients = [Client(stop, poll_json) for _ in range(args.clients)]
+        if args.raw_interval > 0:
+            raw = [Client(stop, poll_raw)]
+        start_stamp, start_total, _ = sim_stats.snapshot()
+        for c in clients + raw:
+            c.start()
+        time.sleep(args.duration)
+        stop.set()
+        for c in clients + raw:
+            c.join()
+        end_stamp, end_total, psus = sim_stats.snapshot()
+
+        elapsed = end_stamp - start_stamp
+        print("modbus requests: %d in %.1fs, %.1f/s" %
+              (end_total - start_total, elapsed,
+               (end_total - start_total) / elapsed if elapsed > 0 else 0.0))
+        report("dump_json", clients)
+        if raw:
+            # Includes modbuscmd process startup and the sleep between calls
+            for c in raw:
+                c.latencies = [l - args.raw_interval * 1000.0
+                               for l in c.latencies]
+            report("modbuscmd", raw)
+        for line in rackmond_command(COMMAND_TYPE_DUMP_STATUS).splitlines():
+            if line.startswith("Transaction latency:"):
+                print(line)
+        print("per-PSU data age (s) and simulator counters:")
+        for addr in sorted(freshness):
+            ages = freshness[addr]
+            counters = psus.get("%02x" % addr, {})
+            print("  %02x: avg %5.1f  max %3d   requests %-7d crc-errors %-5d "
+                  "dropped %d" % (addr, float(sum(ages)) / len(ages),
+                                  max(ages), counters.get("requests", 0),
+                                  counters.get("crc-errors", 0),
+                                  counters.get("dropped", 0)))
+    finally:
+        stop.set()
+        rackmond.terminate()
+        sim.terminate()
+        rackmond.wait()
+        sim.wait()
+        log.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -19,6 +19,17 @@
 #define MAX_ACTIVE_ADDRS 24
 #define REGISTER_PSU_STATUS 0x68
 
+// 3 racks x 2 shelves x 3 PSUs
+#define NUM_PSU_ADDRS 18
+// addresses PSUs were last seen at, tried first on startup
+#define PSU_ADDR_CACHE "/mnt/data/rackmond_psus"
+// empty slots are probed with this timeout (usecs) between monitoring reads
+#define PROBE_TIMEOUT 50000
+// empty slots probed per monitoring pass, at the least
+#define MIN_PROBES_PER_PASS 3
+// a PSU missing this many passes in a row goes back to being probed
+#define PSU_MISSED_LIMIT 3
+
 #define READ_ERROR_RESPONSE -2
 
 struct _lock_holder {
@@ -46,12 +57,34 @@ struct _lock_holder {
 int scanning = 0;
 
 typedef struct _rs485_dev {
-  // hold this for the duration of a command
+  // The bus is handed out in arrival order (a ticket lock) so the real-time
+  // monitoring thread cannot starve raw commands by re-taking it straight
+  // after each transaction; lock only guards the counters.
   pthread_mutex_t lock;
+  pthread_cond_t turn;
+  unsigned int next_ticket;
+  unsigned int now_serving;
   int tty_fd;
   gpio_st gpio;
 } rs485_dev;
 
+// hold the bus for the duration of a command
+void rs485_acquire(rs485_dev *dev) {
+  pthread_mutex_lock(&dev->lock);
+  unsigned int ticket = dev->next_ticket++;
+  while (ticket != dev->now_serving) {
+    pthread_cond_wait(&dev->turn, &dev->lock);
+  }
+  pthread_mutex_unlock(&dev->lock);
+}
+
+void rs485_release(rs485_dev *dev) {
+  pthread_mutex_lock(&dev->lock);
+  dev->now_serving++;
+  pthread_cond_broadcast(&dev->turn);
+  pthread_mutex_unlock(&dev->lock);
+}
+
 typedef struct _register_req {
   uint16_t begin;
   int num;
@@ -67,6 +100,8 @@ typedef struct monitoring_data {
   uint8_t addr;
   uint32_t crc_errors;
   uint32_t timeout_errors;
+  // consecutive passes with no successful read
+  int missed;
   register_range_data range_data[1];
 } monitoring_data;
 
@@ -81,6 +116,8 @@ typedef struct _rackmond_data {
 
   uint8_t num_active_addrs;
   uint8_t active_addrs[MAX_ACTIVE_ADDRS];
+  // set when active_addrs gains an address without stored data
+  int psus_changed;
   monitoring_data* stored_data[MAX_ACTIVE_ADDRS];
   FILE *status_log;
 
@@ -192,7 +229,6 @@ char psu_address(int rack, int shelf, int psu) {
 
 int modbus_command(rs485_dev* dev, int timeout, char* command, size_t len, char* destbuf, size_t dest_limit, size_t expect) {
   int error = 0;
-  lock_holder(devlock, &dev->lock);
   modbus_req req;
   req.tty_fd = dev->tty_fd;
   req.gpio = &dev->gpio;
@@ -203,11 +239,11 @@ int modbus_command(rs485_dev* dev, int timeout, char* command, size_t len, char*
   req.timeout = timeout;
   req.expected_len = expect != 0 ? expect : dest_limit;
   req.scan = scanning;
-  lock_take(devlock);
+  rs485_acquire(dev);
   int cmd_error = modbuscmd(&req);
+  rs485_release(dev);
   CHECK(cmd_error);
 cleanup:
-  lock_release(devlock);
   if (error >= 0) {
     return req.dest_len;
   }
@@ -243,7 +279,7 @@ int read_registers(rs485_dev *dev, int timeout, uint8_t addr, uint16_t begin, ui
     error = -1;
     goto cleanup;
   }
-  if (response[0] != addr) {
+  if ((uint8_t)response[0] != addr) {
     log("Got response for addr %02x when expected %02x\n", response[0], addr);
     error = -1;
     goto cleanup;
@@ -267,44 +303,130 @@ int sub_uint8s(const void* a, const void* b) {
   return (*(uint8_t*)a) - (*(uint8_t*)b);
 }
 
+uint8_t psu_address_at(int idx) {
+  return psu_address(idx / 6, (idx / 3) % 2, idx % 3);
+}
+
+int is_active_psu(uint8_t addr) {
+  for(int i = 0; i < world.num_active_addrs; i++) {
+    if (world.active_addrs[i] == addr) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Remember where PSUs are so a restart can find them without a sweep
+void save_active_psus() {
+  FILE* f = fopen(PSU_ADDR_CACHE ".tmp", "w");
+  if (f == NULL) {
+    return;
+  }
+  for(int i = 0; i < world.num_active_addrs; i++) {
+    fprintf(f, "%02x\n", world.active_addrs[i]);
+  }
+  if (fclose(f) == 0) {
+    rename(PSU_ADDR_CACHE ".tmp", PSU_ADDR_CACHE);
+  }
+}
+
+int load_known_psus(uint8_t* addrs, int max) {
+  FILE* f = fopen(PSU_ADDR_CACHE, "r");
+  unsigned int addr;
+  int n = 0;
+  if (f == NULL) {
+    return 0;
+  }
+  while(n < max && fscanf(f, "%x", &addr) == 1) {
+    addrs[n++] = addr;
+  }
+  fclose(f);
+  return n;
+}
+
+void set_psu_active(uint8_t addr, int active) {
+  lock_holder(worldlock, &world.lock);
+  lock_take(worldlock);
+  if (active && !is_active_psu(addr) &&
+      world.num_active_addrs < MAX_ACTIVE_ADDRS) {
+    world.active_addrs[world.num_active_addrs++] = addr;
+    world.psus_changed = 1;
+  } else if (!active) {
+    for(int i = 0; i < world.num_active_addrs; i++) {
+      if (world.active_addrs[i] == addr) {
+        world.active_addrs[i] =
+          world.active_addrs[--world.num_active_addrs];
+        break;
+      }
+    }
+  }
+  //its the only stdlib sort
+  qsort(world.active_addrs, world.num_active_addrs,
+      sizeof(uint8_t), sub_uint8s);
+  lock_release(worldlock);
+  save_active_psus();
+}
+
+int probe_psu(uint8_t addr, int timeout) {
+  uint16_t status = 0;
+  scanning = 1;
+  int err = read_registers(&world.rs485, timeout, addr,
+      REGISTER_PSU_STATUS, 1, &status);
+  scanning = 0;
+  if (err != 0) {
+    dbg("%02x - %d; ", addr, err);
+  }
+  return err == 0;
+}
+
+// Probe up to budget empty slots, round robin, with a short timeout
+static int probe_pos = 0;
+void probe_empty_slots(int budget) {
+  for(int tried = 0; budget > 0 && tried < NUM_PSU_ADDRS; tried++) {
+    uint8_t addr = psu_address_at(probe_pos);
+    probe_pos = (probe_pos + 1) % NUM_PSU_ADDRS;
+    if (is_active_psu(addr)) {
+      continue;
+    }
+    if (world.paused == 1) {
+      return;
+    }
+    budget--;
+    if (probe_psu(addr, PROBE_TIMEOUT)) {
+      set_psu_active(addr, 1);
+    }
+  }
+}
+
+// Full discovery, run at startup and on request: addresses PSUs were last
+// seen at get the normal timeout, every other slot a short probe.
+// Returns 1 if discovery could not run yet.
 int check_active_psus() {
-  int error = 0;
+  uint8_t known[NUM_PSU_ADDRS];
+  int num_known;
   lock_holder(worldlock, &world.lock);
   lock_take(worldlock);
   if (world.paused == 1) {
+    lock_release(worldlock);
     usleep(1000);
-    goto cleanup;
+    return 1;
   }
   if (world.config == NULL) {
     lock_release(worldlock);
     usleep(5000);
-    goto cleanup;
+    return 1;
   }
-  world.num_active_addrs = 0;
+  lock_release(worldlock);
 
-  scanning = 1;
-  for(int rack = 0; rack < 3; rack++) {
-    for(int shelf = 0; shelf < 2; shelf++) {
-      for(int psu = 0; psu < 3; psu++) {
-        char addr = psu_address(rack, shelf, psu);
-        uint16_t status = 0;
-        int err = read_registers(&world.rs485, world.modbus_timeout, addr, REGISTER_PSU_STATUS, 1, &status);
-        if (err == 0) {
-          world.active_addrs[world.num_active_addrs] = addr;
-          world.num_active_addrs++;
-        } else {
-          dbg("%02x - %d; ", addr, err);
-        }
-      }
+  num_known = load_known_psus(known, NUM_PSU_ADDRS);
+  for(int i = 0; i < num_known; i++) {
+    if (!is_active_psu(known[i]) &&
+        probe_psu(known[i], world.modbus_timeout)) {
+      set_psu_active(known[i], 1);
     }
   }
-  //its the only stdlib sort
-  qsort(world.active_addrs, world.num_active_addrs,
-      sizeof(uint8_t), sub_uint8s);
-cleanup:
-  scanning = 0;
-  lock_release(worldlock);
-  return error;
+  probe_empty_slots(NUM_PSU_ADDRS);
+  return 0;
 }
 
 monitoring_data* alloc_monitoring_data(uint8_t addr) {
@@ -363,6 +485,7 @@ int alloc_monitoring_datas() {
   if (world.config == NULL) {
     goto cleanup;
   }
+  world.psus_changed = 0;
   qsort(world.stored_data, MAX_ACTIVE_ADDRS,
       sizeof(monitoring_data*), sub_storeptrs);
   int data_pos = 0;
@@ -416,14 +539,24 @@ int fetch_monitored_data() {
     goto cleanup;
   }
   if (world.config == NULL) {
+    lock_release(worldlock);
+    usleep(5000);
     goto cleanup;
   }
   lock_release(worldlock);
 
   usleep(1000); // wait a sec btween PSUs to not overload RT scheduling
                 // threshold
-  while(world.stored_data[data_pos] != NULL && data_pos < MAX_ACTIVE_ADDRS) {
-    uint8_t addr = world.stored_data[data_pos]->addr;
+  int probes = MIN_PROBES_PER_PASS;
+  while(data_pos < MAX_ACTIVE_ADDRS && world.stored_data[data_pos] != NULL) {
+    monitoring_data* md = world.stored_data[data_pos];
+    uint8_t addr = md->addr;
+    int timeouts = 0;
+    int responded = 0;
+    if (!is_active_psu(addr)) {
+      data_pos++;
+      continue;
+    }
     //log("readpsu %02x\n", addr);
     for(int r = 0; r < world.config->num_intervals; r++) {
       register_range_data* rd = &world.stored_data[data_pos]->range_data[r];
@@ -440,10 +573,14 @@ int fetch_monitored_data() {
           }
           if(err == MODBUS_RESPONSE_TIMEOUT) {
             world.stored_data[data_pos]->timeout_errors++;
+            timeouts++;
           }
+        } else {
+          responded = 1;
         }
         continue;
       }
+      responded = 1;
       struct timespec ts;
       clock_gettime(CLOCK_REALTIME, &ts);
       uint32_t timestamp = ts.tv_sec;
@@ -477,27 +614,42 @@ int fetch_monitored_data() {
       record_data(rd, timestamp, regs);
       lock_release(worldlock);
     }
+    if (responded) {
+      md->missed = 0;
+    } else if (timeouts > 0 && ++md->missed >= PSU_MISSED_LIMIT) {
+      log("PSU at address 0x%02x stopped responding\n", addr);
+      syslog(LOG_INFO, "PSU at address 0x%02x stopped responding", addr);
+      md->missed = 0;
+      set_psu_active(addr, 0);
+    }
     data_pos++;
+    // pack a short probe of an empty slot between PSUs
+    probe_empty_slots(1);
+    probes--;
+  }
+  if (probes > 0) {
+    probe_empty_slots(probes);
   }
 cleanup:
   lock_release(worldlock);
   return error;
 }
 
-// check for new psus every N seconds
-static int search_at = 0;
-#define SEARCH_PSUS_EVERY 120
+// set to run a full discovery before the next monitoring pass
+static int scan_requested = 0;
 void* monitoring_loop(void* arg) {
   (void) arg;
   world.status_log = fopen("/var/log/psu-status.log", "a+");
+  // this thread spends its life on the bus; switch once, not per request
+  if (modbus_set_realtime(1) != 0) {
+    syslog(LOG_WARNING, "monitoring without real-time priority");
+  }
   while(1) {
-    struct timespec ts;
-    clock_gettime(CLOCK_REALTIME, &ts);
-    if (search_at < ts.tv_sec) {
-      check_active_psus();
+    if (scan_requested && check_active_psus() == 0) {
+      scan_requested = 0;
+    }
+    if (world.psus_changed) {
       alloc_monitoring_datas();
-      clock_gettime(CLOCK_REALTIME, &ts);
-      search_at = ts.tv_sec + SEARCH_PSUS_EVERY;
     }
     fetch_monitored_data();
   }
@@ -510,14 +662,23 @@ int open_rs485_dev(const char* tty_filename, int gpio_num, rs485_dev *dev) {
   dbg("[*] Opening TTY\n");
   tty_fd = open(tty_filename, O_RDWR | O_NOCTTY);
   CHECK(tty_fd);
+  CHECK(modbus_tty_setup(tty_fd));
 
-  dbg("[*] Opening GPIO %d\n", gpio_num);
-  gpio_open(&dev->gpio, gpio_num);
-  dbg("[*] Set GPIO %d dir to out\n", gpio_num);
-  gpio_change_direction(&dev->gpio, GPIO_DIRECTION_OUT);
+  // A negative gpio means there is no transceiver to switch (e.g. a pty)
+  dev->gpio.gs_gpio = gpio_num;
+  dev->gpio.gs_fd = -1;
+  if (gpio_num >= 0) {
+    dbg("[*] Opening GPIO %d\n", gpio_num);
+    gpio_open(&dev->gpio, gpio_num);
+    dbg("[*] Set GPIO %d dir to out\n", gpio_num);
+    gpio_change_direction(&dev->gpio, GPIO_DIRECTION_OUT);
+  }
 
   dev->tty_fd = tty_fd;
   pthread_mutex_init(&dev->lock, NULL);
+  pthread_cond_init(&dev->turn, NULL);
+  dev->next_ticket = 0;
+  dev->now_serving = 0;
 cleanup:
   return error;
 }
@@ -541,10 +702,14 @@ int do_command(int sock, rackmond_command* cmd) {
           expected = 1024;
         }
         char response[expected];
+        // raw commands are rare (f/w updates aside), so only this request
+        // runs real-time rather than the whole connection handler
+        modbus_set_realtime(1);
         int response_len = modbus_command(
             &world.rs485, timeout,
             cmd->raw_modbus.data, cmd->raw_modbus.length,
             response, expected, expected);
+        modbus_set_realtime(0);
         uint16_t response_len_wire = response_len;
         if(response_len < 0) {
           uint16_t error = -response_len;
@@ -568,10 +733,7 @@ int do_command(int sock, rackmond_command* cmd) {
         world.config = calloc(1, config_size);
         memcpy(world.config, &cmd->set_config.config, config_size);
         syslog(LOG_INFO, "got configuration");
-        struct timespec ts;
-        clock_gettime(CLOCK_REALTIME, &ts);
-        uint32_t now = ts.tv_sec;
-        search_at = now;
+        scan_requested = 1;
         lock_release(worldlock);
         break;
       }
@@ -581,9 +743,6 @@ int do_command(int sock, rackmond_command* cmd) {
         if (world.config == NULL) {
           bprintf(&wb, "Unconfigured\n");
         } else {
-          struct timespec ts;
-          clock_gettime(CLOCK_REALTIME, &ts);
-          uint32_t now = ts.tv_sec;
           int data_pos = 0;
           bprintf(&wb, "Monitored PSUs:\n");
           while(world.stored_data[data_pos] != NULL && data_pos < MAX_ACTIVE_ADDRS) {
@@ -593,12 +752,20 @@ int do_command(int sock, rackmond_command* cmd) {
                 world.stored_data[data_pos]->timeout_errors);
             data_pos++;
           }
-          bprintf(&wb, "Active on last scan: ");
+          bprintf(&wb, "Active: ");
           for(int i = 0; i < world.num_active_addrs; i++) {
             bprintf(&wb, "%02x ", world.active_addrs[i]);
           }
           bprintf(&wb, "\n");
-          bprintf(&wb, "Next scan in %d seconds.\n", search_at - now);
+          if (scan_requested) {
+            bprintf(&wb, "Full scan pending.\n");
+          } else {
+            bprintf(&wb, "Probing empty slots between reads, next %02x.\n",
+                psu_address_at(probe_pos));
+          }
+          char hist[256];
+          modbus_latency_histogram(hist, sizeof(hist));
+          bprintf(&wb, "Transaction latency: %s\n", hist);
         }
         lock_release(worldlock);
         break;
@@ -609,10 +776,7 @@ int do_command(int sock, rackmond_command* cmd) {
         if (world.config == NULL) {
           bprintf(&wb, "Unconfigured\n");
         } else {
-          struct timespec ts;
-          clock_gettime(CLOCK_REALTIME, &ts);
-          uint32_t now = ts.tv_sec;
-          search_at = now;
+          scan_requested = 1;
           bprintf(&wb, "Triggering PSU scan...\n");
         }
         lock_release(worldlock);
@@ -725,7 +889,9 @@ int handle_connection(int sock) {
   // if you don't do anything for a whole second we bail
 next:
   CHECKP(poll, poll(&pfd, 1, 1000));
-  if (pfd.revents & (POLLERR | POLLHUP)) {
+  // a client may send its command and hang up straight away (rackmond.py
+  // does); only give up once there is nothing left to read
+  if ((pfd.revents & (POLLERR | POLLHUP)) && !(pfd.revents & POLLIN)) {
     goto cleanup;
   }
   switch(state) {
@@ -774,7 +940,15 @@ int main(int argc, char** argv) {
   verbose = getenv("RACKMOND_VERBOSE") != NULL ? 1 : 0;
   openlog("rackmond", 0, LOG_USER);
   syslog(LOG_INFO, "rackmon/modbus service starting");
-  CHECK(open_rs485_dev(DEFAULT_TTY, DEFAULT_GPIO, &world.rs485));
+  const char *tty = DEFAULT_TTY;
+  int gpio = DEFAULT_GPIO;
+  if (getenv("RACKMOND_TTY") != NULL) {
+    tty = getenv("RACKMOND_TTY");
+  }
+  if (getenv("RACKMOND_GPIO") != NULL) {
+    gpio = atoi(getenv("RACKMOND_GPIO"));
+  }
+  CHECK(open_rs485_dev(tty, gpio, &world.rs485));
   pthread_t monitoring_thread;
   pthread_create(&monitoring_thread, NULL, monitoring_loop, NULL);
   struct sockaddr_un local, client;
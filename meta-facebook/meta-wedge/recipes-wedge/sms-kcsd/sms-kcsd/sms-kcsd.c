@@ -7,7 +7,6 @@
  * and respond to the command using IPMI stack
  *
  * TODO:  Determine if the daemon is already started.
- * TODO:  Cache the file descriptors instead of fopen/fclose everytime
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -28,23 +27,39 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <syslog.h>
 #include <facebook/alert_control.h>
 #include <facebook/ipmi.h>
+#include <openbmc/gpio.h>
 
 
+#ifndef PATH_SMS_KCS
 #define PATH_SMS_KCS "/sys/bus/i2c/drivers/panther_plus/4-0040/sms_kcs"
+#endif
+
 #define MAX_ALERT_CONTROL_RETRIES 3
 
+// PANTHER_I2C_ALERT_N, GPIO B0; asserted while an alert is enabled and pending
+#define GPIO_PANTHER_ALERT 8
+
+/*
+ * Fallback poll interval.  With the alert GPIO watched for edges this only
+ * covers a missed edge; without it, it is the KCS polling interval.
+ */
+#define KCS_POLL_MS 1000
+#define KCS_EDGE_POLL_MS 5000
+
 typedef struct {
   unsigned char fbid;
   unsigned char length;
   unsigned char buf[];
 } kcs_msg_t;
 
+static int kcs_fd = -1;
+
 /*
  * Function to check if there is any new KCS message available
- * TODO: Will be replaced by interrupt-driven approach
  */
 static bool
 is_new_kcs_msg(void) {
@@ -56,33 +71,33 @@ is_new_kcs_msg(void) {
  *  - Reads the incoming request on KCS channel
  *  - Invokes IPMI handler to provide response
  *  - Writes reply back to KCS channel
+ *
+ * The KCS attribute is opened once and accessed at offset 0 with pread and
+ * pwrite; it is reopened only after an error.
  */
 static int
 handle_kcs_msg(void) {
-  FILE *fp;
   kcs_msg_t *msg;
   unsigned char rbuf[256] = {0};
   unsigned char tbuf[256] = {0};
   unsigned char tlen = 0;
   int count = 0;
-  int i = 0;
 
-  // Reads incoming request
-  fp = fopen(PATH_SMS_KCS, "r");
-  if (!fp) {
-    syslog(LOG_ALERT, "failed to open file %s\n", PATH_SMS_KCS);
-    return -1;
+  if (kcs_fd < 0) {
+    kcs_fd = open(PATH_SMS_KCS, O_RDWR);
+    if (kcs_fd < 0) {
+      syslog(LOG_ALERT, "failed to open file %s\n", PATH_SMS_KCS);
+      return -1;
+    }
   }
 
-  count = fread(rbuf, sizeof(unsigned char), sizeof(rbuf), fp);
-  if (count == 0) {
-    syslog(LOG_INFO, "fread returns zero bytes\n");
-    fclose(fp);
-    return -1;
+  // Reads incoming request
+  count = pread(kcs_fd, rbuf, sizeof(rbuf), 0);
+  if (count <= 0) {
+    syslog(LOG_INFO, "read returns %d bytes\n", count);
+    goto kcs_error;
   }
 
-  fclose(fp);
-
   msg = (kcs_msg_t*)rbuf;
 
   // Invoke IPMI handler
@@ -92,28 +107,32 @@ handle_kcs_msg(void) {
   tbuf[0] = tlen;
 
   //Write Reply back to KCS channel
-  fp = fopen(PATH_SMS_KCS, "w");
-  if (!fp) {
-    syslog(LOG_ALERT, "failed to open file %s\n", PATH_SMS_KCS);
-    return -1;
-  }
-
-  count = fwrite(tbuf, sizeof(unsigned char), tlen+1, fp);
+  count = pwrite(kcs_fd, tbuf, tlen+1, 0);
   if (count != tlen+1) {
-    syslog(LOG_ALERT, "fwrite returns: %d, expected: %d\n", count, tlen+1);
-    fclose(fp);
-    return -1;
+    syslog(LOG_ALERT, "write returns: %d, expected: %d\n", count, tlen+1);
+    goto kcs_error;
   }
 
-  fclose(fp);
-
   return 0;
+
+kcs_error:
+  close(kcs_fd);
+  kcs_fd = -1;
+  return -1;
+}
+
+// Nothing to do per edge; the main loop drains pending messages afterwards
+static void
+kcs_alert_event(int gpio, gpio_value_en last, gpio_value_en curr,
+                const struct timespec *ts, void *arg) {
 }
 
 /*
  * Daemon Main loop
  */
 int main(int argc, char **argv) {
+  gpio_watcher_st *w;
+  bool edges = false;
   int i;
   int ret;
   daemon(1, 0);
@@ -134,11 +153,29 @@ int main(int argc, char **argv) {
     exit(-1);
   }
 
-  // Forever loop to poll and process KCS messages
+  // Wake up on the falling edge of the alert line instead of polling
+  w = gpio_watcher_create();
+  if (w != NULL && gpio_watcher_add(w, GPIO_PANTHER_ALERT, GPIO_EDGE_FALLING,
+                                    0, kcs_alert_event, NULL) == 0) {
+    edges = true;
+  } else {
+    syslog(LOG_WARNING, "No edge events for the alert GPIO, polling\n");
+  }
+
+  // Forever loop to wait for and process KCS messages
   while (1) {
-    if (is_new_kcs_msg()) {
-      handle_kcs_msg();
+    // The alert stays asserted while a request is pending, so handle
+    // everything that queued up while the previous message was served
+    while (is_new_kcs_msg()) {
+      if (handle_kcs_msg()) {
+        break;
+      }
+    }
+
+    if (edges) {
+      gpio_watcher_dispatch(w, KCS_EDGE_POLL_MS);
+    } else {
+      usleep(KCS_POLL_MS * 1000);
     }
-    sleep(1);
   }
 }
@@ -0,0 +1,308 @@
+/*
+ * sms_kcsd_test
+ *
+ * Copyright 2014-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Runs sms-kcsd's loop and the real libipmi against a regular file in
+ * place of the sms_kcs attribute and a stub ipmid on a local socket.
+ * The test plays the host: it writes a request at offset 0, raises the
+ * alert and its GPIO edge, and waits for the daemon's reply at offset 0.
+ * It reports commands/s and latency percentiles, and checks that every
+ * reply matches its request, that the attribute is opened once, and that
+ * all requests share one ipmid connection except across a simulated
+ * ipmid restart.  With -p the alert GPIO has no edge support and the
+ * daemon falls back to polling.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define main sms_kcsd_main
+#include "../sms-kcsd.c"
+#undef main
+
+#define EDGE_CMDS   20000
+#define POLL_CMDS   5
+#define REPLY_MS    (3 * KCS_POLL_MS)
+
+#define NETFN_APP_REQ   0x06
+#define CMD_GET_DEV_ID  0x01
+
+ssize_t __real_pwrite(int fd, const void *buf, size_t count, off_t offset);
+int __real_open(const char *path, int flags, ...);
+
+static pthread_mutex_t stub_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stub_cond = PTHREAD_COND_INITIALIZER;
+static bool stub_pending;         // Alert raised, reply not written yet
+static bool stub_edges = true;
+static int stub_kcs_opens;
+static int stub_pipe[2];
+static gpio_event_handler stub_handler;
+
+static int ipmid_conns;           // Connections accepted by the stub ipmid
+static int ipmid_drop_after = -1; // Close the connection after this request
+static int ipmid_reqs;
+
+static int failed;
+
+static uint64_t
+now_us(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int
+__wrap_daemon(int nochdir, int noclose) {
+  return 0;
+}
+
+int
+__wrap_open(const char *path, int flags, ...) {
+  if (!strcmp(path, PATH_SMS_KCS)) {
+    pthread_mutex_lock(&stub_lock);
+    stub_kcs_opens++;
+    pthread_mutex_unlock(&stub_lock);
+  }
+  return __real_open(path, flags, 0644);
+}
+
+// The panther_plus driver clears the alert once the reply is written
+ssize_t
+__wrap_pwrite(int fd, const void *buf, size_t count, off_t offset) {
+  ssize_t ret = __real_pwrite(fd, buf, count, offset);
+
+  pthread_mutex_lock(&stub_lock);
+  stub_pending = false;
+  pthread_cond_signal(&stub_cond);
+  pthread_mutex_unlock(&stub_lock);
+  return ret;
+}
+
+int
+alert_control(e_fbid_t id, e_flag_t cflag) {
+  return 0;
+}
+
+bool
+is_alert_present(e_fbid_t id) {
+  bool pending;
+
+  pthread_mutex_lock(&stub_lock);
+  pending = stub_pending;
+  pthread_mutex_unlock(&stub_lock);
+  return id == FBID_SMS_KCS && pending;
+}
+
+/* The alert GPIO is a pipe: each byte written is one falling edge */
+gpio_watcher_st *
+gpio_watcher_create(void) {
+  if (!stub_edges || pipe(stub_pipe))
+    return NULL;
+  return (gpio_watcher_st *)stub_pipe;
+}
+
+int
+gpio_watcher_add(gpio_watcher_st *w, int gpio, gpio_edge_en edge,
+                 int debounce_ms, gpio_event_handler handler, void *arg) {
+  stub_handler = handler;
+  return 0;
+}
+
+int
+gpio_watcher_dispatch(gpio_watcher_st *w, int timeout_ms) {
+  struct pollfd pfd = { .fd = stub_pipe[0], .events = POLLIN };
+  uint8_t b;
+
+  if (poll(&pfd, 1, timeout_ms) <= 0)
+    return 0;
+  if (read(stub_pipe[0], &b, 1) == 1)
+    stub_handler(GPIO_PANTHER_ALERT, GPIO_VALUE_HIGH, GPIO_VALUE_LOW, NULL,
+                 NULL);
+  return 0;
+}
+
+/*
+ * Stub ipmid: serves requests on a connection until the client closes it,
+ * like ipmid.  The reply is the response NetFn, the command, completion
+ * code 0 and the request data echoed back.
+ */
+static void *
+ipmid_thread(void *arg) {
+  int lsock = *(int *)arg;
+  unsigned char req[256], res[256];
+  int sock, n;
+
+  while ((sock = accept(lsock, NULL, NULL)) >= 0) {
+    ipmid_conns++;
+    while ((n = recv(sock, req, sizeof(req), 0)) >= 2) {
+      res[0] = req[0] + (1 << 2);
+      res[1] = req[1];
+      res[2] = 0;
+      memcpy(&res[3], &req[2], n - 2);
+      if (send(sock, res, n + 1, MSG_NOSIGNAL) < 0)
+        break;
+      if (++ipmid_reqs == ipmid_drop_after)
+        break;
+    }
+    close(sock);
+  }
+  return NULL;
+}
+
+static int
+ipmid_start(void) {
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  static int lsock;
+  pthread_t tid;
+
+  unlink(SOCK_PATH);
+  strcpy(addr.sun_path, SOCK_PATH);
+  lsock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (lsock < 0 || bind(lsock, (struct sockaddr *)&addr, sizeof(addr)) ||
+      listen(lsock, 5))
+    return -1;
+  return pthread_create(&tid, NULL, ipmid_thread, &lsock);
+}
+
+static void *
+kcsd_thread(void *arg) {
+  sms_kcsd_main(0, NULL);
+  return NULL;
+}
+
+/*
+ * One host command: Get Device ID carrying seq as data.  Returns the
+ * latency in microseconds, or -1 if the reply is missing or wrong.
+ */
+static int64_t
+kcs_command(int fd, uint32_t seq) {
+  unsigned char req[8] = { FBID_SMS_KCS, 6, NETFN_APP_REQ << 2,
+                           CMD_GET_DEV_ID };
+  unsigned char res[16];
+  struct timespec deadline;
+  uint64_t start;
+  bool pending;
+  uint8_t b = 0;
+
+  memcpy(&req[4], &seq, sizeof(seq));
+  if (__real_pwrite(fd, req, sizeof(req), 0) != sizeof(req))
+    return -1;
+
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += REPLY_MS / 1000;
+  start = now_us();
+
+  pthread_mutex_lock(&stub_lock);
+  stub_pending = true;
+  pthread_mutex_unlock(&stub_lock);
+  if (stub_edges && write(stub_pipe[1], &b, 1) != 1)
+    return -1;
+
+  pthread_mutex_lock(&stub_lock);
+  while (stub_pending &&
+         pthread_cond_timedwait(&stub_cond, &stub_lock, &deadline) == 0)
+    ;
+  pending = stub_pending;
+  pthread_mutex_unlock(&stub_lock);
+  if (pending)
+    return -1;
+
+  // Length, NetFn, command, completion code, seq
+  if (pread(fd, res, 8, 0) != 8 || res[0] != 7 ||
+      res[1] != ((NETFN_APP_REQ + 1) << 2) || res[2] != CMD_GET_DEV_ID ||
+      res[3] != 0 || memcmp(&res[4], &seq, sizeof(seq)))
+    return -1;
+  return now_us() - start;
+}
+
+static int
+cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+static void
+check(const char *name, int ok) {
+  printf("%s: %s\n", ok ? "PASS" : "FAIL", name);
+  if (!ok)
+    failed = 1;
+}
+
+int
+main(int argc, char **argv) {
+  static uint64_t lat[EDGE_CMDS];
+  pthread_t tid;
+  uint64_t start, elapsed;
+  int64_t us;
+  int n_cmds, bad = 0, fd, i;
+
+  if (argc > 1 && !strcmp(argv[1], "-p"))
+    stub_edges = false;
+  n_cmds = stub_edges ? EDGE_CMDS : POLL_CMDS;
+  ipmid_drop_after = n_cmds / 2;
+
+  fd = __real_open(PATH_SMS_KCS, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0 || ipmid_start()) {
+    perror("setup");
+    return 1;
+  }
+  pthread_create(&tid, NULL, kcsd_thread, NULL);
+  usleep(100 * 1000);
+
+  start = now_us();
+  for (i = 0; i < n_cmds; i++) {
+    us = kcs_command(fd, i);
+    if (us < 0) {
+      bad++;
+      us = REPLY_MS * 1000;
+    }
+    lat[i] = us;
+  }
+  elapsed = now_us() - start;
+
+  qsort(lat, n_cmds, sizeof(lat[0]), cmp_u64);
+  printf("%s: %d commands, %.0f commands/s, latency p50 %llu us, "
+         "p99 %llu us, max %llu us\n",
+         stub_edges ? "alert edge" : "polling", n_cmds,
+         n_cmds * 1e6 / elapsed, (unsigned long long)lat[n_cmds / 2],
+         (unsigned long long)lat[n_cmds * 99 / 100],
+         (unsigned long long)lat[n_cmds - 1]);
+
+  check("every command got its own reply", bad == 0);
+  check("KCS attribute opened once", stub_kcs_opens == 1);
+  check("one ipmid connection, plus one after the restart",
+        ipmid_conns == 2);
+  if (stub_edges)
+    check("p99 latency well under the poll interval",
+          lat[n_cmds * 99 / 100] * 10 < KCS_POLL_MS * 1000);
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  return failed;
+}
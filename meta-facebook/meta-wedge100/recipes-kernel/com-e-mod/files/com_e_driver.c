@@ -36,6 +36,14 @@
 
 #endif
 
+/*
+ * fand reads temp1_input every few seconds and "sensors" (the REST
+ * sensors endpoint) walks every input; both read through the same cache.
+ * The EC auto-increments the register address, so the 16-bit inputs are
+ * fetched with one block read instead of two byte reads.
+ */
+#define COM_E_CACHE_MS 1000
+
 static ssize_t i2c_dev_show_mac(struct device *dev,
                                 struct device_attribute *attr,
                                 char *buf)
@@ -196,14 +204,14 @@ static const i2c_dev_attr_st com_e_attr_table[] = {
     NULL,
     i2c_dev_show_cpu_temp,
     NULL,
-    0x0, 0, 8,
+    0x0, 0, 8, COM_E_CACHE_MS, 1,
   },
   {
     "temp1_input", // mem_temp : fand uses this temp
     NULL,
     i2c_dev_show_mem_temp,
     NULL,
-    0x04, 0, 16,
+    0x04, 0, 16, COM_E_CACHE_MS, 1,
   },
   {
     "version", // version_r,_e,_t
@@ -217,21 +225,21 @@ static const i2c_dev_attr_st com_e_attr_table[] = {
     NULL,
     i2c_dev_show_voltage0,
     NULL,
-    0x20, 0, 16,
+    0x20, 0, 16, COM_E_CACHE_MS, 1,
   },
   {
     "in1_input",// 3V
     NULL,
     i2c_dev_show_voltage1,
     NULL,
-    0x22, 0, 16,
+    0x22, 0, 16, COM_E_CACHE_MS, 1,
   },
   {
     "in2_input",// 5V
     NULL,
     i2c_dev_show_voltage2,
     NULL,
-    0x24, 0, 16,
+    0x24, 0, 16, COM_E_CACHE_MS, 1,
   },
   {
     "date",
@@ -245,14 +253,14 @@ static const i2c_dev_attr_st com_e_attr_table[] = {
     NULL,
     i2c_dev_show_voltage3,
     NULL,
-    0x30, 0, 16,
+    0x30, 0, 16, COM_E_CACHE_MS, 1,
   },
   {
     "in4_input",// VDIMM
     NULL,
     i2c_dev_show_voltage0,
     NULL,
-    0x32, 0, 16,
+    0x32, 0, 16, COM_E_CACHE_MS, 1,
   },
   {
     "product_name",
@@ -0,0 +1,203 @@
+/*
+ * com_e_test
+ *
+ * Copyright 2015-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Builds com_e_driver.c and the i2c_dev_sysfs library on the host against
+ * kshim.h, with this file playing an auto-incrementing COMe EC, and counts
+ * the SMBus transactions fand and "sensors" cause over one minute: fand
+ * reads temp1_input and "sensors" walks every input once every 5 seconds.
+ * The same readings are taken with the table's cache and block reads
+ * cleared, and with an adapter that cannot do I2C block reads; all three
+ * must show the same values.
+ */
+
+#include "../com_e_driver.c"
+
+#define POLL_MS      5000
+#define POLLS        12     // One minute
+#define FAND_LAG_MS  100    // fand runs shortly after "sensors"
+
+unsigned long jiffies = 1;
+
+static uint8_t ec_regs[256];
+static int n_byte_reads;
+static int n_block_reads;
+static int failed;
+
+static const char *sensors_attrs[] = {
+  "in0_input", "in1_input", "in2_input", "in3_input", "in4_input",
+  "temp1_input", "temp2_input",
+};
+#define N_SENSORS (sizeof(sensors_attrs) / sizeof(sensors_attrs[0]))
+
+int
+i2c_smbus_read_byte_data(struct i2c_client *client, uint8_t reg) {
+  n_byte_reads++;
+  return ec_regs[reg];
+}
+
+int
+i2c_smbus_write_byte_data(struct i2c_client *client, uint8_t reg,
+                          uint8_t val) {
+  ec_regs[reg] = val;
+  return 0;
+}
+
+int
+i2c_smbus_read_i2c_block_data(struct i2c_client *client, uint8_t reg,
+                              uint8_t len, uint8_t *values) {
+  int i;
+
+  n_block_reads++;
+  for (i = 0; i < len; i++)
+    values[i] = ec_regs[(reg + i) & 0xFF];
+  return len;
+}
+
+static void
+ec_init(void) {
+  ec_regs[0x00] = 45;                                  // CPU temp
+  ec_regs[0x04] = 0x02; ec_regs[0x05] = 0xA0;          // DIMM 42 C, BE
+  ec_regs[0x20] = 0x77; ec_regs[0x21] = 0x01;          // Vcore, LE
+  ec_regs[0x22] = 0x2C; ec_regs[0x23] = 0x02;          // 3V
+  ec_regs[0x24] = 0x2A; ec_regs[0x25] = 0x02;          // 5V
+  ec_regs[0x30] = 0x09; ec_regs[0x31] = 0x01;          // 12V
+  ec_regs[0x32] = 0x8F; ec_regs[0x33] = 0x01;          // VDIMM
+}
+
+static struct device_attribute *
+find_attr(i2c_dev_data_st *data, const char *name) {
+  int i;
+
+  for (i = 0; i < data->idd_n_attrs; i++) {
+    if (!strcmp(data->idd_attrs[i].isa_dev_attr.attr.name, name))
+      return &data->idd_attrs[i].isa_dev_attr;
+  }
+  return NULL;
+}
+
+static void
+show(struct i2c_client *client, const char *name, char *buf) {
+  i2c_dev_data_st *data = i2c_get_clientdata(client);
+  struct device_attribute *attr = find_attr(data, name);
+
+  buf[0] = '\0';
+  if (!attr || attr->show(&client->dev, attr, buf) < 0)
+    strcpy(buf, "error\n");
+}
+
+/*
+ * Runs POLLS rounds of "sensors" followed by fand and returns the SMBus
+ * transactions they caused. The values read in the first round are left
+ * in vals.
+ */
+static int
+run_minute(struct i2c_client *client, char vals[][32]) {
+  char buf[PAGE_SIZE];
+  int poll, i;
+
+  n_byte_reads = n_block_reads = 0;
+  for (poll = 0; poll < POLLS; poll++) {
+    jiffies += POLL_MS;
+    for (i = 0; i < N_SENSORS; i++) {
+      show(client, sensors_attrs[i], buf);
+      if (poll == 0)
+        snprintf(vals[i], sizeof(vals[i]), "%.31s", buf);
+    }
+    jiffies += FAND_LAG_MS;
+    show(client, "temp1_input", buf);
+  }
+  return n_byte_reads + n_block_reads;
+}
+
+static void
+check(const char *name, int ok) {
+  printf("%s: %s\n", ok ? "PASS" : "FAIL", name);
+  if (!ok)
+    failed = 1;
+}
+
+int
+main(int argc, char **argv) {
+  int n_attrs = sizeof(com_e_attr_table) / sizeof(com_e_attr_table[0]);
+  i2c_dev_attr_st plain_table[n_attrs];
+  struct i2c_adapter adapter = { I2C_FUNC_SMBUS_READ_I2C_BLOCK };
+  struct i2c_client client = { .adapter = &adapter };
+  i2c_dev_data_st plain_data;
+  char plain_vals[N_SENSORS][32], vals[N_SENSORS][32];
+  char byte_vals[N_SENSORS][32];
+  char buf[PAGE_SIZE];
+  int plain, xfers, byte_xfers, same, i;
+
+  ec_init();
+
+  // The table as it was: no cache, byte reads only
+  memcpy(plain_table, com_e_attr_table, sizeof(plain_table));
+  for (i = 0; i < n_attrs; i++) {
+    plain_table[i].ida_cache_ms = 0;
+    plain_table[i].ida_block_read = 0;
+  }
+  i2c_dev_sysfs_data_init(&client, &plain_data, plain_table, n_attrs);
+  plain = run_minute(&client, plain_vals);
+  i2c_dev_sysfs_data_clean(&client, &plain_data);
+
+  check("probe", com_e_probe(&client, NULL) == 0);
+  xfers = run_minute(&client, vals);
+  printf("SMBus transactions per minute: %d without cache and block reads, "
+         "%d with (%d block, %d byte)\n",
+         plain, xfers, n_block_reads, n_byte_reads);
+  check("fand and sensors share the cache and use block reads",
+        xfers * 2 < plain);
+
+  same = 1;
+  for (i = 0; i < N_SENSORS; i++) {
+    printf("  %-12s %s", sensors_attrs[i], vals[i]);
+    same &= !strcmp(vals[i], plain_vals[i]);
+  }
+  check("same readings as byte reads", same);
+  // The driver scales 1/16 C by 1000 / 16, i.e. 62
+  snprintf(buf, sizeof(buf), "%d\n", 0x2A0 * (1000 / 16));
+  check("temp1_input decodes the DIMM temperature", !strcmp(vals[5], buf));
+
+  // The cache does not outlive its interval
+  jiffies += COM_E_CACHE_MS;
+  ec_regs[0x05] = 0xB0;
+  n_byte_reads = n_block_reads = 0;
+  show(&client, "temp1_input", buf);
+  check("expired cache goes back to the EC",
+        n_block_reads == 1 && atoi(buf) == 0x2B0 * (1000 / 16));
+  ec_regs[0x05] = 0xA0;
+  com_e_remove(&client);
+
+  // An adapter without I2C block reads falls back to byte reads
+  adapter.functionality = 0;
+  com_e_probe(&client, NULL);
+  byte_xfers = run_minute(&client, byte_vals);
+  printf("without adapter block support: %d (%d block)\n",
+         byte_xfers, n_block_reads);
+  same = n_block_reads == 0;
+  for (i = 0; i < N_SENSORS; i++)
+    same &= !strcmp(byte_vals[i], plain_vals[i]);
+  check("byte read fallback gives the same readings", same);
+  com_e_remove(&client);
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  return failed;
+}
@@ -0,0 +1,188 @@
+/*
+ * kshim.h - Just enough of the kernel API to build com_e_driver.c and
+ * i2c_dev_sysfs.c as a host program
+ *
+ * Copyright 2015-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef KSHIM_H
+#define KSHIM_H
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define __init
+#define __exit
+#define KERN_DEBUG
+#define printk printf
+#define PAGE_SIZE 4096
+#define GFP_KERNEL 0
+#define S_IRUGO (S_IRUSR | S_IRGRP | S_IROTH)
+
+#define EXPORT_SYMBOL_GPL(sym)
+#define MODULE_AUTHOR(s)
+#define MODULE_DESCRIPTION(s)
+#define MODULE_LICENSE(s)
+#define MODULE_DEVICE_TABLE(type, name)
+#define module_init(fn) \
+  static int (*kshim_init)(void) __attribute__((unused)) = fn
+#define module_exit(fn) \
+  static void (*kshim_exit)(void) __attribute__((unused)) = fn
+
+#define container_of(ptr, type, member) \
+  ((type *)((char *)(ptr) - offsetof(type, member)))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define scnprintf snprintf
+#define strlcpy(dst, src, size) snprintf(dst, size, "%s", src)
+
+#define kzalloc(size, flags) calloc(1, size)
+#define kfree free
+
+#define IS_ERR(ptr) ((unsigned long)(ptr) >= (unsigned long)-4095)
+#define PTR_ERR(ptr) ((long)(ptr))
+
+/* One jiffy is one millisecond; the test moves the clock */
+extern unsigned long jiffies;
+#define msecs_to_jiffies(ms) ((unsigned long)(ms))
+#define time_before(a, b) ((long)((a) - (b)) < 0)
+
+struct mutex {
+  int locked;
+};
+#define mutex_init(m) ((m)->locked = 0)
+#define mutex_lock(m) ((m)->locked++)
+#define mutex_unlock(m) ((m)->locked--)
+
+struct kobject {
+  int unused;
+};
+
+struct device {
+  struct kobject kobj;
+  void *driver_data;
+};
+
+struct device_driver {
+  const char *name;
+};
+
+struct attribute {
+  const char *name;
+  mode_t mode;
+};
+
+struct device_attribute {
+  struct attribute attr;
+  ssize_t (*show)(struct device *dev, struct device_attribute *attr,
+                  char *buf);
+  ssize_t (*store)(struct device *dev, struct device_attribute *attr,
+                   const char *buf, size_t count);
+};
+
+struct attribute_group {
+  struct attribute **attrs;
+};
+
+static inline int
+sysfs_create_group(struct kobject *kobj, const struct attribute_group *grp) {
+  return 0;
+}
+
+static inline void
+sysfs_remove_group(struct kobject *kobj, const struct attribute_group *grp) {
+}
+
+static inline struct device *
+hwmon_device_register(struct device *dev) {
+  return dev;
+}
+
+static inline void
+hwmon_device_unregister(struct device *dev) {
+}
+
+#define I2C_NAME_SIZE 20
+#define I2C_SMBUS_BLOCK_MAX 32
+#define I2C_FUNC_SMBUS_READ_I2C_BLOCK 0x04000000
+#define I2C_CLASS_HWMON (1 << 0)
+#define I2C_CLIENT_END 0xfffeU
+
+struct i2c_adapter {
+  unsigned long functionality;
+};
+
+struct i2c_client {
+  struct device dev;
+  struct i2c_adapter *adapter;
+};
+
+struct i2c_device_id {
+  char name[I2C_NAME_SIZE];
+  const void *driver_data;
+};
+
+struct i2c_board_info {
+  char type[I2C_NAME_SIZE];
+};
+
+struct i2c_client_address_data {
+  const unsigned short *normal_i2c;
+};
+
+#define I2C_CLIENT_INSMOD_1(chip) \
+  static const struct i2c_client_address_data addr_data = { normal_i2c }
+
+struct i2c_driver {
+  unsigned int class;
+  struct device_driver driver;
+  int (*probe)(struct i2c_client *client, const struct i2c_device_id *id);
+  int (*remove)(struct i2c_client *client);
+  const struct i2c_device_id *id_table;
+  int (*detect)(struct i2c_client *client, int kind,
+                struct i2c_board_info *info);
+  const struct i2c_client_address_data *address_data;
+};
+
+#define to_i2c_client(d) container_of(d, struct i2c_client, dev)
+#define i2c_get_clientdata(c) ((c)->dev.driver_data)
+#define i2c_set_clientdata(c, data) ((c)->dev.driver_data = (data))
+#define i2c_check_functionality(adap, func) \
+  (((adap)->functionality & (func)) == (func))
+
+static inline int
+i2c_add_driver(struct i2c_driver *drv) {
+  return 0;
+}
+
+static inline void
+i2c_del_driver(struct i2c_driver *drv) {
+}
+
+/* Provided by the test, which plays the COMe EC */
+int i2c_smbus_read_byte_data(struct i2c_client *client, uint8_t reg);
+int i2c_smbus_write_byte_data(struct i2c_client *client, uint8_t reg,
+                              uint8_t val);
+int i2c_smbus_read_i2c_block_data(struct i2c_client *client, uint8_t reg,
+                                  uint8_t len, uint8_t *values);
+
+#endif
@@ -54,6 +54,9 @@ static ssize_t fancpld_fan_rpm_show(struct device *dev,
   return scnprintf(buf, PAGE_SIZE, "%u\n", val);
 }
 
+/* fand, sensord and REST all poll the tachs; let them share one read */
+#define FANCPLD_TACH_CACHE_MS 500
+
 #define FANTRAY_PWM_HELP                        \
   "each value represents 1/32 duty cycle"
 #define FANTRAY_LED_CTRL_HELP                   \
@@ -138,56 +141,56 @@ static const i2c_dev_attr_st fancpld_attr_table[] = {
     NULL,
     fancpld_fan_rpm_show,
     NULL,
-    0x10, 0, 8,
+    0x10, 0, 8, FANCPLD_TACH_CACHE_MS,
   },
   {
     "fan2_input",
     NULL,
     fancpld_fan_rpm_show,
     NULL,
-    0x11, 0, 8,
+    0x11, 0, 8, FANCPLD_TACH_CACHE_MS,
   },
   {
     "fan3_input",
     NULL,
     fancpld_fan_rpm_show,
     NULL,
-    0x12, 0, 8,
+    0x12, 0, 8, FANCPLD_TACH_CACHE_MS,
   },
   {
     "fan4_input",
     NULL,
     fancpld_fan_rpm_show,
     NULL,
-    0x13, 0, 8,
+    0x13, 0, 8, FANCPLD_TACH_CACHE_MS,
   },
   {
     "fan5_input",
     NULL,
     fancpld_fan_rpm_show,
     NULL,
-    0x14, 0, 8,
+    0x14, 0, 8, FANCPLD_TACH_CACHE_MS,
   },
   {
     "fan6_input",
     NULL,
     fancpld_fan_rpm_show,
     NULL,
-    0x15, 0, 8,
+    0x15, 0, 8, FANCPLD_TACH_CACHE_MS,
   },
   {
     "fan7_input",
     NULL,
     fancpld_fan_rpm_show,
     NULL,
-    0x16, 0, 8,
+    0x16, 0, 8, FANCPLD_TACH_CACHE_MS,
   },
   {
     "fan8_input",
     NULL,
     fancpld_fan_rpm_show,
     NULL,
-    0x17, 0, 8,
+    0x17, 0, 8, FANCPLD_TACH_CACHE_MS,
   },
   {
     "fan9_input",
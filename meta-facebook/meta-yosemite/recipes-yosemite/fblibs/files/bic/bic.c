@@ -20,7 +20,9 @@
  * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <fcntl.h>
 #include <syslog.h>
 #include <errno.h>
@@ -39,6 +41,10 @@
 #define SIZE_IANA_ID 3
 #define GPIO_MAX 31
 
+#define ME_MAX_ARG_NUM 64
+#define ME_MAX_CMD_RETRY 2
+#define ME_MAX_TOTAL_RETRY 30
+
 #define BIOS_VER_REGION_SIZE (4*1024*1024)
 #define BIOS_VER_STR "F20_"
 
@@ -1225,6 +1231,87 @@ bic_me_xmit(uint8_t slot_id, uint8_t *txbuf, uint8_t txlen, uint8_t *rxbuf, uint
   return 0;
 }
 
+// Send one ME request given as data byte strings and print the response
+// (or "ME no response!") to out.  Failed attempts are added to *retry.
+int
+bic_me_xmit_args(uint8_t slot_id, int argc, char **argv, FILE *out, int *retry) {
+  int i, ret = -1, count = ME_MAX_CMD_RETRY;
+  uint8_t tbuf[256] = {0x00};
+  uint8_t rbuf[256] = {0x00};
+  uint8_t tlen = 0;
+  uint8_t rlen = 0;
+
+  for (i = 0; i < argc; i++) {
+    tbuf[tlen++] = (uint8_t)strtoul(argv[i], NULL, 0);
+  }
+
+  while (count >= 0) {
+    ret = bic_me_xmit(slot_id, tbuf, tlen, rbuf, &rlen);
+    if (ret == 0)
+      break;
+
+    if (retry)
+      (*retry)++;
+    count--;
+  }
+  if (ret) {
+    fprintf(out, "ME no response!\n");
+    return ret;
+  }
+
+  for (i = 0; i < rlen; i++) {
+    fprintf(out, "%02X ", rbuf[i]);
+  }
+  fprintf(out, "\n");
+
+  return 0;
+}
+
+// Send the ME requests listed in a file, one request of data bytes per
+// line; '#' starts a comment and "echo" lines are copied to out.  Stops
+// early once *cancel is set, if given.
+int
+bic_me_xmit_file(uint8_t slot_id, const char *path, FILE *out,
+                 volatile uint8_t *cancel) {
+  FILE *fp;
+  int argc;
+  int retry = 0;
+  char buf[1024];
+  char *str, *next, *del=" \n";
+  char *argv[ME_MAX_ARG_NUM];
+
+  if (!(fp = fopen(path, "r"))) {
+    syslog(LOG_WARNING, "Failed to open %s", path);
+    return -1;
+  }
+
+  while ((!cancel || !*cancel) && fgets(buf, sizeof(buf), fp) != NULL) {
+    str = strtok_r(buf, del, &next);
+    for (argc = 0; argc < ME_MAX_ARG_NUM && str; argc++, str = strtok_r(NULL, del, &next)) {
+      if (str[0] == '#')
+        break;
+
+      if (!argc && !strcmp(str, "echo")) {
+        fprintf(out, "%s", (*next) ? next : "\n");
+        break;
+      }
+      argv[argc] = str;
+    }
+    if (argc < 1)
+      continue;
+
+    bic_me_xmit_args(slot_id, argc, argv, out, &retry);
+    if (retry > ME_MAX_TOTAL_RETRY) {
+      fprintf(out, "Maximum retry count exceeded\n");
+      fclose(fp);
+      return -1;
+    }
+  }
+  fclose(fp);
+
+  return 0;
+}
+
 // Read 1S server's FRUID
 int
 bic_get_fruid_info(uint8_t slot_id, uint8_t fru_id, ipmi_fruid_info_t *info) {
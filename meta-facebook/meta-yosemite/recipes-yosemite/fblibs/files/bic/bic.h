@@ -21,6 +21,7 @@
 #ifndef __BIC_H__
 #define __BIC_H__
 
+#include <stdio.h>
 #include <openbmc/ipmi.h>
 #include <openbmc/ipmb.h>
 
@@ -176,6 +177,8 @@ int bic_get_fw_ver(uint8_t slot_id, uint8_t comp, uint8_t *ver);
 
 int bic_update_fw(uint8_t slot_id, uint8_t comp, char *path);
 int bic_me_xmit(uint8_t slot_id, uint8_t *txbuf, uint8_t txlen, uint8_t *rxbuf, uint8_t *rxlen);
+int bic_me_xmit_args(uint8_t slot_id, int argc, char **argv, FILE *out, int *retry);
+int bic_me_xmit_file(uint8_t slot_id, const char *path, FILE *out, volatile uint8_t *cancel);
 
 #ifdef __cplusplus
 } // extern "C"
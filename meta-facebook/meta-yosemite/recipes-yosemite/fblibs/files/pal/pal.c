@@ -26,8 +26,13 @@
 #include <errno.h>
 #include <syslog.h>
 #include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <string.h>
 #include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <openbmc/pwm.h>
 #include "pal.h"
 
 #define BIT(value, index) ((value >> index) & 1)
@@ -38,14 +43,6 @@
 #define GPIO_VAL "/sys/class/gpio/gpio%d/value"
 #define GPIO_DIR "/sys/class/gpio/gpio%d/direction"
 
-#define GPIO_HAND_SW_ID1 138
-#define GPIO_HAND_SW_ID2 139
-#define GPIO_HAND_SW_ID4 140
-#define GPIO_HAND_SW_ID8 141
-
-#define GPIO_RST_BTN 144
-#define GPIO_PWR_BTN 24
-
 #define GPIO_HB_LED 135
 
 #define GPIO_USB_SW0 36
@@ -66,8 +63,6 @@
 #define GPIO_POSTCODE_6 126
 #define GPIO_POSTCODE_7 127
 
-#define GPIO_DBG_CARD_PRSNT 137
-
 #define GPIO_BMC_READY_N    28
 
 #define PAGE_SIZE  0x1000
@@ -89,8 +84,6 @@
 #define CRASHDUMP_BIN       "/usr/local/bin/dump.sh"
 #define CRASHDUMP_FILE      "/mnt/data/crashdump_"
 
-#define LARGEST_DEVICE_NAME 120
-#define PWM_DIR "/sys/devices/platform/ast_pwm_tacho.0"
 #define PWM_UNIT_MAX 96
 
 #define MAX_READ_RETRY 10
@@ -651,31 +644,6 @@ post_exit:
   }
 }
 
-static int
-read_device_hex(const char *device, int *value) {
-    FILE *fp;
-    int rc;
-
-    fp = fopen(device, "r");
-    if (!fp) {
-#ifdef DEBUG
-      syslog(LOG_INFO, "failed to open device %s", device);
-#endif
-      return errno;
-    }
-
-    rc = fscanf(fp, "%x", value);
-    fclose(fp);
-    if (rc != 1) {
-#ifdef DEBUG
-      syslog(LOG_INFO, "failed to read device %s", device);
-#endif
-      return ENOENT;
-    } else {
-      return 0;
-    }
-}
-
 // Platform Abstraction Layer (PAL) Functions
 int
 pal_get_platform_name(char *name) {
@@ -1428,6 +1396,33 @@ pal_post_handle(uint8_t slot, uint8_t status) {
   return 0;
 }
 
+/*
+ * Handle a GPIO interrupt reported by a server's bridge IC: wake gpiod so it
+ * re-reads that slot now instead of at its next scheduled poll.  gpiod may
+ * not be running, so this never blocks and a failed send is not an error.
+ */
+int
+pal_gpio_intr_handle(uint8_t slot, uint8_t gpio) {
+  struct sockaddr_un addr;
+  uint8_t msg[2] = {slot, gpio};
+  int sock;
+
+  sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+  if (sock < 0) {
+    syslog(LOG_WARNING, "pal_gpio_intr_handle: socket() failed");
+    return -1;
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, SOCK_PATH_GPIO, sizeof(addr.sun_path) - 1);
+  sendto(sock, msg, sizeof(msg), MSG_DONTWAIT, (struct sockaddr *)&addr,
+         sizeof(addr));
+  close(sock);
+
+  return 0;
+}
+
 int
 pal_get_fru_list(char *list) {
 
@@ -2678,30 +2673,6 @@ pal_get_fan_name(uint8_t num, char *name) {
   return 0;
 }
 
-static int
-read_fan_value(const int fan, const char *device, int *value) {
-  char device_name[LARGEST_DEVICE_NAME];
-  char output_value[LARGEST_DEVICE_NAME];
-  char full_name[LARGEST_DEVICE_NAME];
-
-  snprintf(device_name, LARGEST_DEVICE_NAME, device, fan);
-  snprintf(full_name, LARGEST_DEVICE_NAME, "%s/%s", PWM_DIR,device_name);
-  return read_device(full_name, value);
-}
-
-static int
-write_fan_value(const int fan, const char *device, const int value) {
-  char full_name[LARGEST_DEVICE_NAME];
-  char device_name[LARGEST_DEVICE_NAME];
-  char output_value[LARGEST_DEVICE_NAME];
-
-  snprintf(device_name, LARGEST_DEVICE_NAME, device, fan);
-  snprintf(full_name, LARGEST_DEVICE_NAME, "%s/%s", PWM_DIR, device_name);
-  snprintf(output_value, LARGEST_DEVICE_NAME, "%d", value);
-  return write_device(full_name, output_value);
-}
-
-
 int
 pal_set_fan_speed(uint8_t fan, uint8_t pwm) {
   int unit;
@@ -2717,9 +2688,9 @@ pal_set_fan_speed(uint8_t fan, uint8_t pwm) {
 
   // For 0%, turn off the PWM entirely
   if (unit == 0) {
-    write_fan_value(fan, "pwm%d_en", 0);
+    ret = pwm_write_attr(fan, PWM_ATTR_EN, 0);
     if (ret < 0) {
-      syslog(LOG_INFO, "set_fan_speed: write_fan_value failed");
+      syslog(LOG_INFO, "set_fan_speed: pwm_write_attr failed");
       return -1;
     }
     return 0;
@@ -2729,27 +2700,27 @@ pal_set_fan_speed(uint8_t fan, uint8_t pwm) {
     unit = 0;
   }
 
-  ret = write_fan_value(fan, "pwm%d_type", 0);
+  ret = pwm_write_attr(fan, PWM_ATTR_TYPE, 0);
   if (ret < 0) {
-    syslog(LOG_INFO, "set_fan_speed: write_fan_value failed");
+    syslog(LOG_INFO, "set_fan_speed: pwm_write_attr failed");
     return -1;
   }
 
-  ret = write_fan_value(fan, "pwm%d_rising", 0);
+  ret = pwm_write_attr(fan, PWM_ATTR_RISING, 0);
   if (ret < 0) {
-    syslog(LOG_INFO, "set_fan_speed: write_fan_value failed");
+    syslog(LOG_INFO, "set_fan_speed: pwm_write_attr failed");
     return -1;
   }
 
-  ret = write_fan_value(fan, "pwm%d_falling", unit);
+  ret = pwm_write_attr(fan, PWM_ATTR_FALLING, unit);
   if (ret < 0) {
-    syslog(LOG_INFO, "set_fan_speed: write_fan_value failed");
+    syslog(LOG_INFO, "set_fan_speed: pwm_write_attr failed");
     return -1;
   }
 
-  ret = write_fan_value(fan, "pwm%d_en", 1);
+  ret = pwm_write_attr(fan, PWM_ATTR_EN, 1);
   if (ret < 0) {
-    syslog(LOG_INFO, "set_fan_speed: write_fan_value failed");
+    syslog(LOG_INFO, "set_fan_speed: pwm_write_attr failed");
     return -1;
   }
 
@@ -2769,7 +2740,7 @@ pal_get_fan_speed(uint8_t fan, int *rpm) {
     return -1;
   }
 
-  return read_fan_value(fan + 1, "fan%d_input", rpm);
+  return tach_read_rpm(fan + 1, rpm);
 }
 
 void
@@ -2794,8 +2765,6 @@ pal_handle_dcmi(uint8_t fru, uint8_t *request, uint8_t req_len, uint8_t *respons
 
 int
 pal_get_pwm_value(uint8_t fan_num, uint8_t *value) {
-  char path[LARGEST_DEVICE_NAME] = {0};
-  char device_name[LARGEST_DEVICE_NAME] = {0};
   int val = 0;
   int pwm_enable = 0;
 
@@ -2805,18 +2774,14 @@ pal_get_pwm_value(uint8_t fan_num, uint8_t *value) {
   }
 
 // Need check pwmX_en to determine the PWM is 0 or 100.
- snprintf(device_name, LARGEST_DEVICE_NAME, "pwm%d_en", fan_num);
- snprintf(path, LARGEST_DEVICE_NAME, "%s/%s", PWM_DIR, device_name);
- if (read_device(path, &pwm_enable)) {
-    syslog(LOG_INFO, "pal_get_pwm_value: read %s failed", path);
+ if (pwm_read_attr(fan_num, PWM_ATTR_EN, 10, &pwm_enable)) {
+    syslog(LOG_INFO, "pal_get_pwm_value: read pwm%d_en failed", fan_num);
     return -1;
   }
 
   if(pwm_enable) {
-    snprintf(device_name, LARGEST_DEVICE_NAME, "pwm%d_falling", fan_num);
-    snprintf(path, LARGEST_DEVICE_NAME, "%s/%s", PWM_DIR, device_name);
-    if (read_device_hex(path, &val)) {
-      syslog(LOG_INFO, "pal_get_pwm_value: read %s failed", path);
+    if (pwm_read_attr(fan_num, PWM_ATTR_FALLING, 16, &val)) {
+      syslog(LOG_INFO, "pal_get_pwm_value: read pwm%d_falling failed", fan_num);
       return -1;
     }
 
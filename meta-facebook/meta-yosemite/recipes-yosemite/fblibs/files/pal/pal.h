@@ -42,6 +42,20 @@ extern "C" {
 #define KV_STORE "/mnt/data/kv_store/%s"
 #define KV_STORE_PATH "/mnt/data/kv_store"
 
+// gpiod listens here for BIC GPIO interrupts forwarded by ipmid
+#define SOCK_PATH_GPIO "/tmp/gpio_socket"
+
+// Front panel inputs; front-paneld watches these for edges
+#define GPIO_HAND_SW_ID1 138
+#define GPIO_HAND_SW_ID2 139
+#define GPIO_HAND_SW_ID4 140
+#define GPIO_HAND_SW_ID8 141
+
+#define GPIO_RST_BTN 144
+#define GPIO_PWR_BTN 24
+
+#define GPIO_DBG_CARD_PRSNT 137
+
 #define SETBIT(x, y)        (x | (1 << y))
 #define GETBIT(x, y)        ((x & (1 << y)) > y)
 #define CLEARBIT(x, y)      (x & (~(1 << y)))
@@ -143,6 +157,7 @@ int pal_post_enable(uint8_t slot);
 int pal_post_disable(uint8_t slot);
 int pal_post_get_last(uint8_t slot, uint8_t *post);
 int pal_post_handle(uint8_t slot, uint8_t status);
+int pal_gpio_intr_handle(uint8_t slot, uint8_t gpio);
 int pal_get_pwr_btn(uint8_t *status);
 int pal_get_rst_btn(uint8_t *status);
 int pal_set_rst_btn(uint8_t slot, uint8_t status);
@@ -0,0 +1,424 @@
+/*
+ * Copyright 2015-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Runs yosemite_common_crashdump() and libbic's ME request path against a
+ * stubbed IPMB transport that answers every ME request after 2 ms: checks
+ * the dump contents, that slots dump in parallel, that a restarted dump
+ * replaces the running one, the me-util retry limit, and the dump.sh
+ * fallback.  Everything under /mnt/data and /usr/local is kept in a
+ * scratch directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../yosemite_common/yosemite_common.c"
+
+#define STUB_LATENCY_US 2000
+#define STUB_NO_RESPONSE 0xEE   // ME requests starting with this fail
+#define LIST_REQUESTS 50
+
+FILE *__real_fopen(const char *path, const char *mode);
+int __real_access(const char *path, int mode);
+int __real_rename(const char *oldpath, const char *newpath);
+int __real_remove(const char *path);
+int __real_system(const char *cmd);
+
+static char root[64] = "/tmp/crashdump_testXXXXXX";
+static pthread_mutex_t stub_lock = PTHREAD_MUTEX_INITIALIZER;
+static int stub_requests[MAX_NUM_FRUS + 1];
+static int stub_fail[MAX_NUM_FRUS + 1];
+static int stub_in_flight;
+static int stub_max_in_flight;
+static char stub_done[MAX_NUM_FRUS + 1][8];
+static int failed;
+
+static void
+check(const char *name, int ok) {
+  printf("%s: %s\n", ok ? "PASS" : "FAIL", name);
+  if (!ok)
+    failed = 1;
+}
+
+static const char *
+redirect(const char *path, char *buf, size_t len) {
+  if (strncmp(path, "/mnt/data/", 10) && strncmp(path, "/usr/local/", 11))
+    return path;
+  snprintf(buf, len, "%s%s", root, path);
+  return buf;
+}
+
+FILE *
+__wrap_fopen(const char *path, const char *mode) {
+  char buf[256];
+  return __real_fopen(redirect(path, buf, sizeof(buf)), mode);
+}
+
+int
+__wrap_access(const char *path, int mode) {
+  char buf[256];
+  return __real_access(redirect(path, buf, sizeof(buf)), mode);
+}
+
+int
+__wrap_rename(const char *oldpath, const char *newpath) {
+  char buf1[256], buf2[256];
+  return __real_rename(redirect(oldpath, buf1, sizeof(buf1)),
+                       redirect(newpath, buf2, sizeof(buf2)));
+}
+
+int
+__wrap_remove(const char *path) {
+  char buf[256];
+  return __real_remove(redirect(path, buf, sizeof(buf)));
+}
+
+/* Runs dump.sh with its paths moved; the ps | kill clean-up is skipped */
+int
+__wrap_system(const char *cmd) {
+  char buf[512];
+  const char *p;
+  size_t n = 0;
+
+  if (!strncmp(cmd, "ps ", 3))
+    return 0;
+
+  for (p = cmd; *p && n < sizeof(buf) - sizeof(root); p++) {
+    if (!strncmp(p, "/mnt/data/", 10) || !strncmp(p, "/usr/local/", 11))
+      n += snprintf(buf + n, sizeof(buf) - n, "%s", root);
+    buf[n++] = *p;
+  }
+  buf[n] = '\0';
+  return __real_system(buf);
+}
+
+static int
+bus_to_slot(unsigned char bus_id) {
+  switch (bus_id) {
+    case 3: return 1;
+    case 1: return 2;
+    case 7: return 3;
+    case 5: return 4;
+  }
+  return 0;
+}
+
+/* The BIC forwards the ME request; the ME echoes it after the slot number */
+void
+lib_ipmb_handle(unsigned char bus_id, unsigned char *request,
+                unsigned char req_len, unsigned char *response,
+                unsigned char *res_len) {
+  ipmb_req_t *req = (ipmb_req_t *) request;
+  ipmb_res_t *res = (ipmb_res_t *) response;
+  int slot = bus_to_slot(bus_id);
+  int n = req_len - IPMB_HDR_SIZE - IPMI_REQ_HDR_SIZE - 4;
+  int fail;
+
+  pthread_mutex_lock(&stub_lock);
+  stub_requests[slot]++;
+  fail = stub_fail[slot];
+  if (++stub_in_flight > stub_max_in_flight)
+    stub_max_in_flight = stub_in_flight;
+  pthread_mutex_unlock(&stub_lock);
+
+  usleep(STUB_LATENCY_US);
+
+  pthread_mutex_lock(&stub_lock);
+  stub_in_flight--;
+  pthread_mutex_unlock(&stub_lock);
+
+  if (fail || (n > 0 && req->data[4] == STUB_NO_RESPONSE)) {
+    *res_len = 0;
+    return;
+  }
+
+  memset(res, 0, sizeof(*res));
+  memcpy(res->data, req->data, 4);      // IANA ID and interface
+  memset(&res->data[4], 0, 3);
+  res->data[7] = slot;
+  memcpy(&res->data[8], &req->data[4], n);
+  *res_len = IPMB_HDR_SIZE + IPMI_RESP_HDR_SIZE + 8 + n;
+}
+
+int
+edb_cache_set(char *key, char *value) {
+  int slot;
+
+  if (sscanf(key, CRASHDUMP_KEY, &slot) == 1 && slot >= 1 &&
+      slot <= MAX_NUM_FRUS) {
+    pthread_mutex_lock(&stub_lock);
+    snprintf(stub_done[slot], sizeof(stub_done[slot]), "%s", value);
+    pthread_mutex_unlock(&stub_lock);
+  }
+  return 0;
+}
+
+static void
+write_file(const char *path, const char *contents, mode_t mode) {
+  char buf[256];
+  FILE *fp;
+
+  fp = __real_fopen(redirect(path, buf, sizeof(buf)), "w");
+  if (fp == NULL) {
+    perror(path);
+    exit(1);
+  }
+  fputs(contents, fp);
+  fclose(fp);
+  chmod(buf, mode);
+}
+
+static char *
+read_dump(uint8_t slot, const char *suffix) {
+  char path[256];
+  char *buf;
+  FILE *fp;
+  long len;
+
+  snprintf(path, sizeof(path), "%s%sslot%d%s", root, CRASHDUMP_FILE, slot,
+           suffix);
+  fp = __real_fopen(path, "r");
+  if (fp == NULL)
+    return NULL;
+  fseek(fp, 0, SEEK_END);
+  len = ftell(fp);
+  rewind(fp);
+  buf = calloc(1, len + 1);
+  fread(buf, 1, len, fp);
+  fclose(fp);
+  return buf;
+}
+
+static void
+write_lists(void) {
+  char buf[64 * LIST_REQUESTS];
+  size_t n = 0;
+  int i;
+
+  n += sprintf(buf + n, "echo == coreid ==\n# comment\n");
+  for (i = 0; i < LIST_REQUESTS; i++)
+    n += sprintf(buf + n, "0xB8 0x40 0x57 0x01 0x00 0x%02x\n", i);
+  n += sprintf(buf + n, "0x%02x\n", STUB_NO_RESPONSE);
+  write_file(CRASHDUMP_COREID, buf, 0644);
+  write_file(CRASHDUMP_MSR, "echo == msr ==\n0xB8 0x41\n", 0644);
+}
+
+/* The dump written for slot by the lists above, without its header */
+static void
+expected_body(uint8_t slot, char *buf) {
+  int i;
+
+  buf += sprintf(buf, "== coreid ==\n");
+  for (i = 0; i < LIST_REQUESTS; i++)
+    buf += sprintf(buf, "%02X B8 40 57 01 00 %02X \n", slot, i);
+  buf += sprintf(buf, "ME no response!\n== msr ==\n%02X B8 41 \n", slot);
+}
+
+static int
+wait_idle(void) {
+  int i, slot;
+
+  for (i = 0; i < 500; i++) {
+    for (slot = 1; slot <= 4; slot++) {
+      if (t_dump[slot-1].is_running)
+        break;
+    }
+    if (slot > 4)
+      return 0;
+    usleep(10000);
+  }
+  return -1;
+}
+
+static void
+date_now(char *buf, size_t len) {
+  FILE *fp = popen("date", "r");
+
+  buf[0] = '\0';
+  if (fp) {
+    if (fgets(buf, len, fp) == NULL)
+      buf[0] = '\0';
+    pclose(fp);
+  }
+}
+
+static void
+test_parallel_dumps(void) {
+  char expected[64 * (LIST_REQUESTS + 4)];
+  char before[64], after[64];
+  char header[96];
+  char *dump, *body;
+  int contents_ok = 1, header_ok = 1, done_ok = 1;
+  int slot;
+
+  date_now(before, sizeof(before));
+  for (slot = 1; slot <= 4; slot++)
+    yosemite_common_crashdump(slot);
+  check("four dumps finish", wait_idle() == 0);
+  date_now(after, sizeof(after));
+
+  for (slot = 1; slot <= 4; slot++) {
+    dump = read_dump(slot, "");
+    if (dump == NULL) {
+      contents_ok = header_ok = 0;
+      continue;
+    }
+    body = strchr(dump, '\n');
+    expected_body(slot, expected);
+    if (body == NULL || strcmp(body + 1, expected))
+      contents_ok = 0;
+
+    if (body)
+      body[1] = '\0';
+    snprintf(header, sizeof(header), "Crash Dump generated at %s", before);
+    if (strcmp(dump, header)) {
+      snprintf(header, sizeof(header), "Crash Dump generated at %s", after);
+      if (strcmp(dump, header))
+        header_ok = 0;
+    }
+    free(dump);
+
+    if (strcmp(stub_done[slot], "0") || t_dump[slot-1].is_running)
+      done_ok = 0;
+  }
+
+  check("every dump holds each response in me-util's format", contents_ok);
+  check("the header line is dump.sh's", header_ok);
+  check("a finished dump clears the ongoing flag and is_running", done_ok);
+  check("slots are dumped in parallel", stub_max_in_flight >= 2);
+}
+
+static void
+test_restart(void) {
+  char expected[64 * (LIST_REQUESTS + 4)];
+  char *dump, *body, *tmp;
+  int requests;
+
+  stub_requests[2] = 0;
+  strcpy(stub_done[2], "1");
+  yosemite_common_crashdump(2);
+  usleep(20 * STUB_LATENCY_US);
+  yosemite_common_crashdump(2);
+  check("a restarted dump finishes", wait_idle() == 0);
+
+  requests = stub_requests[2];
+  check("the first dump stops at the restart",
+        requests > LIST_REQUESTS + 2 && requests < 2 * (LIST_REQUESTS + 2));
+
+  dump = read_dump(2, "");
+  body = dump ? strchr(dump, '\n') : NULL;
+  expected_body(2, expected);
+  check("the dump replacing it is complete",
+        body != NULL && !strcmp(body + 1, expected));
+  free(dump);
+
+  tmp = read_dump(2, ".tmp");
+  check("no partial dump is left behind", tmp == NULL);
+  free(tmp);
+  check("the ongoing flag is cleared once", !strcmp(stub_done[2], "0"));
+}
+
+static void
+test_retry_limit(void) {
+  char expected[64 * 16];
+  char *dump, *body;
+  char *p = expected;
+  int i;
+
+  stub_fail[3] = 1;
+  stub_requests[3] = 0;
+  yosemite_common_crashdump(3);
+  wait_idle();
+  stub_fail[3] = 0;
+
+  /* Three attempts per request, stopping past 30 failed attempts */
+  p += sprintf(p, "== coreid ==\n");
+  for (i = 0; i < 11; i++)
+    p += sprintf(p, "ME no response!\n");
+  p += sprintf(p, "Maximum retry count exceeded\n== msr ==\n");
+  p += sprintf(p, "ME no response!\n");
+
+  dump = read_dump(3, "");
+  body = dump ? strchr(dump, '\n') : NULL;
+  check("an unresponsive ME stops each list at the retry limit",
+        body != NULL && !strcmp(body + 1, expected));
+  check("each request is tried three times", stub_requests[3] == 12 * 3);
+  free(dump);
+}
+
+static void
+test_script_fallback(void) {
+  char path[256];
+  char *dump, *body;
+
+  snprintf(path, sizeof(path), "%s%s", root, CRASHDUMP_COREID);
+  unlink(path);
+  write_file(CRASHDUMP_BIN,
+             "#!/bin/sh\n"
+             "if [ \"$1\" = \"time\" ]; then\n"
+             "  echo \"Crash Dump generated at $(date)\"\n"
+             "  exit 0\n"
+             "fi\n"
+             "echo \"$1 $2\"\n", 0755);
+
+  stub_requests[4] = 0;
+  yosemite_common_crashdump(4);
+  check("a dump.sh dump finishes", wait_idle() == 0);
+
+  dump = read_dump(4, "");
+  body = dump ? strchr(dump, '\n') : NULL;
+  check("without the lists the dump comes from dump.sh",
+        body != NULL && !strncmp(dump, "Crash Dump generated at ", 24) &&
+        !strcmp(body + 1, "slot4 coreid\nslot4 msr\n"));
+  check("dump.sh sends no requests itself", stub_requests[4] == 0);
+  free(dump);
+}
+
+int
+main(void) {
+  char cmd[256];
+
+  if (mkdtemp(root) == NULL) {
+    perror("mkdtemp");
+    return 1;
+  }
+  snprintf(cmd, sizeof(cmd), "mkdir -p %s/mnt/data %s/usr/local/bin "
+           "%s/usr/local/fbpackages/crashdump", root, root, root);
+  if (__real_system(cmd)) {
+    perror(cmd);
+    return 1;
+  }
+  write_lists();
+
+  test_parallel_dumps();
+  test_restart();
+  test_retry_limit();
+  test_script_fallback();
+
+  snprintf(cmd, sizeof(cmd), "rm -rf %s", root);
+  __real_system(cmd);
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  return failed;
+}
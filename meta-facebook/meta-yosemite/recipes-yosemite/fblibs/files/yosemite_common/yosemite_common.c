@@ -29,14 +29,24 @@
 #include <syslog.h>
 #include <pthread.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <facebook/bic.h>
+#include <openbmc/edb.h>
 #include "yosemite_common.h"
 
 #define CRASHDUMP_BIN       "/usr/local/bin/dump.sh"
 #define CRASHDUMP_FILE      "/mnt/data/crashdump_"
+#define CRASHDUMP_COREID    "/usr/local/fbpackages/crashdump/crashdump_coreid"
+#define CRASHDUMP_MSR       "/usr/local/fbpackages/crashdump/crashdump_msr"
+#define CRASHDUMP_BUF_SIZE  (64 * 1024)
 
 struct threadinfo {
-  uint8_t is_running;
+  volatile uint8_t is_running;  // Cleared by the thread when it finishes
+  uint8_t joinable;             // pt has not been joined yet
   uint8_t fru;
+  uint8_t script;               // Run dump.sh, the command lists are absent
+  volatile uint8_t cancel;      // Set to stop the dump at the next request
   pthread_t pt;
 };
 
@@ -107,87 +117,163 @@ yosemite_common_fru_id(char *str, uint8_t *fru) {
   return 0;
 }
 
+/*
+ * Header line of the dump, in the format dump.sh prints it with date(1).
+ */
+static void
+crashdump_header(FILE *out) {
+
+  char buf[64];
+  struct tm tm;
+  time_t now;
+
+  now = time(NULL);
+  localtime_r(&now, &tm);
+  strftime(buf, sizeof(buf), "%a %b %e %H:%M:%S %Z %Y", &tm);
+  fprintf(out, "Crash Dump generated at %s\n", buf);
+}
+
+/*
+ * Collect the crashdump with dump.sh, for images that ship the script
+ * instead of the command lists.
+ */
+static void
+crashdump_run_script(struct threadinfo *t, const char *fruname,
+                     const char *path) {
+
+  char cmd[128];
+
+  sprintf(cmd, "%s time > %s", CRASHDUMP_BIN, path);
+  system(cmd);
+
+  sprintf(cmd, "%s %s coreid >> %s", CRASHDUMP_BIN, fruname, path);
+  if (!t->cancel)
+    system(cmd);
+
+  sprintf(cmd, "%s %s msr >> %s", CRASHDUMP_BIN, fruname, path);
+  if (!t->cancel)
+    system(cmd);
+}
+
+/*
+ * Collect the crashdump in-process.  Responses are streamed through one
+ * buffered file into <CRASHDUMP_FILE><fru>.tmp, which replaces the
+ * previous dump once complete.  Every slot has its own thread and nothing
+ * is shared between them, so dumps on different slots run in parallel.
+ */
 void *
 generate_dump(void *arg) {
 
-  uint8_t fru = *(uint8_t *) arg;
-  char cmd[128];
+  struct threadinfo *t = (struct threadinfo *) arg;
+  uint8_t fru = t->fru;
+  char key[32];
   char fruname[16];
-  int tmpf;
-  int rc;
+  char path[64];
+  char tmp_path[72];
+  char *buf;
+  FILE *out;
 
+  yosemite_common_fru_name(fru, fruname);
+  sprintf(path, "%s%s", CRASHDUMP_FILE, fruname);
+  sprintf(tmp_path, "%s.tmp", path);
 
-  // Usually the pthread cancel state are enable by default but
-  // here we explicitly would like to enable them
-  rc = pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
-  rc = pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
+  if (t->script) {
+    crashdump_run_script(t, fruname, tmp_path);
+  } else {
+    out = fopen(tmp_path, "w");
+    if (out == NULL) {
+      syslog(LOG_WARNING, "Crashdump for FRU: %d failed : cannot open %s",
+          fru, tmp_path);
+      goto done;
+    }
+    buf = malloc(CRASHDUMP_BUF_SIZE);
+    if (buf != NULL)
+      setvbuf(out, buf, _IOFBF, CRASHDUMP_BUF_SIZE);
 
-  yosemite_common_fru_name(fru, fruname);
+    // HEADER LINE for the dump
+    crashdump_header(out);
 
-  // HEADER LINE for the dump
-  memset(cmd, 0, 128);
-  sprintf(cmd, "%s time > %s%s", CRASHDUMP_BIN, CRASHDUMP_FILE, fruname);
-  system(cmd);
+    // COREID dump
+    bic_me_xmit_file(fru, CRASHDUMP_COREID, out, &t->cancel);
 
-  // COREID dump
-  memset(cmd, 0, 128);
-  sprintf(cmd, "%s %s coreid >> %s%s", CRASHDUMP_BIN, fruname, CRASHDUMP_FILE, fruname);
-  system(cmd);
+    // MSR dump
+    if (!t->cancel)
+      bic_me_xmit_file(fru, CRASHDUMP_MSR, out, &t->cancel);
 
-  // MSR dump
-  memset(cmd, 0, 128);
-  sprintf(cmd, "%s %s msr >> %s%s", CRASHDUMP_BIN, fruname, CRASHDUMP_FILE, fruname);
-  system(cmd);
+    fclose(out);
+    free(buf);
+  }
+
+  // A cancelled dump leaves the ongoing flag to the dump replacing it
+  if (t->cancel) {
+    remove(tmp_path);
+    t->is_running = 0;
+    return NULL;
+  }
+  rename(tmp_path, path);
 
   syslog(LOG_CRIT, "Crashdump for FRU: %d is generated.", fru);
 
-  t_dump[fru-1].is_running = 0;
+done:
+  sprintf(key, CRASHDUMP_KEY, fru);
+  edb_cache_set(key, "0");
 
-  sprintf(cmd, CRASHDUMP_KEY, fru);
-  edb_cache_set(cmd, "0");
+  t->is_running = 0;
+  return NULL;
 }
 
 
 int
 yosemite_common_crashdump(uint8_t fru) {
 
-  int ret;
+  struct threadinfo *t = &t_dump[fru-1];
+  uint8_t script = 0;
   char cmd[100];
 
-  // Check if the crashdump script exist
-  if (access(CRASHDUMP_BIN, F_OK) == -1) {
-    syslog(LOG_CRIT, "Crashdump for FRU: %d failed : "
-        "crashdump binary is not preset", fru);
-    return 0;
+  // Prefer the command lists, fall back to the crashdump script
+  if (access(CRASHDUMP_COREID, F_OK) == -1 ||
+      access(CRASHDUMP_MSR, F_OK) == -1) {
+    if (access(CRASHDUMP_BIN, F_OK) == -1) {
+      syslog(LOG_CRIT, "Crashdump for FRU: %d failed : "
+          "crashdump command list is not present", fru);
+      return 0;
+    }
+    script = 1;
   }
 
   // Check if a crashdump for that fru is already running.
-  // If yes, kill that thread and start a new one.
-  if (t_dump[fru-1].is_running) {
-    ret = pthread_cancel(t_dump[fru-1].pt);
-    if (ret == ESRCH) {
-      syslog(LOG_INFO, "yosemite_common_crashdump: No Crashdump pthread exists");
-    } else {
-      pthread_join(t_dump[fru-1].pt, NULL);
+  // If yes, stop that thread and start a new one.
+  if (t->is_running) {
+    t->cancel = 1;
+    if (t->script) {
       sprintf(cmd, "ps | grep '{dump.sh}' | grep 'slot%d' | awk '{print $1}'| xargs kill", fru);
       system(cmd);
       sprintf(cmd, "ps | grep 'me-util' | grep 'slot%d' | awk '{print $1}'| xargs kill", fru);
       system(cmd);
+    }
+  }
+
+  // Reap the previous thread, whether it finished or was just stopped
+  if (t->joinable) {
+    pthread_join(t->pt, NULL);
+    t->joinable = 0;
 #ifdef DEBUG
-      syslog(LOG_INFO, "yosemite_common_crashdump: Previous crashdump thread is cancelled");
+    syslog(LOG_INFO, "yosemite_common_crashdump: Previous crashdump thread is reaped");
 #endif
-    }
   }
 
   // Start a thread to generate the crashdump
-  t_dump[fru-1].fru = fru;
-  if (pthread_create(&(t_dump[fru-1].pt), NULL, generate_dump, (void*) &t_dump[fru-1].fru) < 0) {
+  t->fru = fru;
+  t->script = script;
+  t->cancel = 0;
+  t->is_running = 1;
+  if (pthread_create(&t->pt, NULL, generate_dump, (void*) t) != 0) {
     syslog(LOG_WARNING, "pal_store_crashdump: pthread_create for"
         " FRU %d failed\n", fru);
+    t->is_running = 0;
     return -1;
   }
-
-  t_dump[fru-1].is_running = 1;
+  t->joinable = 1;
 
   syslog(LOG_INFO, "Crashdump for FRU: %d is being generated.", fru);
 
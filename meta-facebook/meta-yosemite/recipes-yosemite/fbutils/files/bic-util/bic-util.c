@@ -18,6 +18,7 @@
  * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+#define _GNU_SOURCE     /* To get defns of open_memstream and strtok_r */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -33,6 +34,35 @@
 #define LAST_RECORD_ID 0xFFFF
 #define MAX_SENSOR_NUM 0xFF
 #define BYTES_ENTIRE_RECORD 0xFF
+#define MAX_NUM_SLOTS 4
+#define DIAG_DEPTH 4    // BIC requests kept in flight per slot
+#define SDR_MAX_RETRY 3 // Failed reads of one SDR record before giving up
+
+typedef int (*diag_fn_t)(uint8_t slot_id, int item, void *res);
+
+/*
+ * A batch of independent BIC requests for one slot. Workers take the next
+ * item under the lock and store its return code and response at the item's
+ * index, so the caller can print the results in order afterwards.
+ */
+typedef struct {
+  uint8_t slot_id;
+  int cnt;
+  int next;
+  pthread_mutex_t lock;
+  diag_fn_t fn;
+  uint8_t *res;
+  size_t res_size;
+  int *ret;
+} diag_batch_t;
+
+typedef struct {
+  uint8_t slot_id;
+  void (*util)(uint8_t slot_id, FILE *fp);
+  char *buf;
+  size_t len;
+  pthread_t pt;
+} diag_slot_t;
 
 static const char *option_list[] = {
   "--get_dev_id",
@@ -54,6 +84,64 @@ print_usage_help(void) {
   printf("       option:\n");
   for (i = 0; i < sizeof(option_list)/sizeof(option_list[0]); i++)
     printf("       %s\n", option_list[i]);
+  printf("Usage: bic-util <all|slotX,slotY,...> <--get_gpio_config|--get_sdr|--read_sensor>\n");
+}
+
+static void *
+diag_worker(void *arg) {
+  diag_batch_t *batch = (diag_batch_t *) arg;
+  int i;
+
+  while (1) {
+    pthread_mutex_lock(&batch->lock);
+    i = batch->next++;
+    pthread_mutex_unlock(&batch->lock);
+    if (i >= batch->cnt) {
+      break;
+    }
+
+    batch->ret[i] = batch->fn(batch->slot_id, i,
+                              batch->res + i * batch->res_size);
+  }
+
+  return NULL;
+}
+
+/*
+ * Issue fn for items 0..cnt-1 with up to DIAG_DEPTH requests in flight.
+ * Each request goes to ipmbd over its own connection and ipmbd pairs the
+ * responses up by IPMB sequence number, so they may overlap on the bus.
+ */
+static void
+diag_run(uint8_t slot_id, int cnt, diag_fn_t fn, void *res, size_t res_size,
+         int *ret) {
+  diag_batch_t batch;
+  pthread_t pt[DIAG_DEPTH - 1];
+  int i, nthreads = 0;
+
+  batch.slot_id = slot_id;
+  batch.cnt = cnt;
+  batch.next = 0;
+  batch.fn = fn;
+  batch.res = (uint8_t *) res;
+  batch.res_size = res_size;
+  batch.ret = ret;
+  pthread_mutex_init(&batch.lock, NULL);
+
+  for (i = 0; i < DIAG_DEPTH - 1 && i < cnt - 1; i++) {
+    if (pthread_create(&pt[nthreads], NULL, diag_worker, &batch)) {
+      break;
+    }
+    nthreads++;
+  }
+
+  // This thread is a worker too, so the batch completes even without threads
+  diag_worker(&batch);
+
+  for (i = 0; i < nthreads; i++) {
+    pthread_join(pt[i], NULL);
+  }
+  pthread_mutex_destroy(&batch.lock);
 }
 
 // Test to Get device ID
@@ -135,34 +223,42 @@ util_get_gpio(uint8_t slot_id) {
   printf("rsvd: %d\n", t->bits.rsvd);
 }
 
+static int
+get_gpio_config_item(uint8_t slot_id, int item, void *res) {
+  return bic_get_gpio_config(slot_id, item, (bic_gpio_config_t *) res);
+}
+
 static void
-util_get_gpio_config(uint8_t slot_id) {
-  int ret;
+util_get_gpio_config(uint8_t slot_id, FILE *fp) {
+  int ret[MAX_GPIO_PINS];
   int i;
-  bic_gpio_config_t gpio_config = {0};
-  bic_gpio_config_u *t = (bic_gpio_config_u *) &gpio_config;
+  bic_gpio_config_t gpio_config[MAX_GPIO_PINS] = {0};
+  bic_gpio_config_u *t;
   char gpio_name[32];
 
 
   // Read configuration of all bits
+  diag_run(slot_id, gpio_pin_cnt, get_gpio_config_item, gpio_config,
+           sizeof(bic_gpio_config_t), ret);
+
   for (i = 0;  i < gpio_pin_cnt; i++) {
-    ret = bic_get_gpio_config(slot_id, i, &gpio_config);
-    if (ret == -1) {
+    if (ret[i] == -1) {
       continue;
     }
+    t = (bic_gpio_config_u *) &gpio_config[i];
     yosemite_get_gpio_name(slot_id, i, gpio_name);
-    printf("gpio_config for pin#%d (%s):\n", i, gpio_pin_name[i]);
-    printf("Direction: %s", t->bits.dir?"Output,":"Input, ");
-    printf(" Interrupt: %s", t->bits.ie?"Enabled, ":"Disabled,");
-    printf(" Trigger: %s", t->bits.edge?"Level ":"Edge ");
+    fprintf(fp, "gpio_config for pin#%d (%s):\n", i, gpio_pin_name[i]);
+    fprintf(fp, "Direction: %s", t->bits.dir?"Output,":"Input, ");
+    fprintf(fp, " Interrupt: %s", t->bits.ie?"Enabled, ":"Disabled,");
+    fprintf(fp, " Trigger: %s", t->bits.edge?"Level ":"Edge ");
     if (t->bits.trig == 0x0) {
-      printf("Trigger,  Edge: %s\n", "Falling Edge");
+      fprintf(fp, "Trigger,  Edge: %s\n", "Falling Edge");
     } else if (t->bits.trig == 0x1) {
-      printf("Trigger,  Edge: %s\n", "Rising Edge");
+      fprintf(fp, "Trigger,  Edge: %s\n", "Rising Edge");
     } else if (t->bits.trig == 0x2) {
-      printf("Trigger,  Edge: %s\n", "Both Edges");
+      fprintf(fp, "Trigger,  Edge: %s\n", "Both Edges");
     } else  {
-      printf("Trigger, Edge: %s\n", "Reserved");
+      fprintf(fp, "Trigger, Edge: %s\n", "Reserved");
     }
   }
 }
@@ -334,9 +430,10 @@ util_get_sdr_info(uint8_t slot_id) {
 }
 
 static void
-util_get_sdr(uint8_t slot_id) {
+util_get_sdr(uint8_t slot_id, FILE *fp) {
   int ret;
   int i;
+  int fails = 0;
   uint16_t rsv;
   uint8_t rlen;
   uint8_t rbuf[MAX_IPMB_RES_LEN] = {0};
@@ -352,47 +449,144 @@ util_get_sdr(uint8_t slot_id) {
   while (1) {
     ret = bic_get_sdr(slot_id, &req, res, &rlen);
     if (ret) {
-      printf("util_get_sdr:bic_get_sdr returns %d\n", ret);
+      fprintf(fp, "util_get_sdr:bic_get_sdr returns %d\n", ret);
+      if (++fails >= SDR_MAX_RETRY) {
+        fprintf(fp, "util_get_sdr: giving up at record 0x%X after %d "
+                "failures\n", req.rec_id, fails);
+        break;
+      }
       continue;
     }
+    fails = 0;
 
     sdr_full_t *sdr = res->data;
 
-    printf("type: %d, ", sdr->type);
-    printf("sensor_num: %d, ", sdr->sensor_num);
-    printf("sensor_type: %d, ", sdr->sensor_type);
-    printf("evt_read_type: %d, ", sdr->evt_read_type);
-    printf("m_val: %d, ", sdr->m_val);
-    printf("m_tolerance: %d, ", sdr->m_tolerance);
-    printf("b_val: %d, ", sdr->b_val);
-    printf("b_accuracy: %d, ", sdr->b_accuracy);
-    printf("accuracy_dir: %d, ", sdr->accuracy_dir);
-    printf("rb_exp: %d,\n", sdr->rb_exp);
+    fprintf(fp, "type: %d, ", sdr->type);
+    fprintf(fp, "sensor_num: %d, ", sdr->sensor_num);
+    fprintf(fp, "sensor_type: %d, ", sdr->sensor_type);
+    fprintf(fp, "evt_read_type: %d, ", sdr->evt_read_type);
+    fprintf(fp, "m_val: %d, ", sdr->m_val);
+    fprintf(fp, "m_tolerance: %d, ", sdr->m_tolerance);
+    fprintf(fp, "b_val: %d, ", sdr->b_val);
+    fprintf(fp, "b_accuracy: %d, ", sdr->b_accuracy);
+    fprintf(fp, "accuracy_dir: %d, ", sdr->accuracy_dir);
+    fprintf(fp, "rb_exp: %d,\n", sdr->rb_exp);
 
     req.rec_id = res->next_rec_id;
     if (req.rec_id == LAST_RECORD_ID) {
-      printf("This record is LAST record\n");
+      fprintf(fp, "This record is LAST record\n");
       break;
     }
   }
 }
 
+static int
+read_sensor_item(uint8_t slot_id, int item, void *res) {
+  return bic_read_sensor(slot_id, item, (ipmi_sensor_reading_t *) res);
+}
+
 // Test to read all Sensors from Monolake Server
 static void
-util_read_sensor(uint8_t slot_id) {
-  int ret;
+util_read_sensor(uint8_t slot_id, FILE *fp) {
+  int ret[MAX_SENSOR_NUM];
   int i;
-  ipmi_sensor_reading_t sensor;
+  ipmi_sensor_reading_t sensor[MAX_SENSOR_NUM];
+
+  diag_run(slot_id, MAX_SENSOR_NUM, read_sensor_item, sensor,
+           sizeof(ipmi_sensor_reading_t), ret);
 
   for (i = 0; i < MAX_SENSOR_NUM; i++) {
-    ret = bic_read_sensor(slot_id, i, &sensor);
-    if (ret) {
+    if (ret[i]) {
       continue;
     }
 
-    printf("sensor#%d: value: 0x%X, flags: 0x%X, status: 0x%X, ext_status: 0x%X\n",
-            i, sensor.value, sensor.flags, sensor.status, sensor.ext_status);
+    fprintf(fp, "sensor#%d: value: 0x%X, flags: 0x%X, status: 0x%X, ext_status: 0x%X\n",
+            i, sensor[i].value, sensor[i].flags, sensor[i].status, sensor[i].ext_status);
+  }
+}
+
+static void *
+diag_slot(void *arg) {
+  diag_slot_t *slot = (diag_slot_t *) arg;
+  ipmi_dev_id_t id = {0};
+  FILE *fp;
+
+  fp = open_memstream(&slot->buf, &slot->len);
+  if (fp == NULL) {
+    return NULL;
+  }
+
+  // Skip a slot whose BIC does not answer instead of timing out every item
+  if (bic_get_dev_id(slot->slot_id, &id)) {
+    fprintf(fp, "BIC no response!\n");
+  } else {
+    slot->util(slot->slot_id, fp);
+  }
+  fclose(fp);
+
+  return NULL;
+}
+
+/*
+ * Run one bulk option on several slots at once. Each slot writes to its
+ * own buffer and the buffers are printed in slot order.
+ */
+static int
+util_multi_slot(char *slots, char *option) {
+  diag_slot_t jobs[MAX_NUM_SLOTS] = {0};
+  void (*util)(uint8_t slot_id, FILE *fp);
+  int njobs = 0;
+  int i, slot_id;
+  char *str, *next;
+
+  if (!strcmp(option, "--get_gpio_config")) {
+    util = util_get_gpio_config;
+  } else if (!strcmp(option, "--get_sdr")) {
+    util = util_get_sdr;
+  } else if (!strcmp(option, "--read_sensor")) {
+    util = util_read_sensor;
+  } else {
+    return -1;
+  }
+
+  if (!strcmp(slots, "all")) {
+    for (slot_id = 1; slot_id <= MAX_NUM_SLOTS; slot_id++) {
+      jobs[njobs++].slot_id = slot_id;
+    }
+  } else {
+    for (str = strtok_r(slots, ",", &next); str && njobs < MAX_NUM_SLOTS;
+         str = strtok_r(NULL, ",", &next)) {
+      if (strncmp(str, "slot", 4) || str[4] < '1' ||
+          str[4] > '0' + MAX_NUM_SLOTS || str[5] != '\0') {
+        return -1;
+      }
+      jobs[njobs++].slot_id = str[4] - '0';
+    }
+  }
+
+  for (i = 0; i < njobs; i++) {
+    jobs[i].util = util;
+    if (pthread_create(&jobs[i].pt, NULL, diag_slot, &jobs[i])) {
+      syslog(LOG_WARNING, "bic-util: pthread_create failed for slot%u",
+          jobs[i].slot_id);
+      diag_slot(&jobs[i]);
+      jobs[i].pt = 0;
+    }
+  }
+
+  for (i = 0; i < njobs; i++) {
+    if (jobs[i].pt) {
+      pthread_join(jobs[i].pt, NULL);
+    }
+    printf("slot%u:\n", jobs[i].slot_id);
+    if (jobs[i].buf) {
+      fwrite(jobs[i].buf, 1, jobs[i].len, stdout);
+      free(jobs[i].buf);
+    }
+    printf("\n");
   }
+
+  return 0;
 }
 
 static int
@@ -439,6 +633,14 @@ main(int argc, char **argv) {
     goto err_exit;
   }
 
+  /* Several slots: run the bulk option on all of them concurrently */
+  if (!strcmp(argv[1], "all") || strchr(argv[1], ',')) {
+    if (argc != 3 || util_multi_slot(argv[1], argv[2])) {
+      goto err_exit;
+    }
+    return 0;
+  }
+
   if (!strcmp(argv[1], "slot1")) {
     slot_id = 1;
   } else if (!strcmp(argv[1] , "slot2")) {
@@ -456,7 +658,7 @@ main(int argc, char **argv) {
   } else if (!strcmp(argv[2], "--get_gpio")) {
     util_get_gpio(slot_id);
   } else if (!strcmp(argv[2], "--get_gpio_config")) {
-    util_get_gpio_config(slot_id);
+    util_get_gpio_config(slot_id, stdout);
   } else if (!strcmp(argv[2], "--get_config")) {
     util_get_config(slot_id);
   } else if (!strcmp(argv[2], "--get_post_code")) {
@@ -464,9 +666,9 @@ main(int argc, char **argv) {
   } else if (!strcmp(argv[2], "--read_fruid")) {
     util_read_fruid(slot_id);
   } else if (!strcmp(argv[2], "--get_sdr")) {
-    util_get_sdr(slot_id);
+    util_get_sdr(slot_id, stdout);
   } else if (!strcmp(argv[2], "--read_sensor")) {
-    util_read_sensor(slot_id);
+    util_read_sensor(slot_id, stdout);
   } else if (argc >= 4) {
     return process_command(slot_id, (argc - 2), (argv + 2));
   } else {
@@ -485,7 +687,7 @@ err_exit:
   util_get_device_id(slot_id);
 
   util_get_gpio(slot_id);
-  util_get_gpio_config(slot_id);
+  util_get_gpio_config(slot_id, stdout);
 
   util_get_config(slot_id);
 
@@ -498,7 +700,7 @@ err_exit:
   util_get_sel(slot_id);
 
   util_get_sdr_info(slot_id);
-  util_get_sdr(slot_id);
-  util_read_sensor(slot_id);
+  util_get_sdr(slot_id, stdout);
+  util_read_sensor(slot_id, stdout);
 #endif
 }
@@ -0,0 +1,456 @@
+/*
+ * bicsim
+ *
+ * Copyright 2015-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Simulated Bridge ICs for exercising bic-util without hardware.
+ *
+ * bicsim stands in for ipmbd on the IPMB buses of the four server slots:
+ * it listens on the same unix sockets, answers the BIC commands bic-util's
+ * diagnostics use, and models the time each request takes. Every request
+ * holds its bus for the transfer time, then takes the BIC's latency, with
+ * at most "depth" requests being worked on by one BIC at a time.
+ *
+ * ipmbd must not be running on the simulated buses (sv stop ipmbd_N); bicsim
+ * refuses to start on a socket something is still accepting on.  It is not
+ * part of the image: build it with "make bicsim".
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <openbmc/ipmi.h>
+#include <openbmc/ipmb.h>
+
+#define MAX_NUM_SLOTS 4
+#define SDR_REC_LEN 48
+#define BIC_NO_SENSOR 0xCB
+
+typedef struct {
+  int bus_id;
+  int sock;
+  struct sockaddr_un addr;
+  dev_t dev;               // The socket file we bound, so exit removes
+  ino_t ino;               // only that one
+  pthread_mutex_t bus;     // One transfer on the wire at a time
+  sem_t busy;              // Requests the BIC works on at once
+  pthread_mutex_t lock;
+  long requests;
+  int inflight;
+  int max_inflight;
+} sim_bus_t;
+
+typedef struct {
+  sim_bus_t *bus;
+  int fd;
+} sim_conn_t;
+
+static const int slot_bus[MAX_NUM_SLOTS] = {3, 1, 7, 5};
+
+static sim_bus_t g_bus[MAX_NUM_SLOTS];
+static int g_nbus;
+static int g_xfer_us = 1000;
+static int g_latency_us = 5000;
+static int g_depth = 4;
+static int g_sensors = 80;
+static int g_records = 80;
+static int g_fail_rec = -1;    // First SDR record that fails to read
+static volatile sig_atomic_t g_stop;
+
+static void
+usage(void) {
+  printf("Usage: bicsim [-s <slot,...>] [-x <xfer us>] [-l <latency us>] "
+         "[-d <depth>] [-n <sensors>] [-r <sdr records>] "
+         "[-f <failing sdr record>]\n");
+}
+
+static void
+on_signal(int sig) {
+  g_stop = 1;
+}
+
+// Fill in the response data for one request; returns its length or -1
+static int
+handle_cmd(uint8_t netfn, uint8_t cmd, uint8_t *data, int dlen, uint8_t *cc,
+           uint8_t *out) {
+  ipmi_sel_sdr_req_t *sreq;
+  uint16_t next;
+  int i, off;
+
+  *cc = CC_SUCCESS;
+
+  if (netfn == NETFN_APP_REQ && cmd == CMD_APP_GET_DEVICE_ID) {
+    memset(out, 0, 15);
+    out[0] = 0x20;
+    out[2] = 0x01;
+    out[4] = 0x02;
+    return 15;
+  }
+
+  if (netfn == NETFN_SENSOR_REQ && cmd == CMD_SENSOR_GET_SENSOR_READING) {
+    if (dlen < 1 || data[0] >= g_sensors) {
+      *cc = BIC_NO_SENSOR;
+      return 0;
+    }
+    out[0] = data[0] + 0x10;
+    out[1] = 0xC0;
+    out[2] = data[0] & 0x3F;
+    out[3] = 0x80;
+    return 4;
+  }
+
+  if (netfn == NETFN_OEM_1S_REQ && cmd == CMD_OEM_1S_GET_GPIO_CONFIG) {
+    if (dlen < 7) {
+      *cc = CC_INVALID_PARAM;
+      return 0;
+    }
+    memcpy(out, data, 3);   // IANA ID
+    for (i = 0; i < 32; i++) {
+      if (data[3 + i / 8] & (1 << (i % 8))) {
+        break;
+      }
+    }
+    out[3] = (uint8_t) (i * 5);
+    return 4;
+  }
+
+  if (netfn == NETFN_STORAGE_REQ && cmd == CMD_STORAGE_RSV_SDR) {
+    out[0] = 0x01;
+    out[1] = 0x00;
+    return 2;
+  }
+
+  if (netfn == NETFN_STORAGE_REQ && cmd == CMD_STORAGE_GET_SDR) {
+    if (dlen < sizeof(ipmi_sel_sdr_req_t)) {
+      *cc = CC_INVALID_PARAM;
+      return 0;
+    }
+    sreq = (ipmi_sel_sdr_req_t *) data;
+    if (g_fail_rec >= 0 && sreq->rec_id >= g_fail_rec) {
+      *cc = CC_UNSPECIFIED_ERROR;
+      return 0;
+    }
+    if (sreq->rec_id >= g_records ||
+        sreq->offset + sreq->nbytes > SDR_REC_LEN) {
+      *cc = CC_PARAM_OUT_OF_RANGE;
+      return 0;
+    }
+    next = (sreq->rec_id + 1 < g_records) ? sreq->rec_id + 1 : 0xFFFF;
+    memcpy(out, &next, 2);
+    for (i = 0; i < sreq->nbytes; i++) {
+      off = sreq->offset + i;
+      switch (off) {
+      case 0:
+        out[2 + i] = sreq->rec_id & 0xFF;
+        break;
+      case 1:
+        out[2 + i] = sreq->rec_id >> 8;
+        break;
+      case 2:
+        out[2 + i] = 0x51;
+        break;
+      case 3:
+        out[2 + i] = 0x01;          // Full sensor record
+        break;
+      case 4:
+        out[2 + i] = SDR_REC_LEN - 5;
+        break;
+      case 7:
+        out[2 + i] = sreq->rec_id;  // Sensor number
+        break;
+      default:
+        out[2 + i] = (uint8_t) (sreq->rec_id * 7 + off);
+        break;
+      }
+    }
+    return 2 + sreq->nbytes;
+  }
+
+  *cc = CC_INVALID_CMD;
+  return 0;
+}
+
+static void *
+conn_handler(void *arg) {
+  sim_conn_t *conn = (sim_conn_t *) arg;
+  sim_bus_t *bus = conn->bus;
+  uint8_t req[MAX_IPMB_RES_LEN];
+  uint8_t res[MAX_IPMB_RES_LEN];
+  ipmb_req_t *preq = (ipmb_req_t *) req;
+  ipmb_res_t *pres = (ipmb_res_t *) res;
+  int len, dlen;
+
+  len = recv(conn->fd, req, sizeof(req), 0);
+  if (len < IPMB_HDR_SIZE + IPMI_REQ_HDR_SIZE - 1) {
+    goto done;
+  }
+
+  pthread_mutex_lock(&bus->lock);
+  bus->requests++;
+  if (++bus->inflight > bus->max_inflight) {
+    bus->max_inflight = bus->inflight;
+  }
+  pthread_mutex_unlock(&bus->lock);
+
+  // The request goes out on the wire, then waits its turn in the BIC
+  pthread_mutex_lock(&bus->bus);
+  usleep(g_xfer_us);
+  pthread_mutex_unlock(&bus->bus);
+
+  sem_wait(&bus->busy);
+  usleep(g_latency_us);
+  sem_post(&bus->busy);
+
+  memset(res, 0, sizeof(res));
+  dlen = handle_cmd(preq->netfn_lun >> LUN_OFFSET, preq->cmd, preq->data,
+                    len - (IPMB_HDR_SIZE + IPMI_REQ_HDR_SIZE - 1), &pres->cc,
+                    pres->data);
+  pres->req_slave_addr = preq->req_slave_addr;
+  pres->netfn_lun = ((preq->netfn_lun >> LUN_OFFSET) + 1) << LUN_OFFSET;
+  pres->res_slave_addr = preq->res_slave_addr;
+  pres->seq_lun = preq->seq_lun;
+  pres->cmd = preq->cmd;
+
+  pthread_mutex_lock(&bus->lock);
+  bus->inflight--;
+  pthread_mutex_unlock(&bus->lock);
+
+  send(conn->fd, res, IPMB_HDR_SIZE + IPMI_RESP_HDR_SIZE + dlen, MSG_NOSIGNAL);
+
+done:
+  close(conn->fd);
+  free(conn);
+  return NULL;
+}
+
+static void *
+bus_listener(void *arg) {
+  sim_bus_t *bus = (sim_bus_t *) arg;
+  sim_conn_t *conn;
+  pthread_t pt;
+  int fd;
+
+  while (!g_stop) {
+    fd = accept(bus->sock, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+
+    conn = malloc(sizeof(sim_conn_t));
+    if (conn == NULL) {
+      close(fd);
+      continue;
+    }
+    conn->bus = bus;
+    conn->fd = fd;
+    if (pthread_create(&pt, NULL, conn_handler, conn)) {
+      close(fd);
+      free(conn);
+      continue;
+    }
+    pthread_detach(pt);
+  }
+
+  return NULL;
+}
+
+/*
+ * Remove a socket file left by a daemon that is gone. Returns -1 if a
+ * daemon still accepts on it, or it cannot be checked.
+ */
+static int
+remove_stale_socket(struct sockaddr_un *addr) {
+  int fd;
+  int ret;
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  ret = connect(fd, (struct sockaddr *) addr, sizeof(*addr)) ? errno : 0;
+  close(fd);
+
+  if (ret == 0) {
+    printf("bicsim: %s is in use, stop ipmbd on that bus first\n",
+           addr->sun_path);
+    return -1;
+  }
+  if (ret == ENOENT) {
+    return 0;
+  }
+  if (ret != ECONNREFUSED) {
+    errno = ret;
+  }
+  if (ret != ECONNREFUSED || unlink(addr->sun_path)) {
+    printf("bicsim: cannot reuse %s: %s\n", addr->sun_path, strerror(errno));
+    return -1;
+  }
+
+  return 0;
+}
+
+static int
+open_bus(sim_bus_t *bus, int bus_id) {
+  struct sockaddr_un *local = &bus->addr;
+  struct stat st;
+
+  bus->bus_id = bus_id;
+  pthread_mutex_init(&bus->bus, NULL);
+  pthread_mutex_init(&bus->lock, NULL);
+  sem_init(&bus->busy, 0, g_depth);
+
+  bus->sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (bus->sock < 0) {
+    return -1;
+  }
+
+  memset(local, 0, sizeof(*local));
+  local->sun_family = AF_UNIX;
+  snprintf(local->sun_path, sizeof(local->sun_path), "%s_%d", SOCK_PATH_IPMB,
+           bus_id);
+  if (remove_stale_socket(local)) {
+    close(bus->sock);
+    return -1;
+  }
+  if (bind(bus->sock, (struct sockaddr *) local, sizeof(*local)) ||
+      listen(bus->sock, 64) || stat(local->sun_path, &st)) {
+    printf("bicsim: cannot listen on %s: %s\n", local->sun_path,
+           strerror(errno));
+    close(bus->sock);
+    return -1;
+  }
+  bus->dev = st.st_dev;
+  bus->ino = st.st_ino;
+
+  return 0;
+}
+
+/* Remove our socket file, unless ipmbd has since put its own there */
+static void
+close_bus(sim_bus_t *bus) {
+  struct stat st;
+
+  shutdown(bus->sock, SHUT_RDWR);
+  close(bus->sock);
+  if (!stat(bus->addr.sun_path, &st) && st.st_dev == bus->dev &&
+      st.st_ino == bus->ino) {
+    unlink(bus->addr.sun_path);
+  }
+}
+
+int
+main(int argc, char **argv) {
+  struct sigaction sa;
+  pthread_t pt[MAX_NUM_SLOTS];
+  char *str, *next;
+  int slots = 0;
+  int slot, opt, i;
+
+  while ((opt = getopt(argc, argv, "s:x:l:d:n:r:f:h")) != -1) {
+    switch (opt) {
+    case 's':
+      for (str = strtok_r(optarg, ",", &next); str;
+           str = strtok_r(NULL, ",", &next)) {
+        slot = atoi(str);
+        if (slot < 1 || slot > MAX_NUM_SLOTS) {
+          usage();
+          return -1;
+        }
+        slots |= 1 << slot;
+      }
+      break;
+    case 'x':
+      g_xfer_us = atoi(optarg);
+      break;
+    case 'l':
+      g_latency_us = atoi(optarg);
+      break;
+    case 'd':
+      g_depth = atoi(optarg);
+      break;
+    case 'n':
+      g_sensors = atoi(optarg);
+      break;
+    case 'r':
+      g_records = atoi(optarg);
+      break;
+    case 'f':
+      g_fail_rec = atoi(optarg);
+      break;
+    default:
+      usage();
+      return opt == 'h' ? 0 : -1;
+    }
+  }
+
+  if (g_depth < 1 || g_records < 1) {
+    usage();
+    return -1;
+  }
+
+  for (slot = 1; slot <= MAX_NUM_SLOTS; slot++) {
+    if (slots && !(slots & (1 << slot))) {
+      continue;
+    }
+    if (open_bus(&g_bus[g_nbus], slot_bus[slot - 1])) {
+      for (i = 0; i < g_nbus; i++) {
+        close_bus(&g_bus[i]);
+      }
+      return -1;
+    }
+    g_nbus++;
+  }
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_signal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  for (i = 0; i < g_nbus; i++) {
+    pthread_create(&pt[i], NULL, bus_listener, &g_bus[i]);
+  }
+  printf("bicsim: %d buses, xfer %d us, latency %d us, depth %d\n", g_nbus,
+         g_xfer_us, g_latency_us, g_depth);
+  fflush(stdout);
+
+  while (!g_stop) {
+    pause();
+  }
+
+  for (i = 0; i < g_nbus; i++) {
+    printf("bus %d: %ld requests, at most %d outstanding\n", g_bus[i].bus_id,
+           g_bus[i].requests, g_bus[i].max_inflight);
+    close_bus(&g_bus[i]);
+  }
+
+  return 0;
+}
@@ -19,23 +19,30 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
 #include <unistd.h>
 #include <errno.h>
 #include <syslog.h>
 #include <string.h>
-#include <pthread.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/file.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
 #include <time.h>
 #include <sys/time.h>
 #include <openbmc/ipmi.h>
 #include <openbmc/ipmb.h>
 #include <openbmc/pal.h>
+#include <openbmc/gpio.h>
 
 #define BTN_MAX_SAMPLES   200
 #define BTN_POWER_OFF     40
+#define BTN_SAMPLE_MS     100
 #define MAX_NUM_SLOTS 4
 #define HB_SLEEP_TIME (5 * 60)
 #define HB_TIMESTAMP_COUNT (60 * 60 / HB_SLEEP_TIME)
@@ -55,9 +62,71 @@
 #define LED_ON_TIME_BMC_SELECT 500
 #define LED_OFF_TIME_BMC_SELECT 500
 
+/*
+ * Fallback poll interval for tasks whose inputs raise GPIO edge events;
+ * the edge itself runs the task right away.
+ */
+#define EDGE_POLL_MS      5000
+#define SLOW_TASK_MS      2000
+#define WAKEUP_STATS_SEC  600 // Log loop wake-ups every x seconds (LOG_DEBUG)
+
+/*
+ * All front panel handling runs from one event loop.  Each task is a step
+ * function that does one bounded piece of work and returns the number of
+ * ms until it wants to run again; anything that used to sleep in the
+ * middle of a handler (button hold timing, LED blink phases) keeps its
+ * place in task->state.  A timerfd is armed for the earliest deadline, and
+ * edges on the buttons, hand switch and debug card present pin make the
+ * tasks that read them due immediately.  Nothing on the loop talks to a
+ * BIC; see fp_slot_t.
+ */
+typedef struct fp_task {
+  const char *name;
+  int (*run)(struct fp_task *task);
+  uint64_t due;         // Monotonic ms when the task runs next
+  int state;
+  uint8_t pos;          // Slot latched when a button press started
+  uint64_t since;       // Monotonic ms when the current state was entered
+} fp_task_t;
+
+/*
+ * Calls that go through a slot's BIC (power state and control, POST
+ * codes) can block for seconds; pal_set_server_power alone sleeps up to
+ * 11 s.  They run on a worker thread per slot so the event loop keeps
+ * serving the buttons and LEDs.  The loop posts requests in slot->req and
+ * the worker leaves its results in the same structure.
+ */
+enum {
+  SLOT_REQ_POWER = 0x1,   // Refresh the cached power state
+  SLOT_REQ_BUTTON = 0x2,  // Power button pressed: toggle the power
+  SLOT_REQ_POST = 0x4,    // Enable POST codes and show the last one
+};
+
+typedef struct {
+  uint8_t slot;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  uint8_t req;            // SLOT_REQ_* not yet picked up by the worker
+  bool busy;              // Worker is running a power button command
+  bool long_press;        // For SLOT_REQ_BUTTON
+  bool power_valid;       // The last power state read succeeded
+  uint8_t power;
+  bool post_failed;       // POST code was not shown; debug card retries
+} fp_slot_t;
 
+static fp_slot_t g_slots[MAX_NUM_SLOTS+1];
 static uint8_t g_sync_led[MAX_NUM_SLOTS+1] = {0x0};
 static uint8_t m_pos = 0xff;
+static bool g_edges = false;  // All front panel inputs raise edge events
+static uint64_t g_wakeups;    // Event loop wake-ups, for the statistics
+
+static uint64_t
+now_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
 static int
 get_handsw_pos(uint8_t *pos) {
@@ -68,558 +137,842 @@ get_handsw_pos(uint8_t *pos) {
   return 0;
 }
 
-// Thread for monitoring debug card hotswap
-static void *
-debug_card_handler() {
-  int curr = -1;
-  int prev = -1;
-  uint8_t prsnt = 0;
-  uint8_t pos;
-  uint8_t prev_pos = 0xff;
+// Power button on the selected slot; runs on the slot's worker
+static void
+slot_power_button(uint8_t slot, bool long_press) {
+  uint8_t power, cmd;
+
+  // Get the current power state (power on vs. power off)
+  if (pal_get_server_power(slot, &power)) {
+    return;
+  }
+
+  // Set power command should reverse of current power state
+  cmd = !power;
+
+  // To determine long button press
+  if (long_press) {
+    pal_update_ts_sled();
+    syslog(LOG_CRIT, "Power Button Long Press for FRU: %d\n", slot);
+  } else {
+
+    // If current power state is ON and it is not a long press,
+    // the power off should be Graceful Shutdown
+    if (power == SERVER_POWER_ON)
+      cmd = SERVER_GRACEFUL_SHUTDOWN;
+
+    pal_update_ts_sled();
+    syslog(LOG_CRIT, "Power Button Press for FRU: %d\n", slot);
+  }
+
+  // Reverse the power state of the given server
+  pal_set_server_power(slot, cmd);
+}
+
+// Enable POST codes and show the last one; runs on the slot's worker
+static int
+slot_post_show(uint8_t slot) {
   uint8_t lpc;
-  int ret;
 
+  // Enable POST codes for all slots
+  if (pal_post_enable(slot)) {
+    return 0;
+  }
+
+  // Get last post code and display it
+  if (pal_post_get_last(slot, &lpc)) {
+    return 0;
+  }
+
+  return pal_post_handle(slot, lpc);
+}
+
+static void *
+slot_worker(void *arg) {
+  fp_slot_t *s = (fp_slot_t *)arg;
+  uint8_t req, power = 0;
+  bool long_press;
+  int power_ret = 0, post_ret = 0;
+
+  pthread_mutex_lock(&s->lock);
   while (1) {
-    ret = pal_get_hand_sw(&pos);
-    if (ret) {
-      goto debug_card_out;
+    while (!s->req) {
+      pthread_cond_wait(&s->cond, &s->lock);
     }
+    req = s->req;
+    long_press = s->long_press;
+    s->req = 0;
+    pthread_mutex_unlock(&s->lock);
 
-    if (pos == prev_pos) {
-      goto debug_card_prs;
+    if (req & SLOT_REQ_BUTTON) {
+      slot_power_button(s->slot, long_press);
+      req |= SLOT_REQ_POWER;
     }
-
-    msleep(10);
-    ret = pal_get_hand_sw(&pos);
-    if (ret) {
-      goto debug_card_out;
+    if (req & SLOT_REQ_POST) {
+      post_ret = slot_post_show(s->slot);
     }
-    m_pos = pos;
-
-    ret = pal_switch_usb_mux(pos);
-    if (ret) {
-      goto debug_card_out;
+    if (req & SLOT_REQ_POWER) {
+      power_ret = pal_get_server_power(s->slot, &power);
     }
 
-
-debug_card_prs:
-    // Check if debug card present or not
-    ret = pal_is_debug_card_prsnt(&prsnt);
-    if (ret) {
-      goto debug_card_out;
+    pthread_mutex_lock(&s->lock);
+    if (req & SLOT_REQ_BUTTON) {
+      s->busy = false;
     }
-    curr = prsnt;
-
-    // Check if Debug Card was either inserted or removed
-    if (curr != prev) {
-      if (!curr) {
-        // Debug Card was removed
-        syslog(LOG_WARNING, "Debug Card Extraction\n");
-        // Switch UART mux to BMC
-        ret = pal_switch_uart_mux(HAND_SW_BMC);
-        if (ret) {
-          goto debug_card_out;
-        }
-      } else {
-        // Debug Card was inserted
-        syslog(LOG_WARNING, "Debug Card Insertion\n");
-      }
+    if (req & SLOT_REQ_POST) {
+      s->post_failed = (post_ret != 0);
+    }
+    if (req & SLOT_REQ_POWER) {
+      s->power_valid = (power_ret == 0);
+      s->power = power;
     }
+  }
 
-    // If Debug Card is present
-    if (curr) {
-      if ((pos == prev_pos) && (curr == prev)) {
-        goto debug_card_out;
-      }
+  return NULL;
+}
 
-      // Switch UART mux based on hand switch
-      ret = pal_switch_uart_mux(pos);
-      if (ret) {
-        goto debug_card_out;
-      }
+// Queue req for the slot's worker; fails if a power command is in flight
+static int
+slot_request(uint8_t slot, uint8_t req, bool long_press) {
+  fp_slot_t *s = &g_slots[slot];
+  int ret = 0;
+
+  pthread_mutex_lock(&s->lock);
+  if (req & SLOT_REQ_BUTTON) {
+    if (s->busy) {
+      ret = -1;
+      goto slot_request_out;
+    }
+    s->busy = true;
+    s->long_press = long_press;
+  }
+  s->req |= req;
+  pthread_cond_signal(&s->cond);
+slot_request_out:
+  pthread_mutex_unlock(&s->lock);
+  return ret;
+}
 
-      // Enable POST code based on hand switch
-      if (pos == HAND_SW_BMC) {
-        // For BMC, there is no need to have POST specific code
-        goto debug_card_done;
-      }
+// Power state as last read by the slot's worker; -1 if that read failed
+static int
+slot_get_power(uint8_t slot, uint8_t *power) {
+  fp_slot_t *s = &g_slots[slot];
+  int ret = -1;
+
+  pthread_mutex_lock(&s->lock);
+  if (s->power_valid) {
+    *power = s->power;
+    ret = 0;
+  }
+  pthread_mutex_unlock(&s->lock);
+  return ret;
+}
 
+// Whether showing the POST code failed since the last call
+static bool
+slot_post_failed(uint8_t slot) {
+  fp_slot_t *s = &g_slots[slot];
+  bool failed;
+
+  pthread_mutex_lock(&s->lock);
+  failed = s->post_failed;
+  s->post_failed = false;
+  pthread_mutex_unlock(&s->lock);
+  return failed;
+}
 
+static void
+slot_workers_start(void) {
+  pthread_t tid;
+  uint8_t slot;
 
-      // Make sure the server at selected position is ready
-      ret = pal_is_fru_ready(pos, &prsnt);
-      if (ret || !prsnt) {
-        goto debug_card_done;
-      }
+  for (slot = 1; slot <= MAX_NUM_SLOTS; slot++) {
+    g_slots[slot].slot = slot;
+    pthread_mutex_init(&g_slots[slot].lock, NULL);
+    pthread_cond_init(&g_slots[slot].cond, NULL);
+    if (pthread_create(&tid, NULL, slot_worker, &g_slots[slot])) {
+      syslog(LOG_WARNING, "front-paneld: pthread_create for slot%d error\n",
+             slot);
+      exit(1);
+    }
+    pthread_detach(tid);
+  }
+}
 
-      // Enable POST codes for all slots
-      ret = pal_post_enable(pos);
-      if (ret) {
-        goto debug_card_done;
-      }
+// Monitor debug card hotswap and hand switch position
+static int
+debug_card_handler(fp_task_t *task) {
+  static int curr = -1;
+  static int prev = -1;
+  static uint8_t prev_pos = 0xff;
+  uint8_t prsnt = 0;
+  uint8_t pos;
+  int ret;
 
-      // Get last post code and display it
-      ret = pal_post_get_last(pos, &lpc);
-      if (ret) {
-        goto debug_card_done;
-      }
+  ret = pal_get_hand_sw(&pos);
+  if (ret) {
+    goto debug_card_out;
+  }
 
-      ret = pal_post_handle(pos, lpc);
+  if (pos != prev_pos) {
+    // Let the hand switch settle before acting on the new position
+    if (!task->state) {
+      task->state = 1;
+      return 10;
+    }
+    m_pos = pos;
+
+    ret = pal_switch_usb_mux(pos);
+    if (ret) {
+      goto debug_card_out;
+    }
+  }
+
+  // Check if debug card present or not
+  ret = pal_is_debug_card_prsnt(&prsnt);
+  if (ret) {
+    goto debug_card_out;
+  }
+  curr = prsnt;
+
+  // Check if Debug Card was either inserted or removed
+  if (curr != prev) {
+    if (!curr) {
+      // Debug Card was removed
+      syslog(LOG_WARNING, "Debug Card Extraction\n");
+      // Switch UART mux to BMC
+      ret = pal_switch_uart_mux(HAND_SW_BMC);
       if (ret) {
         goto debug_card_out;
       }
+    } else {
+      // Debug Card was inserted
+      syslog(LOG_WARNING, "Debug Card Insertion\n");
     }
-
-debug_card_done:
-    prev = curr;
-    prev_pos = pos;
-debug_card_out:
-    if (curr == 1)
-      msleep(500);
-    else
-      sleep(1);
   }
-}
 
-// Thread to monitor Reset Button and propagate to selected server
-static void *
-rst_btn_handler() {
-  int ret;
-  uint8_t pos;
-  int i;
-  uint8_t btn;
+  // If Debug Card is present
+  if (curr) {
+    if ((pos == prev_pos) && (curr == prev) &&
+        (pos > MAX_NUM_SLOTS || !slot_post_failed(pos))) {
+      goto debug_card_out;
+    }
 
-  while (1) {
-    // Check the position of hand switch
-    ret = get_handsw_pos(&pos);
-    if (ret || pos == HAND_SW_BMC) {
-      // For BMC, no need to handle Reset Button
-      sleep(1);
-      continue;
+    // Switch UART mux based on hand switch
+    ret = pal_switch_uart_mux(pos);
+    if (ret) {
+      goto debug_card_out;
     }
 
-    // Check if reset button is pressed
-    ret = pal_get_rst_btn(&btn);
-    if (ret || !btn) {
-      goto rst_btn_out;
+    // Enable POST code based on hand switch
+    if (pos == HAND_SW_BMC) {
+      // For BMC, there is no need to have POST specific code
+      goto debug_card_done;
     }
 
-    // Pass the reset button to the selected slot
-    syslog(LOG_WARNING, "Reset button pressed\n");
-    ret = pal_set_rst_btn(pos, 0);
-    if (ret) {
-      goto rst_btn_out;
+    // Make sure the server at selected position is ready
+    ret = pal_is_fru_ready(pos, &prsnt);
+    if (ret || !prsnt) {
+      goto debug_card_done;
     }
 
+    // The BIC calls run on the slot's worker; a failure is retried
+    slot_request(pos, SLOT_REQ_POST, false);
+  }
+
+debug_card_done:
+  prev = curr;
+  prev_pos = pos;
+debug_card_out:
+  task->state = 0;
+  if (g_edges)
+    return EDGE_POLL_MS;
+  return (curr == 1) ? 500 : 1000;
+}
+
+enum {
+  BTN_IDLE = 0,
+  BTN_HELD,
+};
+
+// Monitor Reset Button and propagate to selected server
+static int
+rst_btn_handler(fp_task_t *task) {
+  int ret;
+  uint8_t pos;
+  uint8_t btn;
+
+  if (task->state == BTN_HELD) {
     // Wait for the button to be released
-    for (i = 0; i < BTN_MAX_SAMPLES; i++) {
-      ret = pal_get_rst_btn(&btn);
-      if (ret || btn) {
-        msleep(100);
-        continue;
+    ret = pal_get_rst_btn(&btn);
+    if (ret || btn) {
+      if (now_ms() - task->since < BTN_MAX_SAMPLES * BTN_SAMPLE_MS) {
+        return BTN_SAMPLE_MS;
       }
-      pal_update_ts_sled();
-      syslog(LOG_WARNING, "Reset button released\n");
-      syslog(LOG_CRIT, "Reset Button pressed for FRU: %d\n", pos);
-      ret = pal_set_rst_btn(pos, 1);
-      goto rst_btn_out;
-    }
 
-    // handle error case
-    if (i == BTN_MAX_SAMPLES) {
+      // handle error case
       pal_update_ts_sled();
       syslog(LOG_WARNING, "Reset button seems to stuck for long time\n");
-      goto rst_btn_out;
+      task->state = BTN_IDLE;
+      return BTN_SAMPLE_MS;
     }
-rst_btn_out:
-    msleep(100);
+
+    pal_update_ts_sled();
+    syslog(LOG_WARNING, "Reset button released\n");
+    syslog(LOG_CRIT, "Reset Button pressed for FRU: %d\n", task->pos);
+    pal_set_rst_btn(task->pos, 1);
+    task->state = BTN_IDLE;
+    return BTN_SAMPLE_MS;
+  }
+
+  // Check the position of hand switch
+  ret = get_handsw_pos(&pos);
+  if (ret || pos == HAND_SW_BMC) {
+    // For BMC, no need to handle Reset Button
+    return 1000;
+  }
+
+  // Check if reset button is pressed
+  ret = pal_get_rst_btn(&btn);
+  if (ret || !btn) {
+    return g_edges ? EDGE_POLL_MS : BTN_SAMPLE_MS;
+  }
+
+  // Pass the reset button to the selected slot
+  syslog(LOG_WARNING, "Reset button pressed\n");
+  ret = pal_set_rst_btn(pos, 0);
+  if (ret) {
+    return BTN_SAMPLE_MS;
   }
+
+  task->state = BTN_HELD;
+  task->pos = pos;
+  task->since = now_ms();
+  return 0;
 }
 
-// Thread to handle Power Button and power on/off the selected server
-static void *
-pwr_btn_handler() {
+// Handle Power Button and power on/off the selected server
+static int
+pwr_btn_handler(fp_task_t *task) {
   int ret;
-  uint8_t pos, btn, cmd;
-  int i;
-  uint8_t power;
+  uint8_t pos, btn;
+  bool long_press = false;
 
-  while (1) {
+  if (task->state == BTN_IDLE) {
     // Check the position of hand switch
     ret = get_handsw_pos(&pos);
     if (ret || pos == HAND_SW_BMC) {
-      sleep(1);
-      continue;
+      return 1000;
     }
 
     // Check if power button is pressed
     ret = pal_get_pwr_btn(&btn);
     if (ret || !btn) {
-      goto pwr_btn_out;
+      return g_edges ? EDGE_POLL_MS : BTN_SAMPLE_MS;
     }
 
     syslog(LOG_WARNING, "power button pressed\n");
+    task->state = BTN_HELD;
+    task->pos = pos;
+    task->since = now_ms();
+  }
 
-    // Wait for the button to be released
-    for (i = 0; i < BTN_POWER_OFF; i++) {
-      ret = pal_get_pwr_btn(&btn);
-      if (ret || btn ) {
-        msleep(100);
-        continue;
-      }
-      syslog(LOG_WARNING, "power button released\n");
-      break;
-    }
-
-
-    // Get the current power state (power on vs. power off)
-    ret = pal_get_server_power(pos, &power);
-    if (ret) {
-      goto pwr_btn_out;
+  // Wait for the button to be released
+  ret = pal_get_pwr_btn(&btn);
+  if (ret || btn) {
+    if (now_ms() - task->since < BTN_POWER_OFF * BTN_SAMPLE_MS) {
+      return BTN_SAMPLE_MS;
     }
+    long_press = true;
+  } else {
+    syslog(LOG_WARNING, "power button released\n");
+  }
 
-    // Set power command should reverse of current power state
-    cmd = !power;
-
-    // To determine long button press
-    if (i >= BTN_POWER_OFF) {
-      pal_update_ts_sled();
-      syslog(LOG_CRIT, "Power Button Long Press for FRU: %d\n", pos);
-    } else {
-
-      // If current power state is ON and it is not a long press,
-      // the power off should be Graceful Shutdown
-      if (power == SERVER_POWER_ON)
-        cmd = SERVER_GRACEFUL_SHUTDOWN;
-
-      pal_update_ts_sled();
-      syslog(LOG_CRIT, "Power Button Press for FRU: %d\n", pos);
-    }
+  task->state = BTN_IDLE;
 
-    // Reverse the power state of the given server
-    ret = pal_set_server_power(pos, cmd);
-pwr_btn_out:
-    msleep(100);
+  // The power change itself takes seconds; hand it to the slot's worker
+  if (slot_request(task->pos, SLOT_REQ_BUTTON, long_press)) {
+    syslog(LOG_WARNING, "Power command for FRU: %d still in progress\n",
+           task->pos);
   }
+  return BTN_SAMPLE_MS;
 }
 
-// Thread to monitor SLED Cycles by using time stamp
-static void *
-ts_handler() {
-  int count = 0;
+// Monitor SLED Cycles by using time stamp
+static int
+ts_handler(fp_task_t *task) {
+  static int count = 0;
+  static uint8_t time_init = 0;
+  static long time_sled_off;
   struct timespec ts;
   struct timespec mts;
   char tstr[64] = {0};
   char buf[128] = {0};
-  uint8_t por = 0;
-  uint8_t time_init = 0;
   long time_sled_on;
-  long time_sled_off;
 
-  // Read the last timestamp from KV storage
-  pal_get_key_value("timestamp_sled", tstr);
-  time_sled_off = (long) strtoul(tstr, NULL, 10);
+  if (time_init == 0) {
+    // Read the last timestamp from KV storage
+    pal_get_key_value("timestamp_sled", tstr);
+    time_sled_off = (long) strtoul(tstr, NULL, 10);
+  }
 
-  while (1) {
+  // Make sure the time is initialized properly
+  // Since there is no battery backup, the time could be reset to build time
+  if (time_init < 100) {  // wait 100s at most, to prevent infinite waiting
+    // Read current time
+    clock_gettime(CLOCK_REALTIME, &ts);
 
-    // Make sure the time is initialized properly
-    // Since there is no battery backup, the time could be reset to build time
-    if (time_init < 100) {  // wait 100s at most, to prevent infinite waiting
-      // Read current time
-      clock_gettime(CLOCK_REALTIME, &ts);
+    if ((ts.tv_sec < time_sled_off) && (++time_init < 100)) {
+      return 1000;
+    }
 
-      if ((ts.tv_sec < time_sled_off) && (++time_init < 100)) {
-        sleep(1);
-        continue;
-      }
+    // If current time is more than the stored time, the date is correct
+    time_init = 100;
+    // Need to log SLED ON event, if this is Power-On-Reset
+    if (pal_is_bmc_por()) {
+      ctime_r(&time_sled_off, buf);
+      syslog(LOG_CRIT, "SLED Powered OFF at %s", buf);
 
-      // If current time is more than the stored time, the date is correct
-      time_init = 100;
-      // Need to log SLED ON event, if this is Power-On-Reset
-      if (pal_is_bmc_por()) {
-        ctime_r(&time_sled_off, buf);
-        syslog(LOG_CRIT, "SLED Powered OFF at %s", buf);
-
-        // Get uptime
-        clock_gettime(CLOCK_MONOTONIC, &mts);
-        // To find out when SLED was on, subtract the uptime from current time
-        time_sled_on = ts.tv_sec - mts.tv_sec;
-
-        ctime_r(&time_sled_on, buf);
-        // Log an event if this is Power-On-Reset
-        syslog(LOG_CRIT, "SLED Powered ON at %s", buf);
-      }
-    }
+      // Get uptime
+      clock_gettime(CLOCK_MONOTONIC, &mts);
+      // To find out when SLED was on, subtract the uptime from current time
+      time_sled_on = ts.tv_sec - mts.tv_sec;
 
-    // Store timestamp every one hour to keep track of SLED power
-    if (count++ == HB_TIMESTAMP_COUNT) {
-      pal_update_ts_sled();
-      count = 0;
+      ctime_r(&time_sled_on, buf);
+      // Log an event if this is Power-On-Reset
+      syslog(LOG_CRIT, "SLED Powered ON at %s", buf);
     }
+  }
 
-    sleep(HB_SLEEP_TIME);
+  // Store timestamp every one hour to keep track of SLED power
+  if (count++ == HB_TIMESTAMP_COUNT) {
+    pal_update_ts_sled();
+    count = 0;
   }
+
+  return HB_SLEEP_TIME * 1000;
 }
 
-// Thread to handle LED state of the server at given slot
-static void *
-led_handler() {
+enum {
+  BLINK_UPDATE = 0,
+  BLINK_ON,
+  BLINK_OFF,
+};
+
+// Handle LED state of the server at given slot
+static int
+led_handler(fp_task_t *task) {
+  static uint8_t power[MAX_NUM_SLOTS+1] = {0};
+  static uint8_t hlth[MAX_NUM_SLOTS+1] = {0};
+  static int led_off_time;
   int ret;
   uint8_t pos;
   uint8_t slot;
   uint8_t ready;
-  uint8_t power[MAX_NUM_SLOTS+1] = {0};
-  uint8_t hlth[MAX_NUM_SLOTS+1] = {0};
-  int led_on_time, led_off_time;
-
-  while (1) {
-    // Get hand switch position to see if this is selected server
-    ret = get_handsw_pos(&pos);
-    if (ret != 0) {
-      sleep(1);
-      continue;
-    }
-
-    for (slot = 1; slot <= MAX_NUM_SLOTS; slot++) {
-      // Check if this LED is managed by sync_led thread
-      if (g_sync_led[slot]) {
-        continue;
-      }
+  int led_on_time;
 
-      ret = pal_is_fru_ready(slot, &ready);
-      if (!ret && ready) {
-        // Get power status for this slot
-        ret = pal_get_server_power(slot, &power[slot]);
-        if (ret) {
-          continue;
-        }
-
-        // Get health status for this slot
-        ret = pal_get_fru_health(slot, &hlth[slot]);
-        if (ret) {
-          continue;
-        }
+  switch (task->state) {
+    case BLINK_ON:
+      pos = task->pos;
+      if (hlth[pos] == FRU_STATUS_GOOD) {
+        pal_set_led(pos, LED_OFF);
       } else {
-        power[slot] = SERVER_POWER_OFF;
-        hlth[slot] = FRU_STATUS_GOOD;
+        pal_set_id_led(pos, ID_LED_OFF);
       }
-
-      if ((pos == slot) || (power[slot] == SERVER_POWER_ON)) {
-        if (hlth[slot] == FRU_STATUS_GOOD) {
-          pal_set_led(slot, LED_ON);
-          pal_set_id_led(slot, ID_LED_OFF);
+      task->state = BLINK_OFF;
+      return led_off_time;
+
+    case BLINK_OFF:
+      pos = task->pos;
+      if (power[pos] == SERVER_POWER_ON) {
+        if (hlth[pos] == FRU_STATUS_GOOD) {
+          pal_set_led(pos, LED_ON);
         } else {
-          pal_set_led(slot, LED_OFF);
-          pal_set_id_led(slot, ID_LED_ON);
+          pal_set_id_led(pos, ID_LED_ON);
         }
-      } else {
-        pal_set_led(slot, LED_OFF);
-        pal_set_id_led(slot, ID_LED_OFF);
       }
-    }
+      task->state = BLINK_UPDATE;
+      return 0;
+  }
 
-    if (pos > MAX_NUM_SLOTS) {
-      sleep(1);
-      continue;
-    }
+  // Get hand switch position to see if this is selected server
+  ret = get_handsw_pos(&pos);
+  if (ret != 0) {
+    return 1000;
+  }
 
-    if (g_sync_led[pos]) {
-      sleep(1);
+  for (slot = 1; slot <= MAX_NUM_SLOTS; slot++) {
+    // Check if this LED is managed by led_sync_handler
+    if (g_sync_led[slot]) {
       continue;
     }
 
-    // Set blink rate
-    if (power[pos] == SERVER_POWER_ON) {
-      led_on_time = 900;
-      led_off_time = 100;
-    } else {
-      led_on_time = 100;
-      led_off_time = 900;
-    }
-
-    msleep(led_on_time);
+    ret = pal_is_fru_ready(slot, &ready);
+    if (!ret && ready) {
+      // Power status comes from the slot's worker, one cycle behind
+      slot_request(slot, SLOT_REQ_POWER, false);
+      ret = slot_get_power(slot, &power[slot]);
+      if (ret) {
+        continue;
+      }
 
-    if (hlth[pos] == FRU_STATUS_GOOD) {
-      pal_set_led(pos, LED_OFF);
+      // Get health status for this slot
+      ret = pal_get_fru_health(slot, &hlth[slot]);
+      if (ret) {
+        continue;
+      }
     } else {
-      pal_set_id_led(pos, ID_LED_OFF);
+      power[slot] = SERVER_POWER_OFF;
+      hlth[slot] = FRU_STATUS_GOOD;
     }
 
-    msleep(led_off_time);
-
-    if (power[pos] == SERVER_POWER_ON) {
-      if (hlth[pos] == FRU_STATUS_GOOD) {
-        pal_set_led(pos, LED_ON);
+    if ((pos == slot) || (power[slot] == SERVER_POWER_ON)) {
+      if (hlth[slot] == FRU_STATUS_GOOD) {
+        pal_set_led(slot, LED_ON);
+        pal_set_id_led(slot, ID_LED_OFF);
       } else {
-        pal_set_id_led(pos, ID_LED_ON);
+        pal_set_led(slot, LED_OFF);
+        pal_set_id_led(slot, ID_LED_ON);
       }
+    } else {
+      pal_set_led(slot, LED_OFF);
+      pal_set_id_led(slot, ID_LED_OFF);
     }
   }
+
+  if (pos > MAX_NUM_SLOTS) {
+    return 1000;
+  }
+
+  if (g_sync_led[pos]) {
+    return 1000;
+  }
+
+  // Set blink rate
+  if (power[pos] == SERVER_POWER_ON) {
+    led_on_time = 900;
+    led_off_time = 100;
+  } else {
+    led_on_time = 100;
+    led_off_time = 900;
+  }
+
+  task->pos = pos;
+  task->state = BLINK_ON;
+  return led_on_time;
 }
 
-// Thread to handle LED state of the SLED
-static void *
-led_sync_handler() {
+enum {
+  SYNC_IDENTIFY_SLED = 1,
+  SYNC_HEALTH,
+  SYNC_BMC_SELECT,
+  SYNC_IDENTIFY_SLOT,
+};
+
+// Handle LED state of the SLED
+static int
+led_sync_handler(fp_task_t *task) {
+  static char id_arr[5] = {0};
   int ret;
   uint8_t pos;
   uint8_t ident = 0;
   char identify[16] = {0};
   char tstr[64] = {0};
-  char id_arr[5] = {0};
   uint8_t slot;
   uint8_t spb_hlth = 0;
   uint8_t nic_hlth = 0;
 
-#ifdef DEBUG
-  syslog(LOG_INFO, "led_handler for slot %d\n", slot);
-#endif
-
-  while (1) {
-    // Handle Slot IDENTIFY condition
-    memset(identify, 0x0, 16);
-    ret = pal_get_key_value("identify_sled", identify);
-    if (ret == 0 && !strcmp(identify, "on")) {
-      // Turn OFF Blue LED
+  // Second half of a blink cycle: turn off what was turned on
+  switch (task->state) {
+    case SYNC_IDENTIFY_SLED:
       for (slot = 1; slot <= MAX_NUM_SLOTS; slot++) {
-        g_sync_led[slot] = 1;
-        pal_set_led(slot, LED_OFF);
+        pal_set_id_led(slot, ID_LED_OFF);
       }
+      task->state = 0;
+      return LED_OFF_TIME_IDENTIFY;
 
-      // Start blinking the ID LED
-      for (slot = 1; slot <= MAX_NUM_SLOTS; slot++) {
-        pal_set_id_led(slot, ID_LED_ON);
+    case SYNC_HEALTH:
+      ret = get_handsw_pos(&pos);
+      if ((ret) || (pos == HAND_SW_BMC)) {
+        for (slot = 1; slot <= MAX_NUM_SLOTS; slot++) {
+           pal_set_id_led(slot, ID_LED_OFF);
+        }
+      } else {
+           pal_set_id_led(pos, ID_LED_OFF);
       }
+      task->state = 0;
+      return LED_OFF_TIME_HEALTH;
 
-      msleep(LED_ON_TIME_IDENTIFY);
+    case SYNC_BMC_SELECT:
+      for (slot = 1; slot <= 4; slot++) {
+        pal_set_led(slot, LED_OFF);
+      }
+      task->state = 0;
+      return LED_OFF_TIME_BMC_SELECT;
 
-      for (slot = 1; slot <= MAX_NUM_SLOTS; slot++) {
-        pal_set_id_led(slot, ID_LED_OFF);
+    case SYNC_IDENTIFY_SLOT:
+      for (slot = 1; slot <=4; slot++) {
+        if (id_arr[slot]) {
+          pal_set_id_led(slot, ID_LED_OFF);
+        }
       }
-      msleep(LED_OFF_TIME_IDENTIFY);
-      continue;
-    }
+      task->state = 0;
+      return LED_OFF_TIME_IDENTIFY;
+  }
 
-    // Handle Sled level health condition
-    ret = pal_get_fru_health(FRU_SPB, &spb_hlth);
-    if (ret) {
-      sleep(1);
-      continue;
+  // Handle Slot IDENTIFY condition
+  memset(identify, 0x0, 16);
+  ret = pal_get_key_value("identify_sled", identify);
+  if (ret == 0 && !strcmp(identify, "on")) {
+    // Turn OFF Blue LED
+    for (slot = 1; slot <= MAX_NUM_SLOTS; slot++) {
+      g_sync_led[slot] = 1;
+      pal_set_led(slot, LED_OFF);
     }
 
-    ret = pal_get_fru_health(FRU_NIC, &nic_hlth);
-    if (ret) {
-      sleep(1);
-      continue;
+    // Start blinking the ID LED
+    for (slot = 1; slot <= MAX_NUM_SLOTS; slot++) {
+      pal_set_id_led(slot, ID_LED_ON);
     }
 
-    if (spb_hlth == FRU_STATUS_BAD || nic_hlth == FRU_STATUS_BAD) {
-      // Turn OFF Blue LED
-      for (slot = 1; slot <= MAX_NUM_SLOTS; slot++) {
-        g_sync_led[slot] = 1;
-        pal_set_led(slot, LED_OFF);
-      }
+    task->state = SYNC_IDENTIFY_SLED;
+    return LED_ON_TIME_IDENTIFY;
+  }
 
-      // Start blinking the Yellow/ID LED
-      for (slot = 1; slot <= MAX_NUM_SLOTS; slot++) {
-        pal_set_id_led(slot, ID_LED_ON);
-      }
+  // Handle Sled level health condition
+  ret = pal_get_fru_health(FRU_SPB, &spb_hlth);
+  if (ret) {
+    return 1000;
+  }
 
-      msleep(LED_ON_TIME_HEALTH);
+  ret = pal_get_fru_health(FRU_NIC, &nic_hlth);
+  if (ret) {
+    return 1000;
+  }
 
-      ret = get_handsw_pos(&pos);
-      if ((ret) || (pos == HAND_SW_BMC)) {
-        for (slot = 1; slot <= MAX_NUM_SLOTS; slot++) {
-           pal_set_id_led(slot, ID_LED_OFF);
-        }
-      } else {
-           pal_set_id_led(pos, ID_LED_OFF);
-      }
-      msleep(LED_OFF_TIME_HEALTH);
-      continue;
+  if (spb_hlth == FRU_STATUS_BAD || nic_hlth == FRU_STATUS_BAD) {
+    // Turn OFF Blue LED
+    for (slot = 1; slot <= MAX_NUM_SLOTS; slot++) {
+      g_sync_led[slot] = 1;
+      pal_set_led(slot, LED_OFF);
     }
 
-    // Check if slot needs to be identified
-    ident = 0;
-    for (slot = 1; slot <= MAX_NUM_SLOTS; slot++)  {
-      id_arr[slot] = 0x0;
-      sprintf(tstr, "identify_slot%d", slot);
-      memset(identify, 0x0, 16);
-      ret = pal_get_key_value(tstr, identify);
-      if (ret == 0 && !strcmp(identify, "on")) {
-        id_arr[slot] = 0x1;
-        ident = 1;
-      }
+    // Start blinking the Yellow/ID LED
+    for (slot = 1; slot <= MAX_NUM_SLOTS; slot++) {
+      pal_set_id_led(slot, ID_LED_ON);
     }
 
-    // Get hand switch position to see if this is selected server
-    ret = get_handsw_pos(&pos);
-    if (ret) {
-      sleep(1);
-      continue;
+    task->state = SYNC_HEALTH;
+    return LED_ON_TIME_HEALTH;
+  }
+
+  // Check if slot needs to be identified
+  ident = 0;
+  for (slot = 1; slot <= MAX_NUM_SLOTS; slot++)  {
+    id_arr[slot] = 0x0;
+    sprintf(tstr, "identify_slot%d", slot);
+    memset(identify, 0x0, 16);
+    ret = pal_get_key_value(tstr, identify);
+    if (ret == 0 && !strcmp(identify, "on")) {
+      id_arr[slot] = 0x1;
+      ident = 1;
     }
+  }
 
-    // Handle BMC select condition when no slot is being identified
-    if ((pos == HAND_SW_BMC) && (ident == 0)) {
-      // Turn OFF Yellow LED
-      for (slot = 1; slot <= MAX_NUM_SLOTS; slot++) {
-        g_sync_led[slot] = 1;
-        pal_set_id_led(slot, ID_LED_OFF);
-      }
+  // Get hand switch position to see if this is selected server
+  ret = get_handsw_pos(&pos);
+  if (ret) {
+    return 1000;
+  }
 
-      // Start blinking Blue LED
-      for (slot = 1; slot <= 4; slot++) {
-        pal_set_led(slot, LED_ON);
-      }
+  // Handle BMC select condition when no slot is being identified
+  if ((pos == HAND_SW_BMC) && (ident == 0)) {
+    // Turn OFF Yellow LED
+    for (slot = 1; slot <= MAX_NUM_SLOTS; slot++) {
+      g_sync_led[slot] = 1;
+      pal_set_id_led(slot, ID_LED_OFF);
+    }
+
+    // Start blinking Blue LED
+    for (slot = 1; slot <= 4; slot++) {
+      pal_set_led(slot, LED_ON);
+    }
 
-      msleep(LED_ON_TIME_BMC_SELECT);
+    task->state = SYNC_BMC_SELECT;
+    return LED_ON_TIME_BMC_SELECT;
+  }
 
-      for (slot = 1; slot <= 4; slot++) {
+  // Handle individual identify slot condition
+  if (ident) {
+    for (slot = 1; slot <=4; slot++) {
+      if (id_arr[slot]) {
+        g_sync_led[slot] = 1;
         pal_set_led(slot, LED_OFF);
+        pal_set_id_led(slot, ID_LED_ON);
+      } else {
+        g_sync_led[slot] = 0;
       }
+    }
 
-      msleep(LED_OFF_TIME_BMC_SELECT);
-      continue;
+    task->state = SYNC_IDENTIFY_SLOT;
+    return LED_ON_TIME_IDENTIFY;
+  }
+
+  for (slot = 1; slot <= 4; slot++) {
+    g_sync_led[slot] = 0;
+  }
+  return 500;
+}
+
+static fp_task_t g_debug_card = {"debug card", debug_card_handler};
+static fp_task_t g_rst_btn = {"reset button", rst_btn_handler};
+static fp_task_t g_pwr_btn = {"power button", pwr_btn_handler};
+static fp_task_t g_ts = {"time stamp", ts_handler};
+static fp_task_t g_led_sync = {"led sync", led_sync_handler};
+static fp_task_t g_led = {"led", led_handler};
+
+static fp_task_t *g_tasks[] = {
+  &g_debug_card,
+  &g_rst_btn,
+  &g_pwr_btn,
+  &g_ts,
+  &g_led_sync,
+  &g_led,
+};
+
+#define NUM_TASKS (sizeof(g_tasks) / sizeof(g_tasks[0]))
+
+// A front panel input changed; run the task that reads it now
+static void
+fp_gpio_event(int gpio, gpio_value_en last, gpio_value_en curr,
+              const struct timespec *ts, void *arg) {
+  fp_task_t *task = (fp_task_t *)arg;
+
+  task->due = 0;
+}
+
+static gpio_watcher_st *
+fp_watch_inputs(void) {
+  static const struct {
+    int gpio;
+    fp_task_t *task;
+  } inputs[] = {
+    {GPIO_HAND_SW_ID1, &g_debug_card},
+    {GPIO_HAND_SW_ID2, &g_debug_card},
+    {GPIO_HAND_SW_ID4, &g_debug_card},
+    {GPIO_HAND_SW_ID8, &g_debug_card},
+    {GPIO_DBG_CARD_PRSNT, &g_debug_card},
+    {GPIO_RST_BTN, &g_rst_btn},
+    {GPIO_PWR_BTN, &g_pwr_btn},
+  };
+  gpio_watcher_st *w;
+  int i;
+
+  w = gpio_watcher_create();
+  if (w == NULL) {
+    syslog(LOG_WARNING, "front-paneld: cannot create gpio watcher\n");
+    return NULL;
+  }
+
+  g_edges = true;
+  for (i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+    if (gpio_watcher_add(w, inputs[i].gpio, GPIO_EDGE_BOTH, 0,
+                         fp_gpio_event, inputs[i].task)) {
+      syslog(LOG_WARNING, "front-paneld: no edge events for GPIO%d, "
+             "polling\n", inputs[i].gpio);
+      g_edges = false;
     }
+  }
 
-    // Handle individual identify slot condition
-    if (ident) {
-      for (slot = 1; slot <=4; slot++) {
-        if (id_arr[slot]) {
-          g_sync_led[slot] = 1;
-          pal_set_led(slot, LED_OFF);
-          pal_set_id_led(slot, ID_LED_ON);
-        } else {
-          g_sync_led[slot] = 0;
-        }
-      }
+  return w;
+}
 
-      msleep(LED_ON_TIME_IDENTIFY);
+static void
+run_fp_tasks(void) {
+  struct epoll_event ev, evs[2];
+  struct itimerspec its;
+  gpio_watcher_st *w;
+  uint64_t now, next, expired;
+  uint64_t stats_due, stats_wakeups = 0;
+  int epfd, tfd, wfd = -1;
+  int delay, n, i;
+
+  epfd = epoll_create1(EPOLL_CLOEXEC);
+  tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (epfd < 0 || tfd < 0) {
+    syslog(LOG_WARNING, "front-paneld: cannot set up event loop\n");
+    exit(1);
+  }
 
-      for (slot = 1; slot <=4; slot++) {
-        if (id_arr[slot]) {
-          pal_set_id_led(slot, ID_LED_OFF);
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = tfd;
+  epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev);
+
+  slot_workers_start();
+
+  w = fp_watch_inputs();
+  if (w != NULL) {
+    wfd = gpio_watcher_fd(w);
+    ev.data.fd = wfd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, wfd, &ev);
+  }
+
+  stats_due = now_ms() + WAKEUP_STATS_SEC * 1000;
+  while (1) {
+    // Run everything that is due, including tasks that asked to rerun now
+    do {
+      next = UINT64_MAX;
+      for (i = 0; i < NUM_TASKS; i++) {
+        now = now_ms();
+        if (g_tasks[i]->due <= now) {
+          delay = g_tasks[i]->run(g_tasks[i]);
+          g_tasks[i]->due = now_ms() + delay;
+          // A slow task delays every other task, including button handling
+          if (g_tasks[i]->due - delay - now > SLOW_TASK_MS) {
+            syslog(LOG_WARNING, "front-paneld: %s task took %llu ms\n",
+                   g_tasks[i]->name,
+                   (unsigned long long)(g_tasks[i]->due - delay - now));
+          }
         }
+        if (g_tasks[i]->due < next)
+          next = g_tasks[i]->due;
       }
+    } while (next <= now_ms());
 
-      msleep(LED_OFF_TIME_IDENTIFY);
-      continue;
+    if (w != NULL && (delay = gpio_watcher_timeout(w)) >= 0 &&
+        now_ms() + delay < next) {
+      next = now_ms() + delay;
     }
 
-    for (slot = 1; slot <= 4; slot++) {
-      g_sync_led[slot] = 0;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = next / 1000;
+    its.it_value.tv_nsec = (next % 1000) * 1000000;
+    timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL);
+
+    n = epoll_wait(epfd, evs, 2, -1);
+    g_wakeups++;
+    for (i = 0; i < n; i++) {
+      if (evs[i].data.fd == tfd) {
+        read(tfd, &expired, sizeof(expired));
+      }
+    }
+    if (w != NULL) {
+      gpio_watcher_dispatch(w, 0);
+    }
+
+    if (now_ms() >= stats_due) {
+      syslog(LOG_DEBUG, "front-paneld: %llu wakeups/min\n",
+             (unsigned long long)((g_wakeups - stats_wakeups) * 60 /
+                                  WAKEUP_STATS_SEC));
+      stats_wakeups = g_wakeups;
+      stats_due += WAKEUP_STATS_SEC * 1000;
     }
-    msleep(500);
   }
 }
 
 int
 main (int argc, char * const argv[]) {
-  pthread_t tid_debug_card;
-  pthread_t tid_rst_btn;
-  pthread_t tid_pwr_btn;
-  pthread_t tid_ts;
-  pthread_t tid_sync_led;
-  pthread_t tid_led;
   int rc;
   int pid_file;
 
@@ -635,43 +988,7 @@ main (int argc, char * const argv[]) {
    openlog("front-paneld", LOG_CONS, LOG_DAEMON);
   }
 
-
-  if (pthread_create(&tid_debug_card, NULL, debug_card_handler, NULL) < 0) {
-    syslog(LOG_WARNING, "pthread_create for debug card error\n");
-    exit(1);
-  }
-
-  if (pthread_create(&tid_rst_btn, NULL, rst_btn_handler, NULL) < 0) {
-    syslog(LOG_WARNING, "pthread_create for reset button error\n");
-    exit(1);
-  }
-
-  if (pthread_create(&tid_pwr_btn, NULL, pwr_btn_handler, NULL) < 0) {
-    syslog(LOG_WARNING, "pthread_create for power button error\n");
-    exit(1);
-  }
-
-  if (pthread_create(&tid_ts, NULL, ts_handler, NULL) < 0) {
-    syslog(LOG_WARNING, "pthread_create for time stamp error\n");
-    exit(1);
-  }
-
-  if (pthread_create(&tid_sync_led, NULL, led_sync_handler, NULL) < 0) {
-    syslog(LOG_WARNING, "pthread_create for led sync error\n");
-    exit(1);
-  }
-
-  if (pthread_create(&tid_led, NULL, led_handler, NULL) < 0) {
-    syslog(LOG_WARNING, "pthread_create for led error\n");
-    exit(1);
-  }
-
-  pthread_join(tid_debug_card, NULL);
-  pthread_join(tid_rst_btn, NULL);
-  pthread_join(tid_pwr_btn, NULL);
-  pthread_join(tid_ts, NULL);
-  pthread_join(tid_sync_led, NULL);
-  pthread_join(tid_led, NULL);
+  run_fp_tasks();
 
   return 0;
 }
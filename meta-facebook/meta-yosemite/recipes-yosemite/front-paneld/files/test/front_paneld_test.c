@@ -0,0 +1,361 @@
+/*
+ * front_paneld_test
+ *
+ * Copyright 2015-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Runs front-paneld's event loop against a stubbed libpal and GPIO
+ * watcher, with the hand switch on slot 1 and a debug card present.
+ * Checks that an idle loop wakes up far less often than the per-task
+ * threads it replaced, that the reset button and LEDs are still served
+ * while a slow power command runs, that a second power press during that
+ * command is dropped, and that a failed POST code display is retried.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#define main front_paneld_main
+#include "../front-paneld.c"
+#undef main
+
+#define TEST_SLOT       1
+#define GET_POWER_MS    200   // pal_get_server_power retrying the BIC
+#define SET_POWER_MS    3000  // pal_set_server_power sleeping
+#define IDLE_SEC        3
+
+/*
+ * Idle wake-ups per minute of the threaded front-paneld, from its sleeps:
+ * debug card 500 ms (120), reset and power buttons 100 ms (600 each),
+ * slot LED blink 900+100 ms (120), LED sync 500 ms (120).
+ */
+#define THREADED_WAKEUPS_PER_MIN  1560
+
+static pthread_mutex_t stub_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint8_t stub_rst_btn;
+static uint8_t stub_pwr_btn;
+static uint64_t stub_rst_ms;      // When the reset was passed to the slot
+static int stub_set_power;        // pal_set_server_power calls
+static uint8_t stub_power_cmd;
+static bool stub_power_busy;
+static int stub_leds;             // pal_set_led calls for TEST_SLOT
+static int stub_posts;            // pal_post_handle calls
+static int stub_post_fail = 1;    // Fail the first POST code display
+static int failed;
+
+static gpio_event_handler stub_handler[256];
+static void *stub_arg[256];
+static int stub_pipe[2];
+
+int
+pal_get_hand_sw(uint8_t *pos) {
+  *pos = TEST_SLOT;
+  return 0;
+}
+
+int
+pal_switch_usb_mux(uint8_t slot) {
+  return 0;
+}
+
+int
+pal_switch_uart_mux(uint8_t slot) {
+  return 0;
+}
+
+int
+pal_is_debug_card_prsnt(uint8_t *status) {
+  *status = 1;
+  return 0;
+}
+
+int
+pal_is_fru_ready(uint8_t fru, uint8_t *status) {
+  *status = 1;
+  return 0;
+}
+
+int
+pal_post_enable(uint8_t slot) {
+  return 0;
+}
+
+int
+pal_post_get_last(uint8_t slot, uint8_t *status) {
+  *status = 0xAA;
+  return 0;
+}
+
+int
+pal_post_handle(uint8_t slot, uint8_t status) {
+  int ret = 0;
+
+  pthread_mutex_lock(&stub_lock);
+  stub_posts++;
+  if (stub_post_fail) {
+    stub_post_fail--;
+    ret = -1;
+  }
+  pthread_mutex_unlock(&stub_lock);
+  return ret;
+}
+
+int
+pal_get_rst_btn(uint8_t *status) {
+  pthread_mutex_lock(&stub_lock);
+  *status = stub_rst_btn;
+  pthread_mutex_unlock(&stub_lock);
+  return 0;
+}
+
+int
+pal_set_rst_btn(uint8_t slot, uint8_t status) {
+  pthread_mutex_lock(&stub_lock);
+  if (!status)
+    stub_rst_ms = now_ms();
+  pthread_mutex_unlock(&stub_lock);
+  return 0;
+}
+
+int
+pal_get_pwr_btn(uint8_t *status) {
+  pthread_mutex_lock(&stub_lock);
+  *status = stub_pwr_btn;
+  pthread_mutex_unlock(&stub_lock);
+  return 0;
+}
+
+void
+pal_update_ts_sled() {
+}
+
+int
+pal_get_server_power(uint8_t slot_id, uint8_t *status) {
+  usleep(GET_POWER_MS * 1000);
+  *status = SERVER_POWER_ON;
+  return 0;
+}
+
+int
+pal_set_server_power(uint8_t slot_id, uint8_t cmd) {
+  pthread_mutex_lock(&stub_lock);
+  stub_set_power++;
+  stub_power_cmd = cmd;
+  stub_power_busy = true;
+  pthread_mutex_unlock(&stub_lock);
+
+  usleep(SET_POWER_MS * 1000);
+
+  pthread_mutex_lock(&stub_lock);
+  stub_power_busy = false;
+  pthread_mutex_unlock(&stub_lock);
+  return 0;
+}
+
+int
+pal_get_key_value(char *key, char *value) {
+  strcpy(value, "0");
+  return 0;
+}
+
+int
+pal_is_bmc_por(void) {
+  return 0;
+}
+
+int
+pal_get_fru_health(uint8_t fru, uint8_t *value) {
+  *value = FRU_STATUS_GOOD;
+  return 0;
+}
+
+int
+pal_set_led(uint8_t slot, uint8_t status) {
+  pthread_mutex_lock(&stub_lock);
+  if (slot == TEST_SLOT)
+    stub_leds++;
+  pthread_mutex_unlock(&stub_lock);
+  return 0;
+}
+
+int
+pal_set_id_led(uint8_t slot, uint8_t status) {
+  return 0;
+}
+
+/*
+ * The watcher is a pipe: each byte written is the GPIO whose edge the
+ * next dispatch reports.
+ */
+gpio_watcher_st *
+gpio_watcher_create(void) {
+  if (pipe(stub_pipe))
+    return NULL;
+  fcntl(stub_pipe[0], F_SETFL, O_NONBLOCK);
+  return (gpio_watcher_st *)stub_pipe;
+}
+
+int
+gpio_watcher_add(gpio_watcher_st *w, int gpio, gpio_edge_en edge,
+                 int debounce_ms, gpio_event_handler handler, void *arg) {
+  stub_handler[gpio & 0xFF] = handler;
+  stub_arg[gpio & 0xFF] = arg;
+  return 0;
+}
+
+int
+gpio_watcher_fd(gpio_watcher_st *w) {
+  return stub_pipe[0];
+}
+
+int
+gpio_watcher_timeout(gpio_watcher_st *w) {
+  return -1;
+}
+
+int
+gpio_watcher_dispatch(gpio_watcher_st *w, int timeout_ms) {
+  uint8_t gpio;
+
+  while (read(stub_pipe[0], &gpio, 1) == 1) {
+    if (stub_handler[gpio])
+      stub_handler[gpio](gpio, GPIO_VALUE_LOW, GPIO_VALUE_HIGH, NULL,
+                         stub_arg[gpio]);
+  }
+  return 0;
+}
+
+static void
+edge(int gpio) {
+  uint8_t b = gpio;
+
+  if (write(stub_pipe[1], &b, 1) != 1)
+    perror("edge");
+}
+
+static void
+set_btn(uint8_t *btn, uint8_t val, int gpio) {
+  pthread_mutex_lock(&stub_lock);
+  *btn = val;
+  pthread_mutex_unlock(&stub_lock);
+  edge(gpio);
+}
+
+static int
+get_stub(int *v) {
+  int n;
+
+  pthread_mutex_lock(&stub_lock);
+  n = *v;
+  pthread_mutex_unlock(&stub_lock);
+  return n;
+}
+
+static uint64_t
+wakeups(void) {
+  return __atomic_load_n(&g_wakeups, __ATOMIC_RELAXED);
+}
+
+static void *
+loop_thread(void *arg) {
+  run_fp_tasks();
+  return NULL;
+}
+
+static void
+check(const char *name, int ok) {
+  printf("%s: %s\n", ok ? "PASS" : "FAIL", name);
+  if (!ok)
+    failed = 1;
+}
+
+int
+main(int argc, char **argv) {
+  pthread_t tid;
+  uint64_t w, start, rst_ms;
+  int per_min, leds, n;
+  bool busy;
+
+  pthread_create(&tid, NULL, loop_thread, NULL);
+  usleep(500 * 1000);
+
+  // Nothing pressed: only the LED blink and LED sync tasks wake the loop
+  w = wakeups();
+  usleep(IDLE_SEC * 1000 * 1000);
+  per_min = (wakeups() - w) * 60 / IDLE_SEC;
+  printf("idle: %d wakeups/min, threaded design: %d\n", per_min,
+         THREADED_WAKEUPS_PER_MIN);
+  check("idle wake-ups under a quarter of the threaded design",
+        per_min > 0 && per_min * 4 < THREADED_WAKEUPS_PER_MIN);
+
+  // The first POST display failed; a debug card edge retries it
+  n = get_stub(&stub_posts);
+  edge(GPIO_DBG_CARD_PRSNT);
+  usleep(300 * 1000);
+  check("failed POST code display is retried",
+        n == 1 && get_stub(&stub_posts) == 2);
+
+  // Short power button press: the worker starts a slow power command
+  set_btn(&stub_pwr_btn, 1, GPIO_PWR_BTN);
+  usleep(150 * 1000);
+  set_btn(&stub_pwr_btn, 0, GPIO_PWR_BTN);
+  start = now_ms();
+  do {
+    usleep(1000);
+    pthread_mutex_lock(&stub_lock);
+    busy = stub_power_busy;
+    pthread_mutex_unlock(&stub_lock);
+  } while (!busy && now_ms() - start < 2000);
+  check("power command started", busy);
+
+  // While it runs, the reset button reaches the slot right away
+  set_btn(&stub_rst_btn, 1, GPIO_RST_BTN);
+  start = now_ms();
+  usleep(100 * 1000);
+  pthread_mutex_lock(&stub_lock);
+  rst_ms = stub_rst_ms;
+  pthread_mutex_unlock(&stub_lock);
+  printf("reset latency during power command: %lld ms\n",
+         rst_ms ? (long long)(rst_ms - start) : -1LL);
+  check("reset button served during power command",
+        rst_ms >= start && rst_ms - start < 50);
+  set_btn(&stub_rst_btn, 0, GPIO_RST_BTN);
+
+  // ... the LEDs keep blinking, and a second press is dropped
+  leds = get_stub(&stub_leds);
+  set_btn(&stub_pwr_btn, 1, GPIO_PWR_BTN);
+  usleep(150 * 1000);
+  set_btn(&stub_pwr_btn, 0, GPIO_PWR_BTN);
+  usleep(1000 * 1000);
+  check("LEDs blink during power command", get_stub(&stub_leds) - leds >= 2);
+
+  usleep((SET_POWER_MS + GET_POWER_MS) * 1000);
+  pthread_mutex_lock(&stub_lock);
+  n = stub_set_power;
+  busy = stub_power_busy;
+  pthread_mutex_unlock(&stub_lock);
+  check("one graceful shutdown, press during command dropped",
+        n == 1 && !busy && stub_power_cmd == SERVER_GRACEFUL_SHUTDOWN);
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  return failed;
+}
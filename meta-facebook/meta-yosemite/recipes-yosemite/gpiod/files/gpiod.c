@@ -28,6 +28,8 @@
 #include <math.h>
 #include <string.h>
 #include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
 #include <sys/un.h>
 #include <sys/file.h>
 #include <openbmc/ipmi.h>
@@ -41,8 +43,15 @@
 #define GETMASK(y)          (1 << y)
 
 #define MAX_NUM_SLOTS       4
-#define DELAY_GPIOD_READ    500000 // Polls each slot gpio values every 4*x usec
-#define SOCK_PATH_GPIO      "/tmp/gpio_socket"
+/*
+ * Each slot is polled on its own thread.  The interval drops to the minimum
+ * after a transition and doubles on every poll that sees no change, up to
+ * the maximum.  A BIC GPIO interrupt forwarded by ipmid (see
+ * pal_gpio_intr_handle) triggers an immediate poll of that slot.
+ */
+#define GPIOD_POLL_MIN_MS   250
+#define GPIOD_POLL_MAX_MS   4000
+#define GPIOD_STATS_SEC     600 // Log IPMB usage every x seconds (LOG_DEBUG)
 
 #define GPIO_BMC_READY_N    28
 
@@ -54,6 +63,22 @@ typedef struct {
   char name[32];
 } gpio_pin_t;
 
+/* Per slot poller state */
+typedef struct {
+  uint8_t fru;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  bool kick;                  // BIC interrupt pending, poll now
+  struct timespec kick_ts;    // when the first pending interrupt arrived
+  /* Statistics, also under lock; reset every GPIOD_STATS_SEC */
+  uint32_t polls;             // bic_get_gpio calls (IPMB round-trips)
+  uint32_t changes;           // polls that saw a pin change
+  uint32_t intr_polls;        // polls triggered by an interrupt
+  uint64_t intr_latency_ms;   // summed interrupt-to-dispatch latency
+} gpio_slot_t;
+
+static gpio_slot_t gpio_slots[MAX_NUM_SLOTS + 1];
+
 static gpio_pin_t gpio_slot1[MAX_GPIO_PINS] = {0};
 static gpio_pin_t gpio_slot2[MAX_GPIO_PINS] = {0};
 static gpio_pin_t gpio_slot3[MAX_GPIO_PINS] = {0};
@@ -199,47 +224,143 @@ init_gpio_pins() {
   }
 }
 
-/* Monitor the gpio pins */
-static int
-gpio_monitor_poll(uint8_t fru_flag) {
+static uint64_t
+ts_to_ms(const struct timespec *ts) {
+  return (uint64_t)ts->tv_sec * 1000 + ts->tv_nsec / 1000000;
+}
+
+static uint64_t
+now_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts_to_ms(&ts);
+}
+
+/*
+ * Sleep for up to interval_ms unless an interrupt for this slot arrives.
+ * Returns true if woken by an interrupt; *kick_ms is when it arrived.
+ */
+static bool
+gpio_slot_wait(gpio_slot_t *slot, int interval_ms, uint64_t *kick_ms) {
+  struct timespec deadline;
+  bool kicked;
+
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += interval_ms / 1000;
+  deadline.tv_nsec += (interval_ms % 1000) * 1000000L;
+  if (deadline.tv_nsec >= 1000000000L) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+
+  pthread_mutex_lock(&slot->lock);
+  while (!slot->kick) {
+    if (pthread_cond_timedwait(&slot->cond, &slot->lock, &deadline) ==
+        ETIMEDOUT) {
+      break;
+    }
+  }
+  kicked = slot->kick;
+  slot->kick = false;
+  *kick_ms = ts_to_ms(&slot->kick_ts);
+  pthread_mutex_unlock(&slot->lock);
+
+  return kicked;
+}
+
+/* Wake the slot's poller for an immediate poll */
+static void
+gpio_slot_kick(gpio_slot_t *slot) {
+  pthread_mutex_lock(&slot->lock);
+  if (!slot->kick) {
+    slot->kick = true;
+    clock_gettime(CLOCK_MONOTONIC, &slot->kick_ts);
+  }
+  pthread_cond_signal(&slot->cond);
+  pthread_mutex_unlock(&slot->lock);
+}
+
+/* Account for one bic_get_gpio poll of the slot */
+static void
+gpio_slot_count(gpio_slot_t *slot, bool changed, bool kicked,
+                uint64_t kick_ms) {
+  pthread_mutex_lock(&slot->lock);
+  slot->polls++;
+  if (changed)
+    slot->changes++;
+  if (kicked) {
+    slot->intr_polls++;
+    slot->intr_latency_ms += now_ms() - kick_ms;
+  }
+  pthread_mutex_unlock(&slot->lock);
+}
+
+/* Act on one monitored pin that changed to the given value */
+static void
+gpio_event_handle(uint8_t fru, gpio_pin_t *gpio, char *pwr_state) {
+
+  // Check if the new GPIO val is ASSERT
+  if (gpio->status == gpio->ass_val) {
+    /*
+     * GPIO - PWRGOOD_CPU assert indicates that the CPU is turned off or in a bad shape.
+     * Raise an error and change the LPS from on to off or vice versa for deassert.
+     */
+    if (strcmp(pwr_state, "off"))
+      pal_set_last_pwr_state(fru, "off");
+
+    syslog(LOG_CRIT, "FRU: %d, System powered OFF", fru);
+
+    // Inform BIOS that BMC is ready
+    bic_set_gpio(fru, GPIO_BMC_READY_N, 0);
+  } else {
+
+    if (strcmp(pwr_state, "on"))
+      pal_set_last_pwr_state(fru, "on");
+
+    syslog(LOG_CRIT, "FRU: %d, System powered ON", fru);
+  }
+}
+
+/* Monitor the gpio pins of one slot */
+static void *
+gpio_monitor_slot(void *arg) {
+  gpio_slot_t *slot = (gpio_slot_t *) arg;
+  uint8_t fru = slot->fru;
   int i, ret;
-  uint8_t fru;
-  uint8_t slot_12v[MAX_NUM_SLOTS + 1];
-  uint32_t revised_pins, n_pin_val, o_pin_val[MAX_NUM_SLOTS + 1] = {0};
+  int interval = GPIOD_POLL_MIN_MS;
+  uint8_t slot_12v = 0;
+  uint32_t revised_pins, n_pin_val, o_pin_val = 0;
+  uint64_t kick_ms;
+  bool kicked;
   gpio_pin_t *gpios;
   char pwr_state[MAX_VALUE_LEN];
 
   uint32_t status;
   bic_gpio_t gpio = {0};
 
-  /* Check for initial Asserts */
-  for (fru = 1; fru <= MAX_NUM_SLOTS; fru++) {
-    if (GETBIT(fru_flag, fru) == 0)
-      continue;
+  gpios = get_struct_gpio_pin(fru);
+  if  (gpios == NULL) {
+    syslog(LOG_WARNING, "gpio_monitor_slot: get_struct_gpio_pin failed for"
+        " fru %u", fru);
+    return NULL;
+  }
 
-    // Inform BIOS that BMC is ready
-    bic_set_gpio(fru, GPIO_BMC_READY_N, 0);
+  /* Check for initial Asserts */
+  // Inform BIOS that BMC is ready
+  bic_set_gpio(fru, GPIO_BMC_READY_N, 0);
 
-    ret = bic_get_gpio(fru, &gpio);
-    if (ret) {
+  ret = bic_get_gpio(fru, &gpio);
+  gpio_slot_count(slot, false, false, 0);
+  if (ret) {
 #ifdef DEBUG
-      syslog(LOG_WARNING, "gpio_monitor_poll: bic_get_gpio failed for "
-        " fru %u", fru);
+    syslog(LOG_WARNING, "gpio_monitor_slot: bic_get_gpio failed for "
+      " fru %u", fru);
 #endif
-      continue;
-    }
-
-    gpios = get_struct_gpio_pin(fru);
-    if  (gpios == NULL) {
-      syslog(LOG_WARNING, "gpio_monitor_poll: get_struct_gpio_pin failed for"
-          " fru %u", fru);
-      continue;
-    }
-
+  } else {
     memcpy(&status, (uint8_t *) &gpio, sizeof(status));
 
-    slot_12v[fru] = 1;
-    o_pin_val[fru] = 0;
+    slot_12v = 1;
 
     for (i = 0; i < MAX_GPIO_PINS; i++) {
 
@@ -249,90 +370,156 @@ gpio_monitor_poll(uint8_t fru_flag) {
       gpios[i].status = GETBIT(status, i);
 
       if (gpios[i].status)
-        o_pin_val[fru] = SETBIT(o_pin_val[fru], i);
+        o_pin_val = SETBIT(o_pin_val, i);
     }
   }
 
-  /* Keep monitoring each fru's gpio pins every 4 * GPIOD_READ_DELAY seconds */
   while(1) {
-    for (fru = 1; fru <= MAX_NUM_SLOTS; fru++) {
-      if (!(GETBIT(fru_flag, fru))) {
-        usleep(DELAY_GPIOD_READ);
-        continue;
-      }
-      if (slot_12v[fru] == 0) {  // workaround, may get fake PWRGOOD_CPU status when slot12V is just turned on
-        pal_is_server_12v_on(fru, &slot_12v[fru]);
-        usleep(DELAY_GPIOD_READ);
-        continue;
-      }
+    kicked = gpio_slot_wait(slot, interval, &kick_ms);
 
-      gpios = get_struct_gpio_pin(fru);
-      if  (gpios == NULL) {
-        syslog(LOG_WARNING, "gpio_monitor_poll: get_struct_gpio_pin failed for"
-            " fru %u", fru);
-        continue;
-      }
+    if (slot_12v == 0) {  // workaround, may get fake PWRGOOD_CPU status when slot12V is just turned on
+      pal_is_server_12v_on(fru, &slot_12v);
+      interval = GPIOD_POLL_MIN_MS;
+      continue;
+    }
 
-      memset(pwr_state, 0, MAX_VALUE_LEN);
-      pal_get_last_pwr_state(fru, pwr_state);
+    memset(pwr_state, 0, MAX_VALUE_LEN);
+    pal_get_last_pwr_state(fru, pwr_state);
 
-      /* Get the GPIO pins */
-      if ((ret = bic_get_gpio(fru, (bic_gpio_t *) &n_pin_val)) < 0) {
-        /* log the error message only when the CPU is on but not reachable. */
-        if (!(strcmp(pwr_state, "on"))) {
+    /* Get the GPIO pins */
+    if ((ret = bic_get_gpio(fru, (bic_gpio_t *) &n_pin_val)) < 0) {
+      /* log the error message only when the CPU is on but not reachable. */
+      if (!(strcmp(pwr_state, "on"))) {
 #ifdef DEBUG
-          syslog(LOG_WARNING, "gpio_monitor_poll: bic_get_gpio failed for "
-              " fru %u", fru);
+        syslog(LOG_WARNING, "gpio_monitor_slot: bic_get_gpio failed for "
+            " fru %u", fru);
 #endif
-        }
+      }
 
-        if ((pal_is_server_12v_on(fru, &slot_12v[fru]) != 0) || slot_12v[fru]) {
-          usleep(DELAY_GPIOD_READ);
-          continue;
-        }
-        n_pin_val = CLEARBIT(o_pin_val[fru], PWRGOOD_CPU);
+      if ((pal_is_server_12v_on(fru, &slot_12v) != 0) || slot_12v) {
+        gpio_slot_count(slot, false, kicked, kick_ms);
+        continue;
       }
+      n_pin_val = CLEARBIT(o_pin_val, PWRGOOD_CPU);
+    }
 
-      if (o_pin_val[fru] == n_pin_val) {
-        usleep(DELAY_GPIOD_READ);
+    /* Only the monitored pins that changed are dispatched */
+    revised_pins = (n_pin_val ^ o_pin_val);
+    o_pin_val = n_pin_val;
+    for (i = 0; i < MAX_GPIO_PINS; i++) {
+      if (!GETBIT(revised_pins, i) || (gpios[i].flag == 0)) {
+        revised_pins = CLEARBIT(revised_pins, i);
         continue;
       }
+      gpios[i].status = GETBIT(n_pin_val, i);
+      gpio_event_handle(fru, &gpios[i], pwr_state);
+    }
 
-      revised_pins = (n_pin_val ^ o_pin_val[fru]);
+    gpio_slot_count(slot, revised_pins != 0, kicked, kick_ms);
 
-      for (i = 0; i < MAX_GPIO_PINS; i++) {
-        if (GETBIT(revised_pins, i) && (gpios[i].flag == 1)) {
-          gpios[i].status = GETBIT(n_pin_val, i);
+    if (revised_pins) {
+      interval = GPIOD_POLL_MIN_MS;
+    } else if (interval < GPIOD_POLL_MAX_MS) {
+      interval *= 2;
+      if (interval > GPIOD_POLL_MAX_MS)
+        interval = GPIOD_POLL_MAX_MS;
+    }
+  } /* while loop */
 
-          // Check if the new GPIO val is ASSERT
-          if (gpios[i].status == gpios[i].ass_val) {
-            /*
-             * GPIO - PWRGOOD_CPU assert indicates that the CPU is turned off or in a bad shape.
-             * Raise an error and change the LPS from on to off or vice versa for deassert.
-             */
-            if (strcmp(pwr_state, "off"))
-              pal_set_last_pwr_state(fru, "off");
+  return NULL;
+}
 
-            syslog(LOG_CRIT, "FRU: %d, System powered OFF", fru);
+/* Receive BIC GPIO interrupts forwarded by ipmid and wake the slot's poller */
+static void *
+gpio_intr_listener(void *arg) {
+  uint8_t fru_flag = *(uint8_t *) arg;
+  struct sockaddr_un local;
+  uint8_t msg[2];
+  int sock;
+
+  sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+  if (sock < 0) {
+    syslog(LOG_WARNING, "gpio_intr_listener: socket() failed");
+    return NULL;
+  }
 
-            // Inform BIOS that BMC is ready
-            bic_set_gpio(fru, GPIO_BMC_READY_N, 0);
-          } else {
+  memset(&local, 0, sizeof(local));
+  local.sun_family = AF_UNIX;
+  strncpy(local.sun_path, SOCK_PATH_GPIO, sizeof(local.sun_path) - 1);
+  unlink(local.sun_path);
+  if (bind(sock, (struct sockaddr *)&local, sizeof(local)) < 0) {
+    syslog(LOG_WARNING, "gpio_intr_listener: bind() failed, polling only");
+    close(sock);
+    return NULL;
+  }
 
-            if (strcmp(pwr_state, "on"))
-              pal_set_last_pwr_state(fru, "on");
+  while (1) {
+    if (recv(sock, msg, sizeof(msg), 0) < 1)
+      continue;
+    if (msg[0] < 1 || msg[0] > MAX_NUM_SLOTS || !GETBIT(fru_flag, msg[0]))
+      continue;
 
-            syslog(LOG_CRIT, "FRU: %d, System powered ON", fru);
-          }
-        }
-      }
+    gpio_slot_kick(&gpio_slots[msg[0]]);
+  }
 
-      o_pin_val[fru] = n_pin_val;
-      usleep(DELAY_GPIOD_READ);
+  return NULL;
+}
 
-    } /* For Loop for each fru */
-  } /* while loop */
-} /* function definition*/
+/* Poll every monitored slot concurrently, each on its own schedule */
+static int
+gpio_monitor_poll(uint8_t fru_flag) {
+  pthread_t tid_slot[MAX_NUM_SLOTS + 1];
+  pthread_t tid_intr;
+  pthread_condattr_t cattr;
+  uint8_t fru;
+  gpio_slot_t *slot;
+  uint32_t polls, changes, intr_polls;
+  uint64_t intr_latency_ms;
+
+  pthread_condattr_init(&cattr);
+  pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+
+  for (fru = 1; fru <= MAX_NUM_SLOTS; fru++) {
+    if (GETBIT(fru_flag, fru) == 0)
+      continue;
+
+    slot = &gpio_slots[fru];
+    slot->fru = fru;
+    pthread_mutex_init(&slot->lock, NULL);
+    pthread_cond_init(&slot->cond, &cattr);
+    if (pthread_create(&tid_slot[fru], NULL, gpio_monitor_slot, slot) != 0) {
+      syslog(LOG_WARNING, "gpio_monitor_poll: pthread_create failed for"
+          " fru %u", fru);
+    }
+  }
+
+  if (pthread_create(&tid_intr, NULL, gpio_intr_listener, &fru_flag) != 0) {
+    syslog(LOG_WARNING, "gpio_monitor_poll: interrupt listener not started");
+  }
+
+  while (1) {
+    sleep(GPIOD_STATS_SEC);
+    for (fru = 1; fru <= MAX_NUM_SLOTS; fru++) {
+      if (GETBIT(fru_flag, fru) == 0)
+        continue;
+      slot = &gpio_slots[fru];
+      pthread_mutex_lock(&slot->lock);
+      polls = slot->polls;
+      changes = slot->changes;
+      intr_polls = slot->intr_polls;
+      intr_latency_ms = slot->intr_latency_ms;
+      slot->polls = slot->changes = slot->intr_polls = 0;
+      slot->intr_latency_ms = 0;
+      pthread_mutex_unlock(&slot->lock);
+      syslog(LOG_DEBUG, "FRU: %d, %u IPMB polls/min, %u changes, %u interrupts"
+          " (avg %llu ms to dispatch)", fru, polls * 60 / GPIOD_STATS_SEC,
+          changes, intr_polls, intr_polls ?
+          (unsigned long long) intr_latency_ms / intr_polls : 0);
+    }
+  }
+
+  return 0;
+}
 
 static void
 print_usage() {
@@ -0,0 +1,201 @@
+/*
+ * gpiod_test
+ *
+ * Copyright 2015-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Runs gpiod's per-slot poller against a stubbed BIC and libpal: checks
+ * that an interrupt triggers a poll well inside the minimum interval, that
+ * a change is still picked up without one, that a quiet slot backs off,
+ * and that the statistics add up.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+int bic_set_gpio(uint8_t slot_id, uint8_t gpio, uint8_t value);
+int pal_is_server_12v_on(uint8_t slot_id, uint8_t *status);
+
+#define main gpiod_main
+#include "../gpiod.c"
+#undef main
+
+#define TEST_FRU  FRU_SLOT1
+
+static pthread_mutex_t stub_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t stub_pins;
+static int stub_fail;
+static int stub_polls;
+static char stub_pwr_state[MAX_VALUE_LEN] = "on";
+static int failed;
+
+int
+bic_get_gpio(uint8_t slot_id, bic_gpio_t *gpio) {
+  int ret = 0;
+
+  pthread_mutex_lock(&stub_lock);
+  stub_polls++;
+  if (stub_fail)
+    ret = -1;
+  else
+    memcpy(gpio, &stub_pins, sizeof(stub_pins));
+  pthread_mutex_unlock(&stub_lock);
+  return ret;
+}
+
+int
+bic_set_gpio(uint8_t slot_id, uint8_t gpio, uint8_t value) {
+  return 0;
+}
+
+int
+bic_get_gpio_config(uint8_t slot_id, uint8_t gpio, bic_gpio_config_t *cfg) {
+  return 0;
+}
+
+int
+bic_set_gpio_config(uint8_t slot_id, uint8_t gpio, bic_gpio_config_t *cfg) {
+  return 0;
+}
+
+int
+pal_get_last_pwr_state(uint8_t fru, char *state) {
+  pthread_mutex_lock(&stub_lock);
+  strcpy(state, stub_pwr_state);
+  pthread_mutex_unlock(&stub_lock);
+  return 0;
+}
+
+int
+pal_set_last_pwr_state(uint8_t fru, char *state) {
+  pthread_mutex_lock(&stub_lock);
+  strcpy(stub_pwr_state, state);
+  pthread_mutex_unlock(&stub_lock);
+  return 0;
+}
+
+int
+pal_is_server_12v_on(uint8_t slot_id, uint8_t *status) {
+  *status = 1;
+  return 0;
+}
+
+int
+pal_get_fru_id(char *fru_str, uint8_t *fru) {
+  return -1;
+}
+
+const char pal_server_list[] = "slot1";
+
+static void
+set_pins(uint32_t pins, int fail) {
+  pthread_mutex_lock(&stub_lock);
+  stub_pins = pins;
+  stub_fail = fail;
+  pthread_mutex_unlock(&stub_lock);
+}
+
+static int
+polls(void) {
+  int n;
+
+  pthread_mutex_lock(&stub_lock);
+  n = stub_polls;
+  pthread_mutex_unlock(&stub_lock);
+  return n;
+}
+
+// Wait up to timeout_ms for the power state to become state; returns ms
+static int
+wait_state(const char *state, int timeout_ms) {
+  uint64_t start = now_ms();
+  char curr[MAX_VALUE_LEN];
+
+  while (now_ms() - start < timeout_ms) {
+    pal_get_last_pwr_state(TEST_FRU, curr);
+    if (!strcmp(curr, state))
+      return now_ms() - start;
+    usleep(1000);
+  }
+  return -1;
+}
+
+static void
+check(const char *name, int ok) {
+  printf("%s: %s\n", ok ? "PASS" : "FAIL", name);
+  if (!ok)
+    failed = 1;
+}
+
+int
+main(int argc, char **argv) {
+  gpio_slot_t *slot = &gpio_slots[TEST_FRU];
+  pthread_condattr_t cattr;
+  pthread_t tid;
+  uint32_t changes, intr_polls;
+  int ms, n;
+
+  set_pins(1 << PWRGOOD_CPU, 0);
+  init_gpio_pins();
+
+  pthread_condattr_init(&cattr);
+  pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+  slot->fru = TEST_FRU;
+  pthread_mutex_init(&slot->lock, NULL);
+  pthread_cond_init(&slot->cond, &cattr);
+  pthread_create(&tid, NULL, gpio_monitor_slot, slot);
+  usleep(50 * 1000);
+
+  // PWRGOOD_CPU asserts (low): the interrupt should beat the 250 ms poll
+  set_pins(0, 0);
+  gpio_slot_kick(slot);
+  ms = wait_state("off", 1000);
+  check("interrupt triggers an immediate poll",
+        ms >= 0 && ms < GPIOD_POLL_MIN_MS / 2);
+
+  // Deassert with no interrupt: the regular poll still sees it
+  set_pins(1 << PWRGOOD_CPU, 0);
+  ms = wait_state("on", GPIOD_POLL_MAX_MS + 500);
+  check("change picked up by polling", ms >= 0);
+
+  // A quiet slot backs off: 250+500+1000+2000 ms covers 3.75 s
+  n = polls();
+  usleep(3000 * 1000);
+  n = polls() - n;
+  check("quiet slot backs off", n > 0 && n <= 4);
+
+  // BIC unreachable with 12V on: no spurious power-off
+  set_pins(0, 1);
+  gpio_slot_kick(slot);
+  usleep(100 * 1000);
+  check("failed read is not a transition", wait_state("on", 1) >= 0);
+  set_pins(1 << PWRGOOD_CPU, 0);
+
+  pthread_mutex_lock(&slot->lock);
+  changes = slot->changes;
+  intr_polls = slot->intr_polls;
+  pthread_mutex_unlock(&slot->lock);
+  check("statistics", changes == 2 && intr_polls == 2);
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  return failed;
+}